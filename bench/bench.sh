@@ -0,0 +1,96 @@
+#!/bin/sh
+#
+# Benchmarks the Voidcaster on a synthetic project and records the results in
+# a machine-readable form, for comparing releases.
+#
+# Usage: bench.sh VOIDCASTER GENCORPUS RESULTS [GENCORPUS-OPTION]...
+#
+# Generates a project with GENCORPUS (options such as -f, -n, -c, -v, -d, -H
+# and -i are passed on; see its usage), then analyzes all of its files with an
+# increasing number of traversal jobs. For each number, the throughput (files
+# and cursors per second) and the peak resident set size are written to the
+# JSON file RESULTS.
+
+set -e
+
+if [ $# -lt 3 ]
+then
+	echo "Usage: $0 VOIDCASTER GENCORPUS RESULTS [GENCORPUS-OPTION]..." >&2
+	exit 1
+fi
+
+voidcaster="$1"
+gencorpus="$2"
+results="$3"
+shift 3
+
+workdir="$(mktemp -d "${TMPDIR:-/tmp}/voidcaster-bench.XXXXXX")"
+trap 'rm -rf "$workdir"' EXIT
+
+"$gencorpus" -o "$workdir/project" "$@"
+echo "project: $(ls "$workdir/project" | grep -c '\.c$') files, $(cat "$workdir/project"/*.c | wc -l) lines"
+
+cpus="$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)"
+revision="$("$voidcaster" --help 2>&1 | sed -n 's/^Voidcaster //p')"
+
+# powers of two up to the number of CPUs, then the number of CPUs itself
+jobslist=1
+jobs=2
+while [ "$jobs" -lt "$cpus" ]
+do
+	jobslist="$jobslist $jobs"
+	jobs=$((jobs * 2))
+done
+if [ "$cpus" -gt 1 ]
+then
+	jobslist="$jobslist $cpus"
+fi
+
+# outputs the value of a sample in an OpenMetrics file
+metric()
+{
+	awk -v name="$2" '$1 == name { print $2 }' "$1"
+}
+
+runs=""
+for jobs in $jobslist
+do
+	start="$(date +%s.%N)"
+	"$voidcaster" --diagnostics=none --no-dedup --traverse-jobs="$jobs" \
+		--metrics="$workdir/metrics.$jobs" -I"$workdir/project" "$workdir/project"/*.c \
+		2> "$workdir/out.$jobs"
+	end="$(date +%s.%N)"
+
+	# the summary of the metrics is output last; the findings come before it
+	sed -i '/^Metrics: /,$d' "$workdir/out.$jobs"
+	if [ "$jobs" -ne 1 ] && ! cmp -s "$workdir/out.1" "$workdir/out.$jobs"
+	then
+		echo "traverse-jobs=$jobs: findings differ from traverse-jobs=1" >&2
+		exit 1
+	fi
+
+	files="$(metric "$workdir/metrics.$jobs" voidcaster_files_total)"
+	cursors="$(metric "$workdir/metrics.$jobs" voidcaster_cursors_total)"
+	rss="$(metric "$workdir/metrics.$jobs" voidcaster_peak_resident_bytes)"
+	run="$(awk -v jobs="$jobs" -v s="$(awk "BEGIN { print $end - $start }")" \
+		-v files="$files" -v cursors="$cursors" -v rss="$rss" -v findings="$(wc -l < "$workdir/out.$jobs")" \
+		'BEGIN {
+			printf "{\"traverse_jobs\": %d, \"seconds\": %.3f, \"files\": %d, \"files_per_second\": %.2f, ", jobs, s, files, files / s
+			printf "\"cursors\": %d, \"cursors_per_second\": %.0f, \"peak_rss_bytes\": %d, \"findings\": %d}", cursors, cursors / s, rss, findings
+		}')"
+	echo "$run"
+	runs="${runs:+$runs,
+    }$run"
+done
+
+cat > "$results" <<EOF
+{
+  "revision": "$revision",
+  "cpus": $cpus,
+  "corpus": "$*",
+  "runs": [
+    $runs
+  ]
+}
+EOF
+echo "results written to $results"
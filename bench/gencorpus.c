@@ -0,0 +1,524 @@
+/**
+ * @file gencorpus.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Generator of synthetic C code for benchmarking the Voidcaster.
+ * @details By default, writes a single C file resembling an amalgamation (lots
+ * of function definitions calling each other) to standard output. With -o, a
+ * whole project is written instead: a number of source files, each including
+ * some of a pool of headers which declare the functions they call. With -x, a
+ * single pathological file is written instead, for stress testing. The output
+ * depends only on the options, not on the platform.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/** The number of helper functions called by the generated functions. */
+#define NUM_HELPERS 64
+
+/** The number of functions declared by each header of a project. */
+#define HEADER_FUNCS 32
+
+/** The pathological files which can be generated for stress testing. */
+static const struct
+{
+	/** The name of the kind of file. */
+	const char *name;
+
+	/** Its size if not given by -n. */
+	unsigned long size;
+} stressKinds[] = {
+	{ "nested", 100000 },
+	{ "statements", 1000000 },
+	{ "macro", 50000 },
+	{ "findings", 100000 },
+	{ "longline", 50000 },
+	{ NULL, 0 }
+};
+
+/** The shape of the code to generate. */
+typedef struct
+{
+	/** The number of function definitions per file. */
+	unsigned long funcs;
+
+	/** The number of calls per function. */
+	unsigned long calls;
+
+	/** The percentage of calls to functions returning void which are cast to void. */
+	unsigned long voidPercent;
+
+	/** The number of nested blocks the calls of a function are spread across. */
+	unsigned long depth;
+
+	/** The number of headers in the pool of a project. */
+	unsigned long headers;
+
+	/** The number of headers included by each source file of a project. */
+	unsigned long fanIn;
+} shape_t;
+
+/** The state of the pseudorandom number generator. */
+static uint64_t rngState;
+
+/**
+ * Returns the next pseudorandom number (xorshift64*).
+ *
+ * @param bound the exclusive upper bound of the number
+ * @return a number between 0 and bound-1
+ */
+static unsigned long nextRandom(unsigned long bound)
+{
+	rngState ^= rngState >> 12;
+	rngState ^= rngState << 25;
+	rngState ^= rngState >> 27;
+	return (unsigned long)((rngState * UINT64_C(2685821657736338717)) >> 33) % bound;
+}
+
+/**
+ * Prints usage information about this program and exits with return code 1.
+ *
+ * @param progname the name of the program
+ */
+static void usage(const char *progname) __attribute__((noreturn));
+
+static void usage(const char *progname)
+{
+	(void)fprintf(stderr,
+		"Usage: %s [-n FUNCTIONS] [-c CALLS] [-v PERCENT] [-d DEPTH] [-s SEED]\n"
+		"       %s -o DIR [-f FILES] [-H HEADERS] [-i INCLUDES] [OPTION]...\n"
+		"       %s -x KIND [-n SIZE]\n"
+		"Writes a synthetic amalgamation-like C file to standard output, or a\n"
+		"synthetic project to DIR, or a pathological C file of the given KIND\n"
+		"(nested, statements, macro, findings or longline) to standard output.\n"
+		"\n"
+		"  -n FUNCTIONS   number of function definitions per file (default 15000,\n"
+		"                 or 50 with -o)\n"
+		"  -c CALLS       number of calls per function (default 8)\n"
+		"  -v PERCENT     percentage of calls whose result is discarded which are\n"
+		"                 cast to void (default 25)\n"
+		"  -d DEPTH       number of nested blocks the calls of each function are\n"
+		"                 spread across (default 0)\n"
+		"  -s SEED        seed of the pseudorandom number generator (default 1)\n"
+		"  -o DIR         write a project to DIR instead: source files f*.c and\n"
+		"                 headers h*.h\n"
+		"  -f FILES       number of source files of the project (default 100)\n"
+		"  -H HEADERS     number of headers of the project (default 32)\n"
+		"  -i INCLUDES    number of headers included by each source file\n"
+		"                 (default 8)\n"
+		"  -x KIND        write a pathological file: with -n SIZE, the number of\n"
+		"                 operands of an expression (nested, default 100000),\n"
+		"                 statements of a function (statements, default 1000000),\n"
+		"                 lines of a macro (macro, default 50000), discarded\n"
+		"                 results (findings, default 100000) or calls on a line\n"
+		"                 (longline, default 50000)\n",
+		progname, progname, progname
+	);
+	exit(1);
+}
+
+/**
+ * Parses a number given as an option argument, exiting on failure.
+ *
+ * @param progname the name of the program
+ * @param str the option argument
+ * @return the number
+ */
+static unsigned long parseNumber(const char *progname, const char *str)
+{
+	char *end;
+	unsigned long val;
+
+	errno = 0;
+	val = strtoul(str, &end, 10);
+	if (errno != 0 || end == str || *end != '\0')
+	{
+		usage(progname);
+	}
+	return val;
+}
+
+/**
+ * Writes the definitions of functions calling each other and other functions.
+ *
+ * @param out the stream to write to
+ * @param shape the shape of the code
+ * @param prefix the prefix of the names of the functions defined
+ * @param callees the names of the other functions which may be called; those
+ * at even indices return int, those at odd indices void
+ * @param numCallees the number of other functions
+ */
+static void writeFunctions(FILE *out, const shape_t *shape, const char *prefix, char **callees, unsigned long numCallees)
+{
+	unsigned long f, c, d, open;
+
+	for (f = 0; f < shape->funcs; ++f)
+	{
+		(void)fprintf(out, "int %sfunc%lu(int a)\n{\n\tint r = a;\n", prefix, f);
+		open = 0;
+
+		for (c = 0; c < shape->calls; ++c)
+		{
+			unsigned long callee = nextRandom(numCallees);
+			bool voidCast = (nextRandom(100) < shape->voidPercent);
+
+			/* spread the calls evenly across the nesting levels */
+			while (open < shape->depth && c * (shape->depth + 1) >= (open + 1) * shape->calls)
+			{
+				for (d = 0; d <= open; ++d)
+					(void)fputc('\t', out);
+				if (open % 2 == 0)
+					(void)fprintf(out, "if (r > %lu)\n", nextRandom(1000));
+				else
+					(void)fprintf(out, "while (r-- > %lu)\n", nextRandom(1000));
+				for (d = 0; d <= open; ++d)
+					(void)fputc('\t', out);
+				(void)fputs("{\n", out);
+				++open;
+			}
+			for (d = 0; d <= open; ++d)
+				(void)fputc('\t', out);
+
+			if (callee % 2 == 0 && nextRandom(2) == 0)
+			{
+				/* use the return value */
+				(void)fprintf(out, "r += %s(r);\n", callees[callee]);
+			}
+			else if (f > 0 && nextRandom(8) == 0)
+			{
+				/* call an earlier function */
+				(void)fprintf(out, "%s%sfunc%lu(r);\n", voidCast ? "(void)" : "", prefix, nextRandom(f));
+			}
+			else
+			{
+				(void)fprintf(out, "%s%s(r);\n", voidCast ? "(void)" : "", callees[callee]);
+			}
+		}
+
+		while (open > 0)
+		{
+			--open;
+			for (d = 0; d <= open; ++d)
+				(void)fputc('\t', out);
+			(void)fputs("}\n", out);
+		}
+
+		(void)fprintf(out, "\tif (r > %lu)\n\t{\n\t\t%s(r);\n\t}\n\treturn r;\n}\n\n", nextRandom(1000), callees[0]);
+	}
+}
+
+/**
+ * Writes a pathological file to standard output.
+ *
+ * @param kind the index of the kind of file in stressKinds
+ * @param size the size of the file, in the unit of its kind
+ */
+static void writeStress(size_t kind, unsigned long size)
+{
+	unsigned long i;
+
+	(void)printf("int helper(int x);\n");
+
+	if (strcmp(stressKinds[kind].name, "nested") == 0)
+	{
+		/* a left-leaning tree as deep as the expression is long */
+		(void)printf("int f(int a)\n{\n\tint r;\n\tr = a");
+		for (i = 1; i < size; ++i)
+		{
+			(void)printf((i % 64 == 0) ? "\n\t\t+ a" : " + a");
+		}
+		(void)printf(";\n\thelper(r);\n\treturn r;\n}\n");
+	}
+	else if (strcmp(stressKinds[kind].name, "statements") == 0)
+	{
+		(void)printf("int f(int r)\n{\n");
+		for (i = 0; i < size; ++i)
+		{
+			(void)printf("\tr ^= r >> %lu;\n", 1 + i % 7);
+		}
+		(void)printf("\thelper(r);\n\treturn r;\n}\n");
+	}
+	else if (strcmp(stressKinds[kind].name, "macro") == 0)
+	{
+		/* every call within the expansion is reported at the same spelling */
+		(void)printf("#define BIG(x) \\\n");
+		for (i = 1; i < size; ++i)
+		{
+			(void)printf("\thelper(x); \\\n");
+		}
+		(void)printf("\thelper(x)\nvoid f(int r)\n{\n\tBIG(r);\n}\n");
+	}
+	else if (strcmp(stressKinds[kind].name, "findings") == 0)
+	{
+		/* functions of a hundred calls each */
+		for (i = 0; i < size; ++i)
+		{
+			if (i % 100 == 0)
+			{
+				(void)printf("%svoid f%lu(int r)\n{\n", (i > 0) ? "}\n" : "", i / 100);
+			}
+			(void)printf("\thelper(r);\n");
+		}
+		(void)printf("}\n");
+	}
+	else
+	{
+		(void)printf("void f(int r) {");
+		for (i = 0; i < size; ++i)
+		{
+			(void)printf(" helper(r);");
+		}
+		(void)printf(" }\n");
+	}
+}
+
+/**
+ * Opens a file in the output directory for writing, exiting on failure.
+ *
+ * @param dir the output directory
+ * @param name the name of the file
+ * @return the stream to write to
+ */
+static FILE *openOutput(const char *dir, const char *name)
+{
+	char path[4096];
+	FILE *out;
+
+	(void)snprintf(path, sizeof(path), "%s/%s", dir, name);
+	out = fopen(path, "w");
+	if (out == NULL)
+	{
+		perror(path);
+		exit(2);
+	}
+	return out;
+}
+
+/**
+ * Closes a file written to, exiting on failure.
+ *
+ * @param out the stream to close
+ */
+static void closeOutput(FILE *out)
+{
+	if (ferror(out) || fclose(out) != 0)
+	{
+		perror("fclose");
+		exit(2);
+	}
+}
+
+/**
+ * Writes a project.
+ *
+ * @param dir the directory to write to
+ * @param shape the shape of the code
+ * @param files the number of source files
+ */
+static void writeProject(const char *dir, const shape_t *shape, unsigned long files)
+{
+	unsigned long h, f, i, k, numCallees;
+	char name[64], prefix[32];
+	char **callees;
+	bool *chosen;
+	FILE *out;
+
+	if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+	{
+		perror(dir);
+		exit(2);
+	}
+
+	callees = malloc((HEADER_FUNCS * shape->fanIn + 1) * sizeof(char *));
+	chosen = calloc(shape->headers, sizeof(bool));
+	if (callees == NULL || (chosen == NULL && shape->headers > 0))
+	{
+		perror("malloc");
+		exit(2);
+	}
+	for (i = 0; i < HEADER_FUNCS * shape->fanIn + 1; ++i)
+	{
+		callees[i] = malloc(32);
+		if (callees[i] == NULL)
+		{
+			perror("malloc");
+			exit(2);
+		}
+	}
+
+	/* each header declares functions and types, and defines a few inline functions */
+	for (h = 0; h < shape->headers; ++h)
+	{
+		(void)snprintf(name, sizeof(name), "h%lu.h", h);
+		out = openOutput(dir, name);
+		(void)fprintf(out, "#ifndef H%lu_H\n#define H%lu_H\n\n", h, h);
+		(void)fprintf(out, "struct h%lu_state\n{\n\tint count;\n\tlong total;\n\tconst char *name;\n};\n\n", h);
+		for (k = 0; k < HEADER_FUNCS; ++k)
+		{
+			(void)fprintf(out, "%s h%lu_fn%lu(int x);\n", (k % 2 == 0) ? "int" : "void", h, k);
+		}
+		(void)fprintf(out,
+			"\nstatic inline int h%lu_inline(struct h%lu_state *s, int x)\n{\n"
+			"\ts->count++;\n\ts->total += x;\n\treturn h%lu_fn0(x);\n}\n\n#endif\n",
+			h, h, h
+		);
+		closeOutput(out);
+	}
+
+	for (f = 0; f < files; ++f)
+	{
+		(void)snprintf(name, sizeof(name), "f%lu.c", f);
+		out = openOutput(dir, name);
+
+		/* pick distinct headers; the declarations of their functions are what may be called */
+		(void)memset(chosen, 0, shape->headers * sizeof(bool));
+		numCallees = 0;
+		for (i = 0; i < shape->fanIn && i < shape->headers; ++i)
+		{
+			do
+			{
+				h = nextRandom(shape->headers);
+			}
+			while (chosen[h]);
+			chosen[h] = true;
+
+			(void)fprintf(out, "#include \"h%lu.h\"\n", h);
+			for (k = 0; k < HEADER_FUNCS; ++k)
+			{
+				(void)snprintf(callees[numCallees++], 32, "h%lu_fn%lu", h, k);
+			}
+		}
+		if (numCallees == 0)
+		{
+			/* no headers; call a local function */
+			(void)fprintf(out, "int f%lu_local(int x);\n", f);
+			(void)snprintf(callees[numCallees++], 32, "f%lu_local", f);
+		}
+		(void)fputc('\n', out);
+
+		(void)snprintf(prefix, sizeof(prefix), "f%lu_", f);
+		writeFunctions(out, shape, prefix, callees, numCallees);
+		closeOutput(out);
+	}
+
+	for (i = 0; i < HEADER_FUNCS * shape->fanIn + 1; ++i)
+	{
+		free(callees[i]);
+	}
+	free(callees);
+	free(chosen);
+}
+
+/**
+ * The main entry point of the generator.
+ * @param argc the number of command-line arguments
+ * @param argv the array of command-line arguments
+ */
+int main(int argc, char **argv)
+{
+	shape_t shape = {
+		.funcs = 0,
+		.calls = 8,
+		.voidPercent = 25,
+		.depth = 0,
+		.headers = 32,
+		.fanIn = 8
+	};
+	unsigned long files = 100, f;
+	const char *dir = NULL, *stress = NULL;
+	size_t kind;
+	char *helpers[NUM_HELPERS];
+	char helperNames[NUM_HELPERS][16];
+	int opt;
+
+	rngState = 1;
+
+	while ((opt = getopt(argc, argv, "n:c:v:d:s:o:f:H:i:x:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+				shape.funcs = parseNumber(argv[0], optarg);
+				break;
+			case 'c':
+				shape.calls = parseNumber(argv[0], optarg);
+				break;
+			case 'v':
+				shape.voidPercent = parseNumber(argv[0], optarg);
+				break;
+			case 'd':
+				shape.depth = parseNumber(argv[0], optarg);
+				break;
+			case 's':
+				rngState = strtoull(optarg, NULL, 10);
+				break;
+			case 'o':
+				dir = optarg;
+				break;
+			case 'f':
+				files = parseNumber(argv[0], optarg);
+				break;
+			case 'H':
+				shape.headers = parseNumber(argv[0], optarg);
+				break;
+			case 'i':
+				shape.fanIn = parseNumber(argv[0], optarg);
+				break;
+			case 'x':
+				stress = optarg;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	if (rngState == 0)
+	{
+		/* xorshift gets stuck on zero */
+		rngState = 1;
+	}
+	if (stress != NULL)
+	{
+		for (kind = 0; stressKinds[kind].name != NULL; ++kind)
+		{
+			if (strcmp(stressKinds[kind].name, stress) == 0)
+			{
+				writeStress(kind, (shape.funcs > 0) ? shape.funcs : stressKinds[kind].size);
+				return 0;
+			}
+		}
+		usage(argv[0]);
+	}
+	if (shape.funcs == 0)
+	{
+		shape.funcs = (dir != NULL) ? 50 : 15000;
+	}
+
+	if (dir != NULL)
+	{
+		writeProject(dir, &shape, files);
+		return 0;
+	}
+
+	/* even-numbered helpers return int, odd-numbered ones void */
+	for (f = 0; f < NUM_HELPERS; ++f)
+	{
+		(void)snprintf(helperNames[f], sizeof(helperNames[f]), "helper%lu", f);
+		helpers[f] = helperNames[f];
+		(void)printf("%s helper%lu(int x);\n", (f % 2 == 0) ? "int" : "void", f);
+	}
+	(void)printf("\n");
+
+	writeFunctions(stdout, &shape, "", helpers, NUM_HELPERS);
+	return 0;
+}
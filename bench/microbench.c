@@ -0,0 +1,355 @@
+/**
+ * @file microbench.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Microbenchmarks of the parts of the Voidcaster which don't involve
+ * libclang.
+ * @details All inputs are generated from a fixed seed, and each measurement is
+ * the best of a few repetitions.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../configs.h"
+#include "../findings.h"
+#include "../interact.h"
+#include "../msa.h"
+#include "../report.h"
+#include "../shared.h"
+
+/** The number of repetitions of each measurement; the best one counts. */
+#define REPEATS 5
+
+/** The number of lines of the file rewritten and looked up in. */
+#define FILE_LINES 200000
+
+/** The number of line lookups measured. */
+#define LOOKUPS 100
+
+/** The number of findings reported. */
+#define REPORTED 100000
+
+/** The configurations named in the warnings; there are none. */
+static configs_t configs;
+
+/** The state of the pseudorandom number generator. */
+static uint64_t rngState = 1;
+
+/* initialize here */
+const char *progname = "<not set>";
+
+/**
+ * Returns the current value of the monotonic clock.
+ *
+ * @return the current time in seconds
+ */
+static double monotonicNow(void)
+{
+	struct timespec ts;
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * Returns the next pseudorandom number (xorshift64*).
+ *
+ * @param bound the exclusive upper bound of the number
+ * @return a number between 0 and bound-1
+ */
+static unsigned long nextRandom(unsigned long bound)
+{
+	rngState ^= rngState >> 12;
+	rngState ^= rngState << 25;
+	rngState ^= rngState >> 27;
+	return (unsigned long)((rngState * UINT64_C(2685821657736338717)) >> 33) % bound;
+}
+
+/**
+ * Writes the file which is rewritten and looked up in.
+ *
+ * @param path the path to the file
+ * @return the size of the file
+ */
+static size_t writeSource(const char *path)
+{
+	FILE *out;
+	unsigned long l;
+	long size;
+
+	out = fopen(path, "w");
+	if (out == NULL)
+	{
+		perror(path);
+		exit(EXITCODE_FILE_OPEN);
+	}
+
+	rngState = 1;
+	for (l = 0; l < FILE_LINES; ++l)
+	{
+		(void)fprintf(out, "\thelper%lu(r, %lu);\n", nextRandom(64), nextRandom(100000));
+	}
+
+	size = ftell(out);
+	if (ferror(out) || fclose(out) != 0)
+	{
+		perror(path);
+		exit(EXITCODE_FILE_OPEN);
+	}
+	return (size_t)size;
+}
+
+/**
+ * Measures rewriting a file with edits to every few lines.
+ *
+ * @param path the path to the file
+ * @param every the distance between edited lines
+ */
+static void benchRewrite(const char *path, unsigned long every)
+{
+	double best = 0.0;
+	size_t size = 0, edits = 0;
+	unsigned long l;
+	int r;
+
+	for (r = 0; r < REPEATS; ++r)
+	{
+		double start;
+
+		size = writeSource(path);
+		edits = 0;
+
+		/* alternately insert casts and remove the indentation */
+		for (l = 1; l <= FILE_LINES; l += every)
+		{
+			modif_t mod = {
+				.file = strdup(path),
+				.type = (edits % 2 == 0) ? MODIF_INSERT : MODIF_REMOVE
+			};
+			if (mod.type == MODIF_INSERT)
+			{
+				mod.m.insert.where = (module_loc_t){ .line = l, .col = 2 };
+				mod.m.insert.what = strdup("(void)");
+			}
+			else
+			{
+				mod.m.remove.fromWhere = (module_loc_t){ .line = l, .col = 1 };
+				mod.m.remove.toWhere = (module_loc_t){ .line = l, .col = 2 };
+			}
+			if (!addModif(mod))
+			{
+				exit(EXITCODE_MM);
+			}
+			++edits;
+		}
+
+		start = monotonicNow();
+		performModifs();
+		start = monotonicNow() - start;
+		disposeModifs();
+
+		if (r == 0 || start < best)
+		{
+			best = start;
+		}
+	}
+
+	(void)printf("rewrite, %6.2f%% of lines edited: %9.3f ms, %8.1f MB/s, %10.0f edits/s\n",
+		100.0 / (double)every, best * 1e3, (double)size / best / 1e6, (double)edits / best
+	);
+}
+
+/**
+ * Measures looking up lines at random in a file.
+ *
+ * @param path the path to the file
+ */
+static void benchLookup(const char *path)
+{
+	double best = 0.0;
+	int r, k;
+
+	(void)writeSource(path);
+
+	for (r = 0; r < REPEATS; ++r)
+	{
+		double start = monotonicNow();
+
+		rngState = 1;
+		for (k = 0; k < LOOKUPS; ++k)
+		{
+			char *lines;
+			size_t len;
+
+			fetchFileLines(path, 1 + nextRandom(FILE_LINES), 1 + nextRandom(3), &lines, &len);
+			free(lines);
+		}
+
+		start = monotonicNow() - start;
+		if (r == 0 || start < best)
+		{
+			best = start;
+		}
+	}
+
+	(void)printf("line lookup in %d lines: %9.3f us per lookup\n", FILE_LINES, best * 1e6 / LOOKUPS);
+}
+
+/**
+ * Measures adding arguments to a string array.
+ *
+ * @param count the number of arguments to add
+ */
+static void benchMsa(size_t count)
+{
+	double best = 0.0;
+	char dir[64];
+	size_t i;
+	int r;
+
+	for (r = 0; r < REPEATS; ++r)
+	{
+		msa_t msa;
+		double start;
+
+		if (msa_create(&msa) == 0)
+		{
+			perror("msa_create");
+			exit(EXITCODE_MM);
+		}
+
+		start = monotonicNow();
+		for (i = 0; i < count; ++i)
+		{
+			(void)snprintf(dir, sizeof(dir), "/usr/src/project/include/dir%zu", i);
+			if (msa_add_prefixed(&msa, (i % 2 == 0) ? "-I" : "-D", dir) == 0)
+			{
+				perror("msa_add_prefixed");
+				exit(EXITCODE_MM);
+			}
+		}
+		start = monotonicNow() - start;
+		msa_destroy(&msa);
+
+		if (r == 0 || start < best)
+		{
+			best = start;
+		}
+	}
+
+	(void)printf("msa_add_prefixed, %7zu arguments: %9.3f ms, %7.1f ns per argument\n",
+		count, best * 1e3, best * 1e9 / (double)count
+	);
+}
+
+/**
+ * Measures reporting findings.
+ */
+static void benchReport(void)
+{
+	findings_t found;
+	double best = 0.0;
+	char file[64], func[64];
+	int r, devnull, saved;
+	size_t i;
+
+	if (findings_create(&found) == 0)
+	{
+		perror("findings_create");
+		exit(EXITCODE_MM);
+	}
+
+	rngState = 1;
+	for (i = 0; i < REPORTED; ++i)
+	{
+		module_loc_t start = { .line = 1 + nextRandom(5000), .col = 1 + nextRandom(40) };
+		module_loc_t end = { .line = start.line, .col = start.col + 6 };
+
+		(void)snprintf(file, sizeof(file), "src/module%lu.c", nextRandom(200));
+		(void)snprintf(func, sizeof(func), "function%lu", nextRandom(1000));
+		if (findings_add(
+			&found, (nextRandom(4) == 0) ? FINDING_SUPERFLUOUS_VOID : FINDING_MISSING_VOID,
+			file, func, start, end, (nextRandom(10) == 0) ? 2 : 0
+		) == 0)
+		{
+			perror("findings_add");
+			exit(EXITCODE_MM);
+		}
+	}
+
+	/* the warnings go to stderr; only their formatting is of interest */
+	(void)fflush(stderr);
+	saved = dup(STDERR_FILENO);
+	devnull = open("/dev/null", O_WRONLY);
+	if (saved == -1 || devnull == -1 || dup2(devnull, STDERR_FILENO) == -1)
+	{
+		perror("dup");
+		exit(EXITCODE_FILE_OPEN);
+	}
+
+	for (r = 0; r < REPEATS; ++r)
+	{
+		double start = monotonicNow();
+		report_findings(&found, report_warnMissingVoid, report_warnSuperfluousVoid);
+		(void)fflush(stderr);
+		start = monotonicNow() - start;
+
+		if (r == 0 || start < best)
+		{
+			best = start;
+		}
+	}
+
+	(void)dup2(saved, STDERR_FILENO);
+	(void)close(saved);
+	(void)close(devnull);
+	findings_destroy(&found);
+
+	(void)printf("report, %d findings: %9.3f ms, %10.0f findings/s\n", REPORTED, best * 1e3, (double)REPORTED / best);
+}
+
+/**
+ * The main entry point of the microbenchmarks.
+ * @param argc the number of command-line arguments
+ * @param argv the array of command-line arguments
+ */
+int main(int argc, char **argv)
+{
+	char dir[] = "/tmp/voidcaster-microbench.XXXXXX";
+	char path[sizeof(dir) + 16], backup[sizeof(dir) + 16];
+
+	(void)argc;
+	progname = argv[0];
+
+	if (mkdtemp(dir) == NULL)
+	{
+		perror("mkdtemp");
+		return EXITCODE_FILE_OPEN;
+	}
+	(void)snprintf(path, sizeof(path), "%s/source.c", dir);
+	(void)snprintf(backup, sizeof(backup), "%s/source.c~", dir);
+	configs_create(&configs);
+	report_init(&configs);
+
+	benchRewrite(path, 1000);
+	benchRewrite(path, 100);
+	benchRewrite(path, 10);
+	benchRewrite(path, 1);
+	benchLookup(path);
+	benchMsa(1000);
+	benchMsa(10000);
+	benchMsa(100000);
+	benchReport();
+
+	(void)unlink(path);
+	(void)unlink(backup);
+	(void)rmdir(dir);
+	configs_destroy(&configs);
+	return EXITCODE_OK;
+}
@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# Benchmarks how long the Voidcaster takes to start up and exit when it doesn't
+# have to parse anything.
+#
+# Usage: startup.sh VOIDCASTER GENCORPUS [RUNS]
+#
+# Times RUNS (default 100) invocations each of --help and of a fully cached run,
+# i.e. a --fast run whose signature database has been written beforehand, and
+# reports the average time per invocation. Fails if any invocation does.
+
+set -e
+
+if [ $# -lt 2 ]
+then
+	echo "Usage: $0 VOIDCASTER GENCORPUS [RUNS]" >&2
+	exit 1
+fi
+
+voidcaster="$1"
+gencorpus="$2"
+runs="${3:-100}"
+
+workdir="$(mktemp -d "${TMPDIR:-/tmp}/voidcaster-bench.XXXXXX")"
+trap 'rm -rf "$workdir"' EXIT
+
+"$gencorpus" -n 50 > "$workdir/small.c"
+"$voidcaster" --diagnostics=none --write-sigdb="$workdir/sigs.db" "$workdir/small.c" 2> /dev/null
+
+# runs the rest of the arguments RUNS times, outputting the average time in milliseconds;
+# fails if a run exits with a status other than 0, since it would be timing the wrong thing
+timeRuns()
+{
+	start="$(date +%s.%N)"
+	i=0
+	while [ "$i" -lt "$runs" ]
+	do
+		"$@" > /dev/null 2>&1 || {
+			echo "$0: $* exited with status $?" >&2
+			return 1
+		}
+		i=$((i + 1))
+	done
+	end="$(date +%s.%N)"
+	awk "BEGIN { printf \"%.2f\", ($end - $start) * 1000 / $runs }"
+}
+
+# command substitution in an argument of echo would swallow the status
+helpTime="$(timeRuns "$voidcaster" --help)"
+echo "--help: $helpTime ms"
+cachedTime="$(timeRuns "$voidcaster" --fast --sigdb="$workdir/sigs.db" "$workdir/small.c")"
+echo "cached: $cachedTime ms"
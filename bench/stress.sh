@@ -0,0 +1,99 @@
+#!/bin/sh
+#
+# Runs the Voidcaster on pathological files and fails if any of them takes too
+# long, uses too much memory or crashes.
+#
+# Usage: stress.sh VOIDCASTER GENCORPUS
+#
+# Each kind of file GENCORPUS can generate with -x is analyzed with the stack
+# limited to 8 MiB and the address space to 8 GiB, as a default shell on a
+# build machine would. The findings file is additionally fixed interactively
+# and checked to be free of findings afterwards. The wall time and the peak
+# resident set size are compared to the budget of each case.
+
+set -e
+
+if [ $# -ne 2 ]
+then
+	echo "Usage: $0 VOIDCASTER GENCORPUS" >&2
+	exit 1
+fi
+
+voidcaster="$1"
+gencorpus="$2"
+
+workdir="$(mktemp -d "${TMPDIR:-/tmp}/voidcaster-stress.XXXXXX")"
+trap 'rm -rf "$workdir"' EXIT
+
+# the budgets: kind, seconds, MiB of peak resident set size
+budgets="nested 10 512
+statements 60 2048
+macro 10 512
+findings 20 512
+longline 10 512"
+
+failures=0
+
+# runs the Voidcaster under the limits; the arguments are passed on
+limited()
+{
+	(
+		ulimit -s 8192
+		ulimit -v 8388608
+		exec timeout 300 "$voidcaster" "$@"
+	)
+}
+
+# checks a run against its budget: name, exit code, start, end, metrics file, seconds, MiB
+check()
+{
+	seconds="$(awk "BEGIN { printf \"%.2f\", $4 - $3 }")"
+	mib="$(awk '$1 == "voidcaster_peak_resident_bytes" { printf "%.0f", $2 / 1048576 }' "$5")"
+	verdict="ok"
+	if [ "$2" -ne 0 ]
+	then
+		verdict="FAILED (exit code $2)"
+	elif awk "BEGIN { exit !($seconds > $6) }"
+	then
+		verdict="FAILED (over $6 s)"
+	elif [ "${mib:-0}" -gt "$7" ]
+	then
+		verdict="FAILED (over $7 MiB)"
+	fi
+	printf '%-22s %8s s %6s MiB  %s\n' "$1" "$seconds" "${mib:-?}" "$verdict"
+	if [ "$verdict" != "ok" ]
+	then
+		failures=$((failures + 1))
+	fi
+}
+
+while read -r kind limit rss
+do
+	"$gencorpus" -x "$kind" > "$workdir/$kind.c"
+	start="$(date +%s.%N)"
+	status=0
+	limited --diagnostics=errors --metrics="$workdir/$kind.metrics" "$workdir/$kind.c" \
+		< /dev/null 2> "$workdir/$kind.out" || status=$?
+	check "$kind" "$status" "$start" "$(date +%s.%N)" "$workdir/$kind.metrics" "$limit" "$rss"
+done <<EOF
+$budgets
+EOF
+
+# fix every finding interactively, then make sure none are left
+start="$(date +%s.%N)"
+status=0
+yes y | limited -i --diagnostics=errors --metrics="$workdir/fix.metrics" "$workdir/findings.c" \
+	> /dev/null 2>&1 || status=$?
+check "findings, interactive" "$status" "$start" "$(date +%s.%N)" "$workdir/fix.metrics" 20 512
+if [ "$status" -eq 0 ] && limited --diagnostics=errors "$workdir/findings.c" 2>&1 | grep -q .
+then
+	echo "findings, interactive: findings left after fixing all of them" >&2
+	failures=$((failures + 1))
+fi
+
+if [ "$failures" -gt 0 ]
+then
+	echo "$failures stress cases failed" >&2
+	exit 1
+fi
+echo "all stress cases passed"
@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+# Benchmarks parallel traversal of a single huge translation unit.
+#
+# Usage: traverse.sh VOIDCASTER GENCORPUS [FUNCTIONS]
+#
+# Generates an amalgamation-sized file with FUNCTIONS (default 15000) function
+# definitions, then times the Voidcaster on it with an increasing number of
+# traversal jobs.
+
+set -e
+
+if [ $# -lt 2 ]
+then
+	echo "Usage: $0 VOIDCASTER GENCORPUS [FUNCTIONS]" >&2
+	exit 1
+fi
+
+voidcaster="$1"
+gencorpus="$2"
+funcs="${3:-15000}"
+
+workdir="$(mktemp -d "${TMPDIR:-/tmp}/voidcaster-bench.XXXXXX")"
+trap 'rm -rf "$workdir"' EXIT
+
+"$gencorpus" -n "$funcs" > "$workdir/amalgamation.c"
+echo "amalgamation: $funcs functions, $(wc -l < "$workdir/amalgamation.c") lines"
+
+cpus="$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)"
+
+# powers of two up to the number of CPUs, then the number of CPUs itself
+jobslist=1
+jobs=2
+while [ "$jobs" -lt "$cpus" ]
+do
+	jobslist="$jobslist $jobs"
+	jobs=$((jobs * 2))
+done
+if [ "$cpus" -gt 1 ]
+then
+	jobslist="$jobslist $cpus"
+fi
+
+for jobs in $jobslist
+do
+	start="$(date +%s.%N)"
+	"$voidcaster" --diagnostics=none --traverse-jobs="$jobs" "$workdir/amalgamation.c" 2> "$workdir/out.$jobs"
+	end="$(date +%s.%N)"
+
+	if [ "$jobs" -ne 1 ] && ! cmp -s "$workdir/out.1" "$workdir/out.$jobs"
+	then
+		echo "traverse-jobs=$jobs: findings differ from traverse-jobs=1" >&2
+		exit 1
+	fi
+
+	seconds="$(awk "BEGIN { printf \"%.3f\", $end - $start }")"
+	echo "traverse-jobs=$jobs: $seconds s, $(wc -l < "$workdir/out.$jobs") findings"
+done
@@ -0,0 +1,471 @@
+/**
+ * @file bundle.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Self-contained recordings of runs, for reproducing them elsewhere.
+ * @details A bundle is an overlay pack. Besides the files opened, it contains
+ * a few entries whose names start with BUNDLE_META (which sorts before any
+ * path) and whose contents are lists of NUL-terminated strings: the command
+ * line, the working directory, the files analyzed and one entry per
+ * configuration (its name, empty for the default one, followed by its Clang
+ * arguments).
+ */
+
+#include "bundle.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/** The prefix of the names of the entries which aren't files. */
+#define BUNDLE_META "\001bundle/"
+
+/** The options of Clang whose next argument is a path. */
+static const char * const PATH_OPTIONS[] = {
+	"-I", "-isystem", "-iquote", "-idirafter", "-include", "-imacros", NULL
+};
+
+/* utility functions */
+
+/**
+ * Makes a path absolute.
+ *
+ * @param cwd The directory relative paths are relative to.
+ * @param path The path.
+ * @return The absolute path (to be freed), or NULL on failure.
+ */
+static char *absolutePath(const char *cwd, const char *path)
+{
+	char *abs;
+
+	if (path[0] == '/')
+	{
+		return strdup(path);
+	}
+
+	abs = malloc(strlen(cwd) + strlen(path) + 2);
+	if (abs != NULL)
+	{
+		(void)sprintf(abs, "%s/%s", cwd, path);
+	}
+	return abs;
+}
+
+/**
+ * Adds an entry consisting of a list of strings to a bundle.
+ *
+ * @param b Pointer to a bundle structure.
+ * @param name The name of the entry, without BUNDLE_META.
+ * @param first If not NULL, a string preceding the list.
+ * @param list The strings.
+ * @param count The number of strings.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int addList(bundle_t *b, const char *name, const char *first, char * const *list, size_t count)
+{
+	char fullName[64];
+	char *data, *p;
+	size_t i, length = (first != NULL) ? strlen(first) + 1 : 0;
+	int ret;
+
+	for (i = 0; i < count; ++i)
+	{
+		length += strlen(list[i]) + 1;
+	}
+
+	data = malloc((length > 0) ? length : 1);
+	if (data == NULL)
+	{
+		return 0;
+	}
+
+	p = data;
+	if (first != NULL)
+	{
+		p = stpcpy(p, first) + 1;
+	}
+	for (i = 0; i < count; ++i)
+	{
+		p = stpcpy(p, list[i]) + 1;
+	}
+
+	(void)snprintf(fullName, sizeof(fullName), BUNDLE_META "%s", name);
+	ret = overlay_addData(&b->files, fullName, data, length);
+	free(data);
+	return ret;
+}
+
+/**
+ * Splits the contents of an entry into a list of strings.
+ *
+ * @param entry The entry.
+ * @param list The array to append the strings to.
+ * @return 1 on success, 0 on failure (setting errno appropriately; EINVAL if
+ * the entry isn't a list).
+ */
+static int splitList(const struct CXUnsavedFile *entry, msa_t *list)
+{
+	const char *p = entry->Contents;
+	const char *end = p + entry->Length;
+
+	if (entry->Length > 0 && end[-1] != '\0')
+	{
+		errno = EINVAL;
+		return 0;
+	}
+
+	for (; p < end; p += strlen(p) + 1)
+	{
+		if (msa_add(list, p) == 0)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * Makes the paths within Clang arguments absolute.
+ *
+ * @param cwd The directory relative paths are relative to.
+ * @param args The arguments.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int absoluteArgs(const char *cwd, msa_t *args)
+{
+	size_t i, k;
+	bool pathNext = false;
+
+	for (i = 0; i < args->count; ++i)
+	{
+		const char *arg = args->arr[i];
+		bool joined = (strncmp(arg, "-I", 2) == 0 && arg[2] != '\0');
+		char *abs;
+		int ret;
+
+		if (pathNext || joined)
+		{
+			abs = absolutePath(cwd, joined ? arg + 2 : arg);
+			if (abs == NULL)
+			{
+				return 0;
+			}
+
+			ret = joined ? msa_add_prefixed(args, "-I", abs) : msa_add(args, abs);
+			free(abs);
+			if (ret == 0)
+			{
+				return 0;
+			}
+
+			/* move the new argument into place */
+			free(args->arr[i]);
+			args->arr[i] = args->arr[--args->count];
+			arg = args->arr[i];
+		}
+
+		pathNext = false;
+		for (k = 0; !joined && PATH_OPTIONS[k] != NULL; ++k)
+		{
+			pathNext = pathNext || (strcmp(arg, PATH_OPTIONS[k]) == 0);
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Fills a bundle structure with empty contents.
+ *
+ * @param b Pointer to fill with a bundle structure.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int emptyBundle(bundle_t *b)
+{
+	overlay_create(&b->files);
+	b->cwd = NULL;
+
+	if (msa_create(&b->argv) == 0)
+	{
+		return 0;
+	}
+	if (msa_create(&b->sources) == 0)
+	{
+		msa_destroy(&b->argv);
+		return 0;
+	}
+	if (msa_create(&b->opened) == 0)
+	{
+		msa_destroy(&b->argv);
+		msa_destroy(&b->sources);
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * Adds a configuration from an entry of a bundle.
+ *
+ * @param entry The entry.
+ * @param cfgs Pointer to a configurations structure.
+ * @return 1 on success, 0 on failure (setting errno appropriately; EINVAL if
+ * the entry is malformed or there are too many configurations).
+ */
+static int loadConfig(const struct CXUnsavedFile *entry, configs_t *cfgs)
+{
+	config_t *cfg = &cfgs->arr[cfgs->count];
+
+	if (cfgs->count >= CONFIGS_MAX)
+	{
+		errno = EINVAL;
+		return 0;
+	}
+	if (msa_create(&cfg->args) == 0)
+	{
+		return 0;
+	}
+	cfg->name = NULL;
+	++cfgs->count;
+
+	if (splitList(entry, &cfg->args) == 0)
+	{
+		return 0;
+	}
+	if (cfg->args.count == 0)
+	{
+		errno = EINVAL;
+		return 0;
+	}
+
+	/* the name comes first */
+	if (cfg->args.arr[0][0] != '\0' && (cfg->name = strdup(cfg->args.arr[0])) == NULL)
+	{
+		return 0;
+	}
+	free(cfg->args.arr[0]);
+	(void)memmove(cfg->args.arr, cfg->args.arr + 1, (cfg->args.count - 1) * sizeof(char *));
+	--cfg->args.count;
+	return 1;
+}
+
+/**
+ * Reads the entries of a loaded bundle which aren't files, then removes them
+ * from its overlay.
+ *
+ * @param b Pointer to a bundle structure whose pack has been loaded.
+ * @param cfgs Pointer to an empty configurations structure.
+ * @return 1 on success, 0 on failure (setting errno appropriately; EINVAL if
+ * the file is not a bundle).
+ */
+static int loadMeta(bundle_t *b, configs_t *cfgs)
+{
+	size_t meta, metaBytes = 0;
+	msa_t cwd;
+	int ret = 1;
+
+	if (msa_create(&cwd) == 0)
+	{
+		return 0;
+	}
+
+	/* the entries which aren't files sort first */
+	for (meta = 0; ret == 1 && meta < b->files.count; ++meta)
+	{
+		const struct CXUnsavedFile *entry = &b->files.files[meta];
+		const char *name = entry->Filename + strlen(BUNDLE_META);
+
+		if (strncmp(entry->Filename, BUNDLE_META, strlen(BUNDLE_META)) != 0)
+		{
+			break;
+		}
+		metaBytes += entry->Length;
+
+		if (strcmp(name, "argv") == 0)
+			ret = splitList(entry, &b->argv);
+		else if (strcmp(name, "cwd") == 0)
+			ret = splitList(entry, &cwd);
+		else if (strcmp(name, "sources") == 0)
+			ret = splitList(entry, &b->sources);
+		else if (strncmp(name, "config/", 7) == 0)
+			ret = loadConfig(entry, cfgs);
+	}
+
+	if (ret == 1 && (cwd.count != 1 || b->argv.count == 0 || cfgs->count == 0))
+	{
+		errno = EINVAL;
+		ret = 0;
+	}
+	if (ret == 1 && (b->cwd = strdup(cwd.arr[0])) == NULL)
+	{
+		ret = 0;
+	}
+	msa_destroy(&cwd);
+
+	if (ret == 1)
+	{
+		/* hand only the files to Clang; the entries live in the pack, so nothing is freed */
+		(void)memmove(b->files.files, b->files.files + meta, (b->files.count - meta) * sizeof(struct CXUnsavedFile));
+		b->files.count -= meta;
+		b->files.bytes -= metaBytes;
+	}
+	return ret;
+}
+
+/* public-facing functions */
+
+int bundle_create(bundle_t *b, int argc, char * const *argv)
+{
+	int i;
+
+	if (emptyBundle(b) == 0)
+	{
+		return 0;
+	}
+
+	b->cwd = getcwd(NULL, 0);
+	if (b->cwd == NULL)
+	{
+		int olderrno = errno;
+		bundle_destroy(b);
+		errno = olderrno;
+		return 0;
+	}
+
+	for (i = 0; i < argc; ++i)
+	{
+		if (msa_add(&b->argv, argv[i]) == 0)
+		{
+			int olderrno = errno;
+			bundle_destroy(b);
+			errno = olderrno;
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+void bundle_destroy(bundle_t *b)
+{
+	overlay_destroy(&b->files);
+	msa_destroy(&b->argv);
+	msa_destroy(&b->sources);
+	msa_destroy(&b->opened);
+	free(b->cwd);
+	b->cwd = NULL;
+}
+
+int bundle_addSource(bundle_t *b, const char *path)
+{
+	return (msa_add(&b->sources, path) && msa_add(&b->opened, path)) ? 1 : 0;
+}
+
+int bundle_addOpened(bundle_t *b, const msa_t *names)
+{
+	size_t i;
+
+	for (i = 0; i < names->count; ++i)
+	{
+		if (msa_add(&b->opened, names->arr[i]) == 0)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int bundle_write(bundle_t *b, const configs_t *cfgs, const char *path)
+{
+	char name[32];
+	size_t i;
+
+	/* the files, each once, read now that the run is over */
+	msa_sort(&b->opened);
+	for (i = 0; i < b->opened.count; ++i)
+	{
+		char *abs;
+		int ret;
+
+		if (i > 0 && strcmp(b->opened.arr[i - 1], b->opened.arr[i]) == 0)
+		{
+			continue;
+		}
+
+		abs = absolutePath(b->cwd, b->opened.arr[i]);
+		if (abs == NULL)
+		{
+			return 0;
+		}
+		ret = overlay_addFile(&b->files, abs, b->opened.arr[i]);
+		free(abs);
+		if (ret == 0 && errno != ENOENT)
+		{
+			return 0;
+		}
+	}
+
+	if (
+		addList(b, "argv", NULL, b->argv.arr, b->argv.count) == 0 ||
+		addList(b, "cwd", b->cwd, NULL, 0) == 0 ||
+		addList(b, "sources", NULL, b->sources.arr, b->sources.count) == 0
+	)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < cfgs->count; ++i)
+	{
+		const config_t *cfg = &cfgs->arr[i];
+
+		(void)snprintf(name, sizeof(name), "config/%02zu", i);
+		if (addList(b, name, (cfg->name != NULL) ? cfg->name : "", cfg->args.arr, cfg->args.count) == 0)
+		{
+			return 0;
+		}
+	}
+
+	overlay_finalize(&b->files);
+	return overlay_write(&b->files, path);
+}
+
+int bundle_load(bundle_t *b, configs_t *cfgs, const char *path)
+{
+	size_t i;
+	int ret;
+
+	if (emptyBundle(b) == 0)
+	{
+		return 0;
+	}
+
+	ret = overlay_load(&b->files, path);
+	if (ret == 1)
+	{
+		overlay_finalize(&b->files);
+		ret = loadMeta(b, cfgs);
+	}
+
+	/* the files are named by their absolute paths; refer to them that way */
+	for (i = 0; ret == 1 && i < b->sources.count; ++i)
+	{
+		char *abs = absolutePath(b->cwd, b->sources.arr[i]);
+		ret = (abs != NULL && msa_replace(&b->sources, i, abs) == 1) ? 1 : 0;
+		free(abs);
+	}
+	for (i = 0; ret == 1 && i < cfgs->count; ++i)
+	{
+		ret = absoluteArgs(b->cwd, &cfgs->arr[i].args);
+	}
+
+	if (ret == 0)
+	{
+		int olderrno = errno;
+		bundle_destroy(b);
+		configs_destroy(cfgs);
+		errno = olderrno;
+	}
+	return ret;
+}
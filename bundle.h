@@ -0,0 +1,104 @@
+/**
+ * @file bundle.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Self-contained recordings of runs, for reproducing them elsewhere.
+ * @details A bundle holds the command line of a run, the working directory,
+ * the files analyzed, the Clang arguments of each configuration and every file
+ * libclang opened while parsing. Replaying a bundle passes the files to Clang
+ * from memory under their original absolute paths, so that neither the
+ * include paths nor the generated headers of the recording machine have to
+ * exist.
+ */
+
+#ifndef __BUNDLE_H__
+#define __BUNDLE_H__
+
+#include <stdlib.h>
+
+#include "configs.h"
+#include "msa.h"
+#include "overlay.h"
+
+/** A bundle being recorded or replayed. */
+typedef struct
+{
+	/** The files opened by libclang, named by their absolute paths. */
+	overlay_t files;
+
+	/** The command line of the recorded run. */
+	msa_t argv;
+
+	/** The working directory of the recorded run. */
+	char *cwd;
+
+	/** The files analyzed; absolute once loaded. */
+	msa_t sources;
+
+	/** While recording, the names of the files opened so far (with duplicates). */
+	msa_t opened;
+} bundle_t;
+
+/**
+ * Start recording a bundle.
+ *
+ * @param b Pointer to fill with a bundle structure.
+ * @param argc The number of command-line arguments of the run.
+ * @param argv The command-line arguments of the run.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int bundle_create(bundle_t *b, int argc, char * const *argv);
+
+/**
+ * Destroy a bundle.
+ *
+ * @param b Pointer to a bundle structure.
+ */
+void bundle_destroy(bundle_t *b);
+
+/**
+ * Record that a file is analyzed.
+ *
+ * @param b Pointer to a bundle structure being recorded.
+ * @param path The path to the file, as given to libclang.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int bundle_addSource(bundle_t *b, const char *path);
+
+/**
+ * Record that libclang opened some files. They are only read when the bundle
+ * is written.
+ *
+ * @param b Pointer to a bundle structure being recorded.
+ * @param names The names of the files, as reported by libclang.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int bundle_addOpened(bundle_t *b, const msa_t *names);
+
+/**
+ * Read the files opened and write the bundle, replacing it atomically. Files
+ * which have vanished since they were opened are skipped.
+ *
+ * @param b Pointer to a bundle structure being recorded.
+ * @param cfgs The finalized configurations of the run.
+ * @param path The path to the bundle.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int bundle_write(bundle_t *b, const configs_t *cfgs, const char *path);
+
+/**
+ * Load a bundle for replaying. Relative paths (of the files analyzed and
+ * within the Clang arguments) are made absolute using the recorded working
+ * directory.
+ *
+ * @param b Pointer to fill with a bundle structure.
+ * @param cfgs Pointer to an empty configurations structure, to be filled with
+ * the finalized configurations of the recorded run.
+ * @param path The path to the bundle.
+ * @return 1 on success, 0 on failure (setting errno appropriately; EINVAL if
+ * the file is not a bundle).
+ */
+int bundle_load(bundle_t *b, configs_t *cfgs, const char *path);
+
+#endif
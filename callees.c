@@ -0,0 +1,334 @@
+/**
+ * @file callees.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Set of targeted callees.
+ */
+
+#include "callees.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* utility functions */
+
+/**
+ * Compares two strings pointed to. Useful for bsearch(3).
+ *
+ * @param left Pointer to the first string (pointer to pointer to char).
+ * @param right Pointer to the second string (pointer to pointer to char).
+ * @return As strcmp(3).
+ */
+static int comparator_strcmp(const void *left, const void *right)
+{
+	return strcmp(*(const char * const *)left, *(const char * const *)right);
+}
+
+/**
+ * Finds the longest part of a name which contains no wildcards.
+ *
+ * @param name the name, possibly containing wildcards
+ * @param len by-ref to the length of the part
+ * @return the start of the part
+ */
+static const char *longestLiteral(const char *name, size_t *len)
+{
+	const char *best = name, *run = name, *p;
+	size_t bestLen = 0;
+
+	for (p = name; ; ++p)
+	{
+		const char *close = NULL;
+
+		if (*p == '[')
+		{
+			/* a closing bracket right at the start (after any negation) is part of the set */
+			const char *set = p + 1;
+			if (*set == '!')
+				++set;
+			if (*set == ']')
+				++set;
+			close = strchr(set, ']');
+			if (close == NULL)
+			{
+				/* fnmatch(3) takes an unterminated bracket literally */
+				continue;
+			}
+		}
+
+		if (*p == '\0' || *p == '*' || *p == '?' || *p == '[' || *p == '\\')
+		{
+			/* the current run of literal characters ends here */
+			if ((size_t)(p - run) > bestLen)
+			{
+				best = run;
+				bestLen = (size_t)(p - run);
+			}
+
+			if (*p == '\0')
+			{
+				break;
+			}
+			else if (*p == '[')
+			{
+				/* skip the bracket expression */
+				p = close;
+			}
+			else if (*p == '\\' && p[1] != '\0')
+			{
+				/* escaped characters aren't worth the trouble */
+				++p;
+			}
+			run = p + 1;
+		}
+	}
+
+	*len = bestLen;
+	return best;
+}
+
+/**
+ * Returns whether a block of text contains a string.
+ *
+ * Where SSE2 is available, sixteen positions are checked at once by comparing
+ * the first and the last character of the string; only positions where both
+ * match are compared in full.
+ *
+ * @param text the text to search
+ * @param size the size of the text
+ * @param lit the string to search for
+ * @param len the length of the string; not zero
+ * @return true if the text contains the string
+ */
+static bool containsLiteral(const char *text, size_t size, const char *lit, size_t len)
+{
+	size_t i = 0;
+
+	if (len > size)
+	{
+		return false;
+	}
+
+#ifdef __SSE2__
+	{
+		const __m128i first = _mm_set1_epi8(lit[0]);
+		const __m128i last = _mm_set1_epi8(lit[len - 1]);
+
+		for (; i + len - 1 + 16 <= size; i += 16)
+		{
+			__m128i blockFirst = _mm_loadu_si128((const __m128i *)(text + i));
+			__m128i blockLast = _mm_loadu_si128((const __m128i *)(text + i + len - 1));
+			unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(
+				_mm_cmpeq_epi8(blockFirst, first),
+				_mm_cmpeq_epi8(blockLast, last)
+			));
+
+			for (; mask != 0; mask &= mask - 1)
+			{
+				if (memcmp(text + i + __builtin_ctz(mask), lit, len) == 0)
+				{
+					return true;
+				}
+			}
+		}
+	}
+#endif
+
+	/* the rest (or everything, without SSE2) */
+	for (; i + len <= size; ++i)
+	{
+		if (text[i] == lit[0] && memcmp(text + i, lit, len) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/* public-facing functions */
+
+int callees_create(callees_t *cs)
+{
+	if (msa_create(&cs->names) == 0)
+	{
+		return 0;
+	}
+	if (msa_create(&cs->patterns) == 0)
+	{
+		msa_destroy(&cs->names);
+		return 0;
+	}
+	if (msa_create(&cs->literals) == 0)
+	{
+		msa_destroy(&cs->names);
+		msa_destroy(&cs->patterns);
+		return 0;
+	}
+	return 1;
+}
+
+void callees_destroy(callees_t *cs)
+{
+	msa_destroy(&cs->names);
+	msa_destroy(&cs->patterns);
+	msa_destroy(&cs->literals);
+}
+
+int callees_add(callees_t *cs, const char *name)
+{
+	size_t litLen;
+	const char *lit = longestLiteral(name, &litLen);
+	char *litCopy;
+	int ret;
+
+	if (litLen == 0)
+	{
+		/* would match everything, and can't be prefiltered */
+		errno = EINVAL;
+		return 0;
+	}
+
+	if (lit[litLen] == '\0' && lit == name)
+	{
+		/* no wildcards */
+		if (msa_add(&cs->names, name) == 0)
+		{
+			return 0;
+		}
+		msa_sort(&cs->names);
+	}
+	else if (msa_add(&cs->patterns, name) == 0)
+	{
+		return 0;
+	}
+
+	litCopy = strndup(lit, litLen);
+	if (litCopy == NULL)
+	{
+		return 0;
+	}
+	ret = msa_add(&cs->literals, litCopy);
+	free(litCopy);
+	return ret;
+}
+
+int callees_addFile(callees_t *cs, const char *path)
+{
+	FILE *f;
+	char *line = NULL;
+	size_t linecap = 0;
+	ssize_t len;
+	int ret = 1, olderrno;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+	{
+		return 0;
+	}
+
+	while (ret == 1 && (len = getline(&line, &linecap, f)) != -1)
+	{
+		/* strip trailing whitespace */
+		while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r' || line[len-1] == ' ' || line[len-1] == '\t'))
+		{
+			line[--len] = '\0';
+		}
+
+		if (len == 0 || line[0] == '#')
+		{
+			continue;
+		}
+
+		ret = callees_add(cs, line);
+	}
+
+	olderrno = errno;
+	if (ret == 1 && ferror(f))
+	{
+		ret = 0;
+	}
+	free(line);
+	(void)fclose(f);
+	errno = olderrno;
+	return ret;
+}
+
+bool callees_match(const callees_t *cs, const char *name)
+{
+	size_t i;
+
+	if (bsearch(&name, cs->names.arr, cs->names.count, sizeof(char *), comparator_strcmp) != NULL)
+	{
+		return true;
+	}
+
+	for (i = 0; i < cs->patterns.count; ++i)
+	{
+		if (fnmatch(cs->patterns.arr[i], name, 0) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int callees_mentioned(const callees_t *cs, const char *path, bool *mentioned)
+{
+	struct stat st;
+	const char *text;
+	size_t i;
+	int fd, olderrno;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return 0;
+	}
+
+	if (fstat(fd, &st) == -1)
+	{
+		olderrno = errno;
+		(void)close(fd);
+		errno = olderrno;
+		return 0;
+	}
+
+	*mentioned = false;
+	if (st.st_size == 0)
+	{
+		/* can't map empty files; they don't mention anything anyway */
+		(void)close(fd);
+		return 1;
+	}
+
+	text = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	olderrno = errno;
+	(void)close(fd);
+	if (text == MAP_FAILED)
+	{
+		errno = olderrno;
+		return 0;
+	}
+
+	for (i = 0; i < cs->literals.count && !*mentioned; ++i)
+	{
+		*mentioned = containsLiteral(text, (size_t)st.st_size, cs->literals.arr[i], strlen(cs->literals.arr[i]));
+	}
+
+	(void)munmap((void *)text, (size_t)st.st_size);
+	return 1;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file callees.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Set of targeted callees.
+ * @details If callees are targeted, only calls to them are reported, and files
+ * which never mention any of them are not analyzed at all. Names may contain
+ * the wildcards of fnmatch(3), e.g. "*_checked".
+ */
+
+#ifndef __CALLEES_H__
+#define __CALLEES_H__
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "msa.h"
+
+/** A set of targeted callees. */
+typedef struct
+{
+	/** The names without wildcards, sorted. */
+	msa_t names;
+
+	/** The names with wildcards. */
+	msa_t patterns;
+
+	/**
+	 * For each name, the longest part without wildcards; a file mentioning
+	 * none of these cannot call any of the callees.
+	 */
+	msa_t literals;
+} callees_t;
+
+/**
+ * Create an empty set of callees.
+ *
+ * @param cs Pointer to fill with a callee set structure.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int callees_create(callees_t *cs);
+
+/**
+ * Destroy a set of callees.
+ *
+ * @param cs Pointer to a callee set structure.
+ */
+void callees_destroy(callees_t *cs);
+
+/**
+ * Add a callee to a set of callees.
+ *
+ * @param cs Pointer to a callee set structure.
+ * @param name The name of the callee, possibly containing wildcards.
+ * @return 1 on success, 0 on failure (setting errno appropriately; EINVAL if
+ * the name consists of wildcards only).
+ */
+int callees_add(callees_t *cs, const char *name);
+
+/**
+ * Add the callees listed in a file, one per line, to a set of callees. Empty
+ * lines and lines starting with '#' are skipped.
+ *
+ * @param cs Pointer to a callee set structure.
+ * @param path The path to the file.
+ * @return 1 on success, 0 on failure (setting errno appropriately; EINVAL if
+ * a name consists of wildcards only).
+ */
+int callees_addFile(callees_t *cs, const char *path);
+
+/**
+ * Returns whether any callees are targeted.
+ *
+ * @param cs Pointer to a callee set structure.
+ * @return true if the set is not empty
+ */
+static inline bool callees_any(const callees_t *cs)
+{
+	return (cs->names.count > 0 || cs->patterns.count > 0);
+}
+
+/**
+ * Returns whether a function is targeted.
+ *
+ * @param cs Pointer to a callee set structure.
+ * @param name The name of the function.
+ * @return true if the function is in the set
+ */
+bool callees_match(const callees_t *cs, const char *name);
+
+/**
+ * Checks whether a file mentions any of the callees, i.e. contains the
+ * literal part of any of their names. Uses SIMD instructions where
+ * available.
+ *
+ * @param cs Pointer to a callee set structure.
+ * @param path The path to the file.
+ * @param mentioned Will be set to true if the file mentions a callee.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int callees_mentioned(const callees_t *cs, const char *path, bool *mentioned);
+
+#endif
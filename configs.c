@@ -0,0 +1,195 @@
+/**
+ * @file configs.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Analysis configurations.
+ */
+
+#include "configs.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/* utility functions */
+
+/**
+ * Splits a string at whitespace, adding each part to a Magical String Array.
+ *
+ * @param msa Pointer to a MSA structure.
+ * @param str The string to split.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int addSplit(msa_t *msa, const char *str)
+{
+	char *copy, *arg, *saveptr = NULL;
+	int ret = 1;
+
+	copy = strdup(str);
+	if (copy == NULL)
+	{
+		return 0;
+	}
+
+	for (arg = strtok_r(copy, " \t\n", &saveptr); arg != NULL; arg = strtok_r(NULL, " \t\n", &saveptr))
+	{
+		ret = msa_add(msa, arg);
+		if (ret == 0)
+		{
+			break;
+		}
+	}
+
+	free(copy);
+	return ret;
+}
+
+/* public-facing functions */
+
+void configs_create(configs_t *cfgs)
+{
+	cfgs->count = 0;
+}
+
+void configs_destroy(configs_t *cfgs)
+{
+	size_t i;
+
+	for (i = 0; i < cfgs->count; ++i)
+	{
+		free(cfgs->arr[i].name);
+		msa_destroy(&cfgs->arr[i].args);
+	}
+	cfgs->count = 0;
+}
+
+int configs_add(configs_t *cfgs, const char *spec)
+{
+	const char *colon = strchr(spec, ':');
+	config_t *cfg;
+	size_t i;
+
+	if (colon == NULL || colon == spec || cfgs->count >= CONFIGS_MAX)
+	{
+		errno = EINVAL;
+		return 0;
+	}
+
+	for (i = 0; i < cfgs->count; ++i)
+	{
+		if (
+			strncmp(cfgs->arr[i].name, spec, (size_t)(colon - spec)) == 0 &&
+			cfgs->arr[i].name[colon - spec] == '\0'
+		)
+		{
+			/* name taken */
+			errno = EINVAL;
+			return 0;
+		}
+	}
+
+	cfg = &cfgs->arr[cfgs->count];
+	cfg->name = strndup(spec, (size_t)(colon - spec));
+	if (cfg->name == NULL)
+	{
+		return 0;
+	}
+
+	if (msa_create(&cfg->args) == 0)
+	{
+		free(cfg->name);
+		return 0;
+	}
+
+	if (addSplit(&cfg->args, colon + 1) == 0)
+	{
+		int olderrno = errno;
+		free(cfg->name);
+		msa_destroy(&cfg->args);
+		errno = olderrno;
+		return 0;
+	}
+
+	++cfgs->count;
+	return 1;
+}
+
+int configs_finalize(configs_t *cfgs, const msa_t *common)
+{
+	size_t i, j;
+
+	if (cfgs->count == 0)
+	{
+		/* add the default configuration */
+		cfgs->arr[0].name = NULL;
+		if (msa_create(&cfgs->arr[0].args) == 0)
+		{
+			return 0;
+		}
+		cfgs->count = 1;
+	}
+
+	for (i = 0; i < cfgs->count; ++i)
+	{
+		msa_t full;
+
+		if (msa_create(&full) == 0)
+		{
+			return 0;
+		}
+
+		for (j = 0; j < common->count; ++j)
+		{
+			if (msa_add(&full, common->arr[j]) == 0)
+			{
+				msa_destroy(&full);
+				return 0;
+			}
+		}
+
+		for (j = 0; j < cfgs->arr[i].args.count; ++j)
+		{
+			if (msa_add(&full, cfgs->arr[i].args.arr[j]) == 0)
+			{
+				msa_destroy(&full);
+				return 0;
+			}
+		}
+
+		msa_destroy(&cfgs->arr[i].args);
+		cfgs->arr[i].args = full;
+	}
+
+	return 1;
+}
+
+const char *configs_describe(const configs_t *cfgs, configset_t set, char *buf, size_t bufsize)
+{
+	size_t i, pos = 0;
+
+	if (bufsize == 0)
+	{
+		return buf;
+	}
+	buf[0] = '\0';
+
+	for (i = 0; i < cfgs->count && pos < bufsize; ++i)
+	{
+		int written;
+
+		if ((set & ((configset_t)1 << i)) == 0 || cfgs->arr[i].name == NULL)
+		{
+			continue;
+		}
+
+		written = snprintf(buf + pos, bufsize - pos, "%s%s", (pos > 0) ? ", " : "", cfgs->arr[i].name);
+		if (written < 0)
+		{
+			break;
+		}
+		pos += (size_t)written;
+	}
+
+	return buf;
+}
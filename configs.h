@@ -0,0 +1,93 @@
+/**
+ * @file configs.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Analysis configurations.
+ * @details A configuration is a named set of additional arguments to Clang
+ * (e.g. macro definitions) under which each file is analyzed.
+ */
+
+#ifndef __CONFIGS_H__
+#define __CONFIGS_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "msa.h"
+
+/** The maximum number of configurations (one bit per configuration). */
+#define CONFIGS_MAX 64
+
+/** A bit set of configurations; bit n stands for configuration n. */
+typedef uint64_t configset_t;
+
+/** A configuration. */
+typedef struct
+{
+	/** The name of the configuration; NULL for the default configuration. */
+	char *name;
+
+	/** The arguments to Clang for this configuration. */
+	msa_t args;
+} config_t;
+
+/** The configurations in use. */
+typedef struct
+{
+	/** How many configurations are there? */
+	size_t count;
+
+	/** The configurations themselves. */
+	config_t arr[CONFIGS_MAX];
+} configs_t;
+
+/**
+ * Create an empty set of configurations.
+ *
+ * @param cfgs Pointer to fill with a configurations structure.
+ */
+void configs_create(configs_t *cfgs);
+
+/**
+ * Destroy a set of configurations.
+ *
+ * @param cfgs Pointer to a configurations structure.
+ */
+void configs_destroy(configs_t *cfgs);
+
+/**
+ * Add a configuration given in the form NAME:ARGS, where ARGS are arguments to
+ * Clang separated by whitespace.
+ *
+ * @param cfgs Pointer to a configurations structure.
+ * @param spec The specification of the configuration.
+ * @return 1 on success, 0 on failure (setting errno appropriately; EINVAL if
+ * the specification is malformed, the name is taken or there are too many
+ * configurations).
+ */
+int configs_add(configs_t *cfgs, const char *spec);
+
+/**
+ * Prepend the given arguments to the arguments of every configuration. If no
+ * configuration has been added, a nameless default configuration is added
+ * first.
+ *
+ * @param cfgs Pointer to a configurations structure.
+ * @param common The arguments common to all configurations.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int configs_finalize(configs_t *cfgs, const msa_t *common);
+
+/**
+ * Write the comma-separated names of a set of configurations into a buffer.
+ *
+ * @param cfgs Pointer to a configurations structure.
+ * @param set The set of configurations whose names to write.
+ * @param buf The buffer to write into.
+ * @param bufsize The size of the buffer; the names are truncated to fit.
+ * @return buf
+ */
+const char *configs_describe(const configs_t *cfgs, configset_t set, char *buf, size_t bufsize);
+
+#endif
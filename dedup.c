@@ -0,0 +1,559 @@
+/**
+ * @file dedup.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Content-addressed deduplication of input files.
+ */
+
+#include "dedup.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/stat.h>
+
+#include "hash.h"
+
+/** The deduplication structure being sorted; used by comparator_dedupidx. */
+static const dedup_entry_t *sorting = NULL;
+
+/* utility functions */
+
+/**
+ * Compares two indices into the deduplication entries being sorted by the key
+ * of the entries they point to, then by the index itself. Useful for qsort(3).
+ *
+ * @param left Pointer to the first index (pointer to size_t).
+ * @param right Pointer to the second index (pointer to size_t).
+ * @return Less than zero if left ordered before right.
+ *         Zero if left and right equally ordered.
+ *         More than zero if right ordered before left.
+ */
+static int comparator_dedupidx(const void *left, const void *right)
+{
+	size_t li = *(const size_t *)left;
+	size_t ri = *(const size_t *)right;
+	const dedup_entry_t *l = &sorting[li];
+	const dedup_entry_t *r = &sorting[ri];
+
+	if (l->hashed != r->hashed)
+		return l->hashed ? -1 : 1;
+	if (l->key != r->key)
+		return (l->key < r->key) ? -1 : 1;
+	if (li != ri)
+		return (li < ri) ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Returns the length of the directory part of a path, including the trailing
+ * slash.
+ *
+ * @param path the path
+ * @return the length of the directory part; zero if the path has none
+ */
+static size_t dirLength(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	return (slash == NULL) ? 0 : (size_t)(slash - path + 1);
+}
+
+/**
+ * Returns whether two files have identical contents.
+ *
+ * @param a the path to the first file
+ * @param b the path to the second file
+ * @return true if both files could be read and have identical contents
+ */
+static bool filesEqual(const char *a, const char *b)
+{
+	FILE *af, *bf;
+	char abuf[4096], bbuf[4096];
+	size_t ar, br;
+	bool equal = true;
+
+	af = fopen(a, "rb");
+	if (af == NULL)
+	{
+		return false;
+	}
+	bf = fopen(b, "rb");
+	if (bf == NULL)
+	{
+		(void)fclose(af);
+		return false;
+	}
+
+	do
+	{
+		ar = fread(abuf, 1, sizeof(abuf), af);
+		br = fread(bbuf, 1, sizeof(bbuf), bf);
+		if (ar != br || memcmp(abuf, bbuf, ar) != 0)
+		{
+			equal = false;
+			break;
+		}
+	}
+	while (ar > 0);
+
+	if (ferror(af) || ferror(bf))
+	{
+		equal = false;
+	}
+
+	(void)fclose(af);
+	(void)fclose(bf);
+	return equal;
+}
+
+/**
+ * Returns the path to the counterpart of a file in another directory, if the
+ * file is located within (or below) the directory of a reference file.
+ *
+ * @param file the file whose counterpart to find
+ * @param ref the reference file
+ * @param other a file in the other directory
+ * @return the newly allocated path to the counterpart; NULL if the file is not
+ * located within the reference file's directory or memory is exhausted (the
+ * latter setting errno to ENOMEM)
+ */
+static char *counterpart(const char *file, const char *ref, const char *other)
+{
+	size_t refDirLen = dirLength(ref);
+	size_t otherDirLen = dirLength(other);
+	size_t restLen;
+	char *ret;
+
+	errno = 0;
+
+	if (strncmp(file, ref, refDirLen) != 0 || (refDirLen == 0 && file[0] == '/'))
+	{
+		/* elsewhere */
+		return NULL;
+	}
+
+	restLen = strlen(file + refDirLen);
+	ret = malloc(otherDirLen + restLen + 1);
+	if (ret == NULL)
+	{
+		return NULL;
+	}
+
+	(void)memcpy(ret, other, otherDirLen);
+	(void)memcpy(ret + otherDirLen, file + refDirLen, restLen + 1);
+	return ret;
+}
+
+/**
+ * Returns whether a path names a regular file.
+ *
+ * @param path the path
+ * @return true if the path names a regular file
+ */
+static bool isFile(const char *path)
+{
+	struct stat st;
+	return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+/**
+ * Concatenates three parts of a path.
+ *
+ * @param a the first part
+ * @param aLen the length of the first part
+ * @param b the second part
+ * @param bLen the length of the second part
+ * @param c the third part (NUL-terminated)
+ * @return the newly allocated path; NULL if memory is exhausted
+ */
+static char *joinPath(const char *a, size_t aLen, const char *b, size_t bLen, const char *c)
+{
+	size_t cLen = strlen(c);
+	char *ret = malloc(aLen + bLen + cLen + 1);
+	if (ret == NULL)
+	{
+		return NULL;
+	}
+
+	(void)memcpy(ret, a, aLen);
+	(void)memcpy(ret + aLen, b, bLen);
+	(void)memcpy(ret + aLen + bLen, c, cLen + 1);
+	return ret;
+}
+
+/**
+ * Returns whether a header next to a duplicate might shadow one which the
+ * analyzed file found elsewhere.
+ *
+ * A quoted include is first looked up relative to the directory of the file
+ * containing it. The files which the analyzed file includes from within its
+ * own directory thus give the directories in which a header found elsewhere,
+ * e.g. via -I, might have been shadowed. The spelling of the include isn't
+ * known, so each trailing part of the header's path is tried; a candidate
+ * next to the duplicate shadows the header unless an identical one exists at
+ * the same place next to the analyzed file, in which case the analyzed file
+ * would have found it too.
+ *
+ * @param rep the analyzed file
+ * @param dup the duplicate
+ * @return true if a header might be resolved differently for the duplicate
+ * (or memory is exhausted)
+ */
+static bool shadowed(const dedup_entry_t *rep, const dedup_entry_t *dup)
+{
+	size_t repDirLen = dirLength(rep->path);
+	size_t dupDirLen = dirLength(dup->path);
+	size_t i, j;
+
+	for (i = 0; i < rep->inclusions.count; ++i)
+	{
+		const char *header = rep->inclusions.arr[i];
+		const char *tail;
+
+		if (strncmp(header, rep->path, repDirLen) == 0 && !(repDirLen == 0 && header[0] == '/'))
+		{
+			/* compared by replicable() */
+			continue;
+		}
+
+		/* each trailing part of the header's path, shortest first; all of it if relative */
+		for (tail = header + strlen(header); tail != NULL; tail = (tail > header) ? tail - 1 : NULL)
+		{
+			if ((tail > header) ? (tail[-1] != '/') : (tail[0] == '/'))
+			{
+				continue;
+			}
+
+			/* each directory of the analyzed file's own headers, starting with its own */
+			for (j = 0; j <= rep->inclusions.count; ++j)
+			{
+				const char *sub = "";
+				size_t subLen = 0;
+				char *dupCand, *repCand;
+				bool shadows;
+
+				if (j > 0)
+				{
+					const char *other = rep->inclusions.arr[j - 1];
+					if (strncmp(other, rep->path, repDirLen) != 0 || (repDirLen == 0 && other[0] == '/'))
+					{
+						continue;
+					}
+					sub = other + repDirLen;
+					subLen = dirLength(sub);
+					if (subLen == 0)
+					{
+						/* the file's own directory; already tried */
+						continue;
+					}
+				}
+
+				dupCand = joinPath(dup->path, dupDirLen, sub, subLen, tail);
+				if (dupCand == NULL)
+				{
+					return true;
+				}
+				if (!isFile(dupCand))
+				{
+					free(dupCand);
+					continue;
+				}
+
+				repCand = joinPath(rep->path, repDirLen, sub, subLen, tail);
+				if (repCand == NULL)
+				{
+					free(dupCand);
+					return true;
+				}
+				shadows = !filesEqual(repCand, dupCand);
+				free(repCand);
+				free(dupCand);
+				if (shadows)
+				{
+					return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Returns whether the findings of an analyzed file may be replicated onto a
+ * duplicate.
+ *
+ * @param rep the analyzed file
+ * @param dup the duplicate
+ * @return true if the files and the headers they include relative to their
+ * directories are identical, and no header next to the duplicate shadows one
+ * included from elsewhere
+ */
+static bool replicable(const dedup_entry_t *rep, const dedup_entry_t *dup)
+{
+	size_t i;
+
+	if (!filesEqual(rep->path, dup->path))
+	{
+		/* hash collision */
+		return false;
+	}
+
+	for (i = 0; i < rep->inclusions.count; ++i)
+	{
+		bool equal;
+		char *cp = counterpart(rep->inclusions.arr[i], rep->path, dup->path);
+		if (cp == NULL)
+		{
+			if (errno == ENOMEM)
+				return false;
+			continue;
+		}
+
+		equal = filesEqual(rep->inclusions.arr[i], cp);
+		free(cp);
+		if (!equal)
+		{
+			return false;
+		}
+	}
+
+	return !shadowed(rep, dup);
+}
+
+/**
+ * Marks one duplicate of a file as handled, releasing the file's retained
+ * results once all of them are.
+ *
+ * @param rep the file whose duplicate has been handled
+ */
+static void dupHandled(dedup_entry_t *rep)
+{
+	if (rep->pendingDups == 0)
+	{
+		return;
+	}
+
+	if (--rep->pendingDups == 0 && rep->analyzed)
+	{
+		findings_destroy(&rep->found);
+		msa_destroy(&rep->inclusions);
+	}
+}
+
+/* public-facing functions */
+
+int dedup_create(dedup_t *dd, const char * const *paths, const uint64_t *argsHashes, size_t count)
+{
+	size_t *order;
+	size_t i;
+
+	dd->count = count;
+	dd->replicated = 0;
+	dd->replicatedBytes = 0;
+	dd->savedSeconds = 0.0;
+	dd->arr = calloc(count, sizeof(dedup_entry_t));
+	if (dd->arr == NULL)
+	{
+		return 0;
+	}
+
+	order = malloc(count * sizeof(size_t));
+	if (order == NULL)
+	{
+		free(dd->arr);
+		dd->arr = NULL;
+		return 0;
+	}
+
+	/* hash everything */
+	for (i = 0; i < count; ++i)
+	{
+		uint64_t contentHash;
+		dedup_entry_t *ent = &dd->arr[i];
+
+		ent->path = paths[i];
+		ent->rep = i;
+		if (i > 0 && paths[i] == paths[i-1])
+		{
+			/* the same file again, with other arguments */
+			ent->hashed = dd->arr[i-1].hashed;
+			ent->size = dd->arr[i-1].size;
+			contentHash = dd->arr[i-1].contentHash;
+		}
+		else
+		{
+			ent->hashed = (hash_file(paths[i], &contentHash, &ent->size) != 0);
+		}
+		ent->contentHash = contentHash;
+		if (ent->hashed)
+		{
+			ent->key = hash_bytes(contentHash, &argsHashes[i], sizeof(argsHashes[i]));
+		}
+
+		order[i] = i;
+	}
+
+	/* group equal keys, first occurrence first */
+	sorting = dd->arr;
+	qsort(order, count, sizeof(size_t), comparator_dedupidx);
+	sorting = NULL;
+
+	for (i = 1; i < count; ++i)
+	{
+		dedup_entry_t *prev = &dd->arr[order[i-1]];
+		dedup_entry_t *cur = &dd->arr[order[i]];
+
+		if (cur->hashed && prev->hashed && cur->key == prev->key)
+		{
+			cur->rep = prev->rep;
+			++dd->arr[cur->rep].pendingDups;
+		}
+	}
+
+	free(order);
+	return 1;
+}
+
+void dedup_destroy(dedup_t *dd)
+{
+	size_t i;
+
+	for (i = 0; i < dd->count; ++i)
+	{
+		if (dd->arr[i].analyzed && dd->arr[i].pendingDups > 0)
+		{
+			findings_destroy(&dd->arr[i].found);
+			msa_destroy(&dd->arr[i].inclusions);
+		}
+	}
+
+	free(dd->arr);
+	dd->arr = NULL;
+	dd->count = 0;
+}
+
+bool dedup_needed(dedup_t *dd, size_t idx)
+{
+	dedup_entry_t *ent = &dd->arr[idx];
+	dedup_entry_t *rep = &dd->arr[ent->rep];
+
+	if (ent->rep == idx)
+	{
+		/* the first of its kind */
+		return true;
+	}
+
+	if (rep->analyzed && rep->pendingDups > 0 && replicable(rep, ent))
+	{
+		return false;
+	}
+
+	/* analyze it separately after all */
+	dupHandled(rep);
+	return true;
+}
+
+int dedup_analyzed(dedup_t *dd, size_t idx, const findings_t *found, const msa_t *inclusions, double seconds)
+{
+	dedup_entry_t *ent = &dd->arr[idx];
+	size_t i;
+
+	ent->seconds = seconds;
+
+	if (ent->rep != idx || ent->pendingDups == 0)
+	{
+		/* nobody will ask for the results */
+		return 1;
+	}
+
+	/* retain copies of the results */
+	if (findings_create(&ent->found) == 0)
+	{
+		return 0;
+	}
+	if (msa_create(&ent->inclusions) == 0)
+	{
+		findings_destroy(&ent->found);
+		return 0;
+	}
+
+	for (i = 0; i < found->count; ++i)
+	{
+		if (findings_copy(&ent->found, &found->arr[i], NULL) == 0)
+		{
+			findings_destroy(&ent->found);
+			msa_destroy(&ent->inclusions);
+			return 0;
+		}
+	}
+
+	for (i = 0; i < inclusions->count; ++i)
+	{
+		if (msa_add(&ent->inclusions, inclusions->arr[i]) == 0)
+		{
+			findings_destroy(&ent->found);
+			msa_destroy(&ent->inclusions);
+			return 0;
+		}
+	}
+
+	ent->analyzed = true;
+	return 1;
+}
+
+int dedup_replicate(dedup_t *dd, size_t idx, findings_t *found)
+{
+	dedup_entry_t *ent = &dd->arr[idx];
+	dedup_entry_t *rep = &dd->arr[ent->rep];
+	size_t i;
+	int ret = 1;
+
+	for (i = 0; i < rep->found.count; ++i)
+	{
+		const finding_t *f = &rep->found.arr[i];
+		char *cp = counterpart(f->file, rep->path, ent->path);
+
+		if (cp == NULL && errno == ENOMEM)
+		{
+			ret = 0;
+			break;
+		}
+
+		ret = findings_copy(found, f, cp);
+		free(cp);
+		if (ret == 0)
+		{
+			break;
+		}
+	}
+
+	++dd->replicated;
+	dd->replicatedBytes += ent->size;
+	dd->savedSeconds += rep->seconds;
+
+	dupHandled(rep);
+	return ret;
+}
+
+void dedup_report(const dedup_t *dd)
+{
+	size_t i, unique = 0;
+
+	for (i = 0; i < dd->count; ++i)
+	{
+		if (dd->arr[i].rep == i)
+		{
+			++unique;
+		}
+	}
+
+	(void)fprintf(stderr,
+		"%s: deduplication: %zu files, %zu with unique contents; "
+		"findings replicated onto %zu files (%zu bytes) instead of analyzing them, "
+		"saving about %.3f s\n",
+		progname, dd->count, unique, dd->replicated, dd->replicatedBytes, dd->savedSeconds
+	);
+}
@@ -0,0 +1,150 @@
+/**
+ * @file dedup.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Content-addressed deduplication of input files.
+ * @details Input files with identical contents, processed with identical
+ * arguments, are analyzed only once; the findings of the first such file are
+ * replicated onto the others.
+ *
+ * Headers included via a path relative to a file's directory are taken into
+ * account: findings are only replicated if each such header has an identical
+ * counterpart relative to the duplicate's directory. Headers included from
+ * elsewhere, e.g. via -I, are only assumed to be resolved identically for all
+ * copies if no file next to the duplicate could shadow them.
+ */
+
+#ifndef __DEDUP_H__
+#define __DEDUP_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "findings.h"
+#include "msa.h"
+
+/** Deduplication information about one input file. */
+typedef struct
+{
+	/** The path to the file. */
+	const char *path;
+
+	/** Hash of the file's contents. Valid iff hashed. */
+	uint64_t contentHash;
+
+	/** Hash of the file's contents and the arguments. Valid iff hashed. */
+	uint64_t key;
+
+	/** Could the file's contents be hashed? */
+	bool hashed;
+
+	/** The size of the file in bytes. */
+	size_t size;
+
+	/**
+	 * The index of the first file with the same key; the file's own index if
+	 * it is the first one.
+	 */
+	size_t rep;
+
+	/** The number of duplicates of this file not yet handled. */
+	size_t pendingDups;
+
+	/** Has the file been analyzed, filling found and inclusions? */
+	bool analyzed;
+
+	/** The findings of the file. Valid iff analyzed and pendingDups > 0. */
+	findings_t found;
+
+	/** The files included by the file. Valid iff analyzed and pendingDups > 0. */
+	msa_t inclusions;
+
+	/** The time spent analyzing the file, in seconds. Valid iff analyzed. */
+	double seconds;
+} dedup_entry_t;
+
+/** Deduplication information about all input files. */
+typedef struct
+{
+	/** The number of input files. */
+	size_t count;
+
+	/** The information about each input file. */
+	dedup_entry_t *arr;
+
+	/** The number of files whose findings were replicated. */
+	size_t replicated;
+
+	/** The number of bytes of files whose findings were replicated. */
+	size_t replicatedBytes;
+
+	/** The analysis time saved by replicating findings, in seconds. */
+	double savedSeconds;
+} dedup_t;
+
+/**
+ * Hash the input files and find duplicates.
+ *
+ * The same file may be listed multiple times in a row, with different
+ * arguments; it is only hashed once.
+ *
+ * @param dd Pointer to fill with a deduplication structure.
+ * @param paths The paths to the input files.
+ * @param argsHashes Hashes of the arguments with which each file is processed.
+ * @param count The number of input files.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int dedup_create(dedup_t *dd, const char * const *paths, const uint64_t *argsHashes, size_t count);
+
+/**
+ * Destroy a deduplication structure.
+ *
+ * @param dd Pointer to a deduplication structure.
+ */
+void dedup_destroy(dedup_t *dd);
+
+/**
+ * Returns whether the file at the given index needs analyzing, i.e. whether
+ * it is not a duplicate of an analyzed file whose findings can be replicated.
+ *
+ * @param dd Pointer to a deduplication structure.
+ * @param idx The index of the file.
+ * @return true if the file needs analyzing.
+ */
+bool dedup_needed(dedup_t *dd, size_t idx);
+
+/**
+ * Record the results of analyzing the file at the given index. They are
+ * retained if the file has duplicates.
+ *
+ * @param dd Pointer to a deduplication structure.
+ * @param idx The index of the file.
+ * @param found The findings of the file.
+ * @param inclusions The files included by the file.
+ * @param seconds The time spent analyzing the file, in seconds.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int dedup_analyzed(dedup_t *dd, size_t idx, const findings_t *found, const msa_t *inclusions, double seconds);
+
+/**
+ * Append the findings of the analyzed file which the file at the given index
+ * duplicates to an array of findings, relocated to the duplicate's directory.
+ * Call only if dedup_needed() returned false for the index.
+ *
+ * @param dd Pointer to a deduplication structure.
+ * @param idx The index of the duplicate file.
+ * @param found The array to which to append the findings.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int dedup_replicate(dedup_t *dd, size_t idx, findings_t *found);
+
+/**
+ * Output a report on the work saved by deduplication to standard error.
+ *
+ * @param dd Pointer to a deduplication structure.
+ */
+void dedup_report(const dedup_t *dd);
+
+#endif
@@ -0,0 +1,674 @@
+/**
+ * @file fastcheck.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Lexical checking of C source code.
+ */
+
+#include "fastcheck.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/** The maximum nesting depth of braces and parentheses which is tracked. */
+#define MAX_NESTING 256
+
+/** The kind of a token. */
+typedef enum
+{
+	/** An identifier or keyword. */
+	TOK_IDENT,
+
+	/** A punctuator. */
+	TOK_PUNCT,
+
+	/** A number, string or character literal. */
+	TOK_LITERAL
+} tok_kind_t;
+
+/** A token. */
+typedef struct
+{
+	/** The kind of the token. */
+	tok_kind_t kind;
+
+	/** The text of the token (not NUL-terminated). */
+	const char *text;
+
+	/** The length of the text. */
+	size_t len;
+
+	/** The location where the token starts. */
+	module_loc_t loc;
+} token_t;
+
+/** The tokens of a file. */
+typedef struct
+{
+	/** How many tokens can the array house? */
+	size_t capacity;
+
+	/** How many tokens is the array housing right now? */
+	size_t count;
+
+	/** The tokens themselves. */
+	token_t *arr;
+} tokens_t;
+
+/** The state of the lexer. */
+typedef struct
+{
+	/** The next character to lex. */
+	const char *p;
+
+	/** The end of the file. */
+	const char *end;
+
+	/** The location of the next character. */
+	module_loc_t loc;
+
+	/** Is the next character the first non-blank one on its line? */
+	bool lineStart;
+} lexer_t;
+
+/** What the checker is checking for, and where it puts its findings. */
+typedef struct
+{
+	/** The signature database to look up functions in. */
+	const sigdb_t *db;
+
+	/** Is the rule missing-void enabled? */
+	bool missingVoid;
+
+	/** Is the rule superfluous-void enabled? */
+	bool superfluousVoid;
+
+	/** Is the rule comma-void enabled? */
+	bool commaVoid;
+
+	/** If not NULL, only calls to these functions are reported. */
+	const callees_t *callees;
+
+	/** The name of the file being checked. */
+	const char *filename;
+
+	/** The array to which findings are appended. */
+	findings_t *found;
+} check_state;
+
+/** What the checker knows about an open brace. */
+typedef struct
+{
+	/** Does the brace open a block (as opposed to an initializer or struct)? */
+	bool block;
+} brace_t;
+
+/** What the checker knows about an open parenthesis. */
+typedef struct
+{
+	/** Does the parenthesis open the head of a control statement? */
+	bool control;
+
+	/** Does the parenthesis follow the first token of a statement? */
+	bool head;
+} paren_t;
+
+/* the lexer */
+
+/**
+ * Returns whether the lexer is looking at the given string.
+ *
+ * @param lx the lexer
+ * @param str the string to compare to
+ * @return true if the next characters equal str
+ */
+static inline bool lookingAt(const lexer_t *lx, const char *str)
+{
+	size_t len = strlen(str);
+	return ((size_t)(lx->end - lx->p) >= len && memcmp(lx->p, str, len) == 0);
+}
+
+/**
+ * Advances the lexer by one character.
+ *
+ * @param lx the lexer
+ */
+static inline void advance(lexer_t *lx)
+{
+	if (*lx->p == '\n')
+	{
+		++lx->loc.line;
+		lx->loc.col = 1;
+		lx->lineStart = true;
+	}
+	else
+	{
+		++lx->loc.col;
+	}
+	++lx->p;
+}
+
+/**
+ * Skips a comment the lexer is looking at.
+ *
+ * @param lx the lexer
+ */
+static void skipComment(lexer_t *lx)
+{
+	if (lookingAt(lx, "//"))
+	{
+		while (lx->p < lx->end && *lx->p != '\n')
+		{
+			advance(lx);
+		}
+		return;
+	}
+
+	/* block comment */
+	advance(lx);
+	advance(lx);
+	while (lx->p < lx->end && !lookingAt(lx, "*/"))
+	{
+		advance(lx);
+	}
+	if (lx->p < lx->end)
+	{
+		advance(lx);
+		advance(lx);
+	}
+}
+
+/**
+ * Skips whitespace, comments, line continuations and preprocessor directives.
+ *
+ * @param lx the lexer
+ */
+static void skipBlanks(lexer_t *lx)
+{
+	while (lx->p < lx->end)
+	{
+		if (lookingAt(lx, "\\\n"))
+		{
+			advance(lx);
+			lx->lineStart = false;
+			advance(lx);
+		}
+		else if (isspace((unsigned char)*lx->p))
+		{
+			advance(lx);
+		}
+		else if (lookingAt(lx, "//") || lookingAt(lx, "/*"))
+		{
+			skipComment(lx);
+		}
+		else if (*lx->p == '#' && lx->lineStart)
+		{
+			/* preprocessor directive; skip until the end of the line */
+			while (lx->p < lx->end && *lx->p != '\n')
+			{
+				if (lookingAt(lx, "\\\n"))
+				{
+					advance(lx);
+					advance(lx);
+				}
+				else if (lookingAt(lx, "//") || lookingAt(lx, "/*"))
+				{
+					skipComment(lx);
+				}
+				else
+				{
+					advance(lx);
+				}
+			}
+		}
+		else
+		{
+			break;
+		}
+	}
+}
+
+/**
+ * Lexes the next token. The lexer must not be at the end of the file.
+ *
+ * @param lx the lexer
+ * @param tok by-ref to the token to fill
+ */
+static void lexToken(lexer_t *lx, token_t *tok)
+{
+	char c = *lx->p;
+
+	tok->text = lx->p;
+	tok->loc = lx->loc;
+	lx->lineStart = false;
+
+	if (isalpha((unsigned char)c) || c == '_' || c == '$')
+	{
+		tok->kind = TOK_IDENT;
+		while (lx->p < lx->end && (isalnum((unsigned char)*lx->p) || *lx->p == '_' || *lx->p == '$'))
+		{
+			advance(lx);
+		}
+	}
+	else if (isdigit((unsigned char)c) || (c == '.' && lx->end - lx->p > 1 && isdigit((unsigned char)lx->p[1])))
+	{
+		/* preprocessing number */
+		tok->kind = TOK_LITERAL;
+		while (lx->p < lx->end && (isalnum((unsigned char)*lx->p) || *lx->p == '_' || *lx->p == '.'))
+		{
+			char prev = *lx->p;
+			advance(lx);
+			if (lx->p < lx->end && strchr("eEpP", prev) != NULL && (*lx->p == '+' || *lx->p == '-'))
+			{
+				advance(lx);
+			}
+		}
+	}
+	else if (c == '"' || c == '\'')
+	{
+		tok->kind = TOK_LITERAL;
+		advance(lx);
+		while (lx->p < lx->end && *lx->p != c && *lx->p != '\n')
+		{
+			if (*lx->p == '\\' && lx->end - lx->p > 1)
+			{
+				advance(lx);
+			}
+			advance(lx);
+		}
+		if (lx->p < lx->end && *lx->p == c)
+		{
+			advance(lx);
+		}
+	}
+	else
+	{
+		tok->kind = TOK_PUNCT;
+		if (lookingAt(lx, "->"))
+		{
+			advance(lx);
+		}
+		advance(lx);
+	}
+
+	tok->len = (size_t)(lx->p - tok->text);
+}
+
+/**
+ * Lexes a whole file, exiting on failure.
+ *
+ * @param text the contents of the file
+ * @param size the size of the file
+ * @param toks the array to fill with tokens
+ */
+static void lexFile(const char *text, size_t size, tokens_t *toks)
+{
+	lexer_t lx = {
+		.p = text,
+		.end = text + size,
+		.loc = { .line = 1, .col = 1 },
+		.lineStart = true
+	};
+
+	for (;;)
+	{
+		skipBlanks(&lx);
+		if (lx.p >= lx.end)
+		{
+			break;
+		}
+
+		if (toks->count >= toks->capacity)
+		{
+			size_t newcap = (toks->capacity == 0) ? 1024 : (toks->capacity * 2);
+			token_t *newarr = realloc(toks->arr, newcap * sizeof(token_t));
+			if (newarr == NULL)
+			{
+				perror("realloc");
+				exit(EXITCODE_MM);
+			}
+			toks->arr = newarr;
+			toks->capacity = newcap;
+		}
+
+		lexToken(&lx, &toks->arr[toks->count++]);
+	}
+}
+
+/* the checker */
+
+/**
+ * Returns whether a token is the given identifier or punctuator.
+ *
+ * @param toks the tokens of the file
+ * @param i the index of the token; may be out of bounds
+ * @param str the text to compare to
+ * @return true if the token exists and its text is str
+ */
+static inline bool tokIs(const tokens_t *toks, size_t i, const char *str)
+{
+	return (
+		i < toks->count &&
+		toks->arr[i].len == strlen(str) &&
+		memcmp(toks->arr[i].text, str, toks->arr[i].len) == 0
+	);
+}
+
+/**
+ * Returns the index of the parenthesis closing the one at the given index.
+ *
+ * @param toks the tokens of the file
+ * @param open the index of the opening parenthesis
+ * @return the index of the closing parenthesis, or the number of tokens if
+ * there is none
+ */
+static size_t matchParen(const tokens_t *toks, size_t open)
+{
+	size_t i, depth = 0;
+
+	for (i = open; i < toks->count; ++i)
+	{
+		if (tokIs(toks, i, "("))
+		{
+			++depth;
+		}
+		else if (tokIs(toks, i, ")") && --depth == 0)
+		{
+			return i;
+		}
+		else if (tokIs(toks, i, ";") || tokIs(toks, i, "{") || tokIs(toks, i, "}"))
+		{
+			/* runaway parenthesis */
+			break;
+		}
+	}
+	return toks->count;
+}
+
+/**
+ * Appends a finding unless the function called isn't targeted, exiting on
+ * failure.
+ *
+ * @param cst the state of the checker
+ * @param kind the kind of finding
+ * @param func the token naming the function called
+ * @param start the start location of the finding
+ * @param end the end location of the finding
+ */
+static void addFinding(
+	const check_state *cst,
+	finding_kind_t kind,
+	const token_t *func,
+	module_loc_t start,
+	module_loc_t end
+)
+{
+	char *name = strndup(func->text, func->len);
+
+	if (name == NULL)
+	{
+		perror("strndup");
+		exit(EXITCODE_MM);
+	}
+
+	if (
+		(cst->callees == NULL || callees_match(cst->callees, name)) &&
+		findings_add(cst->found, kind, cst->filename, name, start, end, 0) == 0
+	)
+	{
+		perror("findings_add");
+		exit(EXITCODE_MM);
+	}
+	free(name);
+}
+
+/**
+ * Checks the statement starting at the given token.
+ *
+ * @param cst the state of the checker
+ * @param toks the tokens of the file
+ * @param i the index of the first token of the statement
+ */
+static void checkStatement(const check_state *cst, const tokens_t *toks, size_t i)
+{
+	const token_t *t = toks->arr;
+	bool cast = false;
+	size_t call = i, close;
+
+	if (tokIs(toks, i, "(") && tokIs(toks, i + 1, "void") && tokIs(toks, i + 2, ")"))
+	{
+		/* cast to void */
+		cast = true;
+		call = i + 3;
+	}
+
+	if (call + 1 >= toks->count || t[call].kind != TOK_IDENT || !tokIs(toks, call + 1, "("))
+	{
+		return;
+	}
+
+	/* the call must make up the whole statement, or the left operand of a comma */
+	close = matchParen(toks, call + 1);
+	if (tokIs(toks, close + 1, ";"))
+	{
+		if (!(cast ? cst->superfluousVoid : cst->missingVoid))
+			return;
+	}
+	else if (!cast && tokIs(toks, close + 1, ","))
+	{
+		if (!cst->commaVoid)
+			return;
+	}
+	else
+	{
+		return;
+	}
+
+	switch (sigdb_lookup(cst->db, t[call].text, t[call].len))
+	{
+		case SIG_VOID:
+			if (cast)
+			{
+				module_loc_t end = t[i + 2].loc;
+				++end.col;
+				addFinding(cst, FINDING_SUPERFLUOUS_VOID, &t[call], t[i].loc, end);
+			}
+			break;
+		case SIG_VALUE:
+			if (!cast)
+			{
+				addFinding(cst, FINDING_MISSING_VOID, &t[call], t[call].loc, t[call].loc);
+			}
+			break;
+		case SIG_UNKNOWN:
+			/* not a known function (or a keyword); can't judge */
+			break;
+	}
+}
+
+/**
+ * Finds the beginnings of statements and checks them.
+ *
+ * Braces following the beginning of a statement, the head of a control
+ * statement or a parenthesized list following the first token of a
+ * statement (a function definition or a loop macro) open blocks; all other
+ * braces open initializers or structure definitions, within which there are no
+ * statements.
+ *
+ * @param cst the state of the checker
+ * @param toks the tokens of the file
+ */
+static void checkTokens(const check_state *cst, const tokens_t *toks)
+{
+	brace_t braces[MAX_NESTING];
+	paren_t parens[MAX_NESTING];
+	size_t braceDepth = 0, parenDepth = 0, stmtFirst = 0, i;
+	bool stmtStart = true, controlNext = false, labelNext = false;
+	paren_t closed = { .control = false, .head = false };
+
+	for (i = 0; i < toks->count; ++i)
+	{
+		bool inBlock = (braceDepth > 0 && braces[braceDepth - 1].block);
+		bool wasStart = stmtStart;
+
+		if (stmtStart)
+		{
+			stmtFirst = i;
+			if (inBlock && parenDepth == 0)
+			{
+				checkStatement(cst, toks, i);
+			}
+		}
+		stmtStart = false;
+
+		if (tokIs(toks, i, "("))
+		{
+			if (parenDepth < MAX_NESTING)
+			{
+				parens[parenDepth].control = controlNext;
+				parens[parenDepth].head = (i == stmtFirst + 1);
+			}
+			++parenDepth;
+			controlNext = false;
+		}
+		else if (tokIs(toks, i, ")"))
+		{
+			if (parenDepth > 0)
+			{
+				--parenDepth;
+				if (parenDepth < MAX_NESTING)
+				{
+					closed = parens[parenDepth];
+					stmtStart = closed.control;
+				}
+			}
+		}
+		else if (tokIs(toks, i, ";"))
+		{
+			stmtStart = (parenDepth == 0);
+			labelNext = false;
+		}
+		else if (tokIs(toks, i, "{"))
+		{
+			bool block = (
+				wasStart ||
+				(tokIs(toks, i - 1, ")") && (closed.head || braceDepth == 0)) ||
+				(braceDepth == 0 && tokIs(toks, i - 1, ";"))
+			);
+
+			if (braceDepth >= MAX_NESTING)
+			{
+				/* too deep to keep track; give up */
+				return;
+			}
+			braces[braceDepth++].block = block;
+			parenDepth = 0;
+			stmtStart = block;
+		}
+		else if (tokIs(toks, i, "}"))
+		{
+			if (braceDepth > 0)
+			{
+				stmtStart = braces[--braceDepth].block;
+			}
+			parenDepth = 0;
+		}
+		else if (tokIs(toks, i, ":"))
+		{
+			/* after a case or goto label, another statement begins */
+			stmtStart = (labelNext && parenDepth == 0);
+			labelNext = false;
+		}
+		else if (
+			tokIs(toks, i, "if") || tokIs(toks, i, "while") ||
+			tokIs(toks, i, "for") || tokIs(toks, i, "switch")
+		)
+		{
+			controlNext = true;
+		}
+		else if (tokIs(toks, i, "else") || tokIs(toks, i, "do"))
+		{
+			stmtStart = true;
+		}
+		else if (tokIs(toks, i, "case") || tokIs(toks, i, "default"))
+		{
+			labelNext = true;
+		}
+		else if (wasStart && toks->arr[i].kind == TOK_IDENT && tokIs(toks, i + 1, ":"))
+		{
+			labelNext = true;
+		}
+	}
+}
+
+/* public-facing functions */
+
+enum exitcodes_e fastcheckFile(
+	const char *filename,
+	const sigdb_t *db,
+	const ruleset_t *rules,
+	const callees_t *callees,
+	findings_t *found
+)
+{
+	tokens_t toks = {
+		.capacity = 0,
+		.count = 0,
+		.arr = NULL
+	};
+	check_state cst = {
+		.db = db,
+		.missingVoid = ruleset_has(rules, "missing-void"),
+		.superfluousVoid = ruleset_has(rules, "superfluous-void"),
+		.commaVoid = ruleset_has(rules, "comma-void"),
+		.callees = (callees != NULL && callees_any(callees)) ? callees : NULL,
+		.filename = filename,
+		.found = found
+	};
+	struct stat st;
+	void *text;
+	int fd;
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd == -1 || fstat(fd, &st) == -1)
+	{
+		(void)fprintf(stderr, "%s: can't open %s: %s\n", progname, filename, strerror(errno));
+		if (fd != -1)
+		{
+			(void)close(fd);
+		}
+		return EXITCODE_FILE_OPEN;
+	}
+
+	if (st.st_size == 0)
+	{
+		/* can't map empty files; nothing to check anyway */
+		(void)close(fd);
+		return EXITCODE_OK;
+	}
+
+	text = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	(void)close(fd);
+	if (text == MAP_FAILED)
+	{
+		(void)fprintf(stderr, "%s: can't read %s: %s\n", progname, filename, strerror(errno));
+		return EXITCODE_FILE_OPEN;
+	}
+
+	lexFile((const char *)text, (size_t)st.st_size, &toks);
+	checkTokens(&cst, &toks);
+
+	free(toks.arr);
+	(void)munmap(text, (size_t)st.st_size);
+	return EXITCODE_OK;
+}
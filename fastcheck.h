@@ -0,0 +1,47 @@
+/**
+ * @file fastcheck.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Lexical checking of C source code.
+ * @details The fast engine neither preprocesses nor parses the file. It lexes
+ * the file, recognizes calls and casts to void at the beginning of statements
+ * and looks up what the functions called return in a signature database
+ * written by a full analysis. The findings are therefore approximate: calls
+ * within macro definitions, calls hidden behind macros and calls in unusual
+ * places (e.g. the condition of a for loop) are not found, and functions are
+ * only told apart by their name.
+ */
+
+#ifndef __FASTCHECK_H__
+#define __FASTCHECK_H__
+
+#include "shared.h"
+#include "callees.h"
+#include "findings.h"
+#include "rules.h"
+#include "sigdb.h"
+
+/**
+ * Checks one file of source code lexically.
+ *
+ * Of the built-in rules, missing-void, superfluous-void and comma-void are
+ * understood; other rules are ignored.
+ *
+ * @param filename the name of the file to check
+ * @param db the signature database to look up functions in
+ * @param rules the rules to check
+ * @param callees if not NULL and not empty, only calls to these functions are
+ * reported
+ * @param found findings are appended to this array
+ * @return EXITCODE_OK, or the exit code which should be returned after cleanup
+ */
+enum exitcodes_e fastcheckFile(
+	const char *filename,
+	const sigdb_t *db,
+	const ruleset_t *rules,
+	const callees_t *callees,
+	findings_t *found
+);
+
+#endif
@@ -0,0 +1,772 @@
+/**
+ * @file findb.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Database of the findings of many runs.
+ * @details The database file consists of a magic number followed by one block
+ * per run. A block starts with a header, followed by the new strings (each
+ * NUL-terminated, padded to a multiple of eight bytes), the records and the
+ * callee index. A run is stored by writing everything but its header first and
+ * the header last, so that a block whose storing was interrupted has no valid
+ * header and is ignored (and overwritten by the next run). All numbers are
+ * stored in host byte order.
+ */
+
+#include "findb.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "hash.h"
+
+/** The magic bytes at the beginning of a findings database file. */
+static const char FINDB_MAGIC[8] = { 'V', 'C', 'F', 'I', 'N', 'D', 'B', '1' };
+
+/** The marker at the beginning of each block. */
+#define RUN_MARKER UINT32_C(0x4e555246)
+
+/** The header of the block of a run. */
+struct findb_run_header
+{
+	/** RUN_MARKER */
+	uint32_t marker;
+
+	/** The number of the run. */
+	uint32_t number;
+
+	/** When the run was stored, in seconds since the epoch. */
+	int64_t time;
+
+	/** The number of new strings. */
+	uint32_t strCount;
+
+	/** The size of the new strings, including padding. */
+	uint32_t strSize;
+
+	/** The number of records. */
+	uint32_t count;
+
+	/** The number of callees. */
+	uint32_t calleeCount;
+
+	/** The size of the block, including this header. */
+	uint64_t length;
+};
+
+/** A source file whose lines are being fingerprinted. */
+typedef struct
+{
+	/** The contents of the file; NULL if it can't be read. */
+	const char *data;
+
+	/** The size of the file. */
+	size_t size;
+
+	/** The line at which pos points. */
+	size_t line;
+
+	/** The offset of the start of the line. */
+	size_t pos;
+} source_file;
+
+/* utility functions */
+
+/**
+ * Rounds a size up to a multiple of eight.
+ *
+ * @param size The size.
+ * @return The rounded size.
+ */
+static inline size_t pad8(size_t size)
+{
+	return (size + 7) & ~(size_t)7;
+}
+
+/**
+ * Returns the slot of the string lookup table where a string is or would be
+ * located.
+ *
+ * @param db Pointer to a findings database structure.
+ * @param str The string.
+ * @return The slot.
+ */
+static uint32_t *stringSlot(const findb_t *db, const char *str)
+{
+	size_t mask = db->slotCount - 1;
+	size_t i = (size_t)hash_string(HASH_INIT, str) & mask;
+
+	while (db->slots[i] != 0 && strcmp(db->strs[db->slots[i] - 1], str) != 0)
+	{
+		i = (i + 1) & mask;
+	}
+	return &db->slots[i];
+}
+
+/**
+ * Adds a string to the strings of a database, which must not contain it yet.
+ *
+ * @param db Pointer to a findings database structure.
+ * @param str The string; not copied.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int addString(findb_t *db, const char *str)
+{
+	if (db->strCount >= UINT32_MAX - 1)
+	{
+		errno = EFBIG;
+		return 0;
+	}
+
+	if (db->strCount == db->strCapacity)
+	{
+		size_t newcap = (db->strCapacity == 0) ? 256 : db->strCapacity * 2;
+		const char **newstrs = realloc(db->strs, newcap * sizeof(const char *));
+		if (newstrs == NULL)
+		{
+			return 0;
+		}
+		db->strs = newstrs;
+		db->strCapacity = newcap;
+	}
+
+	if ((db->strCount + 1) * 2 > db->slotCount)
+	{
+		size_t newcount = (db->slotCount == 0) ? 512 : db->slotCount * 2;
+		uint32_t *oldslots = db->slots;
+		size_t i, oldcount = db->slotCount;
+
+		db->slots = calloc(newcount, sizeof(uint32_t));
+		if (db->slots == NULL)
+		{
+			db->slots = oldslots;
+			return 0;
+		}
+		db->slotCount = newcount;
+
+		for (i = 0; i < oldcount; ++i)
+		{
+			if (oldslots[i] != 0)
+			{
+				*stringSlot(db, db->strs[oldslots[i] - 1]) = oldslots[i];
+			}
+		}
+		free(oldslots);
+	}
+
+	db->strs[db->strCount] = str;
+	++db->strCount;
+	*stringSlot(db, str) = (uint32_t)db->strCount;
+	return 1;
+}
+
+/**
+ * Looks up the number of a string, adding the string if it is new.
+ *
+ * @param db Pointer to a findings database structure.
+ * @param str The string; not copied.
+ * @param num Will be set to the number of the string.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int intern(findb_t *db, const char *str, uint32_t *num)
+{
+	if (findb_lookup(db, str, num))
+	{
+		return 1;
+	}
+	if (addString(db, str) == 0)
+	{
+		return 0;
+	}
+	*num = (uint32_t)(db->strCount - 1);
+	return 1;
+}
+
+/**
+ * Validates the block of a run and adds it to the runs of a database.
+ *
+ * @param db Pointer to a findings database structure.
+ * @param offset The offset of the block.
+ * @return The offset following the block, or zero if there is no intact block
+ * at the offset (or on failure, setting errno appropriately).
+ */
+static size_t addRun(findb_t *db, size_t offset)
+{
+	const struct findb_run_header *hdr = (const struct findb_run_header *)((const char *)db->map + offset);
+	const char *strs, *strEnd;
+	findb_run_t *run, *newruns;
+	size_t i;
+
+	errno = 0;
+	if (
+		db->size - offset < sizeof(struct findb_run_header) ||
+		hdr->marker != RUN_MARKER ||
+		hdr->number != db->runCount + 1 ||
+		hdr->strSize % 8 != 0 ||
+		hdr->length > db->size - offset ||
+		hdr->length != sizeof(struct findb_run_header) + (uint64_t)hdr->strSize +
+			(uint64_t)hdr->count * sizeof(findb_record_t) + (uint64_t)hdr->calleeCount * sizeof(findb_callee_t)
+	)
+	{
+		return 0;
+	}
+
+	newruns = realloc(db->runs, (db->runCount + 1) * sizeof(findb_run_t));
+	if (newruns == NULL)
+	{
+		return 0;
+	}
+	db->runs = newruns;
+	run = &db->runs[db->runCount];
+	run->number = hdr->number;
+	run->time = (time_t)hdr->time;
+	run->count = hdr->count;
+	run->records = (const findb_record_t *)((const char *)(hdr + 1) + hdr->strSize);
+	run->calleeCount = hdr->calleeCount;
+	run->callees = (const findb_callee_t *)(run->records + run->count);
+
+	for (i = 0; i < run->calleeCount; ++i)
+	{
+		if ((uint64_t)run->callees[i].first + run->callees[i].count > run->count)
+		{
+			return 0;
+		}
+	}
+
+	/* check the new strings before taking them in */
+	strs = (const char *)(hdr + 1);
+	strEnd = strs + hdr->strSize;
+	for (i = 0; i < hdr->strCount; ++i)
+	{
+		const char *nul = memchr(strs, '\0', (size_t)(strEnd - strs));
+		if (nul == NULL)
+		{
+			return 0;
+		}
+		strs = nul + 1;
+	}
+
+	strs = (const char *)(hdr + 1);
+	for (i = 0; i < hdr->strCount; ++i)
+	{
+		if (addString(db, strs) == 0)
+		{
+			return 0;
+		}
+		strs += strlen(strs) + 1;
+	}
+
+	++db->runCount;
+	return offset + (size_t)hdr->length;
+}
+
+/**
+ * Maps a database file into memory and finds its runs.
+ *
+ * @param db Pointer to fill with a findings database structure.
+ * @param fd The open database file.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int load(findb_t *db, int fd)
+{
+	struct stat st;
+	size_t offset, next;
+
+	(void)memset(db, 0, sizeof(*db));
+
+	if (fstat(fd, &st) == -1)
+	{
+		return 0;
+	}
+	if ((size_t)st.st_size < sizeof(FINDB_MAGIC))
+	{
+		errno = EINVAL;
+		return 0;
+	}
+
+	db->size = (size_t)st.st_size;
+	db->map = mmap(NULL, db->size, PROT_READ, MAP_SHARED, fd, 0);
+	if (db->map == MAP_FAILED)
+	{
+		db->map = NULL;
+		return 0;
+	}
+
+	if (memcmp(db->map, FINDB_MAGIC, sizeof(FINDB_MAGIC)) != 0)
+	{
+		findb_close(db);
+		errno = EINVAL;
+		return 0;
+	}
+
+	offset = sizeof(FINDB_MAGIC);
+	while ((next = addRun(db, offset)) != 0)
+	{
+		offset = next;
+	}
+	if (errno != 0)
+	{
+		int olderrno = errno;
+		findb_close(db);
+		errno = olderrno;
+		return 0;
+	}
+
+	db->validSize = offset;
+	return 1;
+}
+
+/**
+ * Compares two records by identity and location. Useful for qsort(3).
+ *
+ * @param left Pointer to the first record.
+ * @param right Pointer to the second record.
+ * @return Less than zero if left ordered before right.
+ *         Zero if left and right equally ordered.
+ *         More than zero if right ordered before left.
+ */
+static int comparator_record(const void *left, const void *right)
+{
+	const findb_record_t *l = (const findb_record_t *)left;
+	const findb_record_t *r = (const findb_record_t *)right;
+	int cmp = findb_compareIdentity(l, r);
+
+	if (cmp != 0)
+		return cmp;
+	if (l->line != r->line)
+		return (l->line < r->line) ? -1 : 1;
+	if (l->col != r->col)
+		return (l->col < r->col) ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Compares two findings by file and line. Useful for qsort(3) on an array of
+ * pointers to findings.
+ *
+ * @param left Pointer to the pointer to the first finding.
+ * @param right Pointer to the pointer to the second finding.
+ * @return Less than zero if left ordered before right.
+ *         Zero if left and right equally ordered.
+ *         More than zero if right ordered before left.
+ */
+static int comparator_position(const void *left, const void *right)
+{
+	const finding_t *l = *(const finding_t * const *)left;
+	const finding_t *r = *(const finding_t * const *)right;
+	int cmp = strcmp(l->file, r->file);
+
+	if (cmp != 0)
+		return cmp;
+	if (l->start.line != r->start.line)
+		return (l->start.line < r->start.line) ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Maps a source file to fingerprint its lines.
+ *
+ * @param src Pointer to fill with a source file structure.
+ * @param path The path to the file.
+ */
+static void openSource(source_file *src, const char *path)
+{
+	struct stat st;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	src->data = NULL;
+	src->size = 0;
+	src->line = 1;
+	src->pos = 0;
+
+	if (fd == -1)
+	{
+		return;
+	}
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED)
+		{
+			src->data = map;
+			src->size = (size_t)st.st_size;
+		}
+	}
+	(void)close(fd);
+}
+
+/**
+ * Unmaps a source file.
+ *
+ * @param src Pointer to a source file structure.
+ */
+static void closeSource(source_file *src)
+{
+	if (src->data != NULL)
+	{
+		(void)munmap((void *)src->data, src->size);
+	}
+	src->data = NULL;
+}
+
+/**
+ * Fingerprints a line of a source file: hashes its contents without
+ * whitespace. Lines must be fingerprinted in ascending order.
+ *
+ * @param src Pointer to a source file structure.
+ * @param line The number of the line.
+ * @return The fingerprint; if the line doesn't exist, one derived from its
+ * number.
+ */
+static uint64_t fingerprint(source_file *src, size_t line)
+{
+	uint64_t hash = HASH_INIT;
+	size_t pos;
+
+	while (src->data != NULL && src->line < line && src->pos < src->size)
+	{
+		const char *nl = memchr(src->data + src->pos, '\n', src->size - src->pos);
+		src->pos = (nl == NULL) ? src->size : (size_t)(nl - src->data) + 1;
+		++src->line;
+	}
+	if (src->data == NULL || src->line != line || src->pos >= src->size)
+	{
+		uint64_t num = line;
+		return hash_bytes(hash_string(HASH_INIT, "\001line"), &num, sizeof(num));
+	}
+
+	for (pos = src->pos; pos < src->size && src->data[pos] != '\n'; ++pos)
+	{
+		char c = src->data[pos];
+		if (c != ' ' && c != '\t' && c != '\r' && c != '\v' && c != '\f')
+		{
+			hash = hash_bytes(hash, &c, 1);
+		}
+	}
+	return hash;
+}
+
+/**
+ * Converts findings into records, fingerprinting their lines.
+ *
+ * @param db Pointer to the findings database structure to intern the strings in.
+ * @param found The findings.
+ * @param records The array to fill, in the order of the findings.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int makeRecords(findb_t *db, const findings_t *found, findb_record_t *records)
+{
+	const finding_t **order = malloc((found->count + 1) * sizeof(const finding_t *));
+	source_file src = {
+		.data = NULL
+	};
+	const char *srcName = NULL;
+	size_t i;
+	int ret = 1;
+
+	if (order == NULL)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < found->count; ++i)
+	{
+		order[i] = &found->arr[i];
+	}
+	qsort(order, found->count, sizeof(const finding_t *), comparator_position);
+
+	for (i = 0; i < found->count && ret == 1; ++i)
+	{
+		const finding_t *fnd = order[i];
+		findb_record_t *rec = &records[fnd - found->arr];
+
+		ret = intern(db, fnd->file, &rec->file) && intern(db, fnd->func, &rec->func);
+		if (ret == 0)
+		{
+			break;
+		}
+
+		if (srcName == NULL || strcmp(srcName, fnd->file) != 0)
+		{
+			closeSource(&src);
+			openSource(&src, fnd->file);
+			srcName = fnd->file;
+		}
+
+		rec->kind = (uint32_t)fnd->kind;
+		rec->line = (uint32_t)fnd->start.line;
+		rec->col = (uint32_t)fnd->start.col;
+		rec->endLine = (uint32_t)fnd->end.line;
+		rec->endCol = (uint32_t)fnd->end.col;
+		rec->expansions = (uint32_t)fnd->expansions;
+		rec->fingerprint = fingerprint(&src, fnd->start.line);
+	}
+
+	closeSource(&src);
+	free(order);
+	return ret;
+}
+
+/**
+ * Writes a whole buffer at an offset of a file.
+ *
+ * @param fd The file.
+ * @param buf The buffer.
+ * @param len The length of the buffer.
+ * @param offset The offset.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int writeAt(int fd, const void *buf, size_t len, off_t offset)
+{
+	const char *p = buf;
+
+	while (len > 0)
+	{
+		ssize_t written = pwrite(fd, p, len, offset);
+		if (written == -1)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return 0;
+		}
+		p += written;
+		len -= (size_t)written;
+		offset += (off_t)written;
+	}
+	return 1;
+}
+
+/**
+ * Lays out the block of a run and appends it to a database file.
+ *
+ * @param db Pointer to the loaded findings database structure.
+ * @param fd The open database file, locked.
+ * @param found The findings of the run.
+ * @param when When the run took place.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int appendRun(findb_t *db, int fd, const findings_t *found, time_t when)
+{
+	struct findb_run_header hdr;
+	size_t firstNew = db->strCount, strSize = 0, calleeCount = 0, i, bodySize;
+	findb_record_t *records;
+	findb_callee_t *callees;
+	char *body;
+	int ret;
+
+	if (found->count > UINT32_MAX)
+	{
+		errno = EFBIG;
+		return 0;
+	}
+
+	records = calloc(found->count + 1, sizeof(findb_record_t));
+	callees = malloc((found->count + 1) * sizeof(findb_callee_t));
+	if (records == NULL || callees == NULL)
+	{
+		free(records);
+		free(callees);
+		errno = ENOMEM;
+		return 0;
+	}
+
+	if (makeRecords(db, found, records) == 0)
+	{
+		free(records);
+		free(callees);
+		return 0;
+	}
+	qsort(records, found->count, sizeof(findb_record_t), comparator_record);
+
+	/* index the callees */
+	for (i = 0; i < found->count; ++i)
+	{
+		if (i == 0 || records[i].func != records[i - 1].func)
+		{
+			callees[calleeCount].func = records[i].func;
+			callees[calleeCount].first = (uint32_t)i;
+			callees[calleeCount].count = 0;
+			callees[calleeCount].missing = 0;
+			++calleeCount;
+		}
+		++callees[calleeCount - 1].count;
+		if (records[i].kind == FINDING_MISSING_VOID)
+		{
+			++callees[calleeCount - 1].missing;
+		}
+	}
+
+	for (i = firstNew; i < db->strCount; ++i)
+	{
+		strSize += strlen(db->strs[i]) + 1;
+	}
+	strSize = pad8(strSize);
+
+	bodySize = strSize + found->count * sizeof(findb_record_t) + calleeCount * sizeof(findb_callee_t);
+	body = calloc(bodySize + 1, 1);
+	if (strSize > UINT32_MAX || body == NULL)
+	{
+		free(records);
+		free(callees);
+		free(body);
+		errno = (body == NULL) ? ENOMEM : EFBIG;
+		return 0;
+	}
+
+	strSize = 0;
+	for (i = firstNew; i < db->strCount; ++i)
+	{
+		size_t len = strlen(db->strs[i]) + 1;
+		(void)memcpy(body + strSize, db->strs[i], len);
+		strSize += len;
+	}
+	strSize = pad8(strSize);
+	(void)memcpy(body + strSize, records, found->count * sizeof(findb_record_t));
+	(void)memcpy(body + strSize + found->count * sizeof(findb_record_t), callees, calleeCount * sizeof(findb_callee_t));
+
+	hdr.marker = RUN_MARKER;
+	hdr.number = (uint32_t)db->runCount + 1;
+	hdr.time = (int64_t)when;
+	hdr.strCount = (uint32_t)(db->strCount - firstNew);
+	hdr.strSize = (uint32_t)strSize;
+	hdr.count = (uint32_t)found->count;
+	hdr.calleeCount = (uint32_t)calleeCount;
+	hdr.length = sizeof(hdr) + bodySize;
+
+	/* drop the remains of an interrupted run; the header goes last, once the rest is on disk */
+	ret = (
+		ftruncate(fd, (off_t)db->validSize) == 0 &&
+		writeAt(fd, body, bodySize, (off_t)(db->validSize + sizeof(hdr))) &&
+		fdatasync(fd) == 0 &&
+		writeAt(fd, &hdr, sizeof(hdr), (off_t)db->validSize) &&
+		fdatasync(fd) == 0
+	) ? 1 : 0;
+
+	free(records);
+	free(callees);
+	free(body);
+	return ret;
+}
+
+/* public-facing functions */
+
+int findb_open(findb_t *db, const char *path)
+{
+	int fd, ret, olderrno;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return 0;
+	}
+
+	ret = load(db, fd);
+	olderrno = errno;
+	(void)close(fd);
+	errno = olderrno;
+	return ret;
+}
+
+void findb_close(findb_t *db)
+{
+	if (db->map != NULL)
+	{
+		(void)munmap(db->map, db->size);
+	}
+	free(db->runs);
+	free(db->strs);
+	free(db->slots);
+	(void)memset(db, 0, sizeof(*db));
+}
+
+int findb_append(const char *path, const findings_t *found, time_t when)
+{
+	struct stat st;
+	findb_t db;
+	int fd, ret, olderrno;
+
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+	if (fd == -1)
+	{
+		return 0;
+	}
+
+	/* the lock is released when the file is closed */
+	ret = (flock(fd, LOCK_EX) == 0 && fstat(fd, &st) == 0) ? 1 : 0;
+	if (ret == 1 && st.st_size == 0)
+	{
+		ret = writeAt(fd, FINDB_MAGIC, sizeof(FINDB_MAGIC), 0);
+	}
+	if (ret == 1 && load(&db, fd) == 1)
+	{
+		ret = appendRun(&db, fd, found, when);
+		olderrno = errno;
+		findb_close(&db);
+		errno = olderrno;
+	}
+	else
+	{
+		ret = 0;
+	}
+
+	olderrno = errno;
+	(void)close(fd);
+	errno = olderrno;
+	return ret;
+}
+
+bool findb_lookup(const findb_t *db, const char *str, uint32_t *num)
+{
+	uint32_t slot;
+
+	if (db->slotCount == 0)
+	{
+		return false;
+	}
+
+	slot = *stringSlot(db, str);
+	if (slot == 0)
+	{
+		return false;
+	}
+	*num = slot - 1;
+	return true;
+}
+
+const findb_callee_t *findb_callee(const findb_run_t *run, uint32_t func)
+{
+	size_t lo = 0, hi = run->calleeCount;
+
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (run->callees[mid].func < func)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return (lo < run->calleeCount && run->callees[lo].func == func) ? &run->callees[lo] : NULL;
+}
+
+int findb_compareIdentity(const findb_record_t *left, const findb_record_t *right)
+{
+	if (left->func != right->func)
+		return (left->func < right->func) ? -1 : 1;
+	if (left->file != right->file)
+		return (left->file < right->file) ? -1 : 1;
+	if (left->kind != right->kind)
+		return (left->kind < right->kind) ? -1 : 1;
+	if (left->fingerprint != right->fingerprint)
+		return (left->fingerprint < right->fingerprint) ? -1 : 1;
+	return 0;
+}
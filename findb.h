@@ -0,0 +1,197 @@
+/**
+ * @file findb.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Database of the findings of many runs.
+ * @details Each run appends a block to the database file: the strings (file
+ * and function names) not known from earlier runs, the findings as records of
+ * fixed size sorted by callee, and an index of the callees. Strings are
+ * referenced by their number, counted across the whole file. The file is
+ * memory-mapped for querying, so that questions about the history of the
+ * findings can be answered without parsing any source again.
+ */
+
+#ifndef __FINDB_H__
+#define __FINDB_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "findings.h"
+
+/** A finding, as stored in the database. */
+typedef struct
+{
+	/** The number of the name of the function called. */
+	uint32_t func;
+
+	/** The number of the name of the file where the finding is located. */
+	uint32_t file;
+
+	/** The kind of the finding (a finding_kind_t). */
+	uint32_t kind;
+
+	/** The start location. */
+	uint32_t line, col;
+
+	/** The end location. */
+	uint32_t endLine, endCol;
+
+	/** The number of macro expansions yielding the finding. */
+	uint32_t expansions;
+
+	/**
+	 * The hash of the line of the finding, without whitespace; identifies
+	 * the finding across runs even if lines have been added above it.
+	 */
+	uint64_t fingerprint;
+} findb_record_t;
+
+/** The findings of a run concerning one callee. */
+typedef struct
+{
+	/** The number of the name of the function called. */
+	uint32_t func;
+
+	/** The index of the first record of the callee within the run. */
+	uint32_t first;
+
+	/** The number of records of the callee. */
+	uint32_t count;
+
+	/** How many of them are missing casts. */
+	uint32_t missing;
+} findb_callee_t;
+
+/** A run stored in the database. */
+typedef struct
+{
+	/** The number of the run, counting from 1. */
+	uint32_t number;
+
+	/** When the run was stored. */
+	time_t time;
+
+	/** The number of findings. */
+	size_t count;
+
+	/** The findings, sorted by callee, file, kind and fingerprint. */
+	const findb_record_t *records;
+
+	/** The number of callees. */
+	size_t calleeCount;
+
+	/** The callees, sorted by the number of their name. */
+	const findb_callee_t *callees;
+} findb_run_t;
+
+/** A findings database mapped into memory. */
+typedef struct
+{
+	/** The mapping of the database file. */
+	void *map;
+
+	/** The size of the mapping. */
+	size_t size;
+
+	/** The size of the intact part of the file. */
+	size_t validSize;
+
+	/** The number of runs. */
+	size_t runCount;
+
+	/** The runs, oldest first. */
+	findb_run_t *runs;
+
+	/** The number of strings. */
+	size_t strCount;
+
+	/** How many strings can the array house? */
+	size_t strCapacity;
+
+	/** The strings, by number. */
+	const char **strs;
+
+	/** The number of slots of the string lookup table; a power of two. */
+	size_t slotCount;
+
+	/** The string lookup table: for each slot, the number of a string plus one, or zero. */
+	uint32_t *slots;
+} findb_t;
+
+/**
+ * Map a findings database file into memory. Whatever follows the last intact
+ * run (the remains of a run whose storing was interrupted) is ignored.
+ *
+ * @param db Pointer to fill with a findings database structure.
+ * @param path The path of the database file.
+ * @return 1 on success, 0 on failure (setting errno appropriately; EINVAL if
+ * the file is not a findings database).
+ */
+int findb_open(findb_t *db, const char *path);
+
+/**
+ * Unmap a findings database.
+ *
+ * @param db Pointer to a findings database structure.
+ */
+void findb_close(findb_t *db);
+
+/**
+ * Append the findings of a run to a findings database file, creating it if
+ * necessary. The file is locked meanwhile, so runs may append concurrently.
+ * The lines of the findings are read from the files to fingerprint them.
+ *
+ * @param path The path of the database file.
+ * @param found The findings of the run.
+ * @param when When the run took place.
+ * @return 1 on success, 0 on failure (setting errno appropriately; EINVAL if
+ * the file is not a findings database).
+ */
+int findb_append(const char *path, const findings_t *found, time_t when);
+
+/**
+ * Look up the number of a string.
+ *
+ * @param db Pointer to a findings database structure.
+ * @param str The string.
+ * @param num Will be set to the number of the string.
+ * @return true if the database contains the string
+ */
+bool findb_lookup(const findb_t *db, const char *str, uint32_t *num);
+
+/**
+ * Look up the findings of a run concerning a callee.
+ *
+ * @param run Pointer to a run.
+ * @param func The number of the name of the callee.
+ * @return The callee, or NULL if the run has no findings concerning it.
+ */
+const findb_callee_t *findb_callee(const findb_run_t *run, uint32_t func);
+
+/**
+ * Returns a string of a findings database.
+ *
+ * @param db Pointer to a findings database structure.
+ * @param num The number of the string.
+ * @return The string; "?" if there is no string of that number.
+ */
+static inline const char *findb_string(const findb_t *db, uint32_t num)
+{
+	return (num < db->strCount) ? db->strs[num] : "?";
+}
+
+/**
+ * Compares two records by their identity across runs: callee, file, kind and
+ * fingerprint.
+ *
+ * @param left Pointer to the first record.
+ * @param right Pointer to the second record.
+ * @return Less than zero, zero or more than zero, like strcmp(3).
+ */
+int findb_compareIdentity(const findb_record_t *left, const findb_record_t *right);
+
+#endif
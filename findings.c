@@ -0,0 +1,377 @@
+/**
+ * @file findings.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Collection of findings (missing and superfluous casts to void).
+ * @details An array of findings which automagically expands as needed, much
+ * like the Magical String Array.
+ */
+
+#include "findings.h"
+
+#include <stdbool.h>
+#include <errno.h>
+#include <string.h>
+
+/** Default findings array capacity. */
+static const size_t DEFAULT_CAPACITY = 16;
+
+/* utility functions */
+
+/**
+ * Frees the strings of a finding.
+ *
+ * @param fnd Pointer to the finding whose strings to free.
+ */
+static inline void freeFinding(finding_t *fnd)
+{
+	free(fnd->file);
+	free(fnd->func);
+	fnd->file = NULL;
+	fnd->func = NULL;
+}
+
+/**
+ * Compares two locations.
+ *
+ * @param l the left location
+ * @param r the right location
+ * @return less than, equal to or greater than zero if l is ordered before,
+ * together with or after r
+ */
+static inline int compareLocs(module_loc_t l, module_loc_t r)
+{
+	/* size_t subtraction may lead to bogus results */
+	if (l.line != r.line)
+		return (l.line < r.line) ? -1 : 1;
+	if (l.col != r.col)
+		return (l.col < r.col) ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Compares two findings by their identity: kind, file, location and function.
+ *
+ * @param l the left finding
+ * @param r the right finding
+ * @return less than, equal to or greater than zero if l is ordered before,
+ * together with or after r
+ */
+static int compareFindings(const finding_t *l, const finding_t *r)
+{
+	int cmp;
+
+	if (l->kind != r->kind)
+		return (l->kind < r->kind) ? -1 : 1;
+
+	cmp = strcmp(l->file, r->file);
+	if (cmp != 0)
+		return cmp;
+
+	cmp = compareLocs(l->start, r->start);
+	if (cmp != 0)
+		return cmp;
+
+	return strcmp(l->func, r->func);
+}
+
+/**
+ * Compares two pointers into the same findings array by the identity of the
+ * findings they point to, then by their position in the array. Useful for
+ * qsort(3).
+ *
+ * @param left Pointer to the first pointer (pointer to const finding_t *).
+ * @param right Pointer to the second pointer (pointer to const finding_t *).
+ * @return Less than zero if left ordered before right.
+ *         Zero if left and right equally ordered.
+ *         More than zero if right ordered before left.
+ */
+static int comparator_findptr(const void *left, const void *right)
+{
+	const finding_t *l = *(const finding_t * const *)left;
+	const finding_t *r = *(const finding_t * const *)right;
+	int cmp = compareFindings(l, r);
+
+	if (cmp != 0)
+		return cmp;
+
+	/* keep the sort stable */
+	if (l != r)
+		return (l < r) ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Returns whether two findings describe the same thing.
+ *
+ * @param l the left finding
+ * @param r the right finding
+ * @return true if both findings are of the same kind at the same location and
+ * concern the same function
+ */
+static inline bool sameFinding(const finding_t *l, const finding_t *r)
+{
+	return (compareFindings(l, r) == 0);
+}
+
+/**
+ * Finds the position of a finding in an array of findings sorted by
+ * compareFindings.
+ *
+ * @param sorted the sorted array
+ * @param fnd the finding to look for
+ * @param pos by-ref to the position of the finding, or at which to insert it
+ * @return true if the finding is in the array
+ */
+static bool findSorted(const findings_t *sorted, const finding_t *fnd, size_t *pos)
+{
+	size_t lo = 0, hi = sorted->count;
+
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (compareFindings(&sorted->arr[mid], fnd) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*pos = lo;
+	return (lo < sorted->count && sameFinding(&sorted->arr[lo], fnd));
+}
+
+/* public-facing functions */
+
+int findings_create(findings_t *fnds)
+{
+	fnds->capacity = DEFAULT_CAPACITY;
+	fnds->count = 0;
+	fnds->arr = malloc(fnds->capacity * sizeof(finding_t));
+	if (fnds->arr == NULL)
+	{
+		/* malloc failed */
+		fnds->capacity = 0;
+		return 0;
+	}
+	return 1;
+}
+
+void findings_destroy(findings_t *fnds)
+{
+	findings_clear(fnds);
+	fnds->capacity = 0;
+	free(fnds->arr);
+	fnds->arr = NULL;
+}
+
+void findings_clear(findings_t *fnds)
+{
+	size_t i;
+
+	for (i = 0; i < fnds->count; ++i)
+	{
+		freeFinding(&fnds->arr[i]);
+	}
+	fnds->count = 0;
+}
+
+int findings_add(
+	findings_t *fnds,
+	finding_kind_t kind,
+	const char *file,
+	const char *func,
+	module_loc_t start,
+	module_loc_t end,
+	size_t expansions
+)
+{
+	finding_t newFnd = {
+		.kind = kind,
+		.start = start,
+		.end = end,
+		.expansions = expansions,
+		.configs = 0
+	};
+
+	if (fnds->count >= fnds->capacity)
+	{
+		/* not enough space; double the capacity */
+		finding_t *newarr;
+		size_t newcap = (fnds->capacity == 0) ? DEFAULT_CAPACITY : (fnds->capacity * 2);
+		newarr = realloc(fnds->arr, newcap * sizeof(finding_t));
+		if (newarr == NULL)
+		{
+			/* realloc failed; return 0 and don't touch the existing array */
+			return 0;
+		}
+
+		/* array reallocated successfully; store new pointer */
+		fnds->arr = newarr;
+		fnds->capacity = newcap;
+	}
+
+	newFnd.file = strdup(file);
+	newFnd.func = strdup(func);
+	if (newFnd.file == NULL || newFnd.func == NULL)
+	{
+		/* strdup failed */
+		int olderrno = errno;
+		freeFinding(&newFnd);
+		errno = olderrno;
+		return 0;
+	}
+
+	fnds->arr[fnds->count++] = newFnd;
+	return 1;
+}
+
+int findings_copy(findings_t *fnds, const finding_t *fnd, const char *file)
+{
+	if (findings_add(
+		fnds,
+		fnd->kind,
+		(file != NULL) ? file : fnd->file,
+		fnd->func,
+		fnd->start,
+		fnd->end,
+		fnd->expansions
+	) == 0)
+	{
+		return 0;
+	}
+
+	fnds->arr[fnds->count - 1].configs = fnd->configs;
+	return 1;
+}
+
+int findings_move(findings_t *dst, findings_t *src)
+{
+	if (dst->count + src->count > dst->capacity)
+	{
+		/* make space for all of them at once */
+		finding_t *newarr;
+		size_t newcap = (dst->capacity == 0) ? DEFAULT_CAPACITY : dst->capacity;
+		while (newcap < dst->count + src->count)
+		{
+			newcap *= 2;
+		}
+
+		newarr = realloc(dst->arr, newcap * sizeof(finding_t));
+		if (newarr == NULL)
+		{
+			return 0;
+		}
+		dst->arr = newarr;
+		dst->capacity = newcap;
+	}
+
+	if (src->count > 0)
+	{
+		(void)memcpy(&dst->arr[dst->count], src->arr, src->count * sizeof(finding_t));
+	}
+	dst->count += src->count;
+
+	/* the strings belong to dst now */
+	src->count = 0;
+	return 1;
+}
+
+int findings_collapse(findings_t *fnds)
+{
+	finding_t **order;
+	size_t i, j, kept;
+
+	if (fnds->count < 2)
+	{
+		/* nothing to collapse */
+		return 1;
+	}
+
+	order = malloc(fnds->count * sizeof(finding_t *));
+	if (order == NULL)
+	{
+		return 0;
+	}
+
+	/* sort pointers; equal findings end up next to each other, first one first */
+	for (i = 0; i < fnds->count; ++i)
+	{
+		order[i] = &fnds->arr[i];
+	}
+	qsort(order, fnds->count, sizeof(finding_t *), comparator_findptr);
+
+	/* merge each run of equal findings into its first occurrence */
+	for (i = 0; i < fnds->count; i = j)
+	{
+		finding_t *first = order[i];
+
+		for (j = i + 1; j < fnds->count && sameFinding(first, order[j]); ++j)
+		{
+			finding_t *dupe = order[j];
+			if (first->configs != 0 && (first->configs & dupe->configs) == 0)
+			{
+				/* the same finding in another configuration */
+				if (dupe->expansions > first->expansions)
+					first->expansions = dupe->expansions;
+			}
+			else
+			{
+				/* another expansion in the same configuration */
+				first->expansions += dupe->expansions;
+			}
+			first->configs |= dupe->configs;
+			freeFinding(dupe);
+		}
+	}
+
+	free(order);
+
+	/* compact the array, keeping the original order */
+	kept = 0;
+	for (i = 0; i < fnds->count; ++i)
+	{
+		if (fnds->arr[i].file != NULL)
+		{
+			fnds->arr[kept++] = fnds->arr[i];
+		}
+	}
+	fnds->count = kept;
+
+	return 1;
+}
+
+int findings_dropSeen(findings_t *fnds, findings_t *seen, const char *file)
+{
+	size_t i, pos, kept = 0;
+	int ok = 1;
+
+	for (i = 0; i < fnds->count; ++i)
+	{
+		finding_t *fnd = &fnds->arr[i];
+
+		if (ok && strcmp(fnd->file, file) != 0)
+		{
+			if (findSorted(seen, fnd, &pos))
+			{
+				/* already reported along with another file */
+				freeFinding(fnd);
+				continue;
+			}
+
+			/* append a copy, then move it into place */
+			ok = findings_copy(seen, fnd, NULL);
+			if (ok)
+			{
+				finding_t copy = seen->arr[seen->count - 1];
+				(void)memmove(&seen->arr[pos + 1], &seen->arr[pos], (seen->count - 1 - pos) * sizeof(finding_t));
+				seen->arr[pos] = copy;
+			}
+		}
+
+		fnds->arr[kept++] = *fnd;
+	}
+	fnds->count = kept;
+
+	return ok;
+}
@@ -0,0 +1,179 @@
+/**
+ * @file findings.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Collection of findings (missing and superfluous casts to void).
+ * @details An array of findings which automagically expands as needed, much
+ * like the Magical String Array.
+ */
+
+#ifndef __FINDINGS_H__
+#define __FINDINGS_H__
+
+#include <stdlib.h>
+
+#include "shared.h"
+#include "configs.h"
+
+/** The kind of a finding. */
+typedef enum
+{
+	/** A cast to void is missing. */
+	FINDING_MISSING_VOID,
+
+	/** A cast to void is superfluous. */
+	FINDING_SUPERFLUOUS_VOID,
+
+	/**
+	 * A call can't be checked since the function called can't be found; only
+	 * reported as a warning.
+	 */
+	FINDING_UNCHECKED_CALL
+} finding_kind_t;
+
+/** A single finding. */
+typedef struct
+{
+	/** The kind of the finding. */
+	finding_kind_t kind;
+
+	/** The name of the file where the finding is located. */
+	char *file;
+
+	/** The name of the function called. */
+	char *func;
+
+	/**
+	 * For a missing cast, the location where the cast should be inserted;
+	 * for a superfluous cast, the location where the cast starts.
+	 */
+	module_loc_t start;
+
+	/**
+	 * For a superfluous cast, the location where the cast ends. Unused for
+	 * missing casts.
+	 */
+	module_loc_t end;
+
+	/**
+	 * The number of macro expansions which yielded this finding, or zero
+	 * if the finding is not located within a macro.
+	 */
+	size_t expansions;
+
+	/** The configurations in which the finding occurs. */
+	configset_t configs;
+} finding_t;
+
+/** An expanding array of findings. */
+typedef struct
+{
+	/** How many findings can the array house? */
+	size_t capacity;
+
+	/** How many findings is the array housing right now? */
+	size_t count;
+
+	/** The findings themselves. */
+	finding_t *arr;
+} findings_t;
+
+/**
+ * Create an empty array of findings.
+ *
+ * @param fnds Pointer to fill with a findings structure.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int findings_create(findings_t *fnds);
+
+/**
+ * Destroy an array of findings.
+ *
+ * @param fnds Pointer to a findings structure.
+ */
+void findings_destroy(findings_t *fnds);
+
+/**
+ * Remove all findings from an array of findings, keeping its capacity.
+ *
+ * @param fnds Pointer to a findings structure.
+ */
+void findings_clear(findings_t *fnds);
+
+/**
+ * Add a finding to the end of an array of findings. The strings are
+ * duplicated.
+ *
+ * @param fnds Pointer to a findings structure.
+ * @param kind The kind of the finding.
+ * @param file The name of the file where the finding is located.
+ * @param func The name of the function called.
+ * @param start The start location of the finding.
+ * @param end The end location of the finding.
+ * @param expansions The number of macro expansions yielding this finding.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ *
+ * @note The configurations of the new finding are left empty.
+ */
+int findings_add(
+	findings_t *fnds,
+	finding_kind_t kind,
+	const char *file,
+	const char *func,
+	module_loc_t start,
+	module_loc_t end,
+	size_t expansions
+);
+
+/**
+ * Add a copy of a finding to the end of an array of findings.
+ *
+ * @param fnds Pointer to a findings structure.
+ * @param fnd The finding to copy.
+ * @param file The name of the file to store in the copy; NULL to keep the
+ * finding's file name.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int findings_copy(findings_t *fnds, const finding_t *fnd, const char *file);
+
+/**
+ * Move all findings from one array of findings to the end of another. The
+ * source array is left empty.
+ *
+ * @param dst Pointer to the findings structure to move the findings to.
+ * @param src Pointer to the findings structure to move the findings from.
+ * @return 1 on success, 0 on failure (setting errno appropriately; both arrays
+ * are left untouched).
+ */
+int findings_move(findings_t *dst, findings_t *src);
+
+/**
+ * Collapse findings of the same kind at the same location concerning the
+ * same function into one. The configurations of the findings are merged.
+ * Within the same configuration (or if no configurations are set), macro
+ * expansion counts are summed up; across disjoint configurations, the
+ * highest count is kept. The first occurrence of each finding is kept; the
+ * relative order of the remaining findings is preserved.
+ *
+ * @param fnds Pointer to a findings structure.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int findings_collapse(findings_t *fnds);
+
+/**
+ * Remove the findings located outside a file which have been seen before,
+ * and remember the others as seen. A header included by multiple files (or
+ * a macro defined in it) is thus only reported along with the first of them.
+ *
+ * @param fnds Pointer to the findings structure holding the findings of the
+ * file.
+ * @param seen Pointer to the findings structure holding the findings seen so
+ * far; initially empty and only ever passed to this function.
+ * @param file The name of the file whose findings fnds holds.
+ * @return 1 on success, 0 on failure (setting errno appropriately; the
+ * remaining findings are kept).
+ */
+int findings_dropSeen(findings_t *fnds, findings_t *seen, const char *file);
+
+#endif
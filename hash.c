@@ -0,0 +1,103 @@
+/**
+ * @file hash.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Non-cryptographic hashing of strings and file contents.
+ * @details The 64-bit FNV-1a hash is used throughout.
+ */
+
+#include "hash.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/** The FNV-1a 64-bit prime. */
+static const uint64_t FNV_PRIME = UINT64_C(0x100000001b3);
+
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	size_t i;
+
+	for (i = 0; i < len; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+uint64_t hash_string(uint64_t hash, const char *str)
+{
+	return hash_bytes(hash, str, strlen(str) + 1);
+}
+
+uint64_t hash_strings(const char * const *strs, size_t count)
+{
+	uint64_t hash = HASH_INIT;
+	size_t i;
+
+	for (i = 0; i < count; ++i)
+	{
+		hash = hash_string(hash, strs[i]);
+	}
+
+	return hash;
+}
+
+int hash_file(const char *path, uint64_t *hash, size_t *size)
+{
+	struct stat st;
+	void *f;
+	int fd, olderrno;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return 0;
+	}
+
+	if (fstat(fd, &st) == -1)
+	{
+		olderrno = errno;
+		(void)close(fd);
+		errno = olderrno;
+		return 0;
+	}
+
+	if (size != NULL)
+	{
+		*size = (size_t)st.st_size;
+	}
+
+	if (st.st_size == 0)
+	{
+		/* can't map empty files */
+		*hash = HASH_INIT;
+		(void)close(fd);
+		return 1;
+	}
+
+	f = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (f == MAP_FAILED)
+	{
+		olderrno = errno;
+		(void)close(fd);
+		errno = olderrno;
+		return 0;
+	}
+
+	*hash = hash_bytes(HASH_INIT, f, (size_t)st.st_size);
+
+	(void)munmap(f, (size_t)st.st_size);
+	(void)close(fd);
+	return 1;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file hash.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Non-cryptographic hashing of strings and file contents.
+ * @details The 64-bit FNV-1a hash is used throughout.
+ */
+
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** The initial value of a hash. */
+#define HASH_INIT UINT64_C(0xcbf29ce484222325)
+
+/**
+ * Continue hashing with a block of bytes.
+ *
+ * @param hash The hash so far; HASH_INIT when starting anew.
+ * @param data The bytes to hash.
+ * @param len The number of bytes to hash.
+ * @return The updated hash.
+ */
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t len);
+
+/**
+ * Continue hashing with a NUL-terminated string. The terminating NUL is hashed
+ * too, so that the boundaries between strings hashed in sequence matter.
+ *
+ * @param hash The hash so far; HASH_INIT when starting anew.
+ * @param str The string to hash.
+ * @return The updated hash.
+ */
+uint64_t hash_string(uint64_t hash, const char *str);
+
+/**
+ * Hash an array of strings.
+ *
+ * @param strs The strings to hash.
+ * @param count The number of strings.
+ * @return The hash.
+ */
+uint64_t hash_strings(const char * const *strs, size_t count);
+
+/**
+ * Hash the contents of a file.
+ *
+ * @param path The path to the file.
+ * @param hash Will contain the hash of the file's contents.
+ * @param size Will contain the size of the file, if not NULL.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int hash_file(const char *path, uint64_t *hash, size_t *size);
+
+#endif
@@ -0,0 +1,343 @@
+/**
+ * @file incprof.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Profile of the cost of included files.
+ */
+
+#include "incprof.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/** Default capacity of the arrays. */
+static const size_t DEFAULT_CAPACITY = 64;
+
+/* utility functions */
+
+/**
+ * Ensures there is space for one more element in an expanding array.
+ *
+ * @param arr by-ref to the array
+ * @param capacity by-ref to the capacity of the array
+ * @param count the number of elements in the array
+ * @param elemSize the size of an element
+ * @return 1 on success, 0 on failure (setting errno appropriately)
+ */
+static int ensureSpace(void **arr, size_t *capacity, size_t count, size_t elemSize)
+{
+	void *newarr;
+	size_t newcap;
+
+	if (count < *capacity)
+	{
+		return 1;
+	}
+
+	/* double the capacity */
+	newcap = (*capacity == 0) ? DEFAULT_CAPACITY : (*capacity * 2);
+	newarr = realloc(*arr, newcap * elemSize);
+	if (newarr == NULL)
+	{
+		return 0;
+	}
+	*arr = newarr;
+	*capacity = newcap;
+	return 1;
+}
+
+/**
+ * Finds a file in a profile, adding it if it isn't known yet.
+ *
+ * @param prof Pointer to a profile structure.
+ * @param name The name of the file.
+ * @param size The size of the file.
+ * @param idx Will be set to the index of the file.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int findFile(incprof_t *prof, const char *name, size_t size, size_t *idx)
+{
+	size_t lo = 0, hi = prof->count, cap;
+	char *copy;
+
+	/* binary search for the position by name */
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = strcmp(prof->arr[prof->byName[mid]].name, name);
+		if (cmp == 0)
+		{
+			*idx = prof->byName[mid];
+			return 1;
+		}
+		else if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* both arrays always have the same capacity */
+	cap = prof->capacity;
+	if (
+		ensureSpace((void **)&prof->arr, &prof->capacity, prof->count, sizeof(incprof_file_t)) == 0 ||
+		ensureSpace((void **)&prof->byName, &cap, prof->count, sizeof(size_t)) == 0
+	)
+	{
+		return 0;
+	}
+
+	copy = strdup(name);
+	if (copy == NULL)
+	{
+		return 0;
+	}
+
+	prof->arr[prof->count] = (incprof_file_t){
+		.name = copy,
+		.size = size,
+		.lastTu = SIZE_MAX
+	};
+	(void)memmove(&prof->byName[lo + 1], &prof->byName[lo], (prof->count - lo) * sizeof(size_t));
+	prof->byName[lo] = prof->count;
+	*idx = prof->count++;
+	return 1;
+}
+
+/**
+ * Compares two inclusions by the directive in the main file leading to them,
+ * then by depth. Useful for qsort(3).
+ *
+ * @param left Pointer to the first inclusion.
+ * @param right Pointer to the second inclusion.
+ * @return Less than zero if left ordered before right.
+ *         Zero if left and right equally ordered.
+ *         More than zero if right ordered before left.
+ */
+static int comparator_inclusion(const void *left, const void *right)
+{
+	const incprof_inclusion_t *l = (const incprof_inclusion_t *)left;
+	const incprof_inclusion_t *r = (const incprof_inclusion_t *)right;
+
+	if (l->fromMain != r->fromMain)
+		return l->fromMain ? -1 : 1;
+	if (l->mainOffset != r->mainOffset)
+		return (l->mainOffset < r->mainOffset) ? -1 : 1;
+	if (l->depth != r->depth)
+		return (l->depth < r->depth) ? -1 : 1;
+	return 0;
+}
+
+/** The profile being sorted; qsort(3) has no client data. */
+static const incprof_t *sortedProfile;
+
+/**
+ * Compares two files (given by index) by the time attributed to them,
+ * descending. Useful for qsort(3).
+ *
+ * @param left Pointer to the index of the first file.
+ * @param right Pointer to the index of the second file.
+ * @return Less than zero if left ordered before right.
+ *         Zero if left and right equally ordered.
+ *         More than zero if right ordered before left.
+ */
+static int comparator_seconds(const void *left, const void *right)
+{
+	const incprof_file_t *l = &sortedProfile->arr[*(const size_t *)left];
+	const incprof_file_t *r = &sortedProfile->arr[*(const size_t *)right];
+
+	if (l->seconds != r->seconds)
+		return (l->seconds > r->seconds) ? -1 : 1;
+	return strcmp(l->name, r->name);
+}
+
+/**
+ * Compares two files (given by index) by their average position among the
+ * direct inclusions. Useful for qsort(3).
+ *
+ * @param left Pointer to the index of the first file.
+ * @param right Pointer to the index of the second file.
+ * @return Less than zero if left ordered before right.
+ *         Zero if left and right equally ordered.
+ *         More than zero if right ordered before left.
+ */
+static int comparator_rank(const void *left, const void *right)
+{
+	const incprof_file_t *l = &sortedProfile->arr[*(const size_t *)left];
+	const incprof_file_t *r = &sortedProfile->arr[*(const size_t *)right];
+	double lrank = l->rankSum / (double)l->directTus;
+	double rrank = r->rankSum / (double)r->directTus;
+
+	if (lrank != rrank)
+		return (lrank < rrank) ? -1 : 1;
+	return strcmp(l->name, r->name);
+}
+
+/* public-facing functions */
+
+void incprof_create(incprof_t *prof)
+{
+	(void)memset(prof, 0, sizeof(*prof));
+}
+
+void incprof_destroy(incprof_t *prof)
+{
+	size_t i;
+
+	for (i = 0; i < prof->count; ++i)
+	{
+		free(prof->arr[i].name);
+	}
+	free(prof->arr);
+	free(prof->byName);
+	free(prof->incs);
+	incprof_create(prof);
+}
+
+int incprof_addInclusion(incprof_t *prof, const char *name, size_t size, unsigned int depth, bool fromMain, unsigned int mainOffset)
+{
+	size_t idx;
+
+	if (depth == 0)
+	{
+		/* the main file counts towards the parse time, but isn't shared */
+		prof->mainSize += size;
+		return 1;
+	}
+
+	if (
+		findFile(prof, name, size, &idx) == 0 ||
+		ensureSpace((void **)&prof->incs, &prof->incCapacity, prof->incCount, sizeof(incprof_inclusion_t)) == 0
+	)
+	{
+		return 0;
+	}
+
+	prof->incs[prof->incCount++] = (incprof_inclusion_t){
+		.file = idx,
+		.depth = depth,
+		.mainOffset = mainOffset,
+		.fromMain = fromMain
+	};
+	return 1;
+}
+
+void incprof_endTU(incprof_t *prof, double seconds)
+{
+	size_t i, total = prof->mainSize, rank = 0;
+	incprof_file_t *direct = NULL;
+
+	for (i = 0; i < prof->incCount; ++i)
+	{
+		total += prof->arr[prof->incs[i].file].size;
+	}
+	if (total == 0)
+	{
+		total = 1;
+	}
+
+	/* each group of inclusions stemming from the same directive starts with the directly included file */
+	qsort(prof->incs, prof->incCount, sizeof(incprof_inclusion_t), comparator_inclusion);
+
+	for (i = 0; i < prof->incCount; ++i)
+	{
+		const incprof_inclusion_t *inc = &prof->incs[i];
+		incprof_file_t *file = &prof->arr[inc->file];
+		double share = seconds * (double)file->size / (double)total;
+
+		if (file->lastTu != prof->tus)
+		{
+			/* headers without guards may be included multiple times */
+			file->lastTu = prof->tus;
+			++file->tus;
+		}
+		file->seconds += share;
+
+		if (inc->fromMain && inc->depth == 1)
+		{
+			direct = file;
+			++direct->directTus;
+			direct->rankSum += (double)rank++;
+		}
+		else if (!inc->fromMain || (i > 0 && inc->mainOffset != prof->incs[i - 1].mainOffset))
+		{
+			/* not below a directly included file */
+			direct = NULL;
+		}
+
+		if (direct != NULL)
+		{
+			direct->directSeconds += share;
+		}
+	}
+
+	++prof->tus;
+	prof->seconds += seconds;
+	prof->incCount = 0;
+	prof->mainSize = 0;
+}
+
+void incprof_report(const incprof_t *prof, FILE *out, size_t top)
+{
+	size_t *order, i, numCandidates = 0;
+	double saved = 0.0;
+
+	(void)fprintf(out, "Include profile: %zu translation units, %.3f s parsing\n", prof->tus, prof->seconds);
+	if (prof->count == 0)
+	{
+		return;
+	}
+
+	order = malloc(prof->count * sizeof(size_t));
+	if (order == NULL)
+	{
+		perror("malloc");
+		return;
+	}
+	for (i = 0; i < prof->count; ++i)
+	{
+		order[i] = i;
+	}
+
+	sortedProfile = prof;
+	qsort(order, prof->count, sizeof(size_t), comparator_seconds);
+
+	(void)fprintf(out, "%8s %12s %10s %6s  %s\n", "TUs", "bytes", "est. time", "share", "file");
+	for (i = 0; i < prof->count && i < top; ++i)
+	{
+		const incprof_file_t *file = &prof->arr[order[i]];
+		(void)fprintf(out, "%8zu %12zu %8.3f s %5.1f%%  %s\n",
+			file->tus, file->size * file->tus, file->seconds,
+			(prof->seconds > 0.0) ? (100.0 * file->seconds / prof->seconds) : 0.0,
+			file->name
+		);
+	}
+
+	/*
+	 * Suggest the files included directly by at least half of the translation
+	 * units. Precompiled, each of them (and everything it includes) would be
+	 * parsed once instead of once per translation unit.
+	 */
+	for (i = 0; i < prof->count; ++i)
+	{
+		const incprof_file_t *file = &prof->arr[i];
+		if (file->directTus >= 2 && file->directTus * 2 >= prof->tus)
+		{
+			order[numCandidates++] = i;
+			saved += file->directSeconds * (double)(file->directTus - 1) / (double)file->directTus;
+		}
+	}
+	qsort(order, numCandidates, sizeof(size_t), comparator_rank);
+
+	if (numCandidates > 0)
+	{
+		(void)fprintf(out, "\nSuggested prefix header for precompilation (saves an estimated %.3f s):\n", saved);
+		for (i = 0; i < numCandidates; ++i)
+		{
+			(void)fprintf(out, "#include \"%s\"\n", prof->arr[order[i]].name);
+		}
+	}
+
+	free(order);
+}
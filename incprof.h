@@ -0,0 +1,150 @@
+/**
+ * @file incprof.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Profile of the cost of included files.
+ * @details libclang doesn't say how long it spends on each file, so the time
+ * needed to parse a translation unit is apportioned among the files it
+ * includes by their size. Files included by many translation units which make
+ * up a large part of their parse time are the best candidates for a
+ * precompiled header.
+ */
+
+#ifndef __INCPROF_H__
+#define __INCPROF_H__
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/** What is known about one file across all translation units. */
+typedef struct
+{
+	/** The name of the file. */
+	char *name;
+
+	/** The size of the file. */
+	size_t size;
+
+	/** The number of translation units including the file. */
+	size_t tus;
+
+	/** The share of the parse time of all translation units attributed to the file itself. */
+	double seconds;
+
+	/** The number of translation units including the file directly from the main file. */
+	size_t directTus;
+
+	/**
+	 * The share of the parse time attributed to the file and everything it
+	 * includes, summed over the translation units including it directly.
+	 */
+	double directSeconds;
+
+	/** The sum of the positions among the direct inclusions, for ordering. */
+	double rankSum;
+
+	/** The number of the last translation unit which included the file. */
+	size_t lastTu;
+} incprof_file_t;
+
+/** One file included by the translation unit being added. */
+typedef struct
+{
+	/** Index of the file in the profile. */
+	size_t file;
+
+	/** Depth of the inclusion; 0 for the main file, 1 for direct inclusion. */
+	unsigned int depth;
+
+	/** Offset of the directive in the main file through which it is included. */
+	unsigned int mainOffset;
+
+	/** Whether the directive is located in the main file at all. */
+	bool fromMain;
+} incprof_inclusion_t;
+
+/** A profile of the cost of included files. */
+typedef struct
+{
+	/** How many files can the array house? */
+	size_t capacity;
+
+	/** How many files is the array housing right now? */
+	size_t count;
+
+	/** The files, in the order they were first seen. */
+	incprof_file_t *arr;
+
+	/** The indices of the files, sorted by name. */
+	size_t *byName;
+
+	/** The files included by the translation unit being added. */
+	incprof_inclusion_t *incs;
+
+	/** How many inclusions can the array house? */
+	size_t incCapacity;
+
+	/** How many inclusions is the array housing right now? */
+	size_t incCount;
+
+	/** The size of the main file of the translation unit being added. */
+	size_t mainSize;
+
+	/** The number of translation units profiled. */
+	size_t tus;
+
+	/** The total time spent parsing them. */
+	double seconds;
+} incprof_t;
+
+/**
+ * Create an empty profile.
+ *
+ * @param prof Pointer to fill with a profile structure.
+ */
+void incprof_create(incprof_t *prof);
+
+/**
+ * Destroy a profile.
+ *
+ * @param prof Pointer to a profile structure.
+ */
+void incprof_destroy(incprof_t *prof);
+
+/**
+ * Record a file included by the translation unit being added.
+ *
+ * @param prof Pointer to a profile structure.
+ * @param name The name of the file.
+ * @param size The size of the file.
+ * @param depth 0 for the main file, 1 for files included by it directly, and
+ * so on.
+ * @param fromMain Whether the outermost inclusion directive leading to the file
+ * is located in the main file (rather than e.g. on the command line).
+ * @param mainOffset The offset of that directive in the main file.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int incprof_addInclusion(incprof_t *prof, const char *name, size_t size, unsigned int depth, bool fromMain, unsigned int mainOffset);
+
+/**
+ * Finish adding a translation unit, apportioning its parse time among the
+ * files recorded since the last translation unit.
+ *
+ * @param prof Pointer to a profile structure.
+ * @param seconds The time spent parsing the translation unit.
+ */
+void incprof_endTU(incprof_t *prof, double seconds);
+
+/**
+ * Output the files costing the most parse time and a suggested prefix header
+ * for precompilation.
+ *
+ * @param prof Pointer to a profile structure.
+ * @param out The stream to write to.
+ * @param top The maximum number of files to list.
+ */
+void incprof_report(const incprof_t *prof, FILE *out, size_t top);
+
+#endif
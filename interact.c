@@ -21,53 +21,47 @@
 #include <sys/mman.h>
 
 #include "interact.h"
+#include "trace.h"
 
-/** A modification to be performed on the code. */
-typedef struct modif_s
+/** The modifications to be performed in interactive mode. */
+static modif_t *modifs = NULL;
+
+/** The number of modifications. */
+static size_t numModifs = 0;
+
+/** How many modifications the array can house. */
+static size_t modifsCapacity = 0;
+
+/**
+ * The most recently read file, kept mapped together with the offsets at which
+ * its lines start, since the findings of a file are usually shown in a row.
+ */
+static struct
 {
-	/** The file to modify. */
+	/** The name of the file; NULL if no file is mapped. */
 	char *file;
 
-	/** The type of the modification. */
-	enum
-	{
-		/** Insert text at a given location. */
-		MODIF_INSERT,
+	/** The device containing the file, to notice it being replaced. */
+	dev_t dev;
 
-		/** Remove text between two given locations. */
-		MODIF_REMOVE
-	} type;
+	/** The inode of the file, to notice it being replaced. */
+	ino_t ino;
 
-	/** The pseudopolymorphic union for the types of modification. */
-	union
-	{
-		/** The value of an insertion node. */
-		struct
-		{
-			/** The location where to insert an element. */
-			module_loc_t where;
+	/** The modification time of the file, to notice it being changed. */
+	struct timespec mtime;
 
-			/** The text to insert. */
-			char *what;
-		} insert;
+	/** The contents of the file; NULL if it is empty. */
+	char *contents;
 
-		/** The value of a removal node. */
-		struct
-		{
-			/** The inclusive location where the removal starts. */
-			module_loc_t fromWhere;
+	/** The length of the file. */
+	size_t length;
 
-			/** The inclusive location where the removal ends. */
-			module_loc_t toWhere;
-		} remove;
-	} m;
-} modif_t;
+	/** The offsets at which the lines start. */
+	size_t *lineStarts;
 
-/** The modifications to be performed in interactive mode. */
-static modif_t *modifs = NULL;
-
-/** The number of modifications. */
-static size_t numModifs = 0;
+	/** The number of lines. */
+	size_t numLines;
+} lineIndex = { .file = NULL };
 
 /**
  * Renames a file, copying-and-deleting if the rename fails.
@@ -212,10 +206,189 @@ static int compareModifs(const void *left, const void *right)
 	{
 		return 1;
 	}
-	else
+
+	/* then by what they do, so that duplicates end up next to each other */
+	if (l->type != r->type)
+	{
+		return (l->type < r->type) ? -1 : 1;
+	}
+	switch (l->type)
 	{
-		return 0;
+		case MODIF_INSERT:
+			return strcmp(l->m.insert.what, r->m.insert.what);
+		case MODIF_REMOVE:
+			if (l->m.remove.toWhere.line != r->m.remove.toWhere.line)
+			{
+				return (l->m.remove.toWhere.line < r->m.remove.toWhere.line) ? -1 : 1;
+			}
+			if (l->m.remove.toWhere.col != r->m.remove.toWhere.col)
+			{
+				return (l->m.remove.toWhere.col < r->m.remove.toWhere.col) ? -1 : 1;
+			}
+			break;
 	}
+	return 0;
+}
+
+/**
+ * Frees the strings of a modification.
+ *
+ * @param mod pointer to the modification whose strings to free
+ */
+static void freeModif(modif_t *mod)
+{
+	switch (mod->type)
+	{
+		case MODIF_INSERT:
+			free(mod->m.insert.what);
+			break;
+		case MODIF_REMOVE:
+			break;
+	}
+
+	free(mod->file);
+}
+
+/**
+ * Drops the modifications which duplicate the one before them, e.g. those of
+ * a macro in a header which was accepted along with multiple files including
+ * it. The modifications must be sorted.
+ */
+static void dropDuplicateModifs(void)
+{
+	size_t i, kept = 0;
+
+	for (i = 0; i < numModifs; ++i)
+	{
+		if (kept > 0 && compareModifs(&modifs[kept - 1], &modifs[i]) == 0)
+		{
+			freeModif(&modifs[i]);
+			continue;
+		}
+		modifs[kept++] = modifs[i];
+	}
+	numModifs = kept;
+}
+
+/**
+ * Unmaps the most recently read file.
+ */
+static void releaseLineIndex(void)
+{
+	if (lineIndex.contents != NULL && munmap(lineIndex.contents, lineIndex.length) != 0)
+	{
+		perror("munmap");
+	}
+	free(lineIndex.file);
+	free(lineIndex.lineStarts);
+	lineIndex.file = NULL;
+	lineIndex.contents = NULL;
+	lineIndex.lineStarts = NULL;
+}
+
+/**
+ * Maps the given file and finds the starts of its lines, unless it is the most
+ * recently read file and hasn't changed since.
+ *
+ * @param file the name of the file
+ * @return whether the file is now mapped
+ */
+static bool indexFile(const char *file)
+{
+	struct stat st;
+	size_t i, capacity;
+	int fd;
+
+	/* open the file */
+	fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		perror("open");
+		return false;
+	}
+
+	if (fstat(fd, &st) != 0)
+	{
+		perror("fstat");
+		(void)close(fd);
+		return false;
+	}
+
+	if (
+		lineIndex.file != NULL &&
+		strcmp(lineIndex.file, file) == 0 &&
+		lineIndex.dev == st.st_dev &&
+		lineIndex.ino == st.st_ino &&
+		lineIndex.length == (size_t)st.st_size &&
+		lineIndex.mtime.tv_sec == st.st_mtim.tv_sec &&
+		lineIndex.mtime.tv_nsec == st.st_mtim.tv_nsec
+	)
+	{
+		/* still the same */
+		(void)close(fd);
+		return true;
+	}
+
+	releaseLineIndex();
+
+	lineIndex.dev = st.st_dev;
+	lineIndex.ino = st.st_ino;
+	lineIndex.mtime = st.st_mtim;
+	lineIndex.length = (size_t)st.st_size;
+
+	/* map it into memory */
+	if (lineIndex.length > 0)
+	{
+		lineIndex.contents = mmap(NULL, lineIndex.length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (lineIndex.contents == MAP_FAILED)
+		{
+			perror("mmap");
+			lineIndex.contents = NULL;
+			(void)close(fd);
+			return false;
+		}
+	}
+	if (close(fd) != 0)
+	{
+		perror("close");
+	}
+
+	/* find the starts of the lines */
+	capacity = 64;
+	lineIndex.lineStarts = malloc(capacity * sizeof(size_t));
+	lineIndex.file = strdup(file);
+	if (lineIndex.lineStarts == NULL || lineIndex.file == NULL)
+	{
+		perror("malloc");
+		releaseLineIndex();
+		return false;
+	}
+	lineIndex.lineStarts[0] = 0;
+	lineIndex.numLines = 1;
+
+	for (i = 0; i < lineIndex.length; ++i)
+	{
+		if (lineIndex.contents[i] != '\n')
+		{
+			continue;
+		}
+
+		if (lineIndex.numLines == capacity)
+		{
+			size_t *newStarts = realloc(lineIndex.lineStarts, 2 * capacity * sizeof(size_t));
+			if (newStarts == NULL)
+			{
+				perror("realloc");
+				releaseLineIndex();
+				return false;
+			}
+			lineIndex.lineStarts = newStarts;
+			capacity *= 2;
+		}
+		lineIndex.lineStarts[lineIndex.numLines++] = i + 1;
+	}
+
+	return true;
 }
 
 /**
@@ -223,19 +396,35 @@ static int compareModifs(const void *left, const void *right)
  * @param toadd the modification to add
  * @return whether the add was successful
  */
-static bool addModif(modif_t toadd)
+bool addModif(modif_t toadd)
 {
 	modif_t *newModifs;
+	size_t newCapacity;
+	char *canonical;
 
-	newModifs = realloc(modifs, (numModifs + 1) * sizeof(modif_t));
-	if (newModifs == NULL)
+	/* a header may be named differently by the files including it */
+	canonical = realpath(toadd.file, NULL);
+	if (canonical != NULL)
 	{
-		/* that went belly-up */
-		perror("realloc");
-		return false;
+		free(toadd.file);
+		toadd.file = canonical;
 	}
 
-	modifs = newModifs;
+	if (numModifs == modifsCapacity)
+	{
+		/* double the capacity */
+		newCapacity = (modifsCapacity == 0) ? 64 : (modifsCapacity * 2);
+		newModifs = realloc(modifs, newCapacity * sizeof(modif_t));
+		if (newModifs == NULL)
+		{
+			/* that went belly-up */
+			perror("realloc");
+			return false;
+		}
+
+		modifs = newModifs;
+		modifsCapacity = newCapacity;
+	}
 
 	modifs[numModifs++] = toadd;
 
@@ -251,20 +440,14 @@ void disposeModifs(void)
 
 	for (i = 0; i < numModifs; ++i)
 	{
-		switch (modifs[i].type)
-		{
-			case MODIF_INSERT:
-				free(modifs[i].m.insert.what);
-				break;
-			case MODIF_REMOVE:
-				break;
-		}
-
-		free(modifs[i].file);
+		freeModif(&modifs[i]);
 	}
 
 	free(modifs);
 	modifs = NULL;
+	numModifs = 0;
+	modifsCapacity = 0;
+	releaseLineIndex();
 }
 
 /**
@@ -318,139 +501,82 @@ static bool fetchBoolResponse(void)
  * it when you're done!
  * @param lineslen will contain the length of the lines together
  */
-static void fetchFileLines(const char *file, size_t linenum, size_t linecount, char **lines, size_t *lineslen)
+void fetchFileLines(const char *file, size_t linenum, size_t linecount, char **lines, size_t *lineslen)
 {
-	int fd;
-	char *f;
-	off_t i, filelen, lnstart;
-	size_t ourline = 1;	/*< we're on this line */
-	size_t runlncount;
+	size_t lnstart, lnend;
 
 	assert(linecount > 0);
 
+	*lines = NULL;
 	*lineslen = 0;
 
-	/* open the file */
-	fd = open(file, O_RDONLY | O_CLOEXEC);
-	if (fd == -1)
-	{
-		perror("open");
-		*lines = NULL;
-		*lineslen = 0;
-		return;
-	}
-
-	/* find its length */
-	filelen = lseek(fd, 0, SEEK_END);
-	if (filelen == (off_t)-1)
-	{
-		perror("lseek");
-		(void)close(fd);
-		*lines = NULL;
-		*lineslen = 0;
-		return;
-	}
-
-	if (lseek(fd, 0, SEEK_SET) == (off_t)-1)
+	if (!indexFile(file))
 	{
-		perror("lseek");
-		(void)close(fd);
-		*lines = NULL;
-		*lineslen = 0;
 		return;
 	}
 
-	/* map it into memory */
-	f = mmap(NULL, filelen, PROT_READ, MAP_PRIVATE, fd, 0);
-	if (f == MAP_FAILED)
-	{
-		perror("mmap");
-		(void)close(fd);
-		*lines = NULL;
-		*lineslen = 0;
-		return;
-	}
-
-	/* munge lines */
-	for (i = 0; i < filelen; ++i)
-	{
-		if (f[i] == '\n')
-		{
-			if ((++ourline) == linenum)
-			{
-				/* this is the line where to start. */
-				break;
-			}
-		}
-	}
-
-	if (i >= filelen)
+	if (linenum == 0 || linenum > lineIndex.numLines)
 	{
 		/* line past end of source file O_o */
 		(void)fprintf(stderr, "Line %zu past end of source file %s.\n", linenum, file);
-		(void)munmap(f, filelen);
-		(void)close(fd);
-		*lines = NULL;
-		*lineslen = 0;
 		return;
 	}
 
-	/* skip past the newline we're currently on */
-	++i;
-
-	/* save starting index */
-	lnstart = i;
-
-	/* how long are the lines to return? */
-	*lineslen = 0;
-	runlncount = 1;
-	while (i < filelen)
-	{
-		if (f[i] == '\n')
-		{
-			++runlncount;
-			if (runlncount > linecount)
-			{
-				break;
-			}
-		}
-
-		++(*lineslen);
-		++i;
-	}
+	/* the lines end before the newline ending the last of them */
+	lnstart = lineIndex.lineStarts[linenum - 1];
+	lnend = (linenum - 1 + linecount < lineIndex.numLines)
+		? (lineIndex.lineStarts[linenum - 1 + linecount] - 1)
+		: lineIndex.length;
 
 	/* allocate space for the lines */
+	*lineslen = lnend - lnstart;
 	*lines = malloc(((*lineslen) + 1)*sizeof(char));
 	if (*lines == NULL)
 	{
 		perror("malloc");
-		(void)munmap(f, filelen);
-		(void)close(fd);
-		*lines = NULL;
 		*lineslen = 0;
 		return;
 	}
 
 	/* copy the lines */
-	(void)memcpy(*lines, &f[lnstart], *lineslen);
+	if (*lineslen > 0)
+	{
+		(void)memcpy(*lines, &lineIndex.contents[lnstart], *lineslen);
+	}
 	/* NUL-terminate */
 	(*lines)[*lineslen] = '\0';
 
-	/* clean up */
-	if (munmap(f, filelen) != 0)
-	{
-		perror("munmap");
-	}
-	if (close(fd) != 0)
+	/* it worked out :-) */
+}
+
+/**
+ * Returns a note about the number of macro expansions a finding stands for,
+ * suitable for appending to the description of the finding.
+ *
+ * @param fnd the finding
+ * @param buf buffer in which to store the note, if one is needed
+ * @param bufsize the size of the buffer
+ * @return the note; an empty string if the finding is not within a macro
+ */
+static const char *expansionNote(const finding_t *fnd, char *buf, size_t bufsize)
+{
+	if (fnd->expansions == 0)
 	{
-		perror("close");
+		return "";
 	}
 
-	/* it worked out :-) */
+	(void)snprintf(buf, bufsize, " (within a macro; %zu expansion%s)",
+		fnd->expansions, (fnd->expansions == 1) ? "" : "s"
+	);
+	return buf;
 }
 
-void interactMissingVoid(const char *file, const char *func, module_loc_t loc)
+void interactMissingVoid(const finding_t *fnd)
 {
+	const char *file = fnd->file;
+	const char *func = fnd->func;
+	module_loc_t loc = fnd->start;
+	char notebuf[64];
 	char *line = NULL;
 	size_t linelen = 0;
 
@@ -466,14 +592,14 @@ void interactMissingVoid(const char *file, const char *func, module_loc_t loc)
 	(void)printf(
 		"\n"
 		"File %s, line %zu:\n"
-		"Missing cast to void when calling function '%s'.\n"
+		"Missing cast to void when calling function '%s'%s.\n"
 		"The line, currently:\n"
 		"%s\n"
 		"The line, after its modification:\n"
 		"%.*s(void)%s\n"
 		"Apply fix? (y/n) ",
 		file, loc.line,
-		func,
+		func, expansionNote(fnd, notebuf, sizeof(notebuf)),
 		line,
 		(int)loc.col-1, line, line + loc.col-1
 	);
@@ -503,8 +629,13 @@ void interactMissingVoid(const char *file, const char *func, module_loc_t loc)
 	free(line);
 }
 
-void interactSuperfluousVoid(const char *file, const char *func, module_loc_t start, module_loc_t end)
+void interactSuperfluousVoid(const finding_t *fnd)
 {
+	const char *file = fnd->file;
+	const char *func = fnd->func;
+	module_loc_t start = fnd->start;
+	module_loc_t end = fnd->end;
+	char notebuf[64];
 	char *lines;
 	size_t lineslen;
 	size_t linecount = end.line - start.line + 1;
@@ -543,13 +674,14 @@ void interactSuperfluousVoid(const char *file, const char *func, module_loc_t st
 	(void)printf(
 		"\n"
 		"File %s, lines %zu through %zu:\n"
-		"Superfluous cast to void when calling function '%s'.\n"
+		"Superfluous cast to void when calling function '%s'%s.\n"
 		"The lines, currently:\n"
 		"%s\n"
 		"The lines, after their modification:\n"
 		"%.*s%s\n"
 		"Apply fix? (y/n) ",
-		file, start.line, end.line, func, lines,
+		file, start.line, end.line, func,
+		expansionNote(fnd, notebuf, sizeof(notebuf)), lines,
 		(int)startOffset, lines, lines + endOffset + 1
 	);
 	(void)fflush(stdout);
@@ -704,11 +836,15 @@ void performModifs(void)
 	size_t i;
 	char tmpfn[22];	/* /tmp/voidcasterXXXXXX */
 	int tmpfd;
+	uint64_t traceStart, fileStart = 0;
 	module_loc_t curLoc = {
 		.line = 1,
 		.col = 1
 	};
 
+	/* the files are about to change */
+	releaseLineIndex();
+
 	if (numModifs == 0)
 	{
 		/* nothing to do */
@@ -716,7 +852,10 @@ void performModifs(void)
 	}
 
 	/* first, sort the modifications */
+	traceStart = trace_now();
 	qsort(modifs, numModifs, sizeof(*modifs), compareModifs);
+	dropDuplicateModifs();
+	trace_span("sort modifications", NULL, traceStart);
 
 	for (i = 0; i < numModifs; ++i)
 	{
@@ -739,10 +878,14 @@ void performModifs(void)
 			if (rf != NULL && wf != NULL)
 			{
 				/* replace read file with write file */
+				traceStart = trace_now();
 				overwriteWithBackup(rFn, wFn);
+				trace_span("replace", rFn, traceStart);
+				trace_span("rewrite", rFn, fileStart);
 			}
 
 			/* open the new file for reading */
+			fileStart = trace_now();
 			rFn = modifs[i].file;
 			rf = fopen(rFn, "r");
 			if (rf == NULL)
@@ -835,5 +978,8 @@ void performModifs(void)
 		(void)fclose(wf);
 
 	/* replace read file with write file one last time */
+	traceStart = trace_now();
 	overwriteWithBackup(rFn, wFn);
+	trace_span("replace", rFn, traceStart);
+	trace_span("rewrite", rFn, fileStart);
 }
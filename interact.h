@@ -9,27 +9,88 @@
 #ifndef __INTERACT_H__
 #define __INTERACT_H__
 
+#include <stdbool.h>
+
 #include "shared.h"
 #include "treemunger.h"
 
+/** A modification to be performed on the code. */
+typedef struct modif_s
+{
+	/** The file to modify. */
+	char *file;
+
+	/** The type of the modification. */
+	enum
+	{
+		/** Insert text at a given location. */
+		MODIF_INSERT,
+
+		/** Remove text between two given locations. */
+		MODIF_REMOVE
+	} type;
+
+	/** The pseudopolymorphic union for the types of modification. */
+	union
+	{
+		/** The value of an insertion node. */
+		struct
+		{
+			/** The location where to insert an element. */
+			module_loc_t where;
+
+			/** The text to insert. */
+			char *what;
+		} insert;
+
+		/** The value of a removal node. */
+		struct
+		{
+			/** The inclusive location where the removal starts. */
+			module_loc_t fromWhere;
+
+			/** The inclusive location where the removal ends. */
+			module_loc_t toWhere;
+		} remove;
+	} m;
+} modif_t;
+
 /**
  * Prepares to interactively fix a missing void cast.
  *
- * @param file the name of the file where the cast is missing
- * @param func the name of the function called
- * @param loc the location where the cast should be inserted
+ * @param fnd the finding describing the missing cast
  */
-void interactMissingVoid(const char *file, const char *func, module_loc_t loc);
+void interactMissingVoid(const finding_t *fnd);
 
 /**
  * Prepares to interactively fix a superfluous cast to void.
  *
- * @param file the name of the file containing the cast
- * @param func the name of the function called
- * @param start the location where the cast starts
- * @param end the location where the cast ends
+ * @param fnd the finding describing the superfluous cast
+ */
+void interactSuperfluousVoid(const finding_t *fnd);
+
+/**
+ * Adds a modification to those to be performed.
+ *
+ * @param toadd the modification to add; its strings are freed along with it
+ * @return whether the add was successful
+ */
+bool addModif(modif_t toadd);
+
+/**
+ * Fetches one or more lines of text from the given file.
+ *
+ * On error, the pointer passed in lines will equal NULL and
+ * the line length will be zero.
+ *
+ * @param file the name of the file
+ * @param linenum the 1-based index to the first line to return
+ * @param linecount the number of lines to return
+ * @param lines will point to requested lines of text; don't forget to free()
+ * it when you're done!
+ * @param lineslen will contain the length of the lines together
  */
-void interactSuperfluousVoid(const char *file, const char *func, module_loc_t start, module_loc_t end);
+void fetchFileLines(const char *file, size_t linenum, size_t linecount, char **lines, size_t *lineslen);
 
 /**
  * Disposes of all modifications. Call to clean up.
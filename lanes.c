@@ -0,0 +1,402 @@
+/**
+ * @file lanes.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Priority lanes shared by the Voidcaster processes on a host.
+ * @details All coordination happens through flock(2) on files in the lane
+ * directory, so the kernel releases whatever a process held when it exits,
+ * however it exits. A batch run first tries each slot without blocking,
+ * starting at one chosen by its process ID, and only queues up for that one
+ * if all are taken. Linux doesn't make new shared locks wait for a pending
+ * exclusive one, so a batch run waiting at the gate never holds up an
+ * interactive run.
+ *
+ * The default lane directory is in /tmp if there is no runtime directory, so
+ * other users could create it first or plant symbolic links in it. The
+ * directory must therefore belong to the user and be private to them, and no
+ * symbolic links are followed within it.
+ */
+
+#include "lanes.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/file.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "hash.h"
+#include "metrics.h"
+#include "trace.h"
+
+/** The name of the gate within the lane directory. */
+#define GATE_NAME "interactive.lock"
+
+/* utility functions */
+
+/**
+ * Returns the current value of the monotonic clock.
+ *
+ * @return The current time in seconds.
+ */
+static double monotonicNow(void)
+{
+	struct timespec ts;
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * Closes a file descriptor, keeping errno intact.
+ *
+ * @param fd The file descriptor.
+ */
+static void closeQuietly(int fd)
+{
+	int olderrno = errno;
+	(void)close(fd);
+	errno = olderrno;
+}
+
+/**
+ * Opens a batch slot.
+ *
+ * @param l Pointer to an open lanes structure.
+ * @param slot The index of the slot.
+ * @return The file descriptor, or -1 on failure (setting errno appropriately).
+ */
+static int openSlot(const lanes_t *l, size_t slot)
+{
+	char name[32];
+
+	(void)snprintf(name, sizeof(name), "batch-%zu.lock", slot);
+	return openat(l->dirFd, name, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+}
+
+/**
+ * Takes a batch slot, waiting for one if all are taken.
+ *
+ * @param l Pointer to an open lanes structure; the slot is stored in it.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int takeSlot(lanes_t *l)
+{
+	size_t first = (size_t)getpid() % l->slots;
+	size_t s;
+	int fd;
+
+	for (s = 0; s < l->slots; ++s)
+	{
+		fd = openSlot(l, (first + s) % l->slots);
+		if (fd == -1)
+		{
+			return 0;
+		}
+		if (flock(fd, LOCK_EX | LOCK_NB) == 0)
+		{
+			l->slotFd = fd;
+			return 1;
+		}
+		closeQuietly(fd);
+		if (errno != EWOULDBLOCK)
+		{
+			return 0;
+		}
+	}
+
+	/* all slots are taken; queue up for one */
+	fd = openSlot(l, first);
+	if (fd == -1)
+	{
+		return 0;
+	}
+	if (flock(fd, LOCK_EX) == -1)
+	{
+		closeQuietly(fd);
+		return 0;
+	}
+	l->slotFd = fd;
+	return 1;
+}
+
+/**
+ * Claims the next generation of a file, superseding the interactive runs
+ * which have claimed earlier ones.
+ *
+ * @param l Pointer to an open lanes structure; the generation is stored in it.
+ * @param path The path to the file.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int claimGeneration(lanes_t *l, const char *path)
+{
+	char *real = realpath(path, NULL);
+	uint64_t generation = 0;
+	struct stat st;
+	ssize_t got;
+	int fd;
+
+	/* a file which can't be resolved fails to open later on; its path is as good a name as any */
+	(void)snprintf(l->generationName, sizeof(l->generationName), "file-%016llx.gen",
+		(unsigned long long)hash_string(HASH_INIT, (real != NULL) ? real : path)
+	);
+	free(real);
+
+	for (;;)
+	{
+		fd = openat(l->dirFd, l->generationName, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+		if (fd == -1)
+		{
+			return 0;
+		}
+
+		/* runs started at the same time must still claim different generations */
+		if (flock(fd, LOCK_EX) == -1 || fstat(fd, &st) == -1)
+		{
+			closeQuietly(fd);
+			return 0;
+		}
+		if (st.st_nlink > 0)
+		{
+			break;
+		}
+
+		/* the last run for the file removed it in the meantime; start over */
+		closeQuietly(fd);
+	}
+	got = pread(fd, &generation, sizeof(generation), 0);
+	if (got == -1)
+	{
+		closeQuietly(fd);
+		return 0;
+	}
+	if (got != (ssize_t)sizeof(generation))
+	{
+		/* a new file */
+		generation = 0;
+	}
+	++generation;
+	if (pwrite(fd, &generation, sizeof(generation), 0) != (ssize_t)sizeof(generation))
+	{
+		closeQuietly(fd);
+		return 0;
+	}
+	(void)flock(fd, LOCK_UN);
+
+	l->generationFd = fd;
+	l->generation = generation;
+	return 1;
+}
+
+/**
+ * Releases the generation file of the file analyzed. If no newer run has
+ * claimed a generation of the file, none is analyzing it, so the generation
+ * file is removed to keep the lane directory from growing with every file
+ * ever analyzed. A run which opened the file in the meantime notices that it
+ * has been removed once it gets the lock, and starts over.
+ *
+ * @param l Pointer to a lanes structure holding a generation file.
+ */
+static void releaseGeneration(lanes_t *l)
+{
+	uint64_t generation;
+
+	if (
+		flock(l->generationFd, LOCK_EX) == 0 &&
+		pread(l->generationFd, &generation, sizeof(generation), 0) == (ssize_t)sizeof(generation) &&
+		generation == l->generation
+	)
+	{
+		(void)unlinkat(l->dirFd, l->generationName, 0);
+	}
+
+	/* closing releases the lock */
+	(void)close(l->generationFd);
+	l->generationFd = -1;
+}
+
+/* public-facing functions */
+
+int lanes_open(lanes_t *l, const char *dir, lane_t lane, size_t slots, double slo)
+{
+	struct stat st;
+
+	l->lane = lane;
+	l->dirFd = -1;
+	l->gateFd = -1;
+	l->slots = slots;
+	l->slotFd = -1;
+	l->generationFd = -1;
+	l->generation = 0;
+	l->generationName[0] = '\0';
+	l->slo = slo;
+	l->entered = 0.0;
+	l->admitted = 0.0;
+
+	if (slots == 0)
+	{
+		errno = EINVAL;
+		return 0;
+	}
+
+	if (mkdir(dir, 0700) == -1 && errno != EEXIST)
+	{
+		return 0;
+	}
+	l->dirFd = open(dir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (l->dirFd == -1)
+	{
+		return 0;
+	}
+
+	/* checked on the directory opened, so it can't be swapped in between */
+	if (fstat(l->dirFd, &st) == -1)
+	{
+		closeQuietly(l->dirFd);
+		l->dirFd = -1;
+		return 0;
+	}
+	if (!S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 07777) != 0700)
+	{
+		(void)close(l->dirFd);
+		l->dirFd = -1;
+		errno = EPERM;
+		return 0;
+	}
+
+	l->gateFd = openat(l->dirFd, GATE_NAME, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (l->gateFd == -1)
+	{
+		closeQuietly(l->dirFd);
+		l->dirFd = -1;
+		return 0;
+	}
+
+	if (lane == LANE_BATCH)
+	{
+		/* yield the processor to interactive runs even in the middle of a file; without it, the gate still works */
+		(void)setpriority(PRIO_PROCESS, 0, LANES_BATCH_NICE);
+	}
+	return 1;
+}
+
+void lanes_close(lanes_t *l)
+{
+	if (l->slotFd != -1)
+	{
+		(void)close(l->slotFd);
+		l->slotFd = -1;
+	}
+	if (l->generationFd != -1)
+	{
+		releaseGeneration(l);
+	}
+	if (l->gateFd != -1)
+	{
+		(void)close(l->gateFd);
+		l->gateFd = -1;
+	}
+	if (l->dirFd != -1)
+	{
+		(void)close(l->dirFd);
+		l->dirFd = -1;
+	}
+	l->lane = LANE_NONE;
+}
+
+int lanes_enter(lanes_t *l, const char *path)
+{
+	uint64_t traceStart = trace_now();
+
+	l->entered = monotonicNow();
+
+	if (l->lane == LANE_INTERACTIVE)
+	{
+		if (flock(l->gateFd, LOCK_SH) == -1)
+		{
+			return 0;
+		}
+		if (claimGeneration(l, path) == 0)
+		{
+			int olderrno = errno;
+			(void)flock(l->gateFd, LOCK_UN);
+			errno = olderrno;
+			return 0;
+		}
+	}
+	else
+	{
+		if (takeSlot(l) == 0)
+		{
+			return 0;
+		}
+
+		/* wait until no interactive run is analyzing a file */
+		if (flock(l->gateFd, LOCK_EX) == -1)
+		{
+			closeQuietly(l->slotFd);
+			l->slotFd = -1;
+			return 0;
+		}
+		(void)flock(l->gateFd, LOCK_UN);
+	}
+
+	l->admitted = monotonicNow();
+	metrics_observe(
+		(l->lane == LANE_INTERACTIVE) ? METRIC_INTERACTIVE_WAIT_NS : METRIC_BATCH_WAIT_NS,
+		(uint64_t)((l->admitted - l->entered) * 1e9)
+	);
+	trace_span("wait for lane", path, traceStart);
+	return 1;
+}
+
+bool lanes_superseded(const lanes_t *l)
+{
+	uint64_t generation;
+
+	if (l->generationFd == -1)
+	{
+		return false;
+	}
+
+	/* a torn read is only possible while a newer run is claiming, i.e. once this one has been superseded anyway */
+	return
+		pread(l->generationFd, &generation, sizeof(generation), 0) == (ssize_t)sizeof(generation) &&
+		generation != l->generation;
+}
+
+void lanes_leave(lanes_t *l, bool cancelled)
+{
+	double now = monotonicNow();
+	uint64_t service = (uint64_t)((now - l->admitted) * 1e9);
+
+	if (l->lane == LANE_INTERACTIVE)
+	{
+		metrics_observe(METRIC_INTERACTIVE_SERVICE_NS, service);
+		if (cancelled)
+		{
+			metrics_add(METRIC_CANCELLED, 1);
+		}
+		else if (now - l->entered > l->slo)
+		{
+			metrics_add(METRIC_SLO_MISSES, 1);
+		}
+
+		releaseGeneration(l);
+		(void)flock(l->gateFd, LOCK_UN);
+	}
+	else
+	{
+		metrics_observe(METRIC_BATCH_SERVICE_NS, service);
+
+		/* closing releases the lock */
+		(void)close(l->slotFd);
+		l->slotFd = -1;
+	}
+}
@@ -0,0 +1,146 @@
+/**
+ * @file lanes.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Priority lanes shared by the Voidcaster processes on a host.
+ * @details Editors run Voidcaster on a single file whenever it is saved,
+ * while continuous integration runs it on thousands of files, often on the
+ * same machine. Each run declares its lane: interactive or batch. The lanes
+ * meet in a directory of lock files. An interactive run holds a shared lock
+ * on the gate while it analyzes a file; a batch run waits at the gate before
+ * each file until no interactive run is analyzing one, so an editor never
+ * waits for more than the file a batch run is in the middle of. Batch runs
+ * also lower their scheduling priority and take one of a fixed number of slot
+ * locks per file, which caps how many of them analyze files at once.
+ *
+ * Each interactive run for a file bumps a generation counter kept in a file
+ * named after the file analyzed, which the newest run removes when it is done
+ * with the file. An older run which finds that the counter has
+ * moved on when it is done with the file has been superseded by a newer run
+ * for the same file, whose findings are the ones that matter; it discards its
+ * findings instead of reporting them. A parse in progress can't be aborted,
+ * so the older run still finishes the file it is analyzing.
+ */
+
+#ifndef __LANES_H__
+#define __LANES_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/** The number of batch runs analyzing files at once, unless specified otherwise. */
+#define LANES_DEFAULT_BATCH_JOBS 2
+
+/** The latency an interactive run aims for per file, in seconds, unless specified otherwise. */
+#define LANES_DEFAULT_SLO 0.5
+
+/** How much batch runs lower their scheduling priority (as in nice(1)). */
+#define LANES_BATCH_NICE 10
+
+/** The lane of a run. */
+typedef enum
+{
+	/** The run doesn't take part in scheduling. */
+	LANE_NONE,
+
+	/** An editor waiting for the findings in a few files. */
+	LANE_INTERACTIVE,
+
+	/** A run over many files whose findings nobody is waiting for right away. */
+	LANE_BATCH
+} lane_t;
+
+/** The scheduling state of a run. */
+typedef struct
+{
+	/** The lane of the run. */
+	lane_t lane;
+
+	/** The directory holding the lock files; -1 if not open. */
+	int dirFd;
+
+	/** The gate, locked shared by interactive runs while they analyze a file. */
+	int gateFd;
+
+	/** The number of batch slots. */
+	size_t slots;
+
+	/** The batch slot held while a file is analyzed; -1 if none. */
+	int slotFd;
+
+	/** The generation file of the file being analyzed by an interactive run; -1 if none. */
+	int generationFd;
+
+	/** The generation this run has claimed for the file being analyzed. */
+	uint64_t generation;
+
+	/** The name of the generation file within the lane directory. */
+	char generationName[32];
+
+	/** The latency an interactive run aims for per file, in seconds. */
+	double slo;
+
+	/** When the file being analyzed was entered, in seconds. */
+	double entered;
+
+	/** When the file being analyzed was admitted, in seconds. */
+	double admitted;
+} lanes_t;
+
+/**
+ * Join a lane, creating the directory of lock files if necessary. Batch runs
+ * lower their scheduling priority.
+ *
+ * @param l Pointer to fill with a lanes structure.
+ * @param dir The directory of lock files; the same for all runs which are to
+ * be scheduled together. It must belong to the user and only be accessible by
+ * them (mode 0700); otherwise, errno is set to EPERM.
+ * @param lane The lane to join.
+ * @param slots The number of batch runs analyzing files at once; must be
+ * the same for all batch runs.
+ * @param slo The latency an interactive run aims for per file, in seconds.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int lanes_open(lanes_t *l, const char *dir, lane_t lane, size_t slots, double slo);
+
+/**
+ * Leave the lane.
+ *
+ * @param l Pointer to a lanes structure.
+ */
+void lanes_close(lanes_t *l);
+
+/**
+ * Wait until the file may be analyzed: batch runs wait for a slot and for the
+ * gate, interactive runs claim a new generation of the file. The time waited
+ * is recorded in the metrics of the lane.
+ *
+ * @param l Pointer to an open lanes structure.
+ * @param path The path to the file about to be analyzed.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int lanes_enter(lanes_t *l, const char *path);
+
+/**
+ * Returns whether a newer interactive run has been started for the file
+ * being analyzed.
+ *
+ * @param l Pointer to a lanes structure between lanes_enter() and lanes_leave().
+ * @return true if the findings should be discarded.
+ */
+bool lanes_superseded(const lanes_t *l);
+
+/**
+ * Release what lanes_enter() took. The time spent on the file is recorded in
+ * the metrics of the lane, along with whether it was cancelled and whether it
+ * took longer than the latency aimed for.
+ *
+ * @param l Pointer to a lanes structure after lanes_enter().
+ * @param cancelled Whether the findings were discarded because the run was
+ * superseded.
+ */
+void lanes_leave(lanes_t *l, bool cancelled);
+
+#endif
@@ -0,0 +1,214 @@
+/**
+ * @file libclang.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Loading libclang on demand.
+ * @details Each libclang function used anywhere in the Voidcaster is listed
+ * below; the list expands into a pointer to the function within the library,
+ * the code looking it up and a function of the same name forwarding to it.
+ * Since the definitions have to match the prototypes in the libclang headers,
+ * the compiler catches any mismatch.
+ */
+
+#include "libclang.h"
+
+#include <dlfcn.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <clang-c/Index.h>
+
+/** The libclang found when the Voidcaster was built. */
+#ifndef LIBCLANG_DEFAULT_PATH
+#define LIBCLANG_DEFAULT_PATH "libclang.so"
+#endif
+
+/**
+ * The libclang functions returning a value which are used: return type, name,
+ * parameter list, argument list.
+ */
+#define LIBCLANG_FUNCTIONS(X) \
+	X(CXIndex, clang_createIndex, (int excl, int disp), (excl, disp)) \
+	X(enum CXErrorCode, clang_parseTranslationUnit2FullArgv, \
+		(CXIndex idx, const char *file, const char *const *args, int numArgs, \
+			struct CXUnsavedFile *unsaved, unsigned numUnsaved, unsigned opts, CXTranslationUnit *tu), \
+		(idx, file, args, numArgs, unsaved, numUnsaved, opts, tu)) \
+	X(const char *, clang_getCString, (CXString s), (s)) \
+	X(unsigned, clang_getNumDiagnostics, (CXTranslationUnit tu), (tu)) \
+	X(CXDiagnostic, clang_getDiagnostic, (CXTranslationUnit tu, unsigned i), (tu, i)) \
+	X(enum CXDiagnosticSeverity, clang_getDiagnosticSeverity, (CXDiagnostic d), (d)) \
+	X(CXString, clang_formatDiagnostic, (CXDiagnostic d, unsigned opts), (d, opts)) \
+	X(unsigned, clang_defaultDiagnosticDisplayOptions, (void), ()) \
+	X(CXCursor, clang_getTranslationUnitCursor, (CXTranslationUnit tu), (tu)) \
+	X(CXTranslationUnit, clang_Cursor_getTranslationUnit, (CXCursor c), (c)) \
+	X(CXCursor, clang_getNullCursor, (void), ()) \
+	X(int, clang_Cursor_isNull, (CXCursor c), (c)) \
+	X(enum CXCursorKind, clang_getCursorKind, (CXCursor c), (c)) \
+	X(CXString, clang_getCursorKindSpelling, (enum CXCursorKind k), (k)) \
+	X(CXString, clang_getCursorSpelling, (CXCursor c), (c)) \
+	X(CXString, clang_getCursorDisplayName, (CXCursor c), (c)) \
+	X(CXString, clang_getCursorUSR, (CXCursor c), (c)) \
+	X(CXType, clang_getCursorType, (CXCursor c), (c)) \
+	X(CXType, clang_getCursorResultType, (CXCursor c), (c)) \
+	X(unsigned, clang_equalTypes, (CXType a, CXType b), (a, b)) \
+	X(CXCursor, clang_getCursorReferenced, (CXCursor c), (c)) \
+	X(unsigned, clang_equalCursors, (CXCursor a, CXCursor b), (a, b)) \
+	X(unsigned, clang_hashCursor, (CXCursor c), (c)) \
+	X(CXSourceLocation, clang_getCursorLocation, (CXCursor c), (c)) \
+	X(CXSourceRange, clang_getCursorExtent, (CXCursor c), (c)) \
+	X(CXSourceLocation, clang_getRangeStart, (CXSourceRange r), (r)) \
+	X(CXSourceLocation, clang_getRangeEnd, (CXSourceRange r), (r)) \
+	X(unsigned, clang_equalLocations, (CXSourceLocation a, CXSourceLocation b), (a, b)) \
+	X(CXString, clang_getFileName, (CXFile f), (f)) \
+	X(const char *, clang_getFileContents, (CXTranslationUnit tu, CXFile f, size_t *size), (tu, f, size)) \
+	X(int, clang_Location_isFromMainFile, (CXSourceLocation loc), (loc)) \
+	X(unsigned, clang_visitChildren, (CXCursor parent, CXCursorVisitor visitor, CXClientData data), \
+		(parent, visitor, data)) \
+	X(CXTokenKind, clang_getTokenKind, (CXToken t), (t)) \
+	X(CXString, clang_getTokenSpelling, (CXTranslationUnit tu, CXToken t), (tu, t)) \
+	X(CXSourceLocation, clang_getTokenLocation, (CXTranslationUnit tu, CXToken t), (tu, t)) \
+	X(CXSourceRange, clang_getTokenExtent, (CXTranslationUnit tu, CXToken t), (tu, t))
+
+/** The libclang functions returning nothing which are used. */
+#define LIBCLANG_PROCEDURES(X) \
+	X(void, clang_disposeIndex, (CXIndex idx), (idx)) \
+	X(void, clang_disposeTranslationUnit, (CXTranslationUnit tu), (tu)) \
+	X(void, clang_disposeString, (CXString s), (s)) \
+	X(void, clang_disposeDiagnostic, (CXDiagnostic d), (d)) \
+	X(void, clang_getFileLocation, \
+		(CXSourceLocation loc, CXFile *file, unsigned *line, unsigned *col, unsigned *off), \
+		(loc, file, line, col, off)) \
+	X(void, clang_getSpellingLocation, \
+		(CXSourceLocation loc, CXFile *file, unsigned *line, unsigned *col, unsigned *off), \
+		(loc, file, line, col, off)) \
+	X(void, clang_getPresumedLocation, (CXSourceLocation loc, CXString *file, unsigned *line, unsigned *col), \
+		(loc, file, line, col)) \
+	X(void, clang_getInclusions, (CXTranslationUnit tu, CXInclusionVisitor visitor, CXClientData data), \
+		(tu, visitor, data)) \
+	X(void, clang_tokenize, (CXTranslationUnit tu, CXSourceRange r, CXToken **toks, unsigned *numToks), \
+		(tu, r, toks, numToks)) \
+	X(void, clang_disposeTokens, (CXTranslationUnit tu, CXToken *toks, unsigned numToks), (tu, toks, numToks)) \
+	X(void, clang_annotateTokens, (CXTranslationUnit tu, CXToken *toks, unsigned numToks, CXCursor *curs), \
+		(tu, toks, numToks, curs))
+
+/**
+ * The libclang functions which older versions of libclang lack; check with
+ * libclang_provides() before calling them.
+ */
+#if CINDEX_VERSION_MINOR >= 64
+#define LIBCLANG_OPTIONAL(X) \
+	X(enum CXBinaryOperatorKind, clang_getCursorBinaryOperatorKind, (CXCursor c), (c))
+#else
+#define LIBCLANG_OPTIONAL(X)
+#endif
+
+/** The handle of the loaded library; NULL if it hasn't been loaded yet. */
+static void *handle = NULL;
+
+/* pointers to the functions within the library */
+#define DECLARE_POINTER(ret, name, params, args) static ret (*p_##name) params = NULL;
+LIBCLANG_FUNCTIONS(DECLARE_POINTER)
+LIBCLANG_PROCEDURES(DECLARE_POINTER)
+LIBCLANG_OPTIONAL(DECLARE_POINTER)
+#undef DECLARE_POINTER
+
+/* the functions forwarding to the library */
+#define DEFINE_FUNCTION(ret, name, params, args) ret name params { return p_##name args; }
+#define DEFINE_PROCEDURE(ret, name, params, args) ret name params { p_##name args; }
+LIBCLANG_FUNCTIONS(DEFINE_FUNCTION)
+LIBCLANG_PROCEDURES(DEFINE_PROCEDURE)
+LIBCLANG_OPTIONAL(DEFINE_FUNCTION)
+#undef DEFINE_FUNCTION
+#undef DEFINE_PROCEDURE
+
+/**
+ * Looks up the functions in the library.
+ *
+ * @param lib the handle of the library
+ * @param err on failure, will be set to a description of the problem
+ * @return 1 on success, 0 if a required function is missing
+ */
+static int resolve(void *lib, const char **err)
+{
+	/* the dance through void ** is the way POSIX suggests to obtain function pointers */
+#define RESOLVE_REQUIRED(ret, name, params, args) \
+	*(void **)(&p_##name) = dlsym(lib, #name); \
+	if (p_##name == NULL) \
+	{ \
+		*err = dlerror(); \
+		return 0; \
+	}
+#define RESOLVE_OPTIONAL(ret, name, params, args) \
+	*(void **)(&p_##name) = dlsym(lib, #name);
+
+	LIBCLANG_FUNCTIONS(RESOLVE_REQUIRED)
+	LIBCLANG_PROCEDURES(RESOLVE_REQUIRED)
+	LIBCLANG_OPTIONAL(RESOLVE_OPTIONAL)
+
+#undef RESOLVE_REQUIRED
+#undef RESOLVE_OPTIONAL
+
+	return 1;
+}
+
+int libclang_load(const char *path, const char **err)
+{
+	void *lib;
+
+	if (handle != NULL)
+	{
+		return 1;
+	}
+
+	/*
+	 * libclang parses on a thread of its own with a fixed 8 MiB stack unless
+	 * told otherwise; the Voidcaster provides a thread with a deeper stack.
+	 */
+	(void)setenv("LIBCLANG_NOTHREADS", "1", 1);
+
+	if (path != NULL)
+	{
+		lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	}
+	else
+	{
+		lib = dlopen(LIBCLANG_DEFAULT_PATH, RTLD_NOW | RTLD_LOCAL);
+		if (lib == NULL)
+		{
+			lib = dlopen("libclang.so", RTLD_NOW | RTLD_LOCAL);
+		}
+	}
+
+	if (lib == NULL)
+	{
+		*err = dlerror();
+		return 0;
+	}
+
+	if (resolve(lib, err) == 0)
+	{
+		(void)dlclose(lib);
+		return 0;
+	}
+
+	handle = lib;
+	return 1;
+}
+
+bool libclang_provides(const char *name)
+{
+#define CHECK_OPTIONAL(ret, fname, params, args) \
+	if (strcmp(name, #fname) == 0) \
+	{ \
+		return (p_##fname != NULL); \
+	}
+
+	LIBCLANG_OPTIONAL(CHECK_OPTIONAL)
+
+#undef CHECK_OPTIONAL
+
+	/* the required functions are always there; unknown ones never are */
+	return (handle != NULL && dlsym(handle, name) != NULL);
+}
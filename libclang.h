@@ -0,0 +1,39 @@
+/**
+ * @file libclang.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Loading libclang on demand.
+ * @details The Voidcaster isn't linked against libclang; instead, it defines
+ * the libclang functions it uses itself, forwarding each call to the library
+ * once it has been loaded with libclang_load(). Invocations which never parse
+ * anything thus don't pay for loading the library, and the library to use can
+ * be chosen at run time.
+ */
+
+#ifndef __LIBCLANG_H__
+#define __LIBCLANG_H__
+
+#include <stdbool.h>
+
+/**
+ * Load libclang, unless it has been loaded already. No libclang function may be
+ * called before it has been loaded successfully.
+ *
+ * @param path The path to the library, or NULL to try the library found when
+ * the Voidcaster was built, then whichever libclang the dynamic linker finds.
+ * @param err On failure, will be set to a description of the problem.
+ * @return 1 on success, 0 on failure.
+ */
+int libclang_load(const char *path, const char **err);
+
+/**
+ * Returns whether the loaded libclang provides a function which is optional
+ * because older versions of libclang lack it.
+ *
+ * @param name The name of the function.
+ * @return true if the function may be called
+ */
+bool libclang_provides(const char *name);
+
+#endif
@@ -0,0 +1,437 @@
+/**
+ * @file metrics.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Counters, gauges and histograms of the work done, exported in the
+ * OpenMetrics text format.
+ */
+
+#include "metrics.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/resource.h>
+
+#include "outfile.h"
+
+/** The number of buckets of each histogram with an upper bound (i.e. not counting +Inf). */
+#define METRICS_BOUNDS 18
+
+/** Description of a counter. */
+typedef struct
+{
+	/** The name of the metric family the counter belongs to. */
+	const char *family;
+
+	/** The label distinguishing the counter within its family, or NULL. */
+	const char *label;
+
+	/** The description of the family. */
+	const char *help;
+} counter_desc;
+
+/** Description of a gauge. */
+typedef struct
+{
+	/** The name of the metric. */
+	const char *name;
+
+	/** The unit of the metric, or NULL. */
+	const char *unit;
+
+	/** The description of the metric. */
+	const char *help;
+} gauge_desc;
+
+/** Description of a histogram. */
+typedef struct
+{
+	/** The name of the metric. */
+	const char *name;
+
+	/** The unit in which the metric is exported. */
+	const char *unit;
+
+	/** The description of the metric. */
+	const char *help;
+
+	/** The upper bound of the first bucket, in the unit of observation. */
+	uint64_t firstBound;
+
+	/** The number of units of observation per exported unit. */
+	double exportScale;
+
+	/** The short name shown in the summary. */
+	const char *shortName;
+
+	/** The unit shown in the summary. */
+	const char *summaryUnit;
+
+	/** The number of units of observation per unit shown in the summary. */
+	double summaryScale;
+} histogram_desc;
+
+/** The counters, in the order of metrics_counter_t. */
+static const counter_desc counterDescs[METRIC_COUNTERS] = {
+	{ "voidcaster_files", NULL, "Files analyzed, once per configuration." },
+	{ "voidcaster_failures", NULL, "Files which failed to parse or contained errors." },
+	{ "voidcaster_findings", "kind=\"missing\"", "Casts to void found to be missing or superfluous." },
+	{ "voidcaster_findings", "kind=\"superfluous\"", NULL },
+	{ "voidcaster_cursors", NULL, "Cursors visited while traversing syntax trees." },
+	{ "voidcaster_dedup_lookups", "result=\"hit\"", "Lookups of files with identical contents analyzed earlier." },
+	{ "voidcaster_dedup_lookups", "result=\"miss\"", NULL },
+	{ "voidcaster_shared_cache_lookups", "result=\"hit\"", "Lookups of findings in the cache shared between processes." },
+	{ "voidcaster_shared_cache_lookups", "result=\"miss\"", NULL },
+	{ "voidcaster_cancellations", NULL, "Files whose findings were discarded because a newer run for the same file was started." },
+	{ "voidcaster_slo_misses", NULL, "Files an interactive run took longer than the latency aimed for on." }
+};
+
+/** The gauges, in the order of metrics_gauge_t. */
+static const gauge_desc gaugeDescs[METRIC_GAUGES] = {
+	{ "voidcaster_files_queued", NULL, "Files not analyzed yet." },
+	{ "voidcaster_resident_bytes", "bytes", "Resident set size of the process." },
+	{ "voidcaster_peak_resident_bytes", "bytes", "Peak resident set size of the process." }
+};
+
+/** The histograms, in the order of metrics_histogram_t. */
+static const histogram_desc histogramDescs[METRIC_HISTOGRAMS] = {
+	{
+		"voidcaster_parse_seconds", "seconds", "Time spent parsing a file.",
+		UINT64_C(1000000), 1e9, "parse", "ms", 1e6
+	},
+	{
+		"voidcaster_traverse_seconds", "seconds", "Time spent traversing the syntax tree of a file.",
+		UINT64_C(100000), 1e9, "traverse", "ms", 1e6
+	},
+	{
+		"voidcaster_tu_resident_bytes", "bytes", "Resident set size while a translation unit is loaded.",
+		UINT64_C(16) * 1024 * 1024, 1.0, "TU memory", "MiB", 1024.0 * 1024.0
+	},
+	{
+		"voidcaster_interactive_wait_seconds", "seconds", "Time an interactive run waited before analyzing a file.",
+		UINT64_C(100000), 1e9, "int. wait", "ms", 1e6
+	},
+	{
+		"voidcaster_interactive_service_seconds", "seconds", "Time an interactive run spent analyzing a file.",
+		UINT64_C(1000000), 1e9, "int. serv.", "ms", 1e6
+	},
+	{
+		"voidcaster_batch_wait_seconds", "seconds", "Time a batch run waited for a slot and the gate before analyzing a file.",
+		UINT64_C(100000), 1e9, "batch wait", "ms", 1e6
+	},
+	{
+		"voidcaster_batch_service_seconds", "seconds", "Time a batch run spent analyzing a file.",
+		UINT64_C(1000000), 1e9, "batch serv.", "ms", 1e6
+	}
+};
+
+/** The values of the counters. */
+static atomic_uint_fast64_t counters[METRIC_COUNTERS];
+
+/** The values of the gauges. */
+static atomic_uint_fast64_t gauges[METRIC_GAUGES];
+
+/** The values of a histogram. */
+typedef struct
+{
+	/** The number of observations in each bucket (not cumulative). */
+	atomic_uint_fast64_t buckets[METRICS_BOUNDS + 1];
+
+	/** The number of observations. */
+	atomic_uint_fast64_t count;
+
+	/** The sum of the observations. */
+	atomic_uint_fast64_t sum;
+
+	/** The smallest observation plus one; 0 if nothing has been observed. */
+	atomic_uint_fast64_t minPlusOne;
+
+	/** The largest observation. */
+	atomic_uint_fast64_t max;
+} histogram_values;
+
+/** The values of the histograms. */
+static histogram_values histograms[METRIC_HISTOGRAMS];
+
+/* utility functions */
+
+/**
+ * Returns the upper bound of a bucket of a histogram.
+ *
+ * @param which The histogram.
+ * @param bucket The index of the bucket; less than METRICS_BOUNDS.
+ * @return The upper bound, in the unit of observation.
+ */
+static inline uint64_t bound(metrics_histogram_t which, size_t bucket)
+{
+	return histogramDescs[which].firstBound << bucket;
+}
+
+/**
+ * Writes the metrics to a stream.
+ *
+ * @param out The stream to write to.
+ */
+static void writeMetrics(FILE *out)
+{
+	size_t i, b;
+	const char *family = NULL;
+
+	for (i = 0; i < METRIC_COUNTERS; ++i)
+	{
+		const counter_desc *desc = &counterDescs[i];
+
+		if (family == NULL || strcmp(family, desc->family) != 0)
+		{
+			family = desc->family;
+			(void)fprintf(out, "# TYPE %s counter\n# HELP %s %s\n", family, family, desc->help);
+		}
+
+		if (desc->label != NULL)
+		{
+			(void)fprintf(out, "%s_total{%s} %llu\n",
+				family, desc->label, (unsigned long long)atomic_load(&counters[i])
+			);
+		}
+		else
+		{
+			(void)fprintf(out, "%s_total %llu\n", family, (unsigned long long)atomic_load(&counters[i]));
+		}
+	}
+
+	for (i = 0; i < METRIC_GAUGES; ++i)
+	{
+		const gauge_desc *desc = &gaugeDescs[i];
+
+		(void)fprintf(out, "# TYPE %s gauge\n", desc->name);
+		if (desc->unit != NULL)
+		{
+			(void)fprintf(out, "# UNIT %s %s\n", desc->name, desc->unit);
+		}
+		(void)fprintf(out, "# HELP %s %s\n%s %llu\n",
+			desc->name, desc->help, desc->name, (unsigned long long)atomic_load(&gauges[i])
+		);
+	}
+
+	for (i = 0; i < METRIC_HISTOGRAMS; ++i)
+	{
+		const histogram_desc *desc = &histogramDescs[i];
+		histogram_values *vals = &histograms[i];
+		uint64_t cumulative = 0;
+
+		(void)fprintf(out, "# TYPE %s histogram\n# UNIT %s %s\n# HELP %s %s\n",
+			desc->name, desc->name, desc->unit, desc->name, desc->help
+		);
+		for (b = 0; b < METRICS_BOUNDS; ++b)
+		{
+			cumulative += atomic_load(&vals->buckets[b]);
+			(void)fprintf(out, "%s_bucket{le=\"%g\"} %llu\n",
+				desc->name, (double)bound((metrics_histogram_t)i, b) / desc->exportScale, (unsigned long long)cumulative
+			);
+		}
+		cumulative += atomic_load(&vals->buckets[METRICS_BOUNDS]);
+		(void)fprintf(out, "%s_bucket{le=\"+Inf\"} %llu\n", desc->name, (unsigned long long)cumulative);
+		(void)fprintf(out, "%s_sum %g\n%s_count %llu\n",
+			desc->name, (double)atomic_load(&vals->sum) / desc->exportScale,
+			desc->name, (unsigned long long)atomic_load(&vals->count)
+		);
+	}
+
+	(void)fputs("# EOF\n", out);
+}
+
+/* public-facing functions */
+
+void metrics_add(metrics_counter_t which, uint64_t n)
+{
+	(void)atomic_fetch_add_explicit(&counters[which], n, memory_order_relaxed);
+}
+
+void metrics_set(metrics_gauge_t which, uint64_t value)
+{
+	atomic_store_explicit(&gauges[which], value, memory_order_relaxed);
+}
+
+void metrics_observe(metrics_histogram_t which, uint64_t value)
+{
+	histogram_values *vals = &histograms[which];
+	uint_fast64_t old;
+	size_t b = 0;
+
+	while (b < METRICS_BOUNDS && value > bound(which, b))
+	{
+		++b;
+	}
+
+	(void)atomic_fetch_add_explicit(&vals->buckets[b], 1, memory_order_relaxed);
+	(void)atomic_fetch_add_explicit(&vals->sum, value, memory_order_relaxed);
+	(void)atomic_fetch_add_explicit(&vals->count, 1, memory_order_relaxed);
+
+	old = atomic_load_explicit(&vals->minPlusOne, memory_order_relaxed);
+	while (
+		(old == 0 || value + 1 < old) &&
+		!atomic_compare_exchange_weak_explicit(&vals->minPlusOne, &old, value + 1, memory_order_relaxed, memory_order_relaxed)
+	)
+	{
+		/* the failed exchange has read the current value; compare again */
+	}
+	old = atomic_load_explicit(&vals->max, memory_order_relaxed);
+	while (
+		value > old &&
+		!atomic_compare_exchange_weak_explicit(&vals->max, &old, value, memory_order_relaxed, memory_order_relaxed)
+	)
+	{
+		/* the failed exchange has read the current value; compare again */
+	}
+}
+
+uint64_t metrics_sampleResident(void)
+{
+	FILE *statm;
+	unsigned long size, resident;
+	uint64_t bytes = 0;
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+	{
+		/* in kilobytes */
+		metrics_set(METRIC_PEAK_RESIDENT_BYTES, (uint64_t)usage.ru_maxrss * 1024);
+	}
+
+	statm = fopen("/proc/self/statm", "r");
+	if (statm == NULL)
+	{
+		return 0;
+	}
+	if (fscanf(statm, "%lu %lu", &size, &resident) == 2)
+	{
+		bytes = (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+		metrics_set(METRIC_RESIDENT_BYTES, bytes);
+	}
+	(void)fclose(statm);
+	return bytes;
+}
+
+double metrics_quantile(metrics_histogram_t which, double q)
+{
+	histogram_values *vals = &histograms[which];
+	uint64_t counts[METRICS_BOUNDS + 1];
+	uint64_t total = 0, seen = 0;
+	double rank, estimate, min, max;
+	size_t b;
+
+	/* take a snapshot so the counts add up */
+	for (b = 0; b <= METRICS_BOUNDS; ++b)
+	{
+		counts[b] = atomic_load(&vals->buckets[b]);
+		total += counts[b];
+	}
+	if (total == 0)
+	{
+		return 0.0;
+	}
+
+	rank = q * (double)total;
+	for (b = 0; b < METRICS_BOUNDS; ++b)
+	{
+		if ((double)(seen + counts[b]) >= rank && counts[b] > 0)
+		{
+			break;
+		}
+		seen += counts[b];
+	}
+
+	if (b < METRICS_BOUNDS)
+	{
+		double lower = (b == 0) ? 0.0 : (double)bound(which, b - 1);
+		double upper = (double)bound(which, b);
+		estimate = lower + (upper - lower) * (rank - (double)seen) / (double)counts[b];
+	}
+	else
+	{
+		/* beyond the last bound; the best we can say is that it's at least that */
+		estimate = (double)bound(which, METRICS_BOUNDS - 1);
+	}
+
+	/* the values observed can't lie outside the buckets, but the interpolation can */
+	min = (double)(atomic_load(&vals->minPlusOne) - 1);
+	max = (double)atomic_load(&vals->max);
+	if (estimate < min)
+	{
+		estimate = min;
+	}
+	if (estimate > max)
+	{
+		estimate = max;
+	}
+	return estimate;
+}
+
+int metrics_write(const char *path)
+{
+	outfile_t of;
+
+	/* a scraper must never see a half-written file, nor may two runs sharing it mix theirs */
+	if (outfile_open(&of, path) == 0)
+	{
+		return 0;
+	}
+
+	writeMetrics(of.f);
+	return outfile_close(&of, true);
+}
+
+void metrics_summary(FILE *out)
+{
+	size_t i;
+	uint64_t sharedHits = atomic_load(&counters[METRIC_SHARED_HITS]);
+	uint64_t sharedMisses = atomic_load(&counters[METRIC_SHARED_MISSES]);
+	uint64_t cancelled = atomic_load(&counters[METRIC_CANCELLED]);
+	uint64_t sloMisses = atomic_load(&counters[METRIC_SLO_MISSES]);
+
+	(void)fprintf(out,
+		"Metrics: %llu files, %llu cursors, %llu failed; %llu missing and %llu superfluous casts; %llu dedup hits, %llu misses",
+		(unsigned long long)atomic_load(&counters[METRIC_FILES]),
+		(unsigned long long)atomic_load(&counters[METRIC_CURSORS]),
+		(unsigned long long)atomic_load(&counters[METRIC_FAILURES]),
+		(unsigned long long)atomic_load(&counters[METRIC_FINDINGS_MISSING]),
+		(unsigned long long)atomic_load(&counters[METRIC_FINDINGS_SUPERFLUOUS]),
+		(unsigned long long)atomic_load(&counters[METRIC_DEDUP_HITS]),
+		(unsigned long long)atomic_load(&counters[METRIC_DEDUP_MISSES])
+	);
+	if (sharedHits + sharedMisses > 0)
+	{
+		(void)fprintf(out, "; %llu shared cache hits, %llu misses",
+			(unsigned long long)sharedHits, (unsigned long long)sharedMisses
+		);
+	}
+	if (cancelled + sloMisses > 0)
+	{
+		(void)fprintf(out, "; %llu cancelled, %llu over the latency aimed for",
+			(unsigned long long)cancelled, (unsigned long long)sloMisses
+		);
+	}
+	(void)fputs("\n", out);
+
+	for (i = 0; i < METRIC_HISTOGRAMS; ++i)
+	{
+		const histogram_desc *desc = &histogramDescs[i];
+		uint64_t count = atomic_load(&histograms[i].count);
+
+		if (count == 0)
+		{
+			continue;
+		}
+		(void)fprintf(out, "  %-11s p50 %10.3f %-3s  p99 %10.3f %-3s  mean %10.3f %-3s  (%llu)\n",
+			desc->shortName,
+			metrics_quantile((metrics_histogram_t)i, 0.5) / desc->summaryScale, desc->summaryUnit,
+			metrics_quantile((metrics_histogram_t)i, 0.99) / desc->summaryScale, desc->summaryUnit,
+			(double)atomic_load(&histograms[i].sum) / (double)count / desc->summaryScale, desc->summaryUnit,
+			(unsigned long long)count
+		);
+	}
+}
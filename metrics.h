@@ -0,0 +1,164 @@
+/**
+ * @file metrics.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Counters, gauges and histograms of the work done, exported in the
+ * OpenMetrics text format.
+ * @details All metrics are updated with atomic operations only, so they may be
+ * updated from any thread without taking a lock. Histograms have fixed,
+ * exponentially growing buckets; quantiles are estimated from them.
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** The counters. */
+typedef enum
+{
+	/** Files analyzed (per configuration). */
+	METRIC_FILES,
+
+	/** Files which failed to parse or had errors. */
+	METRIC_FAILURES,
+
+	/** Missing casts to void found. */
+	METRIC_FINDINGS_MISSING,
+
+	/** Superfluous casts to void found. */
+	METRIC_FINDINGS_SUPERFLUOUS,
+
+	/** Cursors visited while traversing syntax trees. */
+	METRIC_CURSORS,
+
+	/** Files whose findings were taken from an identical file analyzed earlier. */
+	METRIC_DEDUP_HITS,
+
+	/** Files which had to be analyzed because no identical file was analyzed earlier. */
+	METRIC_DEDUP_MISSES,
+
+	/** Files whose findings were taken from the shared cache. */
+	METRIC_SHARED_HITS,
+
+	/** Files which had to be analyzed because the shared cache had no valid entry. */
+	METRIC_SHARED_MISSES,
+
+	/** Files whose findings were discarded because a newer run for the same file was started. */
+	METRIC_CANCELLED,
+
+	/** Files an interactive run took longer than the latency aimed for on. */
+	METRIC_SLO_MISSES,
+
+	/** The number of counters. */
+	METRIC_COUNTERS
+} metrics_counter_t;
+
+/** The gauges. */
+typedef enum
+{
+	/** Files not yet analyzed. */
+	METRIC_QUEUE_DEPTH,
+
+	/** The resident set size of the process. */
+	METRIC_RESIDENT_BYTES,
+
+	/** The peak resident set size of the process. */
+	METRIC_PEAK_RESIDENT_BYTES,
+
+	/** The number of gauges. */
+	METRIC_GAUGES
+} metrics_gauge_t;
+
+/** The histograms. */
+typedef enum
+{
+	/** Time spent parsing a file, in nanoseconds. */
+	METRIC_PARSE_NS,
+
+	/** Time spent traversing a file, in nanoseconds. */
+	METRIC_TRAVERSE_NS,
+
+	/** Resident set size while a translation unit is loaded, in bytes. */
+	METRIC_TU_RESIDENT_BYTES,
+
+	/** Time an interactive run waited before analyzing a file, in nanoseconds. */
+	METRIC_INTERACTIVE_WAIT_NS,
+
+	/** Time an interactive run spent analyzing a file, in nanoseconds. */
+	METRIC_INTERACTIVE_SERVICE_NS,
+
+	/** Time a batch run waited for a slot and the gate before analyzing a file, in nanoseconds. */
+	METRIC_BATCH_WAIT_NS,
+
+	/** Time a batch run spent analyzing a file, in nanoseconds. */
+	METRIC_BATCH_SERVICE_NS,
+
+	/** The number of histograms. */
+	METRIC_HISTOGRAMS
+} metrics_histogram_t;
+
+/**
+ * Add to a counter.
+ *
+ * @param which The counter.
+ * @param n The amount to add.
+ */
+void metrics_add(metrics_counter_t which, uint64_t n);
+
+/**
+ * Set a gauge.
+ *
+ * @param which The gauge.
+ * @param value The new value.
+ */
+void metrics_set(metrics_gauge_t which, uint64_t value);
+
+/**
+ * Record an observation in a histogram.
+ *
+ * @param which The histogram.
+ * @param value The value observed, in the unit of the histogram.
+ */
+void metrics_observe(metrics_histogram_t which, uint64_t value);
+
+/**
+ * Set the resident set size gauges to the current and peak resident set size
+ * of the process.
+ *
+ * @return The resident set size in bytes; 0 if it can't be determined.
+ */
+uint64_t metrics_sampleResident(void);
+
+/**
+ * Estimate a quantile of a histogram by interpolating within the bucket it
+ * falls into, but not beyond the smallest and largest values observed.
+ *
+ * @param which The histogram.
+ * @param q The quantile, between 0 and 1.
+ * @return The estimated quantile in the unit of the histogram; 0 if nothing
+ * has been observed.
+ */
+double metrics_quantile(metrics_histogram_t which, double q);
+
+/**
+ * Write all metrics in the OpenMetrics text format. The file is written next
+ * to its final location and then renamed, so that a scraper reading it never
+ * sees a partial file.
+ *
+ * @param path The path to the file to (over)write.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int metrics_write(const char *path);
+
+/**
+ * Output a summary of the histograms (count, p50 and p99) and the counters.
+ *
+ * @param out The stream to write to.
+ */
+void metrics_summary(FILE *out);
+
+#endif
@@ -69,6 +69,18 @@ void msa_destroy(msa_t *msa)
 	msa->arr = NULL;
 }
 
+void msa_clear(msa_t *msa)
+{
+	size_t i;
+
+	/* free all strings */
+	for (i = 0; i < msa->count; ++i)
+	{
+		free(msa->arr[i]);
+	}
+	msa->count = 0;
+}
+
 int msa_add(msa_t *msa, const char *str)
 {
 	char *dupedstr;
@@ -42,6 +42,13 @@ int msa_create(msa_t *msa);
  */
 void msa_destroy(msa_t *msa);
 
+/**
+ * Remove all strings from a Magical String Array, keeping its capacity.
+ *
+ * @param msa Pointer to a MSA structure.
+ */
+void msa_clear(msa_t *msa);
+
 /**
  * Add a duplicate of a string to the end of a Magical String Array.
  *
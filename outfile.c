@@ -0,0 +1,99 @@
+/**
+ * @file outfile.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Output files which replace their predecessors at once.
+ */
+
+#include "outfile.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+/** The suffix of a temporary file's name, replaced by mkstemp(3). */
+#define TMP_SUFFIX ".XXXXXX"
+
+/* public-facing functions */
+
+int outfile_open(outfile_t *of, const char *path)
+{
+	size_t len = strlen(path);
+	int fd, olderrno;
+
+	of->f = NULL;
+	of->tmpPath = NULL;
+	of->path = strdup(path);
+	if (of->path == NULL)
+	{
+		return 0;
+	}
+
+	/* next to the file, so that it can be renamed over it */
+	of->tmpPath = malloc(len + sizeof(TMP_SUFFIX));
+	if (of->tmpPath == NULL)
+	{
+		free(of->path);
+		of->path = NULL;
+		return 0;
+	}
+	(void)memcpy(of->tmpPath, path, len);
+	(void)memcpy(of->tmpPath + len, TMP_SUFFIX, sizeof(TMP_SUFFIX));
+
+	fd = mkstemp(of->tmpPath);
+	if (fd != -1)
+	{
+		/* mkstemp(3) only lets the owner read the file */
+		(void)fchmod(fd, OUTFILE_MODE);
+		of->f = fdopen(fd, "w");
+		if (of->f == NULL)
+		{
+			olderrno = errno;
+			(void)close(fd);
+			(void)unlink(of->tmpPath);
+			errno = olderrno;
+		}
+	}
+
+	if (of->f == NULL)
+	{
+		olderrno = errno;
+		free(of->tmpPath);
+		free(of->path);
+		of->tmpPath = NULL;
+		of->path = NULL;
+		errno = olderrno;
+		return 0;
+	}
+	return 1;
+}
+
+int outfile_close(outfile_t *of, bool keep)
+{
+	int olderrno;
+	bool ok = keep && !ferror(of->f);
+
+	if (fclose(of->f) != 0)
+	{
+		ok = false;
+	}
+	ok = ok && (rename(of->tmpPath, of->path) == 0);
+
+	olderrno = errno;
+	if (!ok)
+	{
+		(void)unlink(of->tmpPath);
+	}
+	free(of->tmpPath);
+	free(of->path);
+	of->f = NULL;
+	of->tmpPath = NULL;
+	of->path = NULL;
+	errno = olderrno;
+
+	return ok ? 1 : 0;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file outfile.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Output files which replace their predecessors at once.
+ * @details The contents are written to a uniquely named temporary file in
+ * the same directory, which is then renamed over the file. Readers see
+ * either the old or the new contents, never a mix; concurrent writers each
+ * write their own temporary file, and the last one renamed wins.
+ */
+
+#ifndef __OUTFILE_H__
+#define __OUTFILE_H__
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/** The permissions of a replaced file; the umask doesn't apply. */
+#define OUTFILE_MODE 0644
+
+/** An output file being written. */
+typedef struct
+{
+	/** The stream to write the contents to. */
+	FILE *f;
+
+	/** The path to the file to be replaced. */
+	char *path;
+
+	/** The path to the temporary file. */
+	char *tmpPath;
+} outfile_t;
+
+/**
+ * Start writing a file.
+ *
+ * @param of Pointer to fill with an output file structure.
+ * @param path The path to the file to be replaced.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int outfile_open(outfile_t *of, const char *path);
+
+/**
+ * Finish writing a file. If keep is true and the contents were written
+ * without errors, the file is replaced; otherwise, the temporary file is
+ * removed and the file stays as it was.
+ *
+ * @param of Pointer to an open output file structure; it is destroyed.
+ * @param keep Whether to replace the file with the contents written.
+ * @return 1 if the file was replaced, 0 otherwise (setting errno
+ * appropriately if keep was true).
+ */
+int outfile_close(outfile_t *of, bool keep);
+
+#endif
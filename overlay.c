@@ -0,0 +1,549 @@
+/**
+ * @file overlay.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief In-memory overlay of header files.
+ * @details A pack consists of a header followed by one record per file: the
+ * length of the name (including its NUL), the length of the contents, the
+ * name and the contents. All numbers are stored in host byte order.
+ */
+
+#include "overlay.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "outfile.h"
+
+/** The magic bytes at the beginning of a pack. */
+static const char PACK_MAGIC[8] = { 'V', 'C', 'O', 'V', 'L', 'P', 'K', '1' };
+
+/** Default overlay capacity. */
+static const size_t DEFAULT_CAPACITY = 64;
+
+/* utility functions */
+
+/**
+ * Compares two unsaved files by their name. Useful for qsort(3).
+ *
+ * @param left Pointer to the first file.
+ * @param right Pointer to the second file.
+ * @return As strcmp(3).
+ */
+static int comparator_unsaved(const void *left, const void *right)
+{
+	const struct CXUnsavedFile *l = (const struct CXUnsavedFile *)left;
+	const struct CXUnsavedFile *r = (const struct CXUnsavedFile *)right;
+	return strcmp(l->Filename, r->Filename);
+}
+
+/**
+ * Returns whether a pointer points into the pack an overlay was loaded from.
+ *
+ * @param ov Pointer to an overlay structure.
+ * @param ptr The pointer.
+ * @return true if the pointer points into the pack
+ */
+static inline bool inPack(const overlay_t *ov, const void *ptr)
+{
+	const char *p = (const char *)ptr;
+	const char *map = (const char *)ov->map;
+	return (map != NULL && p >= map && p < map + ov->mapSize);
+}
+
+/**
+ * Adds a file to an overlay.
+ *
+ * @param ov Pointer to an overlay structure.
+ * @param name The name of the file; taken over by the overlay.
+ * @param contents The contents of the file; taken over by the overlay.
+ * @param length The length of the contents.
+ * @return 1 on success, 0 on failure (setting errno appropriately; the name
+ * and contents are not taken over).
+ */
+static int addFile(overlay_t *ov, const char *name, const char *contents, size_t length)
+{
+	if (ov->count >= ov->capacity)
+	{
+		/* not enough space; double the capacity */
+		struct CXUnsavedFile *newarr;
+		size_t newcap = (ov->capacity == 0) ? DEFAULT_CAPACITY : (ov->capacity * 2);
+		newarr = realloc(ov->files, newcap * sizeof(struct CXUnsavedFile));
+		if (newarr == NULL)
+		{
+			return 0;
+		}
+		ov->files = newarr;
+		ov->capacity = newcap;
+	}
+
+	ov->files[ov->count].Filename = name;
+	ov->files[ov->count].Contents = contents;
+	ov->files[ov->count].Length = length;
+	++ov->count;
+	ov->bytes += length;
+	return 1;
+}
+
+/**
+ * Reads a file into memory.
+ *
+ * @param path The path to the file.
+ * @param size The size of the file.
+ * @return The contents of the file, or NULL on failure (setting errno
+ * appropriately).
+ */
+static char *slurp(const char *path, size_t size)
+{
+	char *buf;
+	size_t got = 0;
+	int fd, olderrno;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return NULL;
+	}
+
+	/* allocate at least one byte so that empty files don't look like failures */
+	buf = malloc((size > 0) ? size : 1);
+	if (buf == NULL)
+	{
+		(void)close(fd);
+		return NULL;
+	}
+
+	while (got < size)
+	{
+		ssize_t rd = read(fd, buf + got, size - got);
+		if (rd == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (rd <= 0)
+		{
+			/* error, or the file shrank */
+			olderrno = (rd == 0) ? EIO : errno;
+			free(buf);
+			(void)close(fd);
+			errno = olderrno;
+			return NULL;
+		}
+		got += (size_t)rd;
+	}
+
+	(void)close(fd);
+	return buf;
+}
+
+/**
+ * Joins a directory and a name into a path.
+ *
+ * @param dir The directory.
+ * @param name The name within the directory.
+ * @return The path (to be freed), or NULL on failure.
+ */
+static char *joinPath(const char *dir, const char *name)
+{
+	size_t dirlen = strlen(dir);
+	bool slash = (dirlen > 0 && dir[dirlen - 1] == '/');
+	char *path = malloc(dirlen + strlen(name) + 2);
+
+	if (path != NULL)
+	{
+		(void)sprintf(path, slash ? "%s%s" : "%s/%s", dir, name);
+	}
+	return path;
+}
+
+/**
+ * Recursively adds the files below a directory to an overlay.
+ *
+ * @param ov Pointer to an overlay structure.
+ * @param dir The path to the directory.
+ * @param added Incremented for every file added.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int addTree(overlay_t *ov, const char *dir, size_t *added)
+{
+	DIR *d;
+	struct dirent *ent;
+	int ret = 1;
+
+	d = opendir(dir);
+	if (d == NULL)
+	{
+		return 0;
+	}
+
+	while (ret == 1 && (ent = readdir(d)) != NULL)
+	{
+		struct stat st;
+		char *path;
+
+		if (ent->d_name[0] == '.')
+		{
+			/* ".", ".." and hidden things (.git et al.) */
+			continue;
+		}
+
+		path = joinPath(dir, ent->d_name);
+		if (path == NULL)
+		{
+			ret = 0;
+			break;
+		}
+
+		if (stat(path, &st) == -1)
+		{
+			/* dangling symlink or vanished file; Clang won't find it either */
+			free(path);
+			continue;
+		}
+
+		if (S_ISDIR(st.st_mode))
+		{
+			ret = addTree(ov, path, added);
+			free(path);
+		}
+		else if (S_ISREG(st.st_mode) && st.st_size <= OVERLAY_MAX_FILE_SIZE)
+		{
+			char *contents = slurp(path, (size_t)st.st_size);
+			if (contents == NULL || addFile(ov, path, contents, (size_t)st.st_size) == 0)
+			{
+				free(contents);
+				free(path);
+				ret = 0;
+				break;
+			}
+			++*added;
+		}
+		else
+		{
+			free(path);
+		}
+	}
+
+	if (ret == 0)
+	{
+		int olderrno = errno;
+		(void)closedir(d);
+		errno = olderrno;
+		return 0;
+	}
+
+	(void)closedir(d);
+	return 1;
+}
+
+/* public-facing functions */
+
+void overlay_create(overlay_t *ov)
+{
+	ov->capacity = 0;
+	ov->count = 0;
+	ov->files = NULL;
+	ov->bytes = 0;
+	ov->map = NULL;
+	ov->mapSize = 0;
+}
+
+void overlay_destroy(overlay_t *ov)
+{
+	size_t i;
+
+	for (i = 0; i < ov->count; ++i)
+	{
+		if (!inPack(ov, ov->files[i].Filename))
+		{
+			free((char *)ov->files[i].Filename);
+			free((char *)ov->files[i].Contents);
+		}
+	}
+	free(ov->files);
+
+	if (ov->map != NULL)
+	{
+		(void)munmap(ov->map, ov->mapSize);
+	}
+
+	overlay_create(ov);
+}
+
+int overlay_addDir(overlay_t *ov, const char *dir, size_t *added)
+{
+	struct stat st;
+
+	*added = 0;
+
+	if (stat(dir, &st) == -1)
+	{
+		return 0;
+	}
+	if (!S_ISDIR(st.st_mode))
+	{
+		errno = ENOTDIR;
+		return 0;
+	}
+
+	return addTree(ov, dir, added);
+}
+
+int overlay_addFile(overlay_t *ov, const char *name, const char *path)
+{
+	struct stat st;
+	char *ourName, *contents;
+
+	if (stat(path, &st) == -1)
+	{
+		return 0;
+	}
+	if (!S_ISREG(st.st_mode))
+	{
+		errno = EISDIR;
+		return 0;
+	}
+
+	ourName = strdup(name);
+	contents = (ourName == NULL) ? NULL : slurp(path, (size_t)st.st_size);
+	if (contents == NULL || addFile(ov, ourName, contents, (size_t)st.st_size) == 0)
+	{
+		int olderrno = errno;
+		free(contents);
+		free(ourName);
+		errno = olderrno;
+		return 0;
+	}
+
+	return 1;
+}
+
+int overlay_addData(overlay_t *ov, const char *name, const char *contents, size_t length)
+{
+	char *ourName = strdup(name);
+	char *ourContents = malloc((length > 0) ? length : 1);
+
+	if (ourName == NULL || ourContents == NULL)
+	{
+		free(ourName);
+		free(ourContents);
+		return 0;
+	}
+	(void)memcpy(ourContents, contents, length);
+
+	if (addFile(ov, ourName, ourContents, length) == 0)
+	{
+		int olderrno = errno;
+		free(ourName);
+		free(ourContents);
+		errno = olderrno;
+		return 0;
+	}
+
+	return 1;
+}
+
+int overlay_load(overlay_t *ov, const char *path)
+{
+	struct stat st;
+	const char *p, *end;
+	uint32_t count, i;
+	int fd, olderrno;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return 0;
+	}
+
+	if (fstat(fd, &st) == -1)
+	{
+		olderrno = errno;
+		(void)close(fd);
+		errno = olderrno;
+		return 0;
+	}
+
+	if ((size_t)st.st_size < sizeof(PACK_MAGIC) + sizeof(uint32_t))
+	{
+		(void)close(fd);
+		errno = EINVAL;
+		return 0;
+	}
+
+	ov->mapSize = (size_t)st.st_size;
+	ov->map = mmap(NULL, ov->mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	olderrno = errno;
+	(void)close(fd);
+	if (ov->map == MAP_FAILED)
+	{
+		ov->map = NULL;
+		ov->mapSize = 0;
+		errno = olderrno;
+		return 0;
+	}
+
+	p = (const char *)ov->map;
+	end = p + ov->mapSize;
+	if (memcmp(p, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0)
+	{
+		overlay_destroy(ov);
+		errno = EINVAL;
+		return 0;
+	}
+	p += sizeof(PACK_MAGIC);
+	(void)memcpy(&count, p, sizeof(count));
+	p += sizeof(count);
+
+	for (i = 0; i < count; ++i)
+	{
+		uint32_t nameLen, dataLen;
+
+		if ((size_t)(end - p) < 2 * sizeof(uint32_t))
+		{
+			break;
+		}
+		(void)memcpy(&nameLen, p, sizeof(nameLen));
+		(void)memcpy(&dataLen, p + sizeof(nameLen), sizeof(dataLen));
+		p += 2 * sizeof(uint32_t);
+
+		if (
+			nameLen == 0 ||
+			(size_t)(end - p) < (size_t)nameLen + dataLen ||
+			p[nameLen - 1] != '\0'
+		)
+		{
+			break;
+		}
+
+		if (addFile(ov, p, p + nameLen, dataLen) == 0)
+		{
+			olderrno = errno;
+			overlay_destroy(ov);
+			errno = olderrno;
+			return 0;
+		}
+		p += nameLen + dataLen;
+	}
+
+	if (i < count || p != end)
+	{
+		/* truncated or trailing garbage */
+		overlay_destroy(ov);
+		errno = EINVAL;
+		return 0;
+	}
+
+	return 1;
+}
+
+int overlay_write(const overlay_t *ov, const char *path)
+{
+	outfile_t of;
+	FILE *out;
+	uint32_t count = (uint32_t)ov->count;
+	size_t i;
+	bool ok;
+
+	if (ov->count > UINT32_MAX)
+	{
+		errno = EFBIG;
+		return 0;
+	}
+
+	/* runs that are handed the same pack path each write a file of their own */
+	if (outfile_open(&of, path) == 0)
+	{
+		return 0;
+	}
+	out = of.f;
+
+	ok = (fwrite(PACK_MAGIC, sizeof(PACK_MAGIC), 1, out) == 1);
+	ok = ok && (fwrite(&count, sizeof(count), 1, out) == 1);
+
+	for (i = 0; ok && i < ov->count; ++i)
+	{
+		const struct CXUnsavedFile *f = &ov->files[i];
+		uint32_t lens[2] = {
+			(uint32_t)(strlen(f->Filename) + 1),
+			(uint32_t)f->Length
+		};
+
+		ok = (fwrite(lens, sizeof(lens), 1, out) == 1);
+		ok = ok && (fwrite(f->Filename, 1, lens[0], out) == lens[0]);
+		ok = ok && (lens[1] == 0 || fwrite(f->Contents, 1, lens[1], out) == lens[1]);
+	}
+
+	return outfile_close(&of, ok);
+}
+
+void overlay_finalize(overlay_t *ov)
+{
+	size_t i, kept = 0;
+
+	qsort(ov->files, ov->count, sizeof(struct CXUnsavedFile), comparator_unsaved);
+
+	/* nested include paths add the same file twice; keep it once */
+	for (i = 0; i < ov->count; ++i)
+	{
+		if (kept > 0 && strcmp(ov->files[kept - 1].Filename, ov->files[i].Filename) == 0)
+		{
+			ov->bytes -= ov->files[i].Length;
+			if (!inPack(ov, ov->files[i].Filename))
+			{
+				free((char *)ov->files[i].Filename);
+				free((char *)ov->files[i].Contents);
+			}
+			continue;
+		}
+		ov->files[kept++] = ov->files[i];
+	}
+	ov->count = kept;
+}
+
+bool overlay_contains(const overlay_t *ov, const char *path)
+{
+	struct CXUnsavedFile key = {
+		.Filename = path
+	};
+
+	return (bsearch(&key, ov->files, ov->count, sizeof(struct CXUnsavedFile), comparator_unsaved) != NULL);
+}
+
+bool overlay_containsDir(const overlay_t *ov, const char *dir)
+{
+	size_t dirlen = strlen(dir);
+	size_t lo = 0, hi = ov->count;
+
+	/* find the first file not ordered before the directory */
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (strcmp(ov->files[mid].Filename, dir) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* files below the directory follow it directly (or "dir-foo" does, if "dir/" ends up further on) */
+	for (; lo < ov->count && strncmp(ov->files[lo].Filename, dir, dirlen) == 0; ++lo)
+	{
+		const char *rest = ov->files[lo].Filename + dirlen;
+		if (rest[0] == '/' || (dirlen > 0 && dir[dirlen - 1] == '/'))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,140 @@
+/**
+ * @file overlay.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief In-memory overlay of header files.
+ * @details The files below the include directories are read into memory once
+ * (or loaded from a single packed file) and handed to every parse as unsaved
+ * files, so that Clang doesn't have to open and read them again for each
+ * translation unit.
+ */
+
+#ifndef __OVERLAY_H__
+#define __OVERLAY_H__
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <clang-c/Index.h>
+
+/** Files larger than this are not put into the overlay. */
+#define OVERLAY_MAX_FILE_SIZE (4 * 1024 * 1024)
+
+/** An overlay of files. */
+typedef struct
+{
+	/** How many files can the array house? */
+	size_t capacity;
+
+	/** How many files is the array housing right now? */
+	size_t count;
+
+	/** The files, sorted by name once the overlay is finalized. */
+	struct CXUnsavedFile *files;
+
+	/** The total size of the files' contents. */
+	size_t bytes;
+
+	/** If the overlay was loaded from a pack, its mapping; otherwise NULL. */
+	void *map;
+
+	/** The size of the pack's mapping. */
+	size_t mapSize;
+} overlay_t;
+
+/**
+ * Create an empty overlay.
+ *
+ * @param ov Pointer to fill with an overlay structure.
+ */
+void overlay_create(overlay_t *ov);
+
+/**
+ * Destroy an overlay.
+ *
+ * @param ov Pointer to an overlay structure.
+ */
+void overlay_destroy(overlay_t *ov);
+
+/**
+ * Read all files below a directory into an overlay. Hidden files and
+ * directories and files larger than OVERLAY_MAX_FILE_SIZE are skipped. The
+ * names of the files are the directory name, as given, joined with their path
+ * relative to the directory.
+ *
+ * @param ov Pointer to an overlay structure.
+ * @param dir The path to the directory.
+ * @param added Will be set to the number of files added.
+ * @return 1 on success, 0 on failure (setting errno appropriately; ENOENT or
+ * ENOTDIR if the directory doesn't exist).
+ */
+int overlay_addDir(overlay_t *ov, const char *dir, size_t *added);
+
+/**
+ * Read a single file into an overlay, regardless of its size.
+ *
+ * @param ov Pointer to an overlay structure.
+ * @param name The name under which to add the file.
+ * @param path The path to the file to read.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int overlay_addFile(overlay_t *ov, const char *name, const char *path);
+
+/**
+ * Add a file with the given contents to an overlay.
+ *
+ * @param ov Pointer to an overlay structure.
+ * @param name The name of the file.
+ * @param contents The contents of the file; copied.
+ * @param length The length of the contents.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int overlay_addData(overlay_t *ov, const char *name, const char *contents, size_t length);
+
+/**
+ * Load an overlay from a packed file. The overlay must be empty.
+ *
+ * @param ov Pointer to an overlay structure.
+ * @param path The path to the packed file.
+ * @return 1 on success, 0 on failure (setting errno appropriately; EINVAL if
+ * the file is not a pack).
+ */
+int overlay_load(overlay_t *ov, const char *path);
+
+/**
+ * Write an overlay into a packed file, replacing it atomically.
+ *
+ * @param ov Pointer to an overlay structure.
+ * @param path The path to the packed file.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int overlay_write(const overlay_t *ov, const char *path);
+
+/**
+ * Sort the files of an overlay so that they can be looked up, and drop files
+ * which have been added multiple times.
+ *
+ * @param ov Pointer to an overlay structure.
+ */
+void overlay_finalize(overlay_t *ov);
+
+/**
+ * Returns whether an overlay contains a file.
+ *
+ * @param ov Pointer to a finalized overlay structure.
+ * @param path The name of the file.
+ * @return true if the overlay contains a file of that name
+ */
+bool overlay_contains(const overlay_t *ov, const char *path);
+
+/**
+ * Returns whether any file of an overlay is located below a directory.
+ *
+ * @param ov Pointer to a finalized overlay structure.
+ * @param dir The path to the directory, as given when adding it.
+ * @return true if a file of the overlay is located below the directory
+ */
+bool overlay_containsDir(const overlay_t *ov, const char *dir);
+
+#endif
@@ -0,0 +1,449 @@
+/**
+ * @file prefetch.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Read-ahead of the files about to be analyzed.
+ * @details The thread waits until the analysis gets within the window of the
+ * next file, then opens that file and the headers it included in the previous
+ * run (each header only once per run) and advises the kernel to read them
+ * ahead with posix_fadvise(2); Linux starts reading asynchronously, just like
+ * with readahead(2). The window is derived from a moving average of the time
+ * between files.
+ */
+
+#include "prefetch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "outfile.h"
+#include "trace.h"
+
+/** Default inclusion list capacity. */
+static const size_t DEFAULT_CAPACITY = 64;
+
+/** How many files the prefetcher runs ahead until the speed of the analysis is known. */
+#define INITIAL_WINDOW 4
+
+/** The weight of the latest interval in the moving average. */
+#define INTERVAL_WEIGHT 0.3
+
+/* utility functions */
+
+/**
+ * Returns the current value of the monotonic clock.
+ *
+ * @return The current time in seconds.
+ */
+static double monotonicNow(void)
+{
+	struct timespec ts;
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * Compares two inclusion list entries by file. Useful for qsort(3) and
+ * bsearch(3).
+ *
+ * @param left Pointer to the first entry.
+ * @param right Pointer to the second entry.
+ * @return As strcmp(3).
+ */
+static int comparator_entry(const void *left, const void *right)
+{
+	return strcmp(((const prefetch_entry_t *)left)->file, ((const prefetch_entry_t *)right)->file);
+}
+
+/**
+ * Advises the kernel to read a file into the page cache.
+ *
+ * @param pf Pointer to a prefetcher structure.
+ * @param path The path to the file.
+ */
+static void warmFile(prefetch_t *pf, const char *path)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd == -1)
+	{
+		/* the analysis will complain if it matters */
+		return;
+	}
+	(void)posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	(void)close(fd);
+	++pf->prefetched;
+}
+
+/**
+ * Records that a header is being prefetched.
+ *
+ * @param pf Pointer to a prefetcher structure.
+ * @param path The path to the header.
+ * @return true if the header hasn't been prefetched before
+ */
+static bool firstTime(prefetch_t *pf, const char *path)
+{
+	uint64_t hash = hash_string(HASH_INIT, path);
+	size_t i;
+
+	if (hash == 0)
+	{
+		hash = 1;
+	}
+
+	if ((pf->headerCount + 1) * 2 > pf->headerSlots)
+	{
+		size_t newslots = (pf->headerSlots == 0) ? 1024 : pf->headerSlots * 2;
+		uint64_t *newheaders = calloc(newslots, sizeof(uint64_t));
+
+		if (newheaders == NULL)
+		{
+			/* prefetching it again doesn't hurt much */
+			return true;
+		}
+		for (i = 0; i < pf->headerSlots; ++i)
+		{
+			if (pf->headers[i] != 0)
+			{
+				size_t j = (size_t)pf->headers[i] & (newslots - 1);
+				while (newheaders[j] != 0)
+				{
+					j = (j + 1) & (newslots - 1);
+				}
+				newheaders[j] = pf->headers[i];
+			}
+		}
+		free(pf->headers);
+		pf->headers = newheaders;
+		pf->headerSlots = newslots;
+	}
+
+	for (i = (size_t)hash & (pf->headerSlots - 1); pf->headers[i] != 0; i = (i + 1) & (pf->headerSlots - 1))
+	{
+		if (pf->headers[i] == hash)
+		{
+			return false;
+		}
+	}
+	pf->headers[i] = hash;
+	++pf->headerCount;
+	return true;
+}
+
+/**
+ * Prefetches a file to be analyzed and the headers it included last time.
+ *
+ * @param pf Pointer to a prefetcher structure.
+ * @param idx The index of the file.
+ */
+static void warmAnalyzed(prefetch_t *pf, size_t idx)
+{
+	uint64_t start = trace_now();
+	prefetch_entry_t key = {
+		.file = (char *)pf->files[idx]
+	};
+	const prefetch_entry_t *entry = NULL;
+	size_t i;
+
+	warmFile(pf, pf->files[idx]);
+
+	if (pf->previous != NULL)
+	{
+		entry = bsearch(&key, pf->previous->arr, pf->previous->count, sizeof(prefetch_entry_t), comparator_entry);
+	}
+	for (i = 0; entry != NULL && i < entry->count; ++i)
+	{
+		const char *header = pf->previous->inclusions.arr[entry->first + i];
+		if (firstTime(pf, header))
+		{
+			warmFile(pf, header);
+		}
+	}
+
+	trace_span("prefetch", pf->files[idx], start);
+}
+
+/**
+ * The body of the prefetching thread.
+ *
+ * @param arg Pointer to the prefetcher structure.
+ * @return NULL
+ */
+static void *prefetchThread(void *arg)
+{
+	prefetch_t *pf = (prefetch_t *)arg;
+	size_t next = 0;
+
+	trace_track(TRACE_TRACK_PREFETCH, "prefetch");
+
+	(void)pthread_mutex_lock(&pf->lock);
+	while (!pf->stop)
+	{
+		if (next <= pf->position)
+		{
+			/* the analysis has overtaken us */
+			next = pf->position + 1;
+		}
+
+		if (next < pf->fileCount && next <= pf->position + pf->window)
+		{
+			size_t idx = next++;
+			(void)pthread_mutex_unlock(&pf->lock);
+			warmAnalyzed(pf, idx);
+			(void)pthread_mutex_lock(&pf->lock);
+		}
+		else
+		{
+			(void)pthread_cond_wait(&pf->moved, &pf->lock);
+		}
+	}
+	(void)pthread_mutex_unlock(&pf->lock);
+
+	trace_flush();
+	return NULL;
+}
+
+/* public-facing functions */
+
+int prefetch_list_create(prefetch_list_t *list)
+{
+	list->capacity = DEFAULT_CAPACITY;
+	list->count = 0;
+	list->arr = malloc(list->capacity * sizeof(prefetch_entry_t));
+	if (list->arr == NULL)
+	{
+		return 0;
+	}
+	if (msa_create(&list->inclusions) == 0)
+	{
+		free(list->arr);
+		list->arr = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+void prefetch_list_destroy(prefetch_list_t *list)
+{
+	size_t i;
+
+	for (i = 0; i < list->count; ++i)
+	{
+		free(list->arr[i].file);
+	}
+	free(list->arr);
+	list->arr = NULL;
+	list->count = 0;
+	list->capacity = 0;
+	msa_destroy(&list->inclusions);
+}
+
+int prefetch_list_add(prefetch_list_t *list, const char *file, const msa_t *inclusions)
+{
+	prefetch_entry_t *entry;
+	size_t i;
+
+	if (list->count == list->capacity)
+	{
+		size_t newcap = list->capacity * 2;
+		prefetch_entry_t *newarr = realloc(list->arr, newcap * sizeof(prefetch_entry_t));
+		if (newarr == NULL)
+		{
+			return 0;
+		}
+		list->arr = newarr;
+		list->capacity = newcap;
+	}
+
+	entry = &list->arr[list->count];
+	entry->file = strdup(file);
+	if (entry->file == NULL)
+	{
+		return 0;
+	}
+	entry->first = list->inclusions.count;
+	entry->count = 0;
+	++list->count;
+
+	for (i = 0; inclusions != NULL && i < inclusions->count; ++i)
+	{
+		if (msa_add(&list->inclusions, inclusions->arr[i]) == 0)
+		{
+			return 0;
+		}
+		++entry->count;
+	}
+	return 1;
+}
+
+int prefetch_list_load(prefetch_list_t *list, const char *path)
+{
+	FILE *f;
+	char *line = NULL;
+	size_t linecap = 0;
+	ssize_t len;
+	int ret = 1, olderrno;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+	{
+		return 0;
+	}
+
+	while (ret == 1 && (len = getline(&line, &linecap, f)) != -1)
+	{
+		if (len > 0 && line[len - 1] == '\n')
+		{
+			line[--len] = '\0';
+		}
+
+		if (len == 0)
+		{
+			continue;
+		}
+		else if (line[0] != '\t')
+		{
+			ret = prefetch_list_add(list, line, NULL);
+		}
+		else if (list->count > 0)
+		{
+			ret = msa_add(&list->inclusions, line + 1);
+			++list->arr[list->count - 1].count;
+		}
+	}
+
+	olderrno = errno;
+	if (ret == 1 && ferror(f))
+	{
+		ret = 0;
+	}
+	free(line);
+	(void)fclose(f);
+	errno = olderrno;
+
+	qsort(list->arr, list->count, sizeof(prefetch_entry_t), comparator_entry);
+	return ret;
+}
+
+int prefetch_list_write(const prefetch_list_t *list, const char *path)
+{
+	outfile_t of;
+	FILE *out;
+	size_t i, j;
+	bool ok = true;
+
+	/* concurrent runs sharing a list each write a file of their own */
+	if (outfile_open(&of, path) == 0)
+	{
+		return 0;
+	}
+	out = of.f;
+
+	for (i = 0; ok && i < list->count; ++i)
+	{
+		const prefetch_entry_t *entry = &list->arr[i];
+
+		ok = (fprintf(out, "%s\n", entry->file) >= 0);
+		for (j = 0; ok && j < entry->count; ++j)
+		{
+			ok = (fprintf(out, "\t%s\n", list->inclusions.arr[entry->first + j]) >= 0);
+		}
+	}
+
+	return outfile_close(&of, ok);
+}
+
+int prefetch_start(prefetch_t *pf, const char * const *files, size_t fileCount, const prefetch_list_t *previous)
+{
+	int err;
+
+	pf->files = files;
+	pf->fileCount = fileCount;
+	pf->previous = previous;
+	pf->position = 0;
+	pf->window = INITIAL_WINDOW;
+	pf->stop = false;
+	pf->movedAt = 0.0;
+	pf->interval = 0.0;
+	pf->running = false;
+	pf->headers = NULL;
+	pf->headerSlots = 0;
+	pf->headerCount = 0;
+	pf->prefetched = 0;
+
+	if (pthread_mutex_init(&pf->lock, NULL) != 0)
+	{
+		return 0;
+	}
+	if (pthread_cond_init(&pf->moved, NULL) != 0)
+	{
+		(void)pthread_mutex_destroy(&pf->lock);
+		return 0;
+	}
+
+	err = pthread_create(&pf->thread, NULL, prefetchThread, pf);
+	if (err != 0)
+	{
+		(void)pthread_cond_destroy(&pf->moved);
+		(void)pthread_mutex_destroy(&pf->lock);
+		errno = err;
+		return 0;
+	}
+
+	pf->running = true;
+	return 1;
+}
+
+void prefetch_advance(prefetch_t *pf, size_t position)
+{
+	double now = monotonicNow();
+	size_t window;
+
+	(void)pthread_mutex_lock(&pf->lock);
+	if (position > pf->position && pf->movedAt > 0.0)
+	{
+		double sample = (now - pf->movedAt) / (double)(position - pf->position);
+		pf->interval = (pf->interval == 0.0) ? sample : (1.0 - INTERVAL_WEIGHT) * pf->interval + INTERVAL_WEIGHT * sample;
+	}
+	if (pf->interval > 0.0)
+	{
+		/* cover the next few moments of work */
+		double files = PREFETCH_LEAD_SECONDS / pf->interval + 1.0;
+		pf->window = (files < PREFETCH_MIN_WINDOW) ? PREFETCH_MIN_WINDOW :
+			(files > PREFETCH_MAX_WINDOW) ? PREFETCH_MAX_WINDOW : (size_t)files;
+	}
+	pf->position = position;
+	pf->movedAt = now;
+	window = pf->window;
+	(void)pthread_cond_signal(&pf->moved);
+	(void)pthread_mutex_unlock(&pf->lock);
+
+	trace_counter("prefetch window", (double)window);
+}
+
+void prefetch_stop(prefetch_t *pf)
+{
+	if (!pf->running)
+	{
+		return;
+	}
+
+	(void)pthread_mutex_lock(&pf->lock);
+	pf->stop = true;
+	(void)pthread_cond_signal(&pf->moved);
+	(void)pthread_mutex_unlock(&pf->lock);
+
+	(void)pthread_join(pf->thread, NULL);
+	(void)pthread_cond_destroy(&pf->moved);
+	(void)pthread_mutex_destroy(&pf->lock);
+	free(pf->headers);
+	pf->headers = NULL;
+	pf->running = false;
+}
@@ -0,0 +1,185 @@
+/**
+ * @file prefetch.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Read-ahead of the files about to be analyzed.
+ * @details A thread runs a few files ahead of the analysis and advises the
+ * kernel to read each of them, and the headers they included in the previous
+ * run, into the page cache, so that parsing doesn't stall on cold storage. The
+ * number of files it runs ahead adapts to how fast the files are analyzed:
+ * it covers about PREFETCH_LEAD_SECONDS of work.
+ */
+
+#ifndef __PREFETCH_H__
+#define __PREFETCH_H__
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "msa.h"
+
+/** How many seconds of work the prefetcher tries to stay ahead. */
+#define PREFETCH_LEAD_SECONDS 1.0
+
+/** The fewest files the prefetcher runs ahead. */
+#define PREFETCH_MIN_WINDOW 1
+
+/** The most files the prefetcher runs ahead. */
+#define PREFETCH_MAX_WINDOW 64
+
+/** A file analyzed and the files it included. */
+typedef struct
+{
+	/** The file analyzed. */
+	char *file;
+
+	/** The index of its first inclusion in the inclusion array. */
+	size_t first;
+
+	/** The number of its inclusions. */
+	size_t count;
+} prefetch_entry_t;
+
+/** The inclusions of the files analyzed in a run. */
+typedef struct
+{
+	/** How many entries can the array house? */
+	size_t capacity;
+
+	/** How many entries is the array housing right now? */
+	size_t count;
+
+	/** The entries, sorted by file once loaded. */
+	prefetch_entry_t *arr;
+
+	/** The files included, grouped by the file including them. */
+	msa_t inclusions;
+} prefetch_list_t;
+
+/** A prefetcher. */
+typedef struct
+{
+	/** The files to be analyzed, in order. */
+	const char * const *files;
+
+	/** The number of files to be analyzed. */
+	size_t fileCount;
+
+	/** The inclusions from the previous run. */
+	const prefetch_list_t *previous;
+
+	/** Guards position, window and stop. */
+	pthread_mutex_t lock;
+
+	/** Signalled when position or stop change. */
+	pthread_cond_t moved;
+
+	/** The index of the file being analyzed. */
+	size_t position;
+
+	/** How many files beyond position to prefetch. */
+	size_t window;
+
+	/** Should the thread stop? */
+	bool stop;
+
+	/** When position last changed, in seconds. */
+	double movedAt;
+
+	/** The average time between changes of position, in seconds; 0 if unknown. */
+	double interval;
+
+	/** The thread. */
+	pthread_t thread;
+
+	/** Is the thread running? */
+	bool running;
+
+	/** The hashes of the headers prefetched (open addressing; zero is free). */
+	uint64_t *headers;
+
+	/** The number of slots of headers; a power of two. */
+	size_t headerSlots;
+
+	/** The number of headers prefetched. */
+	size_t headerCount;
+
+	/** The number of files prefetched, main files and headers. */
+	size_t prefetched;
+} prefetch_t;
+
+/**
+ * Create an empty inclusion list.
+ *
+ * @param list Pointer to fill with an inclusion list structure.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int prefetch_list_create(prefetch_list_t *list);
+
+/**
+ * Destroy an inclusion list.
+ *
+ * @param list Pointer to an inclusion list structure.
+ */
+void prefetch_list_destroy(prefetch_list_t *list);
+
+/**
+ * Add the inclusions of a file to an inclusion list.
+ *
+ * @param list Pointer to an inclusion list structure.
+ * @param file The file analyzed.
+ * @param inclusions The files it included.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int prefetch_list_add(prefetch_list_t *list, const char *file, const msa_t *inclusions);
+
+/**
+ * Load an inclusion list written by prefetch_list_write.
+ *
+ * @param list Pointer to an empty inclusion list structure.
+ * @param path The path to the file.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int prefetch_list_load(prefetch_list_t *list, const char *path);
+
+/**
+ * Write an inclusion list into a file, replacing it atomically. The file lists
+ * each file analyzed on a line of its own, followed by the files it included,
+ * each on a line starting with a tab.
+ *
+ * @param list Pointer to an inclusion list structure.
+ * @param path The path to the file.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int prefetch_list_write(const prefetch_list_t *list, const char *path);
+
+/**
+ * Start prefetching.
+ *
+ * @param pf Pointer to fill with a prefetcher structure.
+ * @param files The files to be analyzed, in order; must stay valid.
+ * @param fileCount The number of files.
+ * @param previous The inclusions of the previous run, or NULL; must stay valid.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int prefetch_start(prefetch_t *pf, const char * const *files, size_t fileCount, const prefetch_list_t *previous);
+
+/**
+ * Tell the prefetcher that the analysis has reached a file.
+ *
+ * @param pf Pointer to a running prefetcher structure.
+ * @param position The index of the file.
+ */
+void prefetch_advance(prefetch_t *pf, size_t position);
+
+/**
+ * Stop prefetching and wait for the thread to finish.
+ *
+ * @param pf Pointer to a prefetcher structure.
+ */
+void prefetch_stop(prefetch_t *pf);
+
+#endif
@@ -0,0 +1,702 @@
+/**
+ * @file query.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief The query subcommand of the Voidcaster.
+ * @details The findings of a run are looked up through its callee index; the
+ * findings new since another run are found by walking the records of each
+ * callee of both runs side by side, as they are sorted by their identity. If a
+ * run has more findings of an identity than the other (e.g. the same line
+ * appears several times in a file), those closest to the other run's are
+ * considered old.
+ */
+
+#include "query.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "callees.h"
+#include "findb.h"
+#include "shared.h"
+
+/** Values returned by getopt_long(3) for the options of the subcommand. */
+enum query_longopts_e
+{
+	/** --callee NAME */
+	QUERY_CALLEE = 0x100,
+
+	/** --counts */
+	QUERY_COUNTS,
+
+	/** --help */
+	QUERY_HELP,
+
+	/** --kind=KIND */
+	QUERY_KIND,
+
+	/** --path=PREFIX */
+	QUERY_PATH,
+
+	/** --run=N */
+	QUERY_RUN,
+
+	/** --runs */
+	QUERY_RUNS,
+
+	/** --since=N */
+	QUERY_SINCE
+};
+
+/** The long options understood by the subcommand. */
+static const struct option queryopts[] = {
+	{ "callee", required_argument, NULL, QUERY_CALLEE },
+	{ "counts", no_argument, NULL, QUERY_COUNTS },
+	{ "help", no_argument, NULL, QUERY_HELP },
+	{ "kind", required_argument, NULL, QUERY_KIND },
+	{ "path", required_argument, NULL, QUERY_PATH },
+	{ "run", required_argument, NULL, QUERY_RUN },
+	{ "runs", no_argument, NULL, QUERY_RUNS },
+	{ "since", required_argument, NULL, QUERY_SINCE },
+	{ NULL, 0, NULL, 0 }
+};
+
+/** What the findings are filtered by. */
+typedef struct
+{
+	/** The callees; if empty, all are. */
+	callees_t callees;
+
+	/** The kind of finding (a finding_kind_t); -1 for all. */
+	int kind;
+
+	/** The directory or file the findings must be located in; NULL for all. */
+	const char *path;
+
+	/** The length of path. */
+	size_t pathLen;
+} query_filter;
+
+/** A finding to output, along with the database it is stored in. */
+typedef struct
+{
+	/** The database. */
+	const findb_t *db;
+
+	/** The record of the finding. */
+	const findb_record_t *rec;
+} query_hit;
+
+/** Two findings of the same identity in different runs which might be the same. */
+typedef struct
+{
+	/** The distance between their lines. */
+	uint32_t distance;
+
+	/** The index of the finding within its group in the run queried. */
+	size_t cur;
+
+	/** The index of the finding within its group in the earlier run. */
+	size_t old;
+} query_pair;
+
+/** Groups of findings of the same identity with more pairs are paired up by their order. */
+#define MAX_PAIRS 65536
+
+/**
+ * Prints usage information about the subcommand.
+ *
+ * @param out the stream to print to
+ */
+static void printQueryUsage(FILE *out)
+{
+	(void)fprintf(out,
+		"Usage: %s query [OPTION]... DB\n"
+		"Outputs the findings stored in DB by a run with --db=DB.\n"
+		"\n"
+		"  --callee NAME          only findings concerning the function NAME, which\n"
+		"                         may contain wildcards; may be given multiple\n"
+		"                         times\n"
+		"  --counts               output the number of missing and superfluous\n"
+		"                         casts per callee in each run (or only in the run\n"
+		"                         given by --run) instead\n"
+		"  --help                 output this help and exit\n"
+		"  --kind=KIND            only missing or superfluous casts\n"
+		"  --path=PREFIX          only findings in the file or below the directory\n"
+		"                         PREFIX, as named when analyzing\n"
+		"  --run=N                the findings of run N (default: the latest)\n"
+		"  --runs                 list the runs instead\n"
+		"  --since=N              only findings which weren't found in run N; a\n"
+		"                         finding is recognized by its callee, file, kind\n"
+		"                         and the contents of its line\n",
+		progname
+	);
+}
+
+/**
+ * Prints usage information about the subcommand to standard error and exits
+ * with return code 1.
+ * @note This function does not return.
+ */
+static void queryUsage(void) __attribute__((noreturn));
+
+static void queryUsage(void)
+{
+	printQueryUsage(stderr);
+	exit(EXITCODE_USAGE);
+}
+
+/**
+ * Prints usage information about the subcommand to standard output and exits
+ * with return code 0.
+ * @note This function does not return.
+ */
+static void queryHelp(void) __attribute__((noreturn));
+
+static void queryHelp(void)
+{
+	printQueryUsage(stdout);
+	exit(EXITCODE_OK);
+}
+
+/**
+ * Parses the number of a run.
+ *
+ * @param arg the argument to parse
+ * @param number by-ref to the number to set
+ * @return true on success, false if the argument is not a positive number
+ */
+static bool parseRun(const char *arg, uint32_t *number)
+{
+	char *end;
+	unsigned long val;
+
+	errno = 0;
+	val = strtoul(arg, &end, 10);
+	if (errno != 0 || end == arg || *end != '\0' || val == 0 || val > UINT32_MAX || arg[0] == '-')
+	{
+		return false;
+	}
+
+	*number = (uint32_t)val;
+	return true;
+}
+
+/**
+ * Formats when a run took place.
+ *
+ * @param run the run
+ * @param buf the buffer to fill
+ * @param size the size of the buffer
+ * @return buf
+ */
+static const char *formatTime(const findb_run_t *run, char *buf, size_t size)
+{
+	struct tm tm;
+
+	if (localtime_r(&run->time, &tm) == NULL || strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm) == 0)
+	{
+		(void)snprintf(buf, size, "%lld", (long long)run->time);
+	}
+	return buf;
+}
+
+/**
+ * Returns whether a callee passes a filter.
+ *
+ * @param db the database
+ * @param filter the filter
+ * @param callee the callee
+ * @return true if the findings concerning the callee are of interest
+ */
+static bool calleeWanted(const findb_t *db, const query_filter *filter, const findb_callee_t *callee)
+{
+	return (!callees_any(&filter->callees) || callees_match(&filter->callees, findb_string(db, callee->func)));
+}
+
+/**
+ * Returns whether a record passes a filter, apart from its callee.
+ *
+ * @param db the database
+ * @param filter the filter
+ * @param rec the record
+ * @return true if the record is of interest
+ */
+static bool recordWanted(const findb_t *db, const query_filter *filter, const findb_record_t *rec)
+{
+	const char *file;
+
+	if (filter->kind != -1 && rec->kind != (uint32_t)filter->kind)
+	{
+		return false;
+	}
+	if (filter->path == NULL)
+	{
+		return true;
+	}
+
+	/* the prefix must end at a path separator */
+	file = findb_string(db, rec->file);
+	return (
+		strncmp(file, filter->path, filter->pathLen) == 0 &&
+		(filter->pathLen == 0 || filter->path[filter->pathLen - 1] == '/' ||
+			file[filter->pathLen] == '/' || file[filter->pathLen] == '\0')
+	);
+}
+
+/**
+ * Compares two hits by file, line and column. Useful for qsort(3).
+ *
+ * @param left Pointer to the first hit.
+ * @param right Pointer to the second hit.
+ * @return Less than zero if left ordered before right.
+ *         Zero if left and right equally ordered.
+ *         More than zero if right ordered before left.
+ */
+static int comparator_hit(const void *left, const void *right)
+{
+	const query_hit *l = (const query_hit *)left;
+	const query_hit *r = (const query_hit *)right;
+	int cmp = strcmp(findb_string(l->db, l->rec->file), findb_string(r->db, r->rec->file));
+
+	if (cmp != 0)
+		return cmp;
+	if (l->rec->line != r->rec->line)
+		return (l->rec->line < r->rec->line) ? -1 : 1;
+	if (l->rec->col != r->rec->col)
+		return (l->rec->col < r->rec->col) ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Lists the runs of a database.
+ *
+ * @param db the database
+ */
+static void listRuns(const findb_t *db)
+{
+	char timebuf[64];
+	size_t r;
+
+	for (r = 0; r < db->runCount; ++r)
+	{
+		const findb_run_t *run = &db->runs[r];
+		(void)printf("%u\t%s\t%zu findings\n", run->number, formatTime(run, timebuf, sizeof(timebuf)), run->count);
+	}
+}
+
+/**
+ * Outputs the number of findings per callee in each run.
+ *
+ * @param db the database
+ * @param filter the filter
+ * @param only the number of the run to restrict the output to; 0 for all runs
+ */
+static void countFindings(const findb_t *db, const query_filter *filter, uint32_t only)
+{
+	char timebuf[64];
+	size_t r, c, i;
+
+	for (r = 0; r < db->runCount; ++r)
+	{
+		const findb_run_t *run = &db->runs[r];
+
+		if (only != 0 && run->number != only)
+		{
+			continue;
+		}
+
+		(void)formatTime(run, timebuf, sizeof(timebuf));
+		for (c = 0; c < run->calleeCount; ++c)
+		{
+			const findb_callee_t *callee = &run->callees[c];
+			uint32_t missing = 0, superfluous = 0;
+
+			if (!calleeWanted(db, filter, callee))
+			{
+				continue;
+			}
+
+			if (filter->kind == -1 && filter->path == NULL)
+			{
+				/* the index knows */
+				missing = callee->missing;
+				superfluous = callee->count - callee->missing;
+			}
+			else
+			{
+				for (i = callee->first; i < callee->first + callee->count; ++i)
+				{
+					const findb_record_t *rec = &run->records[i];
+					if (recordWanted(db, filter, rec))
+					{
+						++*((rec->kind == FINDING_MISSING_VOID) ? &missing : &superfluous);
+					}
+				}
+			}
+
+			if (missing + superfluous > 0)
+			{
+				(void)printf("%u\t%s\t%s\t%u missing\t%u superfluous\n",
+					run->number, timebuf, findb_string(db, callee->func), missing, superfluous
+				);
+			}
+		}
+	}
+}
+
+/**
+ * Compares two pairs of findings by the distance between their lines. Useful
+ * for qsort(3).
+ *
+ * @param left Pointer to the first pair.
+ * @param right Pointer to the second pair.
+ * @return Less than zero if left ordered before right.
+ *         Zero if left and right equally ordered.
+ *         More than zero if right ordered before left.
+ */
+static int comparator_pair(const void *left, const void *right)
+{
+	const query_pair *l = (const query_pair *)left;
+	const query_pair *r = (const query_pair *)right;
+
+	if (l->distance != r->distance)
+		return (l->distance < r->distance) ? -1 : 1;
+	if (l->cur != r->cur)
+		return (l->cur < r->cur) ? -1 : 1;
+	if (l->old != r->old)
+		return (l->old < r->old) ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Decides which of a group of findings of the same identity are new, given
+ * the smaller group of findings of that identity in an earlier run. As lines
+ * are added and removed, the findings closest to each other are paired up
+ * first; those left over are new.
+ *
+ * @param cur the findings, sorted by line
+ * @param curCount the number of findings
+ * @param old the earlier findings, sorted by line
+ * @param oldCount the number of earlier findings; less than curCount
+ * @param isNew the array to fill with whether each finding is new
+ */
+static void pairUp(
+	const findb_record_t *cur,
+	size_t curCount,
+	const findb_record_t *old,
+	size_t oldCount,
+	bool *isNew
+)
+{
+	query_pair *pairs = NULL;
+	bool *oldUsed = NULL;
+	size_t i, j, count = 0;
+
+	if (curCount * oldCount <= MAX_PAIRS)
+	{
+		pairs = malloc(curCount * oldCount * sizeof(query_pair));
+		oldUsed = calloc(oldCount, sizeof(bool));
+	}
+	if (pairs == NULL || oldUsed == NULL)
+	{
+		/* too many to pair up; assume that the last ones are new */
+		for (i = 0; i < curCount; ++i)
+		{
+			isNew[i] = (i >= oldCount);
+		}
+		free(pairs);
+		free(oldUsed);
+		return;
+	}
+
+	for (i = 0; i < curCount; ++i)
+	{
+		isNew[i] = true;
+		for (j = 0; j < oldCount; ++j)
+		{
+			pairs[count].distance = (cur[i].line > old[j].line) ? cur[i].line - old[j].line : old[j].line - cur[i].line;
+			pairs[count].cur = i;
+			pairs[count].old = j;
+			++count;
+		}
+	}
+	qsort(pairs, count, sizeof(query_pair), comparator_pair);
+
+	for (i = 0; i < count; ++i)
+	{
+		if (isNew[pairs[i].cur] && !oldUsed[pairs[i].old])
+		{
+			isNew[pairs[i].cur] = false;
+			oldUsed[pairs[i].old] = true;
+		}
+	}
+
+	free(pairs);
+	free(oldUsed);
+}
+
+/**
+ * Collects the findings of a run, optionally only those not found in another.
+ *
+ * @param db the database
+ * @param filter the filter
+ * @param run the run
+ * @param base the run whose findings to skip, or NULL
+ * @param hits the array to fill; must house as many hits as the run has findings
+ * @param isNew scratch space for as many flags as the run has findings
+ * @return the number of hits
+ */
+static size_t collectFindings(
+	const findb_t *db,
+	const query_filter *filter,
+	const findb_run_t *run,
+	const findb_run_t *base,
+	query_hit *hits,
+	bool *isNew
+)
+{
+	size_t c, i, k, m, count = 0;
+
+	for (c = 0; c < run->calleeCount; ++c)
+	{
+		const findb_callee_t *callee = &run->callees[c];
+		const findb_callee_t *old = (base == NULL) ? NULL : findb_callee(base, callee->func);
+		size_t j = (old == NULL) ? 0 : old->first;
+		size_t oldEnd = (old == NULL) ? 0 : old->first + old->count;
+		size_t end = callee->first + callee->count;
+
+		if (!calleeWanted(db, filter, callee))
+		{
+			continue;
+		}
+
+		/* both are sorted by identity; go through the groups of findings of the same identity */
+		for (i = callee->first; i < end; i = k)
+		{
+			const findb_record_t *rec = &run->records[i];
+			size_t oldStart;
+
+			for (k = i + 1; k < end && findb_compareIdentity(&run->records[k], rec) == 0; ++k)
+			{
+				/* find the end of the group */
+			}
+			while (j < oldEnd && findb_compareIdentity(&base->records[j], rec) < 0)
+			{
+				++j;
+			}
+			for (oldStart = j; j < oldEnd && findb_compareIdentity(&base->records[j], rec) == 0; ++j)
+			{
+				/* find the end of the earlier group */
+			}
+
+			if (j - oldStart >= k - i)
+			{
+				/* none of them is new */
+				continue;
+			}
+			if (j > oldStart)
+			{
+				pairUp(rec, k - i, &base->records[oldStart], j - oldStart, isNew);
+			}
+
+			for (m = i; m < k; ++m)
+			{
+				if ((j == oldStart || isNew[m - i]) && recordWanted(db, filter, &run->records[m]))
+				{
+					hits[count].db = db;
+					hits[count].rec = &run->records[m];
+					++count;
+				}
+			}
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Outputs a finding in the format of the analysis.
+ *
+ * @param hit the finding
+ */
+static void printHit(const query_hit *hit)
+{
+	const findb_record_t *rec = hit->rec;
+
+	(void)printf("%s:%u:%u: %s cast to void when calling function %s",
+		findb_string(hit->db, rec->file), rec->line, rec->col,
+		(rec->kind == FINDING_MISSING_VOID) ? "Missing" : "Pointless",
+		findb_string(hit->db, rec->func)
+	);
+	if (rec->expansions > 0)
+	{
+		(void)printf(" (in %u macro expansion%s)", rec->expansions, (rec->expansions == 1) ? "" : "s");
+	}
+	(void)fputs(".\n", stdout);
+}
+
+/**
+ * Finds a run by its number.
+ *
+ * @param db the database
+ * @param number the number of the run
+ * @return the run, or NULL if the database doesn't contain it
+ */
+static const findb_run_t *findRun(const findb_t *db, uint32_t number)
+{
+	return (number >= 1 && number <= db->runCount) ? &db->runs[number - 1] : NULL;
+}
+
+int query_main(int argc, char **argv)
+{
+	query_filter filter = {
+		.kind = -1,
+		.path = NULL,
+		.pathLen = 0
+	};
+	bool runs = false, counts = false;
+	uint32_t runNumber = 0, sinceNumber = 0;
+	const findb_run_t *run, *base;
+	query_hit *hits;
+	bool *isNew;
+	findb_t db;
+	size_t count, i;
+	int opt;
+
+	if (callees_create(&filter.callees) == 0)
+	{
+		perror("callees_create");
+		return EXITCODE_MM;
+	}
+
+	while ((opt = getopt_long(argc, argv, "", queryopts, NULL)) != -1)
+	{
+		switch (opt)
+		{
+			case QUERY_CALLEE:
+				if (callees_add(&filter.callees, optarg) == 0)
+				{
+					if (errno != EINVAL)
+					{
+						perror("callees_add");
+						return EXITCODE_MM;
+					}
+					(void)fprintf(stderr, "%s: callee '%s' consists of wildcards only\n", progname, optarg);
+					queryUsage();
+				}
+				break;
+			case QUERY_COUNTS:
+				counts = true;
+				break;
+			case QUERY_HELP:
+				queryHelp();
+			case QUERY_KIND:
+				if (strcmp(optarg, "missing") == 0)
+				{
+					filter.kind = FINDING_MISSING_VOID;
+				}
+				else if (strcmp(optarg, "superfluous") == 0)
+				{
+					filter.kind = FINDING_SUPERFLUOUS_VOID;
+				}
+				else
+				{
+					(void)fprintf(stderr, "%s: invalid kind '%s' (missing or superfluous)\n", progname, optarg);
+					queryUsage();
+				}
+				break;
+			case QUERY_PATH:
+				filter.path = optarg;
+				filter.pathLen = strlen(optarg);
+				break;
+			case QUERY_RUN:
+				if (!parseRun(optarg, &runNumber))
+				{
+					(void)fprintf(stderr, "%s: invalid run '%s'\n", progname, optarg);
+					queryUsage();
+				}
+				break;
+			case QUERY_RUNS:
+				runs = true;
+				break;
+			case QUERY_SINCE:
+				if (!parseRun(optarg, &sinceNumber))
+				{
+					(void)fprintf(stderr, "%s: invalid run '%s'\n", progname, optarg);
+					queryUsage();
+				}
+				break;
+			default:
+				queryUsage();
+		}
+	}
+
+	if (optind != argc - 1)
+	{
+		(void)fprintf(stderr, "%s: exactly one database must be specified\n", progname);
+		queryUsage();
+	}
+	if ((runs && counts) || (counts && sinceNumber != 0))
+	{
+		(void)fprintf(stderr, "%s: --runs, --counts and --since can't be combined\n", progname);
+		queryUsage();
+	}
+
+	if (findb_open(&db, argv[optind]) == 0)
+	{
+		(void)fprintf(stderr, "%s: can't open findings database %s: %s\n", progname, argv[optind],
+			(errno == EINVAL) ? "not a findings database" : strerror(errno)
+		);
+		callees_destroy(&filter.callees);
+		return EXITCODE_FILE_OPEN;
+	}
+
+	run = findRun(&db, (runNumber != 0) ? runNumber : (uint32_t)db.runCount);
+	base = findRun(&db, sinceNumber);
+	if ((runNumber != 0 && run == NULL) || (sinceNumber != 0 && base == NULL))
+	{
+		(void)fprintf(stderr, "%s: there is no run %u\n", progname, (run == NULL) ? runNumber : sinceNumber);
+		findb_close(&db);
+		callees_destroy(&filter.callees);
+		return EXITCODE_USAGE;
+	}
+
+	if (runs)
+	{
+		listRuns(&db);
+	}
+	else if (counts)
+	{
+		countFindings(&db, &filter, runNumber);
+	}
+	else if (run != NULL)
+	{
+		hits = malloc((run->count + 1) * sizeof(query_hit));
+		isNew = malloc((run->count + 1) * sizeof(bool));
+		if (hits == NULL || isNew == NULL)
+		{
+			perror("malloc");
+			return EXITCODE_MM;
+		}
+
+		count = collectFindings(&db, &filter, run, base, hits, isNew);
+		qsort(hits, count, sizeof(query_hit), comparator_hit);
+		for (i = 0; i < count; ++i)
+		{
+			printHit(&hits[i]);
+		}
+		free(hits);
+		free(isNew);
+	}
+
+	findb_close(&db);
+	callees_destroy(&filter.callees);
+	return EXITCODE_OK;
+}
@@ -0,0 +1,25 @@
+/**
+ * @file query.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief The query subcommand of the Voidcaster.
+ * @details Answers questions about the findings stored in a database by
+ * earlier runs (see --db), such as which results of a function are ignored
+ * below a directory, which findings are new since a run or how the number of
+ * findings per callee has developed, without parsing any source.
+ */
+
+#ifndef __QUERY_H__
+#define __QUERY_H__
+
+/**
+ * Runs the query subcommand.
+ *
+ * @param argc the number of arguments, including the name of the subcommand
+ * @param argv the arguments, starting with the name of the subcommand
+ * @return the exit code of the Voidcaster
+ */
+int query_main(int argc, char **argv);
+
+#endif
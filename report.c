@@ -0,0 +1,117 @@
+/**
+ * @file report.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Reporting of findings as warnings.
+ */
+
+#include "report.h"
+
+#include <stdio.h>
+
+#include "metrics.h"
+
+/** The configurations named in the warnings. */
+static const configs_t *reportConfigs = NULL;
+
+/** True if a suggestion was given. */
+static bool suggested = false;
+
+/* utility functions */
+
+/**
+ * Outputs the number of macro expansions a finding stands for, if it is located
+ * within a macro, and the configurations it occurs in, if configurations have
+ * been specified; then terminates the warning sentence and line.
+ *
+ * @param fnd the finding whose details to output
+ */
+static void warnDetails(const finding_t *fnd)
+{
+	char cfgbuf[256];
+
+	if (fnd->expansions > 0)
+	{
+		(void)fprintf(stderr, " (in %zu macro expansion%s)",
+			fnd->expansions, (fnd->expansions == 1) ? "" : "s"
+		);
+	}
+	if (
+		reportConfigs != NULL &&
+		configs_describe(reportConfigs, fnd->configs, cfgbuf, sizeof(cfgbuf))[0] != '\0'
+	)
+	{
+		(void)fprintf(stderr, " [%s]", cfgbuf);
+	}
+	(void)fputs(".\n", stderr);
+}
+
+/**
+ * Outputs a warning that a call can't be checked.
+ *
+ * @param fnd the finding describing the call
+ */
+static void warnUncheckedCall(const finding_t *fnd)
+{
+	(void)fprintf(stderr,
+		"%s:%zu:%zu: Warning: can't check call to %s (can't find original definition)",
+		fnd->file, fnd->start.line, fnd->start.col, fnd->func
+	);
+	warnDetails(fnd);
+}
+
+/* public-facing functions */
+
+void report_init(const configs_t *configs)
+{
+	reportConfigs = configs;
+}
+
+void report_warnMissingVoid(const finding_t *fnd)
+{
+	(void)fprintf(stderr,
+		"%s:%zu:%zu: Missing cast to void when calling function %s",
+		fnd->file, fnd->start.line, fnd->start.col, fnd->func
+	);
+	warnDetails(fnd);
+	suggested = true;
+}
+
+void report_warnSuperfluousVoid(const finding_t *fnd)
+{
+	(void)fprintf(stderr,
+		"%s:%zu:%zu: Pointless cast to void when calling function %s",
+		fnd->file, fnd->start.line, fnd->start.col, fnd->func
+	);
+	warnDetails(fnd);
+	suggested = true;
+}
+
+void report_findings(const findings_t *found, missingVoidProc missProc, superfluousVoidProc superProc)
+{
+	size_t i;
+
+	for (i = 0; i < found->count; ++i)
+	{
+		switch (found->arr[i].kind)
+		{
+			case FINDING_MISSING_VOID:
+				metrics_add(METRIC_FINDINGS_MISSING, 1);
+				missProc(&found->arr[i]);
+				break;
+			case FINDING_SUPERFLUOUS_VOID:
+				metrics_add(METRIC_FINDINGS_SUPERFLUOUS, 1);
+				superProc(&found->arr[i]);
+				break;
+			case FINDING_UNCHECKED_CALL:
+				warnUncheckedCall(&found->arr[i]);
+				break;
+		}
+	}
+}
+
+bool report_suggested(void)
+{
+	return suggested;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file report.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Reporting of findings as warnings.
+ * @details Each finding is written to standard error as a line in the format
+ * used by compilers, so that editors can jump to it.
+ */
+
+#ifndef __REPORT_H__
+#define __REPORT_H__
+
+#include <stdbool.h>
+
+#include "configs.h"
+#include "findings.h"
+#include "treemunger.h"
+
+/**
+ * Set the configurations named in the warnings. Call before reporting any
+ * findings.
+ *
+ * @param configs The configurations under which the files are analyzed; must
+ * stay valid while findings are reported.
+ */
+void report_init(const configs_t *configs);
+
+/**
+ * Warns about a missing cast to void.
+ *
+ * @param fnd The finding describing the missing cast.
+ */
+void report_warnMissingVoid(const finding_t *fnd);
+
+/**
+ * Warns about a superfluous cast to void.
+ *
+ * @param fnd The finding describing the superfluous cast.
+ */
+void report_warnSuperfluousVoid(const finding_t *fnd);
+
+/**
+ * Passes each finding to the appropriate callback, counting it in the
+ * metrics. Calls which can't be checked are warned about directly.
+ *
+ * @param found The findings to report.
+ * @param missProc Callback if a cast to void is missing.
+ * @param superProc Callback if a cast to void is superfluous.
+ */
+void report_findings(const findings_t *found, missingVoidProc missProc, superfluousVoidProc superProc);
+
+/**
+ * Returns whether a warning has been output.
+ *
+ * @return true if a suggestion was given.
+ */
+bool report_suggested(void);
+
+#endif
@@ -0,0 +1,282 @@
+/**
+ * @file rules.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Rules checked while traversing the AST.
+ */
+
+#include "rules.h"
+#include "libclang.h"
+
+#include <errno.h>
+#include <string.h>
+
+/* utility functions */
+
+/**
+ * Stores the first child of a node into the cursor passed as client data.
+ *
+ * @param cur the cursor pointing to the child
+ * @param parent the cursor pointing to the node
+ * @param dta pointer to the CXCursor to fill
+ */
+static enum CXChildVisitResult firstChild(CXCursor cur, CXCursor parent, CXClientData dta)
+{
+	*(CXCursor *)dta = cur;
+	return CXChildVisit_Break;
+}
+
+/**
+ * Returns whether a binary operator is the comma operator.
+ *
+ * @param ctx the surroundings of the operator
+ * @param cur the cursor pointing to the operator
+ * @param lhs the cursor pointing to the left operand
+ * @return true if the operator is the comma operator
+ */
+static bool isCommaOperator(const rule_ctx_t *ctx, CXCursor cur, CXCursor lhs)
+{
+	CXTranslationUnit tu;
+	CXToken *toks, *lhsToks;
+	unsigned int numToks, numLhsToks;
+	bool comma = false;
+
+#if CINDEX_VERSION_MINOR >= 64
+	/* the library in use might be older than the headers */
+	if (libclang_provides("clang_getCursorBinaryOperatorKind"))
+	{
+		return (clang_getCursorBinaryOperatorKind(cur) == CXBinaryOperator_Comma);
+	}
+#endif
+
+	/* the operator is the token right after the left operand */
+	tu = clang_Cursor_getTranslationUnit(cur);
+	rule_lock(ctx);
+	clang_tokenize(tu, clang_getCursorExtent(lhs), &lhsToks, &numLhsToks);
+	clang_tokenize(tu, clang_getCursorExtent(cur), &toks, &numToks);
+	if (numLhsToks < numToks)
+	{
+		CXString spelling = clang_getTokenSpelling(tu, toks[numLhsToks]);
+		comma = (strcmp(clang_getCString(spelling), ",") == 0);
+		clang_disposeString(spelling);
+	}
+	clang_disposeTokens(tu, toks, numToks);
+	clang_disposeTokens(tu, lhsToks, numLhsToks);
+	rule_unlock(ctx);
+
+	return comma;
+}
+
+/* the built-in rules */
+
+/**
+ * Checks for calls whose result is discarded without a cast to void.
+ *
+ * @param ctx the surroundings of the call
+ * @param cur the cursor pointing to the call
+ */
+static void checkMissingVoid(const rule_ctx_t *ctx, CXCursor cur)
+{
+	if (!ctx->discarded || ctx->voidCastAbove)
+	{
+		return;
+	}
+
+	switch (rule_calleeResult(ctx, cur))
+	{
+		case CXType_Void:
+		case CXType_Invalid:
+		case CXType_Unexposed:
+			/* nothing to discard, or can't judge; skip */
+			break;
+		default:
+			rule_reportCall(ctx, FINDING_MISSING_VOID, cur, clang_getNullCursor());
+			break;
+	}
+}
+
+/**
+ * Checks for casts to void of calls which don't return anything.
+ *
+ * @param ctx the surroundings of the call
+ * @param cur the cursor pointing to the call
+ */
+static void checkSuperfluousVoid(const rule_ctx_t *ctx, CXCursor cur)
+{
+	if (!ctx->voidCastAbove)
+	{
+		return;
+	}
+
+	if (rule_calleeResult(ctx, cur) == CXType_Void)
+	{
+		/* magic! */
+		rule_reportCall(ctx, FINDING_SUPERFLUOUS_VOID, cur, ctx->voidCast);
+	}
+}
+
+/**
+ * Checks for calls as the left operand of the comma operator whose result is
+ * discarded without a cast to void.
+ *
+ * @param ctx the surroundings of the operator
+ * @param cur the cursor pointing to the binary operator
+ */
+static void checkCommaVoid(const rule_ctx_t *ctx, CXCursor cur)
+{
+	CXCursor lhs = clang_getNullCursor();
+
+	(void)clang_visitChildren(cur, firstChild, (CXClientData)&lhs);
+	if (clang_getCursorKind(lhs) != CXCursor_CallExpr || !isCommaOperator(ctx, cur, lhs))
+	{
+		return;
+	}
+
+	switch (rule_calleeResult(ctx, lhs))
+	{
+		case CXType_Void:
+		case CXType_Invalid:
+		case CXType_Unexposed:
+			break;
+		default:
+			rule_reportCall(ctx, FINDING_MISSING_VOID, lhs, clang_getNullCursor());
+			break;
+	}
+}
+
+/** The cursor kinds the call rules are interested in. */
+static const enum CXCursorKind callKinds[] = { CXCursor_CallExpr };
+
+/** The cursor kinds the comma rule is interested in. */
+static const enum CXCursorKind commaKinds[] = { CXCursor_BinaryOperator };
+
+/** The rule finding missing casts to void. */
+static const rule_t missingVoidRule = {
+	.name = "missing-void",
+	.description = "results of calls discarded without a cast to void",
+	.kinds = callKinds,
+	.numKinds = sizeof(callKinds) / sizeof(callKinds[0]),
+	.check = checkMissingVoid
+};
+
+/** The rule finding superfluous casts to void. */
+static const rule_t superfluousVoidRule = {
+	.name = "superfluous-void",
+	.description = "casts to void of calls returning nothing",
+	.kinds = callKinds,
+	.numKinds = sizeof(callKinds) / sizeof(callKinds[0]),
+	.check = checkSuperfluousVoid
+};
+
+/** The rule finding missing casts to void in the comma operator. */
+static const rule_t commaVoidRule = {
+	.name = "comma-void",
+	.description = "results of calls discarded by the comma operator without a cast to void",
+	.kinds = commaKinds,
+	.numKinds = sizeof(commaKinds) / sizeof(commaKinds[0]),
+	.check = checkCommaVoid
+};
+
+const rule_t * const rules_builtin[] = {
+	&missingVoidRule,
+	&superfluousVoidRule,
+	&commaVoidRule,
+	NULL
+};
+
+/* public-facing functions */
+
+void ruleset_create(ruleset_t *rs)
+{
+	rs->count = 0;
+	(void)memset(rs->byKind, 0, sizeof(rs->byKind));
+}
+
+int ruleset_add(ruleset_t *rs, const rule_t *rule)
+{
+	size_t i;
+
+	for (i = 0; i < rs->count; ++i)
+	{
+		if (rs->rules[i] == rule)
+		{
+			/* already there */
+			return 1;
+		}
+	}
+
+	if (rs->count >= RULES_MAX)
+	{
+		errno = EINVAL;
+		return 0;
+	}
+
+	for (i = 0; i < rule->numKinds; ++i)
+	{
+		if ((unsigned int)rule->kinds[i] >= RULES_KINDS)
+		{
+			errno = EINVAL;
+			return 0;
+		}
+	}
+
+	for (i = 0; i < rule->numKinds; ++i)
+	{
+		rs->byKind[rule->kinds[i]] |= (uint32_t)1 << rs->count;
+	}
+	rs->rules[rs->count++] = rule;
+	return 1;
+}
+
+bool ruleset_has(const ruleset_t *rs, const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < rs->count; ++i)
+	{
+		if (strcmp(rs->rules[i]->name, name) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+int ruleset_addNamed(ruleset_t *rs, const char *names)
+{
+	const char *name = names;
+
+	for (;;)
+	{
+		const char *comma = strchr(name, ',');
+		size_t len = (comma != NULL) ? (size_t)(comma - name) : strlen(name);
+		bool all = (len == 3 && strncmp(name, "all", 3) == 0);
+		bool known = false;
+		size_t i;
+
+		for (i = 0; rules_builtin[i] != NULL; ++i)
+		{
+			if (all || (strlen(rules_builtin[i]->name) == len && strncmp(rules_builtin[i]->name, name, len) == 0))
+			{
+				known = true;
+				if (ruleset_add(rs, rules_builtin[i]) == 0)
+				{
+					return 0;
+				}
+			}
+		}
+
+		if (!known)
+		{
+			errno = EINVAL;
+			return 0;
+		}
+
+		if (comma == NULL)
+		{
+			return 1;
+		}
+		name = comma + 1;
+	}
+}
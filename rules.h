@@ -0,0 +1,197 @@
+/**
+ * @file rules.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Rules checked while traversing the AST.
+ * @details Each rule states which kinds of cursors it is interested in. A rule
+ * set maps each cursor kind to the rules interested in it, so that a single
+ * traversal of the AST can dispatch each node to exactly those rules.
+ */
+
+#ifndef __RULES_H__
+#define __RULES_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <clang-c/Index.h>
+
+#include "findings.h"
+
+/** The maximum number of rules in a rule set (one bit per rule). */
+#define RULES_MAX 32
+
+/**
+ * The number of cursor kinds which rules may be interested in. Cursors of
+ * other kinds are never dispatched to a rule.
+ */
+#define RULES_KINDS 1024
+
+/**
+ * The surroundings of the node examined by a rule, as established by the
+ * traversal.
+ */
+typedef struct
+{
+	/** Is the node a statement of its own, i.e. is its value discarded? */
+	bool discarded;
+
+	/** Is the node directly below a cast to void? */
+	bool voidCastAbove;
+
+	/** The cast to void above the node. Valid iff voidCastAbove. */
+	CXCursor voidCast;
+
+	/** The state of the traversal; only to be passed back to rule_*(). */
+	void *descent;
+} rule_ctx_t;
+
+/**
+ * Type of callback which examines a node.
+ *
+ * @param ctx the surroundings of the node
+ * @param cur the cursor pointing to the node
+ */
+typedef void (*ruleCheckProc)(const rule_ctx_t *ctx, CXCursor cur);
+
+/** A rule. */
+typedef struct
+{
+	/** The name of the rule, as given on the command line. */
+	const char *name;
+
+	/** A short description of what the rule looks for. */
+	const char *description;
+
+	/** The kinds of cursors the rule is interested in. */
+	const enum CXCursorKind *kinds;
+
+	/** The number of cursor kinds the rule is interested in. */
+	size_t numKinds;
+
+	/** The function examining each node of the kinds given above. */
+	ruleCheckProc check;
+} rule_t;
+
+/** A set of rules, indexed by the kinds of cursors they are interested in. */
+typedef struct
+{
+	/** How many rules are in the set? */
+	size_t count;
+
+	/** The rules themselves. */
+	const rule_t *rules[RULES_MAX];
+
+	/** For each cursor kind, a bit set of the rules interested in it. */
+	uint32_t byKind[RULES_KINDS];
+} ruleset_t;
+
+/** The rules built into the Voidcaster, terminated by NULL. */
+extern const rule_t * const rules_builtin[];
+
+/**
+ * Create an empty set of rules.
+ *
+ * @param rs Pointer to fill with a rule set structure.
+ */
+void ruleset_create(ruleset_t *rs);
+
+/**
+ * Add a rule to a set of rules. Adding a rule which is already in the set
+ * does nothing.
+ *
+ * @param rs Pointer to a rule set structure.
+ * @param rule The rule to add.
+ * @return 1 on success, 0 on failure (setting errno to EINVAL if the set is
+ * full or the rule is interested in an unsupported cursor kind).
+ */
+int ruleset_add(ruleset_t *rs, const rule_t *rule);
+
+/**
+ * Add built-in rules to a set of rules.
+ *
+ * @param rs Pointer to a rule set structure.
+ * @param names The comma-separated names of the rules to add, or "all".
+ * @return 1 on success, 0 on failure (setting errno to EINVAL if a name is
+ * unknown).
+ */
+int ruleset_addNamed(ruleset_t *rs, const char *names);
+
+/**
+ * Returns whether a set of rules contains the rule of the given name.
+ *
+ * @param rs Pointer to a rule set structure.
+ * @param name The name of the rule.
+ * @return true if the set contains the rule
+ */
+bool ruleset_has(const ruleset_t *rs, const char *name);
+
+/**
+ * Pass a node to each rule of a set which is interested in its kind.
+ *
+ * @param rs Pointer to a rule set structure.
+ * @param ctx The surroundings of the node.
+ * @param cur The cursor pointing to the node.
+ * @param kind The kind of the cursor.
+ */
+static inline void ruleset_dispatch(const ruleset_t *rs, const rule_ctx_t *ctx, CXCursor cur, enum CXCursorKind kind)
+{
+	uint32_t interested;
+
+	if ((unsigned int)kind >= RULES_KINDS)
+	{
+		return;
+	}
+
+	for (interested = rs->byKind[kind]; interested != 0; interested &= interested - 1)
+	{
+		rs->rules[__builtin_ctz(interested)]->check(ctx, cur);
+	}
+}
+
+/*
+ * The following functions are provided by the traversal for use by rules.
+ */
+
+/**
+ * Acquires the lock serializing calls into libclang which are not safe to
+ * perform concurrently on the same translation unit (those decoding source
+ * locations or tokenizing), if the translation unit is traversed by multiple
+ * threads.
+ *
+ * @param ctx the surroundings of the node being examined
+ */
+void rule_lock(const rule_ctx_t *ctx);
+
+/**
+ * Releases the lock acquired by rule_lock().
+ *
+ * @param ctx the surroundings of the node being examined
+ */
+void rule_unlock(const rule_ctx_t *ctx);
+
+/**
+ * Returns the kind of the result type of the function called. If the function
+ * cannot be found (and is targeted), a FINDING_UNCHECKED_CALL is reported.
+ *
+ * @param ctx the surroundings of the node being examined
+ * @param call the cursor pointing to the call
+ * @return the kind of the result type; CXType_Invalid if the function cannot be
+ * found or is not among the callees targeted
+ */
+enum CXTypeKind rule_calleeResult(const rule_ctx_t *ctx, CXCursor call);
+
+/**
+ * Reports a finding concerning a function call.
+ *
+ * @param ctx the surroundings of the node being examined
+ * @param kind the kind of finding
+ * @param call the cursor pointing to the call
+ * @param cast the cursor pointing to the cast to void in question if the
+ * finding is a superfluous cast; ignored otherwise
+ */
+void rule_reportCall(const rule_ctx_t *ctx, finding_kind_t kind, CXCursor call, CXCursor cast);
+
+#endif
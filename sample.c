@@ -0,0 +1,598 @@
+/**
+ * @file sample.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Estimates from a random sample of the files.
+ */
+
+#include "sample.h"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "hash.h"
+
+/** The quantile of the normal distribution for 95% confidence. */
+#define Z_95 1.959964
+
+/** A file being assigned to a stratum. */
+typedef struct
+{
+	/** The directory of the file; not NUL-terminated. */
+	const char *dir;
+
+	/** The length of the directory. */
+	size_t dirLen;
+
+	/** The size of the file; 0 if unknown. */
+	off_t size;
+
+	/** The index of the file. */
+	size_t index;
+} placed_t;
+
+/** The share of a directory in the sample. */
+typedef struct
+{
+	/** The index of the first file of the directory among the files placed. */
+	size_t start;
+
+	/** The number of files in the directory. */
+	size_t population;
+
+	/** The number of them which would be chosen if files could be split. */
+	double quota;
+
+	/** The number of them to choose. */
+	size_t chosen;
+} share_t;
+
+/** An estimate of a total. */
+typedef struct
+{
+	/** The estimated total. */
+	double total;
+
+	/** The variance of the estimate. */
+	double variance;
+} estimate_t;
+
+/** A value across all files sampled. */
+typedef struct
+{
+	/** The number of files sampled. */
+	size_t n;
+
+	/** The mean of the value. */
+	double mean;
+
+	/** The variance of the value. */
+	double variance;
+} pooled_t;
+
+/* utility functions */
+
+/**
+ * Returns the next pseudorandom number (xorshift64*).
+ *
+ * @param state the state of the generator; must not be zero
+ * @param bound the exclusive upper bound of the number
+ * @return a number between 0 and bound-1
+ */
+static size_t nextRandom(uint64_t *state, size_t bound)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return (size_t)(((*state * UINT64_C(2685821657736338717)) >> 11) % bound);
+}
+
+/**
+ * Compares two files by directory, then size, then index. Useful for qsort(3).
+ *
+ * @param left Pointer to the first file (pointer to placed_t).
+ * @param right Pointer to the second file (pointer to placed_t).
+ * @return Less than zero if left ordered before right.
+ *         Zero if left and right equally ordered.
+ *         More than zero if right ordered before left.
+ */
+static int comparator_placed(const void *left, const void *right)
+{
+	const placed_t *l = left;
+	const placed_t *r = right;
+	int cmp = memcmp(l->dir, r->dir, (l->dirLen < r->dirLen) ? l->dirLen : r->dirLen);
+
+	if (cmp != 0)
+		return cmp;
+	if (l->dirLen != r->dirLen)
+		return (l->dirLen < r->dirLen) ? -1 : 1;
+	if (l->size != r->size)
+		return (l->size < r->size) ? -1 : 1;
+	if (l->index != r->index)
+		return (l->index < r->index) ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Compares two indices. Useful for qsort(3).
+ *
+ * @param left Pointer to the first index (pointer to size_t).
+ * @param right Pointer to the second index (pointer to size_t).
+ * @return Less than zero, zero or more than zero, like strcmp(3).
+ */
+static int comparator_index(const void *left, const void *right)
+{
+	size_t l = *(const size_t *)left;
+	size_t r = *(const size_t *)right;
+
+	return (l > r) - (l < r);
+}
+
+/**
+ * Compares two shares by the number of files chosen, then by the number of
+ * files, both descending, then by position. Useful for qsort(3).
+ *
+ * @param left Pointer to the first share (pointer to share_t *).
+ * @param right Pointer to the second share (pointer to share_t *).
+ * @return Less than zero if left ordered before right.
+ *         Zero if left and right equally ordered.
+ *         More than zero if right ordered before left.
+ */
+static int comparator_share(const void *left, const void *right)
+{
+	const share_t *l = *(share_t * const *)left;
+	const share_t *r = *(share_t * const *)right;
+
+	if (l->chosen != r->chosen)
+		return (l->chosen > r->chosen) ? -1 : 1;
+	if (l->population != r->population)
+		return (l->population > r->population) ? -1 : 1;
+	return (l->start > r->start) - (l->start < r->start);
+}
+
+/**
+ * Compares two shares by how far they fall short of their quota, descending,
+ * then by position. Useful for qsort(3).
+ *
+ * @param left Pointer to the first share (pointer to share_t *).
+ * @param right Pointer to the second share (pointer to share_t *).
+ * @return Less than zero if left ordered before right.
+ *         Zero if left and right equally ordered.
+ *         More than zero if right ordered before left.
+ */
+static int comparator_shortfall(const void *left, const void *right)
+{
+	const share_t *l = *(share_t * const *)left;
+	const share_t *r = *(share_t * const *)right;
+	double ls = l->quota - (double)l->chosen;
+	double rs = r->quota - (double)r->chosen;
+
+	if (ls != rs)
+		return (ls > rs) ? -1 : 1;
+	return (l->start > r->start) - (l->start < r->start);
+}
+
+/**
+ * Reduces the shares by the number of files too many, taking from the
+ * largest ones first. If there are at least as many shares as files wanted,
+ * the largest directories get one file each and the others none.
+ *
+ * @param byShare The shares, sorted by comparator_share.
+ * @param count The number of shares.
+ * @param want The number of files wanted.
+ * @param excess The number of files chosen beyond that.
+ */
+static void trimShares(share_t **byShare, size_t count, size_t want, size_t excess)
+{
+	size_t i, level, next, leveled;
+
+	if (count >= want)
+	{
+		for (i = 0; i < count; ++i)
+		{
+			byShare[i]->chosen = (i < want) ? 1 : 0;
+		}
+		return;
+	}
+
+	/* level the largest shares down until enough has been taken */
+	level = byShare[0]->chosen;
+	leveled = 0;
+	while (excess > 0)
+	{
+		while (leveled < count && byShare[leveled]->chosen == level)
+		{
+			++leveled;
+		}
+
+		/* every share keeps at least one file, which leaves enough */
+		next = (leveled < count) ? byShare[leveled]->chosen : 1;
+		if (leveled * (level - next) >= excess)
+		{
+			break;
+		}
+		excess -= leveled * (level - next);
+		level = next;
+	}
+
+	/* the first ones are the largest; they give one more */
+	for (i = 0; i < leveled; ++i)
+	{
+		byShare[i]->chosen = level - excess / leveled - ((i < excess % leveled) ? 1 : 0);
+	}
+}
+
+/**
+ * Add a stratum and choose its files at random.
+ *
+ * @param smp Pointer to a sample structure.
+ * @param placed The files of the stratum; shuffled partially.
+ * @param population The number of files of the stratum.
+ * @param chosen The number of files to choose.
+ * @param state The state of the pseudorandom number generator.
+ */
+static void addStratum(sample_t *smp, placed_t *placed, size_t population, size_t chosen, uint64_t *state)
+{
+	sample_stratum_t *stratum = &smp->strata[smp->stratumCount];
+	size_t i;
+
+	stratum->dir = placed[0].dir;
+	stratum->dirLen = placed[0].dirLen;
+	stratum->population = population;
+	stratum->chosen = chosen;
+
+	for (i = 0; i < population; ++i)
+	{
+		smp->files[placed[i].index].stratum = smp->stratumCount;
+	}
+
+	/* the first few of a partial Fisher-Yates shuffle */
+	for (i = 0; i < chosen; ++i)
+	{
+		size_t j = i + nextRandom(state, population - i);
+		placed_t swap = placed[i];
+
+		placed[i] = placed[j];
+		placed[j] = swap;
+		smp->picks[smp->pickCount++] = placed[i].index;
+	}
+
+	++smp->stratumCount;
+}
+
+/**
+ * Add the variance of the estimate of a stratum's total to an estimate.
+ *
+ * @param est The estimate to add to.
+ * @param population The number of files in the stratum.
+ * @param n The number of files sampled from it.
+ * @param sum The sum of the values of the files sampled.
+ * @param sumSquares The sum of the squares of those values.
+ * @param pooled The mean and variance of the values across all files sampled,
+ * and their number, for strata where they can't be estimated from the files
+ * sampled from the stratum.
+ */
+static void addStratumEstimate(
+	estimate_t *est,
+	size_t population,
+	size_t n,
+	double sum,
+	double sumSquares,
+	const pooled_t *pooled
+)
+{
+	double mean, variance;
+
+	if (n == 0)
+	{
+		/* a directory left out of a sample smaller than the number of directories */
+		if (pooled->n > 0)
+		{
+			est->total += (double)population * pooled->mean;
+			est->variance += (double)population * (double)population * pooled->variance / (double)pooled->n;
+		}
+		return;
+	}
+
+	mean = sum / (double)n;
+	variance = (n > 1) ? (sumSquares - sum * mean) / (double)(n - 1) : pooled->variance;
+	if (variance < 0.0)
+	{
+		/* rounding */
+		variance = 0.0;
+	}
+
+	est->total += (double)population * mean;
+	est->variance += (double)population * (double)population *
+		(1.0 - (double)n / (double)population) * variance / (double)n;
+}
+
+/**
+ * Output an estimate with the half-width of its confidence interval.
+ *
+ * @param out The stream to output to.
+ * @param est The estimate.
+ */
+static void printEstimate(FILE *out, const estimate_t *est)
+{
+	(void)fprintf(out, " %10.0f +/-%8.0f", est->total, Z_95 * sqrt(est->variance));
+}
+
+/* public functions */
+
+int sample_choose(sample_t *smp, const char * const *paths, size_t count, size_t want, uint64_t seed)
+{
+	placed_t *placed;
+	share_t *shares, **byShare;
+	size_t i, start, end, shareCount = 0, total = 0;
+	uint64_t state;
+
+	smp->count = count;
+	smp->stratumCount = 0;
+	smp->pickCount = 0;
+	smp->seed = seed;
+	smp->files = calloc(count, sizeof(sample_file_t));
+	smp->strata = malloc(count * sizeof(sample_stratum_t));
+	smp->picks = malloc(count * sizeof(size_t));
+	placed = malloc(count * sizeof(placed_t));
+	shares = malloc(count * sizeof(share_t));
+	byShare = malloc(count * sizeof(share_t *));
+	if (
+		count == 0 || smp->files == NULL || smp->strata == NULL || smp->picks == NULL || placed == NULL ||
+		shares == NULL || byShare == NULL
+	)
+	{
+		free(placed);
+		free(shares);
+		free(byShare);
+		sample_destroy(smp);
+		if (count == 0)
+		{
+			errno = EINVAL;
+		}
+		return 0;
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		const char *slash = strrchr(paths[i], '/');
+		struct stat st;
+
+		placed[i].dir = paths[i];
+		placed[i].dirLen = (slash == NULL) ? 0 : (slash == paths[i]) ? 1 : (size_t)(slash - paths[i]);
+
+		/* files which can't be examined are left for the analysis to complain about */
+		placed[i].size = (stat(paths[i], &st) == 0) ? st.st_size : 0;
+		placed[i].index = i;
+	}
+	qsort(placed, count, sizeof(placed_t), comparator_placed);
+	if (want > count)
+	{
+		want = count;
+	}
+
+	/* xorshift gets stuck on zero */
+	state = hash_bytes(HASH_INIT, &seed, sizeof(seed));
+	if (state == 0)
+	{
+		state = 1;
+	}
+
+	/* proportional allocation, but every directory is represented if possible */
+	for (start = 0; start < count; start = end)
+	{
+		share_t *share = &shares[shareCount++];
+
+		for (end = start + 1; end < count; ++end)
+		{
+			if (placed[end].dirLen != placed[start].dirLen || memcmp(placed[end].dir, placed[start].dir, placed[start].dirLen) != 0)
+			{
+				break;
+			}
+		}
+
+		share->start = start;
+		share->population = end - start;
+		share->quota = (double)want * (double)share->population / (double)count;
+		share->chosen = (size_t)(share->quota + 0.5);
+		if (share->chosen < 1)
+		{
+			share->chosen = 1;
+		}
+		if (share->chosen > share->population)
+		{
+			share->chosen = share->population;
+		}
+		total += share->chosen;
+		byShare[shareCount - 1] = share;
+	}
+
+	/* rounding up and representing every directory mustn't exceed the number asked for */
+	if (total > want)
+	{
+		qsort(byShare, shareCount, sizeof(share_t *), comparator_share);
+		trimShares(byShare, shareCount, want, total - want);
+	}
+	else if (total < want)
+	{
+		/* rounding down fell short; those which fell shortest of their quota make up for it */
+		qsort(byShare, shareCount, sizeof(share_t *), comparator_shortfall);
+		for (i = 0; total < want; ++i)
+		{
+			++byShare[i]->chosen;
+			++total;
+		}
+	}
+
+	for (i = 0; i < shareCount; ++i)
+	{
+		const share_t *share = &shares[i];
+
+		if (share->chosen >= SAMPLE_SPLIT_MIN && share->population >= 2 * SAMPLE_SPLIT_MIN)
+		{
+			/* the smaller and the larger half, each with at least two files sampled to estimate its variance */
+			size_t half = share->population / 2;
+			size_t chosenSmall = (size_t)((double)share->chosen * (double)half / (double)share->population + 0.5);
+
+			addStratum(smp, &placed[share->start], half, chosenSmall, &state);
+			addStratum(smp, &placed[share->start + half], share->population - half, share->chosen - chosenSmall, &state);
+		}
+		else
+		{
+			addStratum(smp, &placed[share->start], share->population, share->chosen, &state);
+		}
+	}
+
+	free(shares);
+	free(byShare);
+	free(placed);
+
+	/* analyze them in the order given */
+	qsort(smp->picks, smp->pickCount, sizeof(size_t), comparator_index);
+	return 1;
+}
+
+void sample_destroy(sample_t *smp)
+{
+	free(smp->files);
+	free(smp->strata);
+	free(smp->picks);
+	smp->files = NULL;
+	smp->strata = NULL;
+	smp->picks = NULL;
+	smp->count = 0;
+	smp->stratumCount = 0;
+	smp->pickCount = 0;
+}
+
+void sample_record(sample_t *smp, size_t pick, const findings_t *found, double seconds)
+{
+	sample_file_t *file = &smp->files[smp->picks[pick]];
+	size_t f;
+
+	file->recorded = true;
+	file->missing = 0.0;
+	file->superfluous = 0.0;
+	file->seconds = seconds;
+
+	for (f = 0; f < found->count; ++f)
+	{
+		if (found->arr[f].kind == FINDING_MISSING_VOID)
+		{
+			file->missing += 1.0;
+		}
+		else if (found->arr[f].kind == FINDING_SUPERFLUOUS_VOID)
+		{
+			file->superfluous += 1.0;
+		}
+	}
+}
+
+void sample_report(const sample_t *smp, FILE *out)
+{
+	/* per stratum: count, sums and sums of squares of missing, superfluous and seconds */
+	double *sums = calloc(smp->stratumCount * 7, sizeof(double));
+	double all[7] = { 0 };
+	pooled_t pooled[3];
+	estimate_t dirEst[3], totalEst[3];
+	size_t h, i, k, analyzed = 0, dirFiles = 0, dirAnalyzed = 0;
+
+	if (sums == NULL)
+	{
+		perror("calloc");
+		return;
+	}
+
+	for (i = 0; i < smp->count; ++i)
+	{
+		const sample_file_t *file = &smp->files[i];
+		double values[3] = { file->missing, file->superfluous, file->seconds };
+		double *s = &sums[file->stratum * 7];
+
+		if (!file->recorded)
+		{
+			continue;
+		}
+
+		++analyzed;
+		s[0] += 1.0;
+		all[0] += 1.0;
+		for (k = 0; k < 3; ++k)
+		{
+			s[1 + 2 * k] += values[k];
+			s[2 + 2 * k] += values[k] * values[k];
+			all[1 + 2 * k] += values[k];
+			all[2 + 2 * k] += values[k] * values[k];
+		}
+	}
+
+	for (k = 0; k < 3; ++k)
+	{
+		double mean = (analyzed > 0) ? all[1 + 2 * k] / all[0] : 0.0;
+
+		pooled[k].n = analyzed;
+		pooled[k].mean = mean;
+		pooled[k].variance = (analyzed > 1) ? (all[2 + 2 * k] - all[1 + 2 * k] * mean) / (all[0] - 1.0) : 0.0;
+		totalEst[k].total = totalEst[k].variance = 0.0;
+		dirEst[k].total = dirEst[k].variance = 0.0;
+	}
+
+	(void)fprintf(out, "Sample: %zu of %zu files analyzed (seed %llu), %.3f s\n",
+		analyzed, smp->count, (unsigned long long)smp->seed, all[5]
+	);
+	(void)fprintf(out, "%10s %10s %21s %21s  %s\n", "files", "analyzed", "missing casts", "superfluous casts", "directory");
+
+	for (h = 0; h < smp->stratumCount; ++h)
+	{
+		const sample_stratum_t *stratum = &smp->strata[h];
+		const sample_stratum_t *next = (h + 1 < smp->stratumCount) ? &smp->strata[h + 1] : NULL;
+		const double *s = &sums[h * 7];
+
+		for (k = 0; k < 3; ++k)
+		{
+			addStratumEstimate(&dirEst[k], stratum->population, (size_t)s[0], s[1 + 2 * k], s[2 + 2 * k], &pooled[k]);
+			addStratumEstimate(&totalEst[k], stratum->population, (size_t)s[0], s[1 + 2 * k], s[2 + 2 * k], &pooled[k]);
+		}
+		dirFiles += stratum->population;
+		dirAnalyzed += (size_t)s[0];
+
+		if (next != NULL && next->dirLen == stratum->dirLen && memcmp(next->dir, stratum->dir, stratum->dirLen) == 0)
+		{
+			/* the other half of the same directory */
+			continue;
+		}
+
+		(void)fprintf(out, "%10zu %10zu", dirFiles, dirAnalyzed);
+		printEstimate(out, &dirEst[0]);
+		printEstimate(out, &dirEst[1]);
+		if (stratum->dirLen == 0)
+		{
+			(void)fprintf(out, "  .\n");
+		}
+		else
+		{
+			(void)fprintf(out, "  %.*s\n", (int)stratum->dirLen, stratum->dir);
+		}
+
+		dirFiles = dirAnalyzed = 0;
+		for (k = 0; k < 3; ++k)
+		{
+			dirEst[k].total = dirEst[k].variance = 0.0;
+		}
+	}
+
+	(void)fprintf(out, "%10zu %10zu", smp->count, analyzed);
+	printEstimate(out, &totalEst[0]);
+	printEstimate(out, &totalEst[1]);
+	(void)fprintf(out, "  (total)\n");
+
+	(void)fprintf(out, "Estimated time to analyze all files: %.1f s +/- %.1f s\n",
+		totalEst[2].total, Z_95 * sqrt(totalEst[2].variance)
+	);
+	(void)fprintf(out, "(+/- gives the 95%% confidence interval.)\n");
+
+	free(sums);
+}
@@ -0,0 +1,131 @@
+/**
+ * @file sample.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Estimates from a random sample of the files.
+ * @details The files are divided into strata by their directory and, where
+ * the sample is large enough, into the smaller and the larger half of each
+ * directory's files. Each stratum contributes to the sample in proportion to
+ * its size, but at least one file, so that every directory is represented;
+ * where that and rounding exceed the size of the sample, the largest strata
+ * give up files, and where rounding falls short of it, those furthest below
+ * their share get more. If there are more directories than files to sample,
+ * only the largest directories get one each, and the others are estimated
+ * from all files sampled. The findings and analysis times of the files
+ * sampled are then extrapolated to all files with a stratified estimator,
+ * giving 95% confidence intervals.
+ */
+
+#ifndef __SAMPLE_H__
+#define __SAMPLE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "findings.h"
+
+/** The number of files a stratum needs in the sample to be split by size. */
+#define SAMPLE_SPLIT_MIN 4
+
+/** What is known about one file. */
+typedef struct
+{
+	/** The index of the stratum of the file. */
+	size_t stratum;
+
+	/** Has the file been analyzed? */
+	bool recorded;
+
+	/** The number of missing casts found in the file. */
+	double missing;
+
+	/** The number of superfluous casts found in the file. */
+	double superfluous;
+
+	/** How long the file took to analyze, in seconds. */
+	double seconds;
+} sample_file_t;
+
+/** A group of similar files, sampled independently of the others. */
+typedef struct
+{
+	/** The directory of the files; not NUL-terminated. */
+	const char *dir;
+
+	/** The length of the directory; 0 for the current directory. */
+	size_t dirLen;
+
+	/** The number of files in the stratum. */
+	size_t population;
+
+	/** The number of them chosen for the sample. */
+	size_t chosen;
+} sample_stratum_t;
+
+/** A stratified sample of files. */
+typedef struct
+{
+	/** The number of files. */
+	size_t count;
+
+	/** The files, in the order given. */
+	sample_file_t *files;
+
+	/** The number of strata. */
+	size_t stratumCount;
+
+	/** The strata, sorted by directory. */
+	sample_stratum_t *strata;
+
+	/** The number of files chosen. */
+	size_t pickCount;
+
+	/** The indices of the files chosen, in ascending order. */
+	size_t *picks;
+
+	/** The seed the files were chosen with. */
+	uint64_t seed;
+} sample_t;
+
+/**
+ * Choose a stratified random sample of files.
+ *
+ * @param smp Pointer to fill with a sample structure.
+ * @param paths The paths of the files; must stay valid.
+ * @param count The number of files.
+ * @param want The number of files to choose; all of them if there are fewer.
+ * @param seed The seed of the pseudorandom number generator.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int sample_choose(sample_t *smp, const char * const *paths, size_t count, size_t want, uint64_t seed);
+
+/**
+ * Destroy a sample.
+ *
+ * @param smp Pointer to a sample structure.
+ */
+void sample_destroy(sample_t *smp);
+
+/**
+ * Record what the analysis of a file chosen for the sample yielded.
+ *
+ * @param smp Pointer to a sample structure.
+ * @param pick The index of the file among those chosen.
+ * @param found The findings in the file.
+ * @param seconds How long the file took to analyze.
+ */
+void sample_record(sample_t *smp, size_t pick, const findings_t *found, double seconds);
+
+/**
+ * Output the estimated numbers of findings per directory and in total, and the
+ * estimated time needed to analyze all files.
+ *
+ * @param smp Pointer to a sample structure.
+ * @param out The stream to output to.
+ */
+void sample_report(const sample_t *smp, FILE *out);
+
+#endif
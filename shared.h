@@ -49,7 +49,10 @@ enum exitcodes_e
 	EXITCODE_CLANG_FAIL = 5,
 
 	/** Memory management error. */
-	EXITCODE_MM = 6
+	EXITCODE_MM = 6,
+
+	/** A newer interactive run for a file cancelled the analysis of the file. */
+	EXITCODE_CANCELLED = 7
 };
 
 #endif
@@ -0,0 +1,621 @@
+/**
+ * @file shmcache.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Cache of findings shared by all Voidcaster processes on a host.
+ * @details The file starts with a header, followed by the slots of the hash
+ * table (open addressing with linear probing) and the arena. A slot holds a
+ * key and a reference to an entry in the arena (its offset in units of
+ * ENTRY_ALIGN and its length); a key is claimed by compare-and-swap, and the
+ * reference is published with release semantics once the entry has been
+ * written. Space in the arena is claimed by atomically advancing its head and
+ * is never reused, so published entries never change. The file is only locked
+ * while it is being created.
+ *
+ * The payload of an entry consists of the number of files included and the
+ * number of findings, then the included files (modification time, size, name)
+ * and the findings. All numbers are stored in host byte order.
+ */
+
+#include "shmcache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "hash.h"
+
+/** The magic bytes at the beginning of a cache file. */
+static const char CACHE_MAGIC[8] = { 'V', 'C', 'S', 'H', 'M', 'C', '0', '1' };
+
+/** The smallest cache file accepted. */
+#define MIN_SIZE ((size_t)1024 * 1024)
+
+/** The alignment of entries in the arena. */
+#define ENTRY_ALIGN 16
+
+/** How many slots are probed before giving up. */
+#define MAX_PROBES 64
+
+/** The header of a cache file. */
+typedef struct
+{
+	/** CACHE_MAGIC. */
+	char magic[8];
+
+	/** The size of the file. */
+	uint64_t size;
+
+	/** The number of slots; a power of two. */
+	uint64_t slotCount;
+
+	/** The offset of the arena. */
+	uint64_t arenaStart;
+
+	/** The offset of the free space in the arena; may exceed the size once the arena is full. */
+	_Atomic uint64_t arenaHead;
+} cache_header;
+
+/** A slot of the hash table. */
+typedef struct
+{
+	/** The key; zero if the slot is free. */
+	_Atomic uint64_t key;
+
+	/** The reference to the entry; zero if none has been published yet. */
+	_Atomic uint64_t ref;
+} cache_slot;
+
+/** The header of an entry in the arena. */
+typedef struct
+{
+	/** The key of the entry. */
+	uint64_t key;
+
+	/** The hash of the payload. */
+	uint64_t checksum;
+
+	/** The length of the payload. */
+	uint64_t length;
+} entry_header;
+
+/** The description of a file included, as stored. */
+typedef struct
+{
+	/** The modification time of the file, seconds. */
+	int64_t mtimeSec;
+
+	/** The modification time of the file, nanoseconds. */
+	int64_t mtimeNsec;
+
+	/** The size of the file. */
+	uint64_t size;
+
+	/** The length of the name of the file, including its NUL. */
+	uint64_t nameLen;
+} stored_dep;
+
+/** A finding, as stored. */
+typedef struct
+{
+	/** The kind of the finding. */
+	uint64_t kind;
+
+	/** The start location. */
+	uint64_t startLine, startCol;
+
+	/** The end location. */
+	uint64_t endLine, endCol;
+
+	/** The number of macro expansions. */
+	uint64_t expansions;
+
+	/** The length of the file name, including its NUL. */
+	uint64_t fileLen;
+
+	/** The length of the function name, including its NUL. */
+	uint64_t funcLen;
+} stored_finding;
+
+/** A buffer into which a payload is serialized. */
+typedef struct
+{
+	/** The bytes. */
+	char *data;
+
+	/** The number of bytes. */
+	size_t length;
+
+	/** How many bytes can the buffer house? */
+	size_t capacity;
+} payload_buf;
+
+/* utility functions */
+
+/**
+ * Returns the header of a cache.
+ *
+ * @param sc Pointer to an open shared cache structure.
+ * @return The header.
+ */
+static inline cache_header *header(const shmcache_t *sc)
+{
+	return (cache_header *)sc->map;
+}
+
+/**
+ * Returns the slots of a cache.
+ *
+ * @param sc Pointer to an open shared cache structure.
+ * @return The slots.
+ */
+static inline cache_slot *slots(const shmcache_t *sc)
+{
+	return (cache_slot *)((char *)sc->map + sizeof(cache_header));
+}
+
+/**
+ * Appends bytes to a payload buffer.
+ *
+ * @param buf The buffer.
+ * @param data The bytes to append.
+ * @param length The number of bytes.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int append(payload_buf *buf, const void *data, size_t length)
+{
+	if (buf->length + length > buf->capacity)
+	{
+		size_t newcap = (buf->capacity == 0) ? 4096 : buf->capacity;
+		char *newdata;
+
+		while (newcap < buf->length + length)
+		{
+			newcap *= 2;
+		}
+		newdata = realloc(buf->data, newcap);
+		if (newdata == NULL)
+		{
+			return 0;
+		}
+		buf->data = newdata;
+		buf->capacity = newcap;
+	}
+
+	(void)memcpy(buf->data + buf->length, data, length);
+	buf->length += length;
+	return 1;
+}
+
+/**
+ * Takes bytes from a payload being deserialized.
+ *
+ * @param p By-ref to the current position; advanced.
+ * @param end The end of the payload.
+ * @param length The number of bytes to take.
+ * @return The bytes taken, or NULL if the payload is too short.
+ */
+static const char *take(const char **p, const char *end, size_t length)
+{
+	const char *taken = *p;
+
+	if ((size_t)(end - *p) < length)
+	{
+		return NULL;
+	}
+	*p += length;
+	return taken;
+}
+
+/**
+ * Takes a NUL-terminated string from a payload being deserialized.
+ *
+ * @param p By-ref to the current position; advanced.
+ * @param end The end of the payload.
+ * @param length The length of the string, including its NUL.
+ * @return The string, or NULL if the payload is too short or the string isn't
+ * terminated.
+ */
+static const char *takeString(const char **p, const char *end, uint64_t length)
+{
+	const char *str = (length == 0 || length > (uint64_t)(end - *p)) ? NULL : take(p, end, (size_t)length);
+	return (str == NULL || str[length - 1] != '\0') ? NULL : str;
+}
+
+/**
+ * Finds the payload of the entry published under a key.
+ *
+ * @param sc Pointer to an open shared cache structure.
+ * @param key The key; not zero.
+ * @param length By-ref to the length of the payload.
+ * @return The payload, or NULL if no intact entry is published under the key.
+ */
+static const char *lookup(const shmcache_t *sc, uint64_t key, size_t *length)
+{
+	const cache_header *hdr = header(sc);
+	cache_slot *sl = slots(sc);
+	uint64_t mask = hdr->slotCount - 1;
+	unsigned int i;
+
+	for (i = 0; i < MAX_PROBES; ++i)
+	{
+		cache_slot *slot = &sl[(key + i) & mask];
+		uint64_t found = atomic_load_explicit(&slot->key, memory_order_acquire);
+		uint64_t ref, offset;
+		const entry_header *ent;
+		const char *payload;
+
+		if (found == 0)
+		{
+			return NULL;
+		}
+		if (found != key)
+		{
+			continue;
+		}
+
+		ref = atomic_load_explicit(&slot->ref, memory_order_acquire);
+		offset = (ref >> 32) * ENTRY_ALIGN;
+		*length = (size_t)(ref & UINT32_MAX);
+		if (
+			ref == 0 || offset < hdr->arenaStart ||
+			offset + sizeof(entry_header) + *length > sc->size
+		)
+		{
+			/* not published yet (or its writer crashed) */
+			return NULL;
+		}
+
+		ent = (const entry_header *)((const char *)sc->map + offset);
+		payload = (const char *)(ent + 1);
+		if (
+			ent->key != key || ent->length != *length ||
+			ent->checksum != hash_bytes(HASH_INIT, payload, *length)
+		)
+		{
+			return NULL;
+		}
+		return payload;
+	}
+
+	return NULL;
+}
+
+/**
+ * Writes an entry into the arena and publishes it under a key.
+ *
+ * @param sc Pointer to an open shared cache structure.
+ * @param key The key; not zero.
+ * @param payload The payload.
+ * @param length The length of the payload.
+ * @return 1 on success, 0 on failure (setting errno appropriately; ENOSPC if
+ * the cache is full).
+ */
+static int publish(shmcache_t *sc, uint64_t key, const char *payload, size_t length)
+{
+	cache_header *hdr = header(sc);
+	cache_slot *sl = slots(sc);
+	uint64_t mask = hdr->slotCount - 1;
+	uint64_t total = (sizeof(entry_header) + length + ENTRY_ALIGN - 1) / ENTRY_ALIGN * ENTRY_ALIGN;
+	uint64_t offset, ref;
+	entry_header *ent;
+	unsigned int i;
+
+	if (length > UINT32_MAX || atomic_load(&hdr->arenaHead) + total > sc->size)
+	{
+		errno = ENOSPC;
+		return 0;
+	}
+
+	offset = atomic_fetch_add(&hdr->arenaHead, total);
+	if (offset + total > sc->size)
+	{
+		errno = ENOSPC;
+		return 0;
+	}
+
+	ent = (entry_header *)((char *)sc->map + offset);
+	ent->key = key;
+	ent->length = length;
+	ent->checksum = hash_bytes(HASH_INIT, payload, length);
+	(void)memcpy(ent + 1, payload, length);
+	ref = ((offset / ENTRY_ALIGN) << 32) | (uint64_t)length;
+
+	for (i = 0; i < MAX_PROBES; ++i)
+	{
+		cache_slot *slot = &sl[(key + i) & mask];
+		uint64_t expected = 0;
+
+		if (
+			atomic_compare_exchange_strong(&slot->key, &expected, key) ||
+			expected == key
+		)
+		{
+			/* the entry is complete; make it visible */
+			atomic_store_explicit(&slot->ref, ref, memory_order_release);
+			return 1;
+		}
+	}
+
+	errno = ENOSPC;
+	return 0;
+}
+
+/**
+ * Returns whether a file still has the given size and modification time.
+ *
+ * @param path The path to the file.
+ * @param dep The stored description of the file.
+ * @return true if the file is unchanged
+ */
+static bool unchanged(const char *path, const stored_dep *dep)
+{
+	struct stat st;
+
+	return (
+		stat(path, &st) == 0 &&
+		(uint64_t)st.st_size == dep->size &&
+		(int64_t)st.st_mtim.tv_sec == dep->mtimeSec &&
+		(int64_t)st.st_mtim.tv_nsec == dep->mtimeNsec
+	);
+}
+
+/* public-facing functions */
+
+int shmcache_open(shmcache_t *sc, const char *path, size_t size)
+{
+	struct stat st;
+	cache_header *hdr;
+	static const char unset[sizeof(CACHE_MAGIC)] = { 0 };
+	int fd, olderrno;
+
+	sc->map = NULL;
+	sc->size = 0;
+
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+	if (fd == -1)
+	{
+		return 0;
+	}
+
+	/* only held while the file might be created */
+	if (flock(fd, LOCK_EX) == -1 || fstat(fd, &st) == -1)
+	{
+		olderrno = errno;
+		(void)close(fd);
+		errno = olderrno;
+		return 0;
+	}
+
+	if (st.st_size == 0)
+	{
+		if (size < MIN_SIZE)
+		{
+			size = MIN_SIZE;
+		}
+		if (ftruncate(fd, (off_t)size) == -1)
+		{
+			olderrno = errno;
+			(void)close(fd);
+			errno = olderrno;
+			return 0;
+		}
+	}
+	else
+	{
+		size = (size_t)st.st_size;
+	}
+
+	if (size < MIN_SIZE)
+	{
+		(void)close(fd);
+		errno = EINVAL;
+		return 0;
+	}
+
+	sc->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (sc->map == MAP_FAILED)
+	{
+		olderrno = errno;
+		sc->map = NULL;
+		(void)close(fd);
+		errno = olderrno;
+		return 0;
+	}
+	sc->size = size;
+	hdr = header(sc);
+
+	if (memcmp(hdr->magic, unset, sizeof(unset)) == 0)
+	{
+		/* new (or its creator crashed before finishing); the file is all zeroes */
+		uint64_t slotCount = 1;
+		while (slotCount * 2 * sizeof(cache_slot) <= size / 16)
+		{
+			slotCount *= 2;
+		}
+
+		hdr->size = size;
+		hdr->slotCount = slotCount;
+		hdr->arenaStart = (sizeof(cache_header) + slotCount * sizeof(cache_slot) + ENTRY_ALIGN - 1)
+			/ ENTRY_ALIGN * ENTRY_ALIGN;
+		atomic_store(&hdr->arenaHead, hdr->arenaStart);
+		(void)memcpy(hdr->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	}
+	else if (
+		memcmp(hdr->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+		hdr->size != size ||
+		hdr->slotCount == 0 || (hdr->slotCount & (hdr->slotCount - 1)) != 0 ||
+		hdr->arenaStart < sizeof(cache_header) + hdr->slotCount * sizeof(cache_slot) ||
+		hdr->arenaStart > size
+	)
+	{
+		shmcache_close(sc);
+		(void)close(fd);
+		errno = EINVAL;
+		return 0;
+	}
+
+	(void)flock(fd, LOCK_UN);
+	(void)close(fd);
+	return 1;
+}
+
+void shmcache_close(shmcache_t *sc)
+{
+	if (sc->map != NULL)
+	{
+		(void)munmap(sc->map, sc->size);
+	}
+	sc->map = NULL;
+	sc->size = 0;
+}
+
+int shmcache_getFindings(shmcache_t *sc, uint64_t key, findings_t *found, msa_t *inclusions)
+{
+	const char *p, *end, *raw;
+	size_t length;
+	uint64_t counts[2], i;
+	findings_t ours;
+	int ret = 1;
+
+	p = lookup(sc, (key != 0) ? key : 1, &length);
+	if (p == NULL)
+	{
+		return 0;
+	}
+	end = p + length;
+
+	raw = take(&p, end, sizeof(counts));
+	if (raw == NULL)
+	{
+		return 0;
+	}
+	(void)memcpy(counts, raw, sizeof(counts));
+
+	/* are the files included still the same? */
+	for (i = 0; i < counts[0]; ++i)
+	{
+		stored_dep dep;
+		const char *name;
+
+		raw = take(&p, end, sizeof(stored_dep));
+		if (raw == NULL)
+		{
+			return 0;
+		}
+		(void)memcpy(&dep, raw, sizeof(dep));
+		name = takeString(&p, end, dep.nameLen);
+		if (name == NULL || !unchanged(name, &dep))
+		{
+			return 0;
+		}
+		if (inclusions != NULL && msa_add(inclusions, name) == 0)
+		{
+			return 0;
+		}
+	}
+
+	if (findings_create(&ours) == 0)
+	{
+		return 0;
+	}
+	for (i = 0; ret == 1 && i < counts[1]; ++i)
+	{
+		const char *file, *func;
+		stored_finding fnd;
+		module_loc_t start, fin;
+
+		raw = take(&p, end, sizeof(stored_finding));
+		if (raw == NULL)
+		{
+			ret = 0;
+			break;
+		}
+		(void)memcpy(&fnd, raw, sizeof(fnd));
+		file = takeString(&p, end, fnd.fileLen);
+		func = (file == NULL) ? NULL : takeString(&p, end, fnd.funcLen);
+		if (func == NULL)
+		{
+			ret = 0;
+			break;
+		}
+
+		start.line = (size_t)fnd.startLine;
+		start.col = (size_t)fnd.startCol;
+		fin.line = (size_t)fnd.endLine;
+		fin.col = (size_t)fnd.endCol;
+		ret = findings_add(&ours, (finding_kind_t)fnd.kind, file, func, start, fin, (size_t)fnd.expansions);
+	}
+
+	ret = (ret == 1 && p == end) ? findings_move(found, &ours) : 0;
+	findings_destroy(&ours);
+	return ret;
+}
+
+int shmcache_putFindings(shmcache_t *sc, uint64_t key, const findings_t *found, const msa_t *inclusions)
+{
+	payload_buf buf = {
+		.data = NULL,
+		.length = 0,
+		.capacity = 0
+	};
+	uint64_t counts[2] = { inclusions->count, found->count };
+	size_t i;
+	int ret;
+
+	ret = append(&buf, counts, sizeof(counts));
+
+	for (i = 0; ret == 1 && i < inclusions->count; ++i)
+	{
+		struct stat st;
+		stored_dep dep;
+
+		if (stat(inclusions->arr[i], &st) == -1)
+		{
+			ret = 0;
+			break;
+		}
+		dep.mtimeSec = (int64_t)st.st_mtim.tv_sec;
+		dep.mtimeNsec = (int64_t)st.st_mtim.tv_nsec;
+		dep.size = (uint64_t)st.st_size;
+		dep.nameLen = strlen(inclusions->arr[i]) + 1;
+		ret = append(&buf, &dep, sizeof(dep)) && append(&buf, inclusions->arr[i], (size_t)dep.nameLen);
+	}
+
+	for (i = 0; ret == 1 && i < found->count; ++i)
+	{
+		const finding_t *f = &found->arr[i];
+		stored_finding fnd = {
+			.kind = (uint64_t)f->kind,
+			.startLine = f->start.line,
+			.startCol = f->start.col,
+			.endLine = f->end.line,
+			.endCol = f->end.col,
+			.expansions = f->expansions,
+			.fileLen = strlen(f->file) + 1,
+			.funcLen = strlen(f->func) + 1
+		};
+		ret = (
+			append(&buf, &fnd, sizeof(fnd)) &&
+			append(&buf, f->file, (size_t)fnd.fileLen) &&
+			append(&buf, f->func, (size_t)fnd.funcLen)
+		);
+	}
+
+	if (ret == 1)
+	{
+		ret = publish(sc, (key != 0) ? key : 1, buf.data, buf.length);
+	}
+
+	free(buf.data);
+	return ret;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file shmcache.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Cache of findings shared by all Voidcaster processes on a host.
+ * @details The cache is a file of fixed size mapped into the memory of every
+ * process using it: a hash table of keys and references followed by an arena
+ * into which entries are appended. Processes claim slots and space with
+ * atomic operations only, so any number of them may use the cache at once
+ * without taking a lock. An entry only becomes visible once it has been
+ * written completely, and carries a checksum, so that the remains of a process
+ * which crashed while storing are never mistaken for an entry. Once the arena
+ * is full, no further entries are stored; delete the file to start afresh.
+ *
+ * Each entry holds the findings of a file analyzed with certain arguments,
+ * along with the size and modification time of every file it included; the
+ * entry is only used if none of them has changed.
+ */
+
+#ifndef __SHMCACHE_H__
+#define __SHMCACHE_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "findings.h"
+#include "msa.h"
+
+/** The size of a newly created cache file. */
+#define SHMCACHE_DEFAULT_SIZE ((size_t)64 * 1024 * 1024)
+
+/** A shared cache. */
+typedef struct
+{
+	/** The mapping of the cache file; NULL if the cache isn't open. */
+	void *map;
+
+	/** The size of the mapping. */
+	size_t size;
+} shmcache_t;
+
+/**
+ * Open a cache file, creating it with the given size if it doesn't exist yet.
+ *
+ * @param sc Pointer to fill with a shared cache structure.
+ * @param path The path to the cache file.
+ * @param size The size of the file if it has to be created.
+ * @return 1 on success, 0 on failure (setting errno appropriately; EINVAL if
+ * the file is not a cache file).
+ */
+int shmcache_open(shmcache_t *sc, const char *path, size_t size);
+
+/**
+ * Close a cache.
+ *
+ * @param sc Pointer to a shared cache structure.
+ */
+void shmcache_close(shmcache_t *sc);
+
+/**
+ * Look up the findings stored under a key, checking that none of the files
+ * included when they were found has changed since.
+ *
+ * @param sc Pointer to an open shared cache structure.
+ * @param key The key.
+ * @param found The array to which to append the findings.
+ * @param inclusions If not NULL, the names of the files included are
+ * appended to this array.
+ * @return 1 if the findings have been appended, 0 if there is no valid entry
+ * (or on failure, setting errno appropriately).
+ */
+int shmcache_getFindings(shmcache_t *sc, uint64_t key, findings_t *found, msa_t *inclusions);
+
+/**
+ * Store findings under a key, replacing any entry stored earlier.
+ *
+ * @param sc Pointer to an open shared cache structure.
+ * @param key The key.
+ * @param found The findings.
+ * @param inclusions The names of the files included when they were found.
+ * @return 1 on success, 0 on failure (setting errno appropriately; ENOSPC if
+ * the cache is full, ENOENT if an included file has vanished).
+ */
+int shmcache_putFindings(shmcache_t *sc, uint64_t key, const findings_t *found, const msa_t *inclusions);
+
+#endif
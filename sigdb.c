@@ -0,0 +1,366 @@
+/**
+ * @file sigdb.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Database of function signatures.
+ * @details The database file consists of a header, the entries sorted by the
+ * hash of the function name, and the NUL-terminated strings referenced by the
+ * entries. All numbers are stored in host byte order.
+ */
+
+#include "sigdb.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "hash.h"
+#include "outfile.h"
+
+/** The magic bytes at the beginning of a signature database file. */
+static const char SIGDB_MAGIC[8] = { 'V', 'C', 'S', 'I', 'G', 'D', 'B', '1' };
+
+/** Default signature collection capacity. */
+static const size_t DEFAULT_CAPACITY = 64;
+
+/** The header of a signature database file. */
+struct sigdb_header
+{
+	/** SIGDB_MAGIC */
+	char magic[8];
+
+	/** The number of entries. */
+	uint32_t count;
+
+	/** The size of the string table. */
+	uint32_t strsize;
+};
+
+/** An entry of a signature database file. */
+struct sigdb_entry
+{
+	/** The hash of the name of the function. */
+	uint64_t nameHash;
+
+	/** The offset of the name within the string table. */
+	uint32_t name;
+
+	/** The length of the name. */
+	uint32_t nameLen;
+
+	/** The offset of the USR within the string table. */
+	uint32_t usr;
+
+	/** What the function returns (a sig_result_t). */
+	uint32_t result;
+};
+
+/* utility functions */
+
+/**
+ * Hashes the name of a function.
+ *
+ * @param name the name of the function
+ * @param len the length of the name
+ * @return the hash
+ */
+static inline uint64_t nameHash(const char *name, size_t len)
+{
+	return hash_bytes(HASH_INIT, name, len);
+}
+
+/**
+ * Compares two signatures by the hash of their name, their name and their USR.
+ * Useful for qsort(3).
+ *
+ * @param left Pointer to the first signature.
+ * @param right Pointer to the second signature.
+ * @return Less than zero if left ordered before right.
+ *         Zero if left and right equally ordered.
+ *         More than zero if right ordered before left.
+ */
+static int comparator_sig(const void *left, const void *right)
+{
+	const sig_t *l = (const sig_t *)left;
+	const sig_t *r = (const sig_t *)right;
+	uint64_t lh = nameHash(l->name, strlen(l->name));
+	uint64_t rh = nameHash(r->name, strlen(r->name));
+	int cmp;
+
+	if (lh != rh)
+		return (lh < rh) ? -1 : 1;
+
+	cmp = strcmp(l->name, r->name);
+	if (cmp != 0)
+		return cmp;
+
+	return strcmp(l->usr, r->usr);
+}
+
+/* public-facing functions */
+
+int sigdb_builder_create(sigdb_builder_t *bld)
+{
+	bld->capacity = DEFAULT_CAPACITY;
+	bld->count = 0;
+	bld->arr = malloc(bld->capacity * sizeof(sig_t));
+	if (bld->arr == NULL)
+	{
+		bld->capacity = 0;
+		return 0;
+	}
+	return 1;
+}
+
+void sigdb_builder_destroy(sigdb_builder_t *bld)
+{
+	size_t i;
+
+	for (i = 0; i < bld->count; ++i)
+	{
+		free(bld->arr[i].name);
+		free(bld->arr[i].usr);
+	}
+	free(bld->arr);
+	bld->arr = NULL;
+	bld->capacity = 0;
+	bld->count = 0;
+}
+
+int sigdb_builder_add(sigdb_builder_t *bld, const char *name, const char *usr, sig_result_t result)
+{
+	sig_t sig = {
+		.result = result
+	};
+
+	if (bld->count >= bld->capacity)
+	{
+		/* not enough space; double the capacity */
+		sig_t *newarr;
+		size_t newcap = (bld->capacity == 0) ? DEFAULT_CAPACITY : (bld->capacity * 2);
+		newarr = realloc(bld->arr, newcap * sizeof(sig_t));
+		if (newarr == NULL)
+		{
+			return 0;
+		}
+		bld->arr = newarr;
+		bld->capacity = newcap;
+	}
+
+	sig.name = strdup(name);
+	sig.usr = strdup(usr);
+	if (sig.name == NULL || sig.usr == NULL)
+	{
+		int olderrno = errno;
+		free(sig.name);
+		free(sig.usr);
+		errno = olderrno;
+		return 0;
+	}
+
+	bld->arr[bld->count++] = sig;
+	return 1;
+}
+
+int sigdb_write(sigdb_builder_t *bld, const char *path)
+{
+	struct sigdb_header hdr;
+	struct sigdb_entry *entries;
+	char *strings;
+	outfile_t of;
+	FILE *out;
+	size_t i, count = 0, strsize = 0, maxStrsize = 0;
+	bool ok;
+	int olderrno;
+
+	qsort(bld->arr, bld->count, sizeof(sig_t), comparator_sig);
+
+	for (i = 0; i < bld->count; ++i)
+	{
+		maxStrsize += strlen(bld->arr[i].name) + strlen(bld->arr[i].usr) + 2;
+	}
+	if (maxStrsize > UINT32_MAX || bld->count > UINT32_MAX)
+	{
+		errno = EFBIG;
+		return 0;
+	}
+
+	entries = malloc((bld->count + 1) * sizeof(struct sigdb_entry));
+	strings = malloc(maxStrsize + 1);
+	if (entries == NULL || strings == NULL)
+	{
+		free(entries);
+		free(strings);
+		errno = ENOMEM;
+		return 0;
+	}
+
+	/* lay out the entries and strings, skipping repeated USRs */
+	for (i = 0; i < bld->count; ++i)
+	{
+		const sig_t *sig = &bld->arr[i];
+		size_t nameLen = strlen(sig->name);
+		size_t usrLen = strlen(sig->usr);
+
+		if (i > 0 && comparator_sig(sig, &bld->arr[i-1]) == 0)
+		{
+			continue;
+		}
+
+		entries[count].nameHash = nameHash(sig->name, nameLen);
+		entries[count].name = (uint32_t)strsize;
+		entries[count].nameLen = (uint32_t)nameLen;
+		(void)memcpy(&strings[strsize], sig->name, nameLen + 1);
+		strsize += nameLen + 1;
+		entries[count].usr = (uint32_t)strsize;
+		(void)memcpy(&strings[strsize], sig->usr, usrLen + 1);
+		strsize += usrLen + 1;
+		entries[count].result = (uint32_t)sig->result;
+		++count;
+	}
+
+	(void)memcpy(hdr.magic, SIGDB_MAGIC, sizeof(hdr.magic));
+	hdr.count = (uint32_t)count;
+	hdr.strsize = (uint32_t)strsize;
+
+	/* a database shared between runs is written by whichever finishes; each writes a file of its own */
+	ok = (outfile_open(&of, path) == 1);
+	if (ok)
+	{
+		out = of.f;
+		ok = (fwrite(&hdr, sizeof(hdr), 1, out) == 1);
+		ok = ok && (count == 0 || fwrite(entries, sizeof(struct sigdb_entry), count, out) == count);
+		ok = ok && (strsize == 0 || fwrite(strings, 1, strsize, out) == strsize);
+		ok = (outfile_close(&of, ok) == 1);
+	}
+
+	olderrno = errno;
+	free(entries);
+	free(strings);
+	errno = olderrno;
+
+	return ok ? 1 : 0;
+}
+
+int sigdb_open(sigdb_t *db, const char *path)
+{
+	const struct sigdb_header *hdr;
+	struct stat st;
+	size_t entsize;
+	int fd, olderrno;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return 0;
+	}
+
+	if (fstat(fd, &st) == -1)
+	{
+		olderrno = errno;
+		(void)close(fd);
+		errno = olderrno;
+		return 0;
+	}
+
+	if ((size_t)st.st_size < sizeof(struct sigdb_header))
+	{
+		(void)close(fd);
+		errno = EINVAL;
+		return 0;
+	}
+
+	db->size = (size_t)st.st_size;
+	db->map = mmap(NULL, db->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	olderrno = errno;
+	(void)close(fd);
+	if (db->map == MAP_FAILED)
+	{
+		db->map = NULL;
+		errno = olderrno;
+		return 0;
+	}
+
+	/* validate the header */
+	hdr = (const struct sigdb_header *)db->map;
+	entsize = (size_t)hdr->count * sizeof(struct sigdb_entry);
+	if (
+		memcmp(hdr->magic, SIGDB_MAGIC, sizeof(SIGDB_MAGIC)) != 0 ||
+		sizeof(struct sigdb_header) + entsize + hdr->strsize != db->size ||
+		(hdr->strsize > 0 && ((const char *)db->map)[db->size - 1] != '\0')
+	)
+	{
+		sigdb_close(db);
+		errno = EINVAL;
+		return 0;
+	}
+
+	db->count = hdr->count;
+	db->entries = (const struct sigdb_entry *)((const char *)db->map + sizeof(struct sigdb_header));
+	db->strings = (const char *)db->map + sizeof(struct sigdb_header) + entsize;
+	return 1;
+}
+
+void sigdb_close(sigdb_t *db)
+{
+	if (db->map != NULL)
+	{
+		(void)munmap(db->map, db->size);
+	}
+	db->map = NULL;
+	db->size = 0;
+	db->count = 0;
+	db->entries = NULL;
+	db->strings = NULL;
+}
+
+sig_result_t sigdb_lookup(const sigdb_t *db, const char *name, size_t len)
+{
+	uint64_t hash = nameHash(name, len);
+	size_t lo = 0, hi = db->count;
+	sig_result_t result = SIG_UNKNOWN;
+	bool seen = false;
+
+	/* find the first entry with the hash */
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (db->entries[mid].nameHash < hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* functions of the same name (e.g. static ones in different files) must agree */
+	for (; lo < db->count && db->entries[lo].nameHash == hash; ++lo)
+	{
+		const struct sigdb_entry *ent = &db->entries[lo];
+
+		if (
+			ent->nameLen != len ||
+			(size_t)ent->name + len >= (size_t)((const char *)db->map + db->size - db->strings) ||
+			memcmp(&db->strings[ent->name], name, len) != 0
+		)
+		{
+			/* hash collision */
+			continue;
+		}
+
+		if (seen && result != (sig_result_t)ent->result)
+		{
+			return SIG_UNKNOWN;
+		}
+		result = (sig_result_t)ent->result;
+		seen = true;
+	}
+
+	return result;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file sigdb.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Database of function signatures.
+ * @details Records whether functions return a value, keyed by their name and
+ * USR (Unified Symbol Resolution). The database is collected during a full
+ * analysis, written to a file and memory-mapped by the fast engine, which
+ * cannot resolve declarations itself.
+ */
+
+#ifndef __SIGDB_H__
+#define __SIGDB_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** What a function returns, as far as the Voidcaster is concerned. */
+typedef enum
+{
+	/** Unknown, or different functions of the same name disagree. */
+	SIG_UNKNOWN = 0,
+
+	/** The function returns nothing. */
+	SIG_VOID,
+
+	/** The function returns a value. */
+	SIG_VALUE
+} sig_result_t;
+
+/** A function signature being collected. */
+typedef struct
+{
+	/** The name of the function. */
+	char *name;
+
+	/** The USR of the function. */
+	char *usr;
+
+	/** What the function returns. */
+	sig_result_t result;
+} sig_t;
+
+/** An expanding array of signatures being collected. */
+typedef struct
+{
+	/** How many signatures can the array house? */
+	size_t capacity;
+
+	/** How many signatures is the array housing right now? */
+	size_t count;
+
+	/** The signatures themselves. */
+	sig_t *arr;
+} sigdb_builder_t;
+
+/** A signature database mapped into memory. */
+typedef struct
+{
+	/** The mapping of the database file. */
+	void *map;
+
+	/** The size of the mapping. */
+	size_t size;
+
+	/** The number of entries. */
+	size_t count;
+
+	/** The entries, sorted by the hash of their name. */
+	const struct sigdb_entry *entries;
+
+	/** The strings referenced by the entries. */
+	const char *strings;
+} sigdb_t;
+
+/**
+ * Create an empty collection of signatures.
+ *
+ * @param bld Pointer to fill with a signature collection structure.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int sigdb_builder_create(sigdb_builder_t *bld);
+
+/**
+ * Destroy a collection of signatures.
+ *
+ * @param bld Pointer to a signature collection structure.
+ */
+void sigdb_builder_destroy(sigdb_builder_t *bld);
+
+/**
+ * Add a signature to a collection of signatures. The strings are duplicated.
+ *
+ * @param bld Pointer to a signature collection structure.
+ * @param name The name of the function.
+ * @param usr The USR of the function.
+ * @param result What the function returns.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int sigdb_builder_add(sigdb_builder_t *bld, const char *name, const char *usr, sig_result_t result);
+
+/**
+ * Write a collection of signatures into a database file, replacing it
+ * atomically. Signatures with the same USR are only written once.
+ *
+ * @param bld Pointer to a signature collection structure; it is sorted.
+ * @param path The path of the database file.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int sigdb_write(sigdb_builder_t *bld, const char *path);
+
+/**
+ * Map a signature database file into memory.
+ *
+ * @param db Pointer to fill with a signature database structure.
+ * @param path The path of the database file.
+ * @return 1 on success, 0 on failure (setting errno appropriately; EINVAL if
+ * the file is not a signature database).
+ */
+int sigdb_open(sigdb_t *db, const char *path);
+
+/**
+ * Unmap a signature database.
+ *
+ * @param db Pointer to a signature database structure.
+ */
+void sigdb_close(sigdb_t *db);
+
+/**
+ * Look up what a function returns.
+ *
+ * @param db Pointer to a signature database structure.
+ * @param name The name of the function (not necessarily NUL-terminated).
+ * @param len The length of the name.
+ * @return What the function returns; SIG_UNKNOWN if no function of that name
+ * is known or functions of that name disagree.
+ */
+sig_result_t sigdb_lookup(const sigdb_t *db, const char *name, size_t len);
+
+#endif
@@ -0,0 +1,27 @@
+#include <stdio.h>
+
+void i_return_nothing(void);
+void neither_do_i(void);
+int add1(int a);
+
+/* two calls to the same function; each of them is reported on its own */
+#define LOG() do { printf("a"); printf("b"); } while (0)
+
+/* two pointless casts to void */
+#define VV() do { (void)i_return_nothing(); (void)neither_do_i(); } while (0)
+
+/* the same function twice, and a call to it passed as the argument */
+#define TWICE(x) do { add1(x); add1(1); } while (0)
+
+void macros(void)
+{
+	/* both calls in LOG, each in 2 macro expansions */
+	LOG();
+	LOG();
+
+	/* both casts in VV, each in 1 macro expansion */
+	VV();
+
+	/* both calls in TWICE; the call in the argument is not counted among them */
+	TWICE(add1(2));
+}
@@ -0,0 +1,54 @@
+#!/bin/sh
+#
+# Checks that --sample analyzes exactly the number of files asked for, however
+# the files are spread across directories.
+#
+# Usage: sample.sh VOIDCASTER
+
+set -e
+
+if [ $# -ne 1 ]
+then
+	echo "Usage: $0 VOIDCASTER" >&2
+	exit 1
+fi
+
+voidcaster="$1"
+
+workdir="$(mktemp -d "${TMPDIR:-/tmp}/voidcaster-sample.XXXXXX")"
+trap 'rm -rf "$workdir"' EXIT
+
+# seven files in three directories
+mkdir "$workdir/a" "$workdir/b" "$workdir/c"
+for file in a/1 a/2 a/3 b/1 b/2 c/1 c/2
+do
+	echo "int f(void) { return 0; }" > "$workdir/$file.c"
+done
+
+failures=0
+
+# checks how many files a run analyzed: amount, expected count
+check()
+{
+	analyzed="$("$voidcaster" --sample="$1" "$workdir"/*/*.c 2>&1 | awk '$1 == "Sample:" { print $2 }')"
+	if [ "$analyzed" != "$2" ]
+	then
+		echo "--sample=$1: analyzed ${analyzed:-no} files instead of $2" >&2
+		failures=$((failures + 1))
+	fi
+}
+
+for count in 1 2 3 4 5 6 7
+do
+	check "$count" "$count"
+done
+check 9 7
+check 40% 3
+check 0.5 4
+
+if [ "$failures" -gt 0 ]
+then
+	echo "$failures sample cases failed" >&2
+	exit 1
+fi
+echo "all sample cases passed"
@@ -0,0 +1,522 @@
+/**
+ * @file toolchain.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Discovery of the system include paths and builtin macros of a
+ * compiler.
+ * @details The cache file starts with a block of comments stating the format
+ * version, the compiler, the modification time and size of its binary and its
+ * include paths. The rest of the file defines the compiler's builtin macros,
+ * each guarded so that Clang's own definitions win.
+ */
+
+#include "toolchain.h"
+#include "hash.h"
+#include "outfile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/** The first line of a cache file. */
+static const char CACHE_MAGIC[] = "/* voidcaster toolchain 1 */\n";
+
+/** The format of the line describing the compiler binary in a cache file. */
+#define STAMP_FORMAT "/* compiler %s %lld.%09ld %lld */\n"
+
+/** The line which ends the comment block of a cache file. */
+static const char CACHE_END[] = "/* end */\n";
+
+/* utility functions */
+
+/**
+ * Finds a compiler in PATH.
+ *
+ * @param compiler The compiler's name or path.
+ * @return The path to the compiler (to be freed), or NULL on failure (setting
+ * errno appropriately).
+ */
+static char *findCompiler(const char *compiler)
+{
+	const char *path = getenv("PATH");
+	const char *dir, *end;
+
+	if (strchr(compiler, '/') != NULL)
+	{
+		return strdup(compiler);
+	}
+
+	if (path == NULL)
+	{
+		path = "/usr/bin:/bin";
+	}
+
+	for (dir = path; ; dir = end + 1)
+	{
+		size_t dirlen;
+		char *candidate;
+
+		end = strchr(dir, ':');
+		if (end == NULL)
+		{
+			end = dir + strlen(dir);
+		}
+		dirlen = (size_t)(end - dir);
+
+		candidate = malloc(dirlen + strlen(compiler) + 3);
+		if (candidate == NULL)
+		{
+			return NULL;
+		}
+		/* an empty entry means the working directory */
+		if (dirlen == 0)
+			(void)sprintf(candidate, "./%s", compiler);
+		else
+			(void)sprintf(candidate, "%.*s/%s", (int)dirlen, dir, compiler);
+
+		if (access(candidate, X_OK) == 0)
+		{
+			return candidate;
+		}
+		free(candidate);
+
+		if (*end == '\0')
+		{
+			break;
+		}
+	}
+
+	errno = ENOENT;
+	return NULL;
+}
+
+/**
+ * Creates a directory unless it exists.
+ *
+ * @param dir The path to the directory.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int ensureDir(const char *dir)
+{
+	if (mkdir(dir, 0700) == -1 && errno != EEXIST)
+	{
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * Determines the path of the cache file for a compiler, creating the cache
+ * directory if necessary. The cache directory is $XDG_CACHE_HOME/voidcaster,
+ * falling back to $HOME/.cache/voidcaster.
+ *
+ * @param compiler The path to the compiler.
+ * @return The path to the cache file (to be freed), or NULL on failure
+ * (setting errno appropriately).
+ */
+static char *cachePath(const char *compiler)
+{
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	char *path;
+	size_t baselen;
+
+	if (xdg != NULL && xdg[0] == '/')
+	{
+		baselen = strlen(xdg);
+		path = malloc(baselen + sizeof("/voidcaster/toolchain-0123456789abcdef.h"));
+		if (path == NULL)
+		{
+			return NULL;
+		}
+		(void)strcpy(path, xdg);
+	}
+	else if (home != NULL && home[0] != '\0')
+	{
+		baselen = strlen(home) + sizeof("/.cache") - 1;
+		path = malloc(baselen + sizeof("/voidcaster/toolchain-0123456789abcdef.h"));
+		if (path == NULL)
+		{
+			return NULL;
+		}
+		(void)sprintf(path, "%s/.cache", home);
+		if (ensureDir(path) == 0)
+		{
+			free(path);
+			return NULL;
+		}
+	}
+	else
+	{
+		errno = ENOENT;
+		return NULL;
+	}
+
+	(void)strcpy(path + baselen, "/voidcaster");
+	if (ensureDir(path) == 0)
+	{
+		free(path);
+		return NULL;
+	}
+
+	(void)sprintf(path + baselen, "/voidcaster/toolchain-%016" PRIx64 ".h", hash_string(HASH_INIT, compiler));
+	return path;
+}
+
+/**
+ * Strips the trailing newline from a line.
+ *
+ * @param line The line.
+ * @param len The length of the line.
+ * @return The new length of the line.
+ */
+static inline size_t chomp(char *line, size_t len)
+{
+	if (len > 0 && line[len - 1] == '\n')
+	{
+		line[--len] = '\0';
+	}
+	return len;
+}
+
+/**
+ * Loads the include paths from a cache file if it is up to date.
+ *
+ * @param tc Pointer to an empty toolchain structure.
+ * @param path The path to the cache file.
+ * @param stamp The line describing the compiler binary as it is now.
+ * @return 1 if the cache was up to date and has been loaded, 0 otherwise.
+ */
+static int loadCache(toolchain_t *tc, const char *path, const char *stamp)
+{
+	FILE *f;
+	char *line = NULL;
+	size_t linecap = 0;
+	ssize_t len;
+	int state = 0, ret = 0;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+	{
+		return 0;
+	}
+
+	while ((len = getline(&line, &linecap, f)) != -1)
+	{
+		if (state == 0)
+		{
+			/* format version */
+			if (strcmp(line, CACHE_MAGIC) != 0)
+				break;
+			state = 1;
+		}
+		else if (state == 1)
+		{
+			/* the compiler and its binary */
+			if (strcmp(line, stamp) != 0)
+				break;
+			state = 2;
+		}
+		else if (strcmp(line, CACHE_END) == 0)
+		{
+			ret = 1;
+			break;
+		}
+		else if (len > 15 && strncmp(line, "/* include ", 11) == 0 && strcmp(line + len - 4, " */\n") == 0)
+		{
+			line[len - 4] = '\0';
+			if (msa_add(&tc->includes, line + 11) == 0)
+			{
+				break;
+			}
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	free(line);
+	(void)fclose(f);
+
+	if (ret == 0)
+	{
+		msa_clear(&tc->includes);
+	}
+	return ret;
+}
+
+/**
+ * Runs the compiler on an empty file, asking it for its builtin macros and its
+ * include paths.
+ *
+ * @param compiler The path to the compiler.
+ * @param defs Will be set to a temporary file containing the compiler's
+ * standard output, i.e. the macros.
+ * @param diag Will be set to a temporary file containing the compiler's
+ * standard error output, i.e. the include paths.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int runCompiler(const char *compiler, FILE **defs, FILE **diag)
+{
+	pid_t pid;
+	int status, olderrno;
+
+	*defs = tmpfile();
+	*diag = tmpfile();
+	if (*defs == NULL || *diag == NULL)
+	{
+		olderrno = errno;
+		if (*defs != NULL)
+			(void)fclose(*defs);
+		if (*diag != NULL)
+			(void)fclose(*diag);
+		errno = olderrno;
+		return 0;
+	}
+
+	pid = fork();
+	if (pid == -1)
+	{
+		olderrno = errno;
+		(void)fclose(*defs);
+		(void)fclose(*diag);
+		errno = olderrno;
+		return 0;
+	}
+
+	if (pid == 0)
+	{
+		/* child: the messages must not be translated */
+		int devnull = open("/dev/null", O_RDONLY);
+		if (
+			devnull == -1 ||
+			dup2(devnull, STDIN_FILENO) == -1 ||
+			dup2(fileno(*defs), STDOUT_FILENO) == -1 ||
+			dup2(fileno(*diag), STDERR_FILENO) == -1 ||
+			setenv("LC_ALL", "C", 1) == -1
+		)
+		{
+			_exit(127);
+		}
+		(void)execl(compiler, compiler, "-E", "-dM", "-v", "-x", "c", "/dev/null", (char *)NULL);
+		_exit(127);
+	}
+
+	while (waitpid(pid, &status, 0) == -1)
+	{
+		if (errno != EINTR)
+		{
+			olderrno = errno;
+			(void)fclose(*defs);
+			(void)fclose(*diag);
+			errno = olderrno;
+			return 0;
+		}
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		(void)fclose(*defs);
+		(void)fclose(*diag);
+		errno = EPROTO;
+		return 0;
+	}
+
+	rewind(*defs);
+	rewind(*diag);
+	return 1;
+}
+
+/**
+ * Collects the include paths from the compiler's verbose output.
+ *
+ * @param tc Pointer to an empty toolchain structure.
+ * @param diag The compiler's standard error output.
+ * @return 1 on success, 0 on failure (setting errno appropriately; EPROTO if
+ * the search list wasn't found).
+ */
+static int parseSearchList(toolchain_t *tc, FILE *diag)
+{
+	char *line = NULL;
+	size_t linecap = 0;
+	ssize_t len;
+	bool inList = false, complete = false;
+	int ret = 1;
+
+	while (ret == 1 && !complete && (len = getline(&line, &linecap, diag)) != -1)
+	{
+		len = (ssize_t)chomp(line, (size_t)len);
+
+		if (!inList)
+		{
+			inList = (strcmp(line, "#include <...> search starts here:") == 0);
+		}
+		else if (strcmp(line, "End of search list.") == 0)
+		{
+			complete = true;
+		}
+		else if (line[0] == ' ' && strstr(line, " (framework directory)") == NULL && strstr(line, "*/") == NULL)
+		{
+			ret = msa_add(&tc->includes, line + 1);
+		}
+	}
+
+	free(line);
+	if (ret == 1 && !complete)
+	{
+		errno = EPROTO;
+		ret = 0;
+	}
+	return ret;
+}
+
+/**
+ * Writes a cache file.
+ *
+ * @param tc Pointer to a toolchain structure whose include paths are known.
+ * @param path The path to the cache file.
+ * @param stamp The line describing the compiler binary.
+ * @param defs The compiler's standard output, i.e. its builtin macros.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int writeCache(const toolchain_t *tc, const char *path, const char *stamp, FILE *defs)
+{
+	char *line = NULL;
+	size_t i, linecap = 0;
+	ssize_t len;
+	outfile_t of;
+	FILE *out;
+	bool ok;
+
+	/* concurrent runs may write the same cache; each writes a file of its own */
+	if (outfile_open(&of, path) == 0)
+	{
+		return 0;
+	}
+	out = of.f;
+
+	ok = (fputs(CACHE_MAGIC, out) != EOF) && (fputs(stamp, out) != EOF);
+	for (i = 0; ok && i < tc->includes.count; ++i)
+	{
+		ok = (fprintf(out, "/* include %s */\n", tc->includes.arr[i]) >= 0);
+	}
+	ok = ok && (fputs(CACHE_END, out) != EOF);
+
+	while (ok && (len = getline(&line, &linecap, defs)) != -1)
+	{
+		size_t namelen;
+
+		len = (ssize_t)chomp(line, (size_t)len);
+		if (strncmp(line, "#define ", 8) != 0)
+		{
+			continue;
+		}
+
+		/* the name ends at the parameter list or the replacement */
+		namelen = strcspn(line + 8, " (");
+		ok = (fprintf(out, "#ifndef %.*s\n%s\n#endif\n", (int)namelen, line + 8, line) >= 0);
+	}
+	free(line);
+
+	return outfile_close(&of, ok);
+}
+
+/* public-facing functions */
+
+int toolchain_create(toolchain_t *tc)
+{
+	tc->definesPath = NULL;
+	return msa_create(&tc->includes);
+}
+
+void toolchain_destroy(toolchain_t *tc)
+{
+	msa_destroy(&tc->includes);
+	free(tc->definesPath);
+	tc->definesPath = NULL;
+}
+
+int toolchain_probe(toolchain_t *tc, const char *compiler, bool *probed)
+{
+	struct stat st;
+	char *resolved, *path, *stamp;
+	FILE *defs, *diag;
+	int stamplen, ok, olderrno;
+
+	*probed = false;
+
+	resolved = findCompiler(compiler);
+	if (resolved == NULL)
+	{
+		return 0;
+	}
+
+	if (stat(resolved, &st) == -1)
+	{
+		olderrno = errno;
+		free(resolved);
+		errno = olderrno;
+		return 0;
+	}
+
+	/* the cache is valid as long as the compiler binary stays the same */
+	stamplen = snprintf(NULL, 0, STAMP_FORMAT,
+		resolved, (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec, (long long)st.st_size
+	);
+	stamp = malloc((size_t)stamplen + 1);
+	if (stamp == NULL)
+	{
+		free(resolved);
+		return 0;
+	}
+	(void)snprintf(stamp, (size_t)stamplen + 1, STAMP_FORMAT,
+		resolved, (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec, (long long)st.st_size
+	);
+
+	/* without a cache, the compiler is run each time */
+	path = cachePath(resolved);
+
+	if (path != NULL && loadCache(tc, path, stamp) == 1)
+	{
+		tc->definesPath = path;
+		free(stamp);
+		free(resolved);
+		return 1;
+	}
+
+	*probed = true;
+	ok = runCompiler(resolved, &defs, &diag);
+	if (ok == 1)
+	{
+		ok = parseSearchList(tc, diag);
+		olderrno = errno;
+		(void)fclose(diag);
+
+		if (ok == 1 && path != NULL && writeCache(tc, path, stamp, defs) == 1)
+		{
+			tc->definesPath = path;
+			path = NULL;
+		}
+		/* otherwise, the include paths are known, but the macros aren't */
+
+		(void)fclose(defs);
+		errno = olderrno;
+	}
+
+	olderrno = errno;
+	free(path);
+	free(stamp);
+	free(resolved);
+	errno = olderrno;
+	return ok;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file toolchain.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Discovery of the system include paths and builtin macros of a
+ * compiler.
+ * @details The compiler is asked once; its answers are kept in a per-user
+ * cache file, which is reused until the compiler binary changes. The cache file
+ * doubles as a header which defines those builtin macros of the compiler that
+ * Clang doesn't define itself.
+ */
+
+#ifndef __TOOLCHAIN_H__
+#define __TOOLCHAIN_H__
+
+#include <stdbool.h>
+
+#include "msa.h"
+
+/** What is known about a compiler. */
+typedef struct
+{
+	/** The compiler's system include paths, in the order they are searched. */
+	msa_t includes;
+
+	/**
+	 * The path to the header defining the compiler's builtin macros, or NULL
+	 * if it couldn't be written.
+	 */
+	char *definesPath;
+} toolchain_t;
+
+/**
+ * Create an empty toolchain description.
+ *
+ * @param tc Pointer to fill with a toolchain structure.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int toolchain_create(toolchain_t *tc);
+
+/**
+ * Destroy a toolchain description.
+ *
+ * @param tc Pointer to a toolchain structure.
+ */
+void toolchain_destroy(toolchain_t *tc);
+
+/**
+ * Find out the system include paths and builtin macros of a compiler, from the
+ * cache if it is up to date, or else by running the compiler (and updating the
+ * cache).
+ *
+ * @param tc Pointer to an empty toolchain structure.
+ * @param compiler The compiler's name (looked up in PATH) or path.
+ * @param probed Will be set to true if the compiler had to be run.
+ * @return 1 on success, 0 on failure (setting errno appropriately; ENOENT if
+ * the compiler can't be found, EPROTO if its output can't be understood).
+ */
+int toolchain_probe(toolchain_t *tc, const char *compiler, bool *probed);
+
+#endif
@@ -0,0 +1,292 @@
+/**
+ * @file trace.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Output of trace events for the Chrome trace viewer and Perfetto.
+ * @details The file is written in the JSON object format: an object whose
+ * traceEvents member holds the array of events. Spans are complete ("X")
+ * events, so a thread needs no stack of open spans.
+ */
+
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+/** The size of the buffer of each thread. */
+#define TRACE_BUFFER_SIZE 65536
+
+/** The maximum length of an escaped detail; longer ones are truncated. */
+#define TRACE_DETAIL_SIZE 512
+
+/** The number of tracks which are given names. */
+#define TRACE_NAMED_TRACKS 1024
+
+/** The file being written; NULL if tracing is off. */
+static FILE *out = NULL;
+
+/** Serializes writes to the file. */
+static pthread_mutex_t outLock = PTHREAD_MUTEX_INITIALIZER;
+
+/** The time tracing started. */
+static struct timespec origin;
+
+/** Which tracks have been named already. */
+static atomic_bool named[TRACE_NAMED_TRACKS];
+
+/** The events buffered by this thread. */
+static _Thread_local char buffer[TRACE_BUFFER_SIZE];
+
+/** The number of bytes buffered by this thread. */
+static _Thread_local size_t buffered = 0;
+
+/** The track of this thread. */
+static _Thread_local unsigned int track = TRACE_TRACK_MAIN;
+
+/* utility functions */
+
+/**
+ * Appends an event to the buffer of this thread, writing the buffer out first
+ * if the event doesn't fit.
+ *
+ * @param fmt The format of the event, as with printf(3).
+ */
+static void append(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void append(const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buffer + buffered, sizeof(buffer) - buffered, fmt, ap);
+	va_end(ap);
+
+	if (len < 0)
+	{
+		return;
+	}
+	if ((size_t)len >= sizeof(buffer) - buffered)
+	{
+		/* doesn't fit; make room and try again */
+		trace_flush();
+
+		va_start(ap, fmt);
+		len = vsnprintf(buffer, sizeof(buffer), fmt, ap);
+		va_end(ap);
+
+		if (len < 0 || (size_t)len >= sizeof(buffer))
+		{
+			return;
+		}
+	}
+	buffered += (size_t)len;
+}
+
+/**
+ * Escapes a string for inclusion in a JSON string literal.
+ *
+ * @param str The string to escape.
+ * @param esc The buffer to write the escaped string to; TRACE_DETAIL_SIZE
+ * bytes large.
+ */
+static void escape(const char *str, char *esc)
+{
+	size_t o = 0;
+
+	for (; *str != '\0' && o + 7 < TRACE_DETAIL_SIZE; ++str)
+	{
+		unsigned char c = (unsigned char)*str;
+		if (c == '"' || c == '\\')
+		{
+			esc[o++] = '\\';
+			esc[o++] = (char)c;
+		}
+		else if (c < 0x20)
+		{
+			o += (size_t)sprintf(esc + o, "\\u%04x", c);
+		}
+		else
+		{
+			esc[o++] = (char)c;
+		}
+	}
+	esc[o] = '\0';
+}
+
+/**
+ * Returns the time since tracing started.
+ *
+ * @return The time in microseconds, as trace events expect it.
+ */
+static inline double micros(void)
+{
+	return (double)trace_now() / 1000.0;
+}
+
+/* public-facing functions */
+
+int trace_open(const char *path)
+{
+	size_t i;
+
+	out = fopen(path, "w");
+	if (out == NULL)
+	{
+		return 0;
+	}
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &origin);
+	for (i = 0; i < TRACE_NAMED_TRACKS; ++i)
+	{
+		atomic_init(&named[i], false);
+	}
+
+	/* every event after this one is preceded by a comma */
+	(void)fputs(
+		"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+		"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"voidcaster\"}}",
+		out
+	);
+	trace_track(TRACE_TRACK_MAIN, "main");
+	return 1;
+}
+
+int trace_close(void)
+{
+	int ret = 1;
+
+	if (out == NULL)
+	{
+		return 1;
+	}
+
+	trace_flush();
+	if (fputs("\n]}\n", out) == EOF)
+	{
+		ret = 0;
+	}
+	if (fclose(out) != 0)
+	{
+		ret = 0;
+	}
+	out = NULL;
+	return ret;
+}
+
+bool trace_on(void)
+{
+	return (out != NULL);
+}
+
+void trace_track(unsigned int newTrack, const char *name)
+{
+	char esc[TRACE_DETAIL_SIZE];
+
+	if (out == NULL)
+	{
+		return;
+	}
+
+	track = newTrack;
+	if (newTrack < TRACE_NAMED_TRACKS && !atomic_exchange(&named[newTrack], true))
+	{
+		escape(name, esc);
+		append(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+			newTrack, esc
+		);
+		append(",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"sort_index\":%u}}",
+			newTrack, newTrack
+		);
+	}
+}
+
+uint64_t trace_now(void)
+{
+	struct timespec now;
+
+	if (out == NULL)
+	{
+		return 0;
+	}
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)(now.tv_sec - origin.tv_sec) * UINT64_C(1000000000) + (uint64_t)now.tv_nsec - (uint64_t)origin.tv_nsec;
+}
+
+void trace_span(const char *name, const char *detail, uint64_t start)
+{
+	double end = micros();
+	char esc[TRACE_DETAIL_SIZE];
+
+	if (out == NULL)
+	{
+		return;
+	}
+
+	if (detail == NULL)
+	{
+		append(",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+			name, track, (double)start / 1000.0, end - (double)start / 1000.0
+		);
+	}
+	else
+	{
+		escape(detail, esc);
+		append(",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"detail\":\"%s\"}}",
+			name, track, (double)start / 1000.0, end - (double)start / 1000.0, esc
+		);
+	}
+}
+
+void trace_counter(const char *name, double value)
+{
+	if (out == NULL)
+	{
+		return;
+	}
+
+	append(",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%g}}",
+		name, track, micros(), value
+	);
+}
+
+void trace_rss(void)
+{
+	FILE *statm;
+	unsigned long size, resident;
+
+	if (out == NULL)
+	{
+		return;
+	}
+
+	statm = fopen("/proc/self/statm", "r");
+	if (statm == NULL)
+	{
+		return;
+	}
+	if (fscanf(statm, "%lu %lu", &size, &resident) == 2)
+	{
+		trace_counter("RSS (MiB)", (double)resident * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0));
+	}
+	(void)fclose(statm);
+}
+
+void trace_flush(void)
+{
+	if (out == NULL || buffered == 0)
+	{
+		return;
+	}
+
+	(void)pthread_mutex_lock(&outLock);
+	(void)fwrite(buffer, 1, buffered, out);
+	(void)pthread_mutex_unlock(&outLock);
+	buffered = 0;
+}
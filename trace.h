@@ -0,0 +1,91 @@
+/**
+ * @file trace.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Output of trace events for the Chrome trace viewer and Perfetto.
+ * @details Events are collected in a buffer per thread and only written out
+ * when the buffer is full, when the thread is done, or when tracing ends; all
+ * functions return immediately if tracing is off.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** The track of the main thread. */
+#define TRACE_TRACK_MAIN 0
+
+/** The track of the prefetching thread; beyond those of the traversal workers. */
+#define TRACE_TRACK_PREFETCH 1000
+
+/**
+ * Start tracing into a file.
+ *
+ * @param path The path to the file to write.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int trace_open(const char *path);
+
+/**
+ * Stop tracing, writing out all events and closing the file.
+ *
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int trace_close(void);
+
+/**
+ * Returns whether tracing is on.
+ *
+ * @return true if events are being recorded
+ */
+bool trace_on(void);
+
+/**
+ * Put the events of the calling thread on a track. The track is given a name
+ * the first time it is used. Threads which don't choose a track end up on the
+ * main track.
+ *
+ * @param track The number of the track.
+ * @param name The name of the track.
+ */
+void trace_track(unsigned int track, const char *name);
+
+/**
+ * Returns the current time, to be passed to trace_span() later.
+ *
+ * @return The time since tracing started, in nanoseconds; 0 if tracing is off.
+ */
+uint64_t trace_now(void);
+
+/**
+ * Record a span which started at the given time and ends now.
+ *
+ * @param name The name of the span; not escaped.
+ * @param detail If not NULL, a detail (e.g. a file name) shown with the span.
+ * @param start The time the span started, as returned by trace_now().
+ */
+void trace_span(const char *name, const char *detail, uint64_t start);
+
+/**
+ * Record the value of a counter.
+ *
+ * @param name The name of the counter; not escaped.
+ * @param value The value of the counter.
+ */
+void trace_counter(const char *name, double value);
+
+/**
+ * Record the resident set size of the process as a counter.
+ */
+void trace_rss(void);
+
+/**
+ * Write out the events buffered by the calling thread. Must be called by each
+ * thread other than the one calling trace_close() before it ends.
+ */
+void trace_flush(void);
+
+#endif
@@ -9,20 +9,214 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #include "treemunger.h"
+#include "hash.h"
+#include "metrics.h"
+#include "trace.h"
+
+/** The maximum number of threads traversing a translation unit. */
+#define MAX_TRAVERSE_JOBS 256
+
+/**
+ * The size of the stack of the thread parsing a translation unit. Clang's
+ * parser recurses for each level of nesting (e.g. of binary operators), so
+ * generated code needs far more than the usual 8 MiB. Only the pages actually
+ * used are backed by memory.
+ */
+#define PARSE_STACK_SIZE ((size_t)256 * 1024 * 1024)
+
+/** A macro expansion within a translation unit. */
+typedef struct
+{
+	/** The file in which the macro is expanded. */
+	CXFile file;
+
+	/** The offset at which the expansion starts. */
+	unsigned int start;
+
+	/** The offset at which the expansion ends. */
+	unsigned int end;
+
+	/** The cursor pointing to the expansion. */
+	CXCursor cur;
+} macro_exp_t;
+
+/** The macro expansions within a translation unit, sorted by location. */
+typedef struct
+{
+	/** How many expansions can the array house? */
+	size_t capacity;
+
+	/** How many expansions is the array housing right now? */
+	size_t count;
+
+	/** The expansions themselves. */
+	macro_exp_t *arr;
+} macro_exps_t;
+
+/** Where a function call or cast to void is spelled within a macro definition. */
+typedef struct
+{
+	/** The macro definition; a null cursor if the slot is free. */
+	CXCursor def;
+
+	/** The hash of the macro definition cursor. */
+	unsigned int defHash;
+
+	/** The name of the function called; NULL for a cast to void. */
+	char *func;
+
+	/** How many calls to the function (or casts to void) precede it within the definition. */
+	unsigned int occurrence;
+
+	/** The name of the file containing the definition; NULL if not found. */
+	char *fileName;
+
+	/** The location where the call or cast starts. */
+	module_loc_t start;
+
+	/** The location where the call or cast ends. */
+	module_loc_t end;
+} macro_spelling_t;
+
+/**
+ * The spellings within macro definitions found so far, as an open-addressing
+ * hash table. Every finding in an expansion of the same macro would otherwise
+ * tokenize the whole definition again.
+ */
+typedef struct
+{
+	/** How many slots does the table have? Zero or a power of two. */
+	size_t capacity;
+
+	/** How many slots are occupied? */
+	size_t count;
+
+	/** The slots. */
+	macro_spelling_t *slots;
+} macro_spellings_t;
+
+/** A call or cast to void stemming from the body of a macro. */
+typedef struct
+{
+	/** The cursor pointing to the call or cast. */
+	CXCursor cur;
+
+	/** The hash of the cursor. */
+	unsigned int hash;
+
+	/** The expansion the code stems from. */
+	const macro_exp_t *exp;
+
+	/** The name of the function called; NULL for a cast to void. */
+	char *func;
+
+	/** The position of the code within its top-level node, in the order of the descent. */
+	size_t seq;
+
+	/** How many calls to the function (or casts to void) precede it within the expansion. */
+	unsigned int occurrence;
+} macro_occurrence_t;
+
+/**
+ * The calls and casts to void stemming from macro bodies within a top-level
+ * node. libclang locates all code from a macro body at the expansion, so the
+ * order of the calls to a function (or of the casts) within an expansion is
+ * what tells which of them in the definition a finding stems from.
+ */
+typedef struct
+{
+	/** The top-level node they were collected from; a null cursor if none yet. */
+	CXCursor item;
+
+	/** How many can the array house? */
+	size_t capacity;
+
+	/** How many is the array housing right now? */
+	size_t count;
+
+	/** The calls and casts, sorted by the hashes of their cursors. */
+	macro_occurrence_t *arr;
+} macro_occurrences_t;
+
+/** The top-level cursors of a translation unit. */
+typedef struct
+{
+	/** How many cursors can the array house? */
+	size_t capacity;
+
+	/** How many cursors is the array housing right now? */
+	size_t count;
+
+	/** The cursors themselves. */
+	CXCursor *arr;
+} cursors_t;
+
+/** What to collect from the top level of a translation unit. */
+typedef struct
+{
+	/** The macro expansions are collected here. */
+	macro_exps_t *exps;
+
+	/** If not NULL, all top-level cursors are collected here. */
+	cursors_t *items;
+
+	/** If not NULL, the signatures of all functions are collected here. */
+	sigdb_builder_t *sigs;
+} toplevel_collection;
+
+/** What is needed to profile the inclusions of a translation unit. */
+typedef struct
+{
+	/** The translation unit. */
+	CXTranslationUnit tu;
+
+	/** The profile to add the inclusions to. */
+	incprof_t *profile;
+} inclusion_profiling;
 
 /**
  * A structure containing the state of the descent through the AST.
  */
 typedef struct
 {
-	/** Missing void cast callback. */
-	missingVoidProc missProc;
+	/** The array to which findings are appended. */
+	findings_t *found;
+
+	/** The rules to check. */
+	const ruleset_t *rules;
+
+	/** If not NULL, only calls to these functions are reported. */
+	const callees_t *callees;
+
+	/** The macro expansions of the translation unit. */
+	const macro_exps_t *exps;
 
-	/** Superfluous void cast callback. */
-	superfluousVoidProc superProc;
+	/** The spellings within macro definitions found so far; guarded by tuLock. */
+	macro_spellings_t *spellings;
+
+	/** The top-level node being descended into. */
+	CXCursor item;
+
+	/** The calls and casts stemming from macro bodies within item; owned by the thread. */
+	macro_occurrences_t *occurrences;
+
+	/**
+	 * The lock serializing calls into libclang which are not safe to perform
+	 * concurrently on the same translation unit; NULL if the translation unit
+	 * is traversed by a single thread.
+	 */
+	pthread_mutex_t *tuLock;
+
+	/** The number of cursors visited by the thread performing the descent. */
+	size_t *cursors;
 
 	/** The current recursion depth. */
 	size_t level;
@@ -30,261 +224,1651 @@ typedef struct
 	/** Are we preceded by a cast to void? */
 	bool voidCastAbove;
 
-	/** Are we preceded by a compound statement? */
-	bool compoundStmtAbove;
+	/** Are we preceded by a compound statement? */
+	bool compoundStmtAbove;
+
+	/** The cursor pointing to the cast to void. Valid iff voidCastAbove. */
+	CXCursor voidCast;
+} descent_state;
+
+/** A node on the path of the descent whose children are being visited. */
+typedef struct
+{
+	/** The state of the descent at the children. */
+	descent_state state;
+
+	/** The index of the next child to visit among the pending cursors. */
+	size_t next;
+
+	/** The index after the last child among the pending cursors. */
+	size_t end;
+} descent_frame;
+
+/** The explicit stack of a descent. */
+typedef struct
+{
+	/** The nodes on the path to the current node. */
+	descent_frame *frames;
+
+	/** How many frames can the array house? */
+	size_t capacity;
+
+	/** The children of the nodes on the path which are still to be visited. */
+	cursors_t pending;
+} descent_stack;
+
+/** What is needed to descend into each top-level node of a translation unit. */
+typedef struct
+{
+	/** The state with which to start the descent into each node. */
+	descent_state *state;
+
+	/** The stack to use. */
+	descent_stack *stack;
+} descent_traversal;
+
+/**
+ * Compares two macro expansions by their location. Useful for qsort(3),
+ * bsearch(3), et al.
+ *
+ * @param left Pointer to the first expansion.
+ * @param right Pointer to the second expansion.
+ * @return Less than zero if left ordered before right.
+ *         Zero if left and right equally ordered.
+ *         More than zero if right ordered before left.
+ */
+static int comparator_macroexp(const void *left, const void *right)
+{
+	const macro_exp_t *l = (const macro_exp_t *)left;
+	const macro_exp_t *r = (const macro_exp_t *)right;
+
+	if (l->file != r->file)
+		return ((uintptr_t)l->file < (uintptr_t)r->file) ? -1 : 1;
+	if (l->start != r->start)
+		return (l->start < r->start) ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Ensures there is space for one more element in an expanding array, exiting
+ * on failure.
+ *
+ * @param arr the array
+ * @param capacity by-ref to the capacity of the array
+ * @param count the number of elements in the array
+ * @param elemSize the size of an element
+ * @return the (possibly moved) array
+ */
+static void *ensureSpace(void *arr, size_t *capacity, size_t count, size_t elemSize)
+{
+	void *newarr;
+	size_t newcap;
+
+	if (count < *capacity)
+	{
+		return arr;
+	}
+
+	/* double the capacity */
+	newcap = (*capacity == 0) ? 64 : (*capacity * 2);
+	newarr = realloc(arr, newcap * elemSize);
+	if (newarr == NULL)
+	{
+		perror("realloc");
+		exit(EXITCODE_MM);
+	}
+	*capacity = newcap;
+	return newarr;
+}
+
+/**
+ * Adds the signature of the function declared by the cursor to a collection of
+ * signatures, exiting on failure.
+ *
+ * @param sigs the collection of signatures
+ * @param cur the cursor pointing to the function declaration
+ */
+static void collectSignature(sigdb_builder_t *sigs, CXCursor cur)
+{
+	CXString name = clang_getCursorSpelling(cur);
+	CXString usr = clang_getCursorUSR(cur);
+	sig_result_t result;
+
+	switch (clang_getCursorResultType(cur).kind)
+	{
+		case CXType_Void:
+			result = SIG_VOID;
+			break;
+		case CXType_Invalid:
+		case CXType_Unexposed:
+			result = SIG_UNKNOWN;
+			break;
+		default:
+			result = SIG_VALUE;
+			break;
+	}
+
+	if (sigdb_builder_add(sigs, clang_getCString(name), clang_getCString(usr), result) == 0)
+	{
+		perror("sigdb_builder_add");
+		exit(EXITCODE_MM);
+	}
+
+	clang_disposeString(usr);
+	clang_disposeString(name);
+}
+
+/**
+ * Called upon every top-level node of a translation unit; collects the macro
+ * expansions and, if requested, the nodes themselves and the signatures of
+ * the functions declared.
+ *
+ * @param cur the cursor pointing to the node
+ * @param parent the cursor pointing to the parent
+ * @param dta pointer to the toplevel_collection to fill
+ */
+static enum CXChildVisitResult collectTopLevel(CXCursor cur, CXCursor parent, CXClientData dta)
+{
+	toplevel_collection *coll = (toplevel_collection *)dta;
+	macro_exps_t *exps = coll->exps;
+	CXSourceRange rng;
+	macro_exp_t exp = { .cur = cur };
+
+	if (coll->items != NULL)
+	{
+		coll->items->arr = ensureSpace(coll->items->arr, &coll->items->capacity, coll->items->count, sizeof(CXCursor));
+		coll->items->arr[coll->items->count++] = cur;
+	}
+
+	if (coll->sigs != NULL && clang_getCursorKind(cur) == CXCursor_FunctionDecl)
+	{
+		collectSignature(coll->sigs, cur);
+	}
+
+	if (clang_getCursorKind(cur) != CXCursor_MacroExpansion)
+	{
+		return CXChildVisit_Continue;
+	}
+
+	rng = clang_getCursorExtent(cur);
+	clang_getFileLocation(clang_getRangeStart(rng), &exp.file, NULL, NULL, &exp.start);
+	clang_getFileLocation(clang_getRangeEnd(rng), NULL, NULL, NULL, &exp.end);
+
+	exps->arr = ensureSpace(exps->arr, &exps->capacity, exps->count, sizeof(macro_exp_t));
+	exps->arr[exps->count++] = exp;
+	return CXChildVisit_Continue;
+}
+
+/**
+ * Finds the macro expansion whose body the code pointed to by the cursor stems
+ * from in its entirety.
+ *
+ * libclang maps every location within a macro's body onto the location where
+ * the macro is expanded (even clang_getSpellingLocation() does so), while
+ * locations within a macro's arguments are mapped onto the location where the
+ * argument is written. Code stemming from a macro's body thus starts exactly
+ * where the expansion starts.
+ *
+ * @param exps the macro expansions of the translation unit
+ * @param cur the cursor whose macro expansion to find
+ * @return the expansion, or NULL if the code does not stem from a macro
+ */
+static const macro_exp_t *findExpansion(const macro_exps_t *exps, CXCursor cur)
+{
+	CXSourceRange rng = clang_getCursorExtent(cur);
+	const macro_exp_t *found;
+	macro_exp_t key;
+	unsigned int end;
+
+	if (exps->count == 0)
+	{
+		return NULL;
+	}
+
+	clang_getFileLocation(clang_getRangeStart(rng), &key.file, NULL, NULL, &key.start);
+	found = bsearch(&key, exps->arr, exps->count, sizeof(macro_exp_t), comparator_macroexp);
+	if (found == NULL)
+	{
+		return NULL;
+	}
+
+	/* the code must end within the expansion too */
+	clang_getFileLocation(clang_getRangeEnd(rng), NULL, NULL, NULL, &end);
+	return (end <= found->end) ? found : NULL;
+}
+
+/**
+ * Returns whether the given token is spelled as the given string.
+ *
+ * @param tu the translation unit containing the token
+ * @param tok the token to check
+ * @param str the expected spelling
+ * @return true if the token is spelled as str
+ */
+static inline bool tokenIs(CXTranslationUnit tu, CXToken tok, const char *str)
+{
+	CXString spell = clang_getTokenSpelling(tu, tok);
+	bool ret = (strcmp(clang_getCString(spell), str) == 0);
+	clang_disposeString(spell);
+	return ret;
+}
+
+/**
+ * Stores the presumed location of a token into the parameters passed by
+ * reference.
+ *
+ * @param cloc the location to store
+ * @param locFileName by-ref to string specifying the filename, or NULL
+ * @param loc by-ref to location
+ */
+static inline void presumedLocation(CXSourceLocation cloc, CXString *locFileName, module_loc_t *loc)
+{
+	unsigned int l, c;
+	clang_getPresumedLocation(cloc, locFileName, &l, &c);
+	loc->line = l;
+	loc->col = c;
+}
+
+/**
+ * Finds the slot of a spelling within a macro definition in the table.
+ *
+ * @param spellings the table; must have at least one free slot
+ * @param def the macro definition
+ * @param defHash the hash of the macro definition cursor
+ * @param func the name of the function called; NULL for a cast to void
+ * @param occurrence how many calls to the function (or casts to void) precede
+ * it within the definition
+ * @return the slot containing the spelling, or the free slot where it belongs
+ */
+static macro_spelling_t *spellingSlot(
+	const macro_spellings_t *spellings,
+	CXCursor def,
+	unsigned int defHash,
+	const char *func,
+	unsigned int occurrence
+)
+{
+	size_t mask = spellings->capacity - 1;
+	uint64_t hash = hash_string(defHash, (func != NULL) ? func : "");
+	size_t i = (size_t)(hash_bytes(hash, &occurrence, sizeof(occurrence)) & mask);
+
+	for (;; i = (i + 1) & mask)
+	{
+		macro_spelling_t *slot = &spellings->slots[i];
+		if (clang_Cursor_isNull(slot->def))
+		{
+			return slot;
+		}
+		if (
+			slot->defHash == defHash &&
+			slot->occurrence == occurrence &&
+			((slot->func == NULL) == (func == NULL)) &&
+			(func == NULL || strcmp(slot->func, func) == 0) &&
+			clang_equalCursors(slot->def, def)
+		)
+		{
+			return slot;
+		}
+	}
+}
+
+/**
+ * Grows the table of spellings within macro definitions if it is more than
+ * half full.
+ *
+ * @param spellings the table
+ */
+static void growSpellings(macro_spellings_t *spellings)
+{
+	macro_spellings_t grown;
+	size_t i;
+
+	if (2 * (spellings->count + 1) <= spellings->capacity)
+	{
+		return;
+	}
+
+	grown.capacity = (spellings->capacity == 0) ? 64 : (spellings->capacity * 2);
+	grown.count = spellings->count;
+	grown.slots = malloc(grown.capacity * sizeof(macro_spelling_t));
+	if (grown.slots == NULL)
+	{
+		perror("malloc");
+		exit(EXITCODE_MM);
+	}
+	for (i = 0; i < grown.capacity; ++i)
+	{
+		grown.slots[i].def = clang_getNullCursor();
+	}
+
+	for (i = 0; i < spellings->capacity; ++i)
+	{
+		macro_spelling_t *slot = &spellings->slots[i];
+		if (!clang_Cursor_isNull(slot->def))
+		{
+			*spellingSlot(&grown, slot->def, slot->defHash, slot->func, slot->occurrence) = *slot;
+		}
+	}
+
+	free(spellings->slots);
+	*spellings = grown;
+}
+
+/**
+ * Adds a spelling within a macro definition to the table, not found yet.
+ *
+ * @param spellings the table
+ * @param def the macro definition
+ * @param defHash the hash of the macro definition cursor
+ * @param func the name of the function called; NULL for a cast to void
+ * @param occurrence how many calls to the function (or casts to void) precede
+ * it within the definition
+ * @return the slot of the spelling; valid until the next spelling is added
+ */
+static macro_spelling_t *addSpelling(
+	macro_spellings_t *spellings,
+	CXCursor def,
+	unsigned int defHash,
+	const char *func,
+	unsigned int occurrence
+)
+{
+	macro_spelling_t *spell;
+
+	growSpellings(spellings);
+	spell = spellingSlot(spellings, def, defHash, func, occurrence);
+	spell->def = def;
+	spell->defHash = defHash;
+	spell->func = NULL;
+	spell->occurrence = occurrence;
+	spell->fileName = NULL;
+	if (func != NULL && (spell->func = strdup(func)) == NULL)
+	{
+		perror("strdup");
+		exit(EXITCODE_MM);
+	}
+	++spellings->count;
+	return spell;
+}
+
+/**
+ * Finds where the calls to a function or the casts to void are spelled within
+ * the definition of a macro by tokenizing the definition, and adds them to the
+ * table. They are counted in the order in which they are spelled, which is
+ * the order in which the descent meets them in an expansion.
+ *
+ * If there are none, a spelling which hasn't been found is added for the
+ * first one, so that the definition isn't tokenized again.
+ *
+ * @param spellings the table
+ * @param def the macro definition
+ * @param defHash the hash of the macro definition cursor
+ * @param func the name of the function called; NULL for casts to void
+ */
+static void findMacroSpellings(macro_spellings_t *spellings, CXCursor def, unsigned int defHash, const char *func)
+{
+	CXTranslationUnit tu = clang_Cursor_getTranslationUnit(def);
+	CXToken *toks;
+	unsigned int numToks, i;
+	unsigned int seen = 0;
+	bool matched;
+
+	clang_tokenize(tu, clang_getCursorExtent(def), &toks, &numToks);
+
+	/* skip the name of the macro */
+	for (i = 1; i + 2 < numToks; ++i)
+	{
+		if (func != NULL)
+		{
+			/* identifier followed by an opening parenthesis */
+			matched = (
+				clang_getTokenKind(toks[i]) == CXToken_Identifier &&
+				tokenIs(tu, toks[i], func) &&
+				tokenIs(tu, toks[i+1], "(")
+			);
+		}
+		else
+		{
+			/* "(", "void", ")" */
+			matched = (
+				clang_getTokenKind(toks[i]) == CXToken_Punctuation &&
+				tokenIs(tu, toks[i], "(") &&
+				tokenIs(tu, toks[i+1], "void") &&
+				tokenIs(tu, toks[i+2], ")")
+			);
+		}
+
+		if (matched)
+		{
+			macro_spelling_t *spell = addSpelling(spellings, def, defHash, func, seen++);
+			CXString fileName;
+
+			/* presumed, like the locations outside macros, so that line markers are honored */
+			presumedLocation(clang_getTokenLocation(tu, toks[i]), &fileName, &spell->start);
+			presumedLocation(clang_getRangeEnd(clang_getTokenExtent(tu, toks[i+2])), NULL, &spell->end);
+			spell->fileName = strdup(clang_getCString(fileName));
+			clang_disposeString(fileName);
+			if (spell->fileName == NULL)
+			{
+				perror("strdup");
+				exit(EXITCODE_MM);
+			}
+		}
+	}
+
+	if (seen == 0)
+	{
+		(void)addSpelling(spellings, def, defHash, func, 0);
+	}
+
+	clang_disposeTokens(tu, toks, numToks);
+}
+
+/**
+ * Frees the table of spellings within macro definitions.
+ *
+ * @param spellings the table
+ */
+static void disposeSpellings(macro_spellings_t *spellings)
+{
+	size_t i;
+
+	for (i = 0; i < spellings->capacity; ++i)
+	{
+		if (!clang_Cursor_isNull(spellings->slots[i].def))
+		{
+			free(spellings->slots[i].func);
+			free(spellings->slots[i].fileName);
+		}
+	}
+	free(spellings->slots);
+}
+
+/**
+ * Finds where a function call or a cast to void is spelled within the
+ * definition of a macro, tokenizing each definition only once per function
+ * (or once for the casts).
+ *
+ * @param spellings the spellings found so far
+ * @param occ the call or cast within the expansion of the macro
+ * @param fileName by-ref to the name of the file containing the definition;
+ * owned by spellings
+ * @param start by-ref to the location where the call or cast starts
+ * @param end by-ref to the location where the cast ends
+ * @return true if the spelling was found; if false, the by-ref parameters are
+ * untouched
+ */
+static bool macroSpelling(
+	macro_spellings_t *spellings,
+	const macro_occurrence_t *occ,
+	const char **fileName,
+	module_loc_t *start,
+	module_loc_t *end
+)
+{
+	CXCursor def = clang_getCursorReferenced(occ->exp->cur);
+	macro_spelling_t *spell;
+	unsigned int defHash;
+
+	if (clang_Cursor_isNull(def) || clang_getCursorKind(def) != CXCursor_MacroDefinition)
+	{
+		return false;
+	}
+
+	growSpellings(spellings);
+	defHash = clang_hashCursor(def);
+	spell = spellingSlot(spellings, def, defHash, occ->func, occ->occurrence);
+	if (clang_Cursor_isNull(spell->def))
+	{
+		if (clang_Cursor_isNull(spellingSlot(spellings, def, defHash, occ->func, 0)->def))
+		{
+			/* all of them at once, so that each definition is tokenized only once per function */
+			findMacroSpellings(spellings, def, defHash, occ->func);
+		}
+
+		spell = spellingSlot(spellings, def, defHash, occ->func, occ->occurrence);
+		if (clang_Cursor_isNull(spell->def))
+		{
+			/* more of them in the expansion than in the definition, e.g. from a nested macro */
+			spell = addSpelling(spellings, def, defHash, occ->func, occ->occurrence);
+		}
+	}
+
+	if (spell->fileName == NULL)
+	{
+		return false;
+	}
+	*fileName = spell->fileName;
+	*start = spell->start;
+	*end = spell->end;
+	return true;
+}
+
+/**
+ * Acquires the translation unit lock of the descent, if there is one.
+ *
+ * @param dstate the state of the descent
+ */
+static inline void lockTU(const descent_state *dstate)
+{
+	if (dstate->tuLock != NULL)
+	{
+		(void)pthread_mutex_lock(dstate->tuLock);
+	}
+}
+
+/**
+ * Releases the translation unit lock of the descent, if there is one.
+ *
+ * @param dstate the state of the descent
+ */
+static inline void unlockTU(const descent_state *dstate)
+{
+	if (dstate->tuLock != NULL)
+	{
+		(void)pthread_mutex_unlock(dstate->tuLock);
+	}
+}
+
+/**
+ * Stores the location information from the cursor into the parameters
+ * passed by reference.
+ *
+ * @param cur cursor whose location to obtain
+ * @param locFileName by-ref to string specifying the filename
+ * @param loc by-ref to location
+ */
+static inline void cursorLocation(CXCursor cur, CXString *locFileName, module_loc_t *loc)
+{
+	unsigned int l, c;
+
+	CXSourceLocation cloc = clang_getCursorLocation(cur);
+	clang_getPresumedLocation(cloc, locFileName, &l, &c);
+	loc->line = l;
+	loc->col = c;
+}
+
+/**
+ * Returns the extent of the cast referenced by the given cursor.
+ *
+ * @param cur cursor to C-style cast whose extent to obtain
+ * @param start by-ref to the location where the cast begins
+ * @param end by-ref to the location where the cast ends
+ */
+static inline void castExtent(CXCursor cur, module_loc_t *start, module_loc_t *end)
+{
+	CXToken *toks;
+	CXCursor *curs;
+	CXTranslationUnit tu = clang_Cursor_getTranslationUnit(cur);
+	unsigned int numToks, i;
+	bool startSet = false;
+
+	assert(clang_getCursorKind(cur) == CXCursor_CStyleCastExpr);
+
+	/* where is it? */
+	CXSourceRange rng = clang_getCursorExtent(cur);
+
+	/* tokenize the cast */
+	clang_tokenize(tu, rng, &toks, &numToks);
+
+	/* annotate it */
+	curs = malloc(numToks * sizeof(CXCursor));
+	if (curs == NULL)
+	{
+		perror("malloc");
+		exit(EXITCODE_MM);
+	}
+	clang_annotateTokens(tu, toks, numToks, curs);
+
+	/* find the tokens which correspond to the cursor */
+	for (i = 0; i < numToks; ++i)
+	{
+		CXSourceRange tokExt;
+		unsigned int newEL, newEC;
+
+		if (
+			clang_getCursorKind(cur) != clang_getCursorKind(curs[i]) ||
+			!clang_equalTypes(clang_getCursorType(cur), clang_getCursorType(curs[i]))
+		)
+		{
+			/* not part of our cast anymore */
+			break;
+		}
+
+		/* fetch token range */
+		tokExt = clang_getTokenExtent(tu, toks[i]);
+		clang_getPresumedLocation(clang_getRangeEnd(tokExt), NULL, &newEL, &newEC);
+
+		if (!startSet)
+		{
+			unsigned int newSL, newSC;
+			clang_getPresumedLocation(clang_getRangeStart(tokExt), NULL, &newSL, &newSC);
+			start->line = newSL;
+			start->col = newSC;
+			startSet = true;
+		}
+
+		end->line = newEL;
+		end->col = newEC;
+	}
+
+	/* free cursors, free tokens */
+	free(curs);
+	clang_disposeTokens(tu, toks, numToks);
+}
+
+/**
+ * Appends a child of a node to the cursors pending a visit.
+ *
+ * @param cur the cursor pointing to the child
+ * @param parent the cursor pointing to the node
+ * @param dta pointer to the cursors_t pending a visit
+ */
+static enum CXChildVisitResult collectChild(CXCursor cur, CXCursor parent, CXClientData dta)
+{
+	cursors_t *pending = (cursors_t *)dta;
+
+	(void)parent;
+
+	pending->arr = ensureSpace(pending->arr, &pending->capacity, pending->count, sizeof(CXCursor));
+	pending->arr[pending->count++] = cur;
+	return CXChildVisit_Continue;
+}
+
+/**
+ * Compares two calls or casts stemming from macro bodies by their expansion,
+ * then by the function called (casts first), then by their order. Useful for
+ * qsort(3).
+ *
+ * @param left Pointer to the first occurrence.
+ * @param right Pointer to the second occurrence.
+ * @return As strcmp(3).
+ */
+static int comparator_occurrence(const void *left, const void *right)
+{
+	const macro_occurrence_t *l = (const macro_occurrence_t *)left;
+	const macro_occurrence_t *r = (const macro_occurrence_t *)right;
+
+	if (l->exp != r->exp)
+		return ((uintptr_t)l->exp < (uintptr_t)r->exp) ? -1 : 1;
+	if ((l->func == NULL) != (r->func == NULL))
+		return (l->func == NULL) ? -1 : 1;
+	if (l->func != NULL && strcmp(l->func, r->func) != 0)
+		return strcmp(l->func, r->func);
+	if (l->seq != r->seq)
+		return (l->seq < r->seq) ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Compares two calls or casts stemming from macro bodies by the hashes of
+ * their cursors. Useful for qsort(3).
+ *
+ * @param left Pointer to the first occurrence.
+ * @param right Pointer to the second occurrence.
+ * @return As strcmp(3).
+ */
+static int comparator_occurrence_hash(const void *left, const void *right)
+{
+	const macro_occurrence_t *l = (const macro_occurrence_t *)left;
+	const macro_occurrence_t *r = (const macro_occurrence_t *)right;
+
+	if (l->hash != r->hash)
+		return (l->hash < r->hash) ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Frees the calls and casts stemming from macro bodies, leaving the array
+ * empty.
+ *
+ * @param occs the calls and casts
+ */
+static void clearOccurrences(macro_occurrences_t *occs)
+{
+	size_t k;
+
+	for (k = 0; k < occs->count; ++k)
+	{
+		free(occs->arr[k].func);
+	}
+	occs->count = 0;
+	occs->item = clang_getNullCursor();
+}
+
+/**
+ * Frees the calls and casts stemming from macro bodies.
+ *
+ * @param occs the calls and casts
+ */
+static void disposeOccurrences(macro_occurrences_t *occs)
+{
+	clearOccurrences(occs);
+	free(occs->arr);
+}
+
+/**
+ * Collects the calls and casts to void stemming from macro bodies within the
+ * top-level node of the descent and numbers them by their occurrence within
+ * their expansion.
+ *
+ * @param dstate the state of the descent; the translation unit lock must not
+ * be held
+ */
+static void collectOccurrences(const descent_state *dstate)
+{
+	macro_occurrences_t *occs = dstate->occurrences;
+	cursors_t pending = {
+		.capacity = 0,
+		.count = 0,
+		.arr = NULL
+	};
+	size_t k, seq = 0;
+
+	clearOccurrences(occs);
+	occs->item = dstate->item;
+
+	/* depth first with an explicit stack, in the order of the descent, as the code may be nested deeply */
+	pending.arr = ensureSpace(pending.arr, &pending.capacity, pending.count, sizeof(CXCursor));
+	pending.arr[pending.count++] = dstate->item;
+	while (pending.count > 0)
+	{
+		CXCursor cur = pending.arr[--pending.count];
+		enum CXCursorKind kind = clang_getCursorKind(cur);
+		size_t first, last;
+
+		if (
+			kind == CXCursor_CallExpr ||
+			(kind == CXCursor_CStyleCastExpr && clang_getCursorType(cur).kind == CXType_Void)
+		)
+		{
+			const macro_exp_t *exp;
+
+			lockTU(dstate);
+			exp = findExpansion(dstate->exps, cur);
+			unlockTU(dstate);
+
+			if (exp != NULL)
+			{
+				macro_occurrence_t *occ;
+
+				occs->arr = ensureSpace(occs->arr, &occs->capacity, occs->count, sizeof(macro_occurrence_t));
+				occ = &occs->arr[occs->count++];
+				occ->cur = cur;
+				occ->hash = clang_hashCursor(cur);
+				occ->exp = exp;
+				occ->func = NULL;
+				occ->seq = seq;
+				occ->occurrence = 0;
+				if (kind == CXCursor_CallExpr)
+				{
+					CXString name = clang_getCursorSpelling(cur);
+					occ->func = strdup(clang_getCString(name));
+					clang_disposeString(name);
+					if (occ->func == NULL)
+					{
+						perror("strdup");
+						exit(EXITCODE_MM);
+					}
+				}
+			}
+			++seq;
+		}
+
+		/* the first child has to end up on top */
+		first = pending.count;
+		(void)clang_visitChildren(cur, collectChild, (CXClientData)&pending);
+		for (last = pending.count; first + 1 < last; ++first, --last)
+		{
+			CXCursor swap = pending.arr[first];
+			pending.arr[first] = pending.arr[last - 1];
+			pending.arr[last - 1] = swap;
+		}
+	}
+	free(pending.arr);
+
+	/* number the calls to each function and the casts within each expansion */
+	qsort(occs->arr, occs->count, sizeof(macro_occurrence_t), comparator_occurrence);
+	for (k = 1; k < occs->count; ++k)
+	{
+		macro_occurrence_t *prev = &occs->arr[k - 1];
+		macro_occurrence_t *occ = &occs->arr[k];
+
+		if (
+			prev->exp == occ->exp &&
+			(prev->func == NULL) == (occ->func == NULL) &&
+			(occ->func == NULL || strcmp(prev->func, occ->func) == 0)
+		)
+		{
+			occ->occurrence = prev->occurrence + 1;
+		}
+	}
+	qsort(occs->arr, occs->count, sizeof(macro_occurrence_t), comparator_occurrence_hash);
+}
+
+/**
+ * Looks up a call or cast stemming from a macro body within the top-level
+ * node of the descent, collecting the calls and casts of the node first if
+ * that hasn't been done yet.
+ *
+ * @param dstate the state of the descent; the translation unit lock must not
+ * be held
+ * @param cur the cursor pointing to the call or cast
+ * @return the call or cast, or NULL if it doesn't stem from a macro body
+ */
+static const macro_occurrence_t *findOccurrence(const descent_state *dstate, CXCursor cur)
+{
+	macro_occurrences_t *occs = dstate->occurrences;
+	unsigned int hash = clang_hashCursor(cur);
+	size_t lo = 0, hi, mid;
+
+	if (!clang_equalCursors(occs->item, dstate->item))
+	{
+		collectOccurrences(dstate);
+	}
+
+	/* the first one with the hash */
+	hi = occs->count;
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if (occs->arr[mid].hash < hash)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	for (; lo < occs->count && occs->arr[lo].hash == hash; ++lo)
+	{
+		if (clang_equalCursors(occs->arr[lo].cur, cur))
+		{
+			return &occs->arr[lo];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Appends a finding to the findings array of the descent, exiting on failure.
+ *
+ * @param dstate the state of the descent
+ * @param kind the kind of finding
+ * @param file the name of the file where the finding is located
+ * @param func the name of the function called
+ * @param start the start location of the finding
+ * @param end the end location of the finding
+ * @param expansions the number of macro expansions yielding the finding
+ */
+static inline void addFinding(
+	descent_state *dstate,
+	finding_kind_t kind,
+	const char *file,
+	const char *func,
+	module_loc_t start,
+	module_loc_t end,
+	size_t expansions
+)
+{
+	if (findings_add(dstate->found, kind, file, func, start, end, expansions) == 0)
+	{
+		perror("findings_add");
+		exit(EXITCODE_MM);
+	}
+}
+
+/**
+ * Appends a finding concerning a function call to the findings array of the
+ * descent. If the code in question stems from the body of a macro, the finding
+ * is placed where the code is spelled within the macro's definition.
+ *
+ * @param dstate the state of the descent
+ * @param kind the kind of finding
+ * @param cur the cursor pointing to the code in question (the call if a cast
+ * is missing, the cast if it is superfluous)
+ * @param file the name of the file where the code is located
+ * @param func the name of the function called
+ * @param start the location where the code starts
+ * @param end the location where the code ends
+ */
+static void reportCall(
+	descent_state *dstate,
+	finding_kind_t kind,
+	CXCursor cur,
+	const char *file,
+	const char *func,
+	module_loc_t start,
+	module_loc_t end
+)
+{
+	const macro_exp_t *exp;
+	const macro_occurrence_t *occ = NULL;
+	const char *defFileName;
+	bool inMacro;
+
+	lockTU(dstate);
+	exp = findExpansion(dstate->exps, cur);
+	unlockTU(dstate);
+
+	if (exp != NULL)
+	{
+		/* which of the calls or casts in the definition it is */
+		occ = findOccurrence(dstate, cur);
+	}
+
+	lockTU(dstate);
+	inMacro = (occ != NULL && macroSpelling(dstate->spellings, occ, &defFileName, &start, &end));
+	unlockTU(dstate);
+
+	if (inMacro)
+	{
+		/* the name outlives the slot moving when the table grows */
+		addFinding(dstate, kind, defFileName, func, start, end, 1);
+		return;
+	}
+
+	addFinding(dstate, kind, file, func, start, end, 0);
+}
+
+void rule_lock(const rule_ctx_t *ctx)
+{
+	lockTU((const descent_state *)ctx->descent);
+}
+
+void rule_unlock(const rule_ctx_t *ctx)
+{
+	unlockTU((const descent_state *)ctx->descent);
+}
+
+enum CXTypeKind rule_calleeResult(const rule_ctx_t *ctx, CXCursor call)
+{
+	descent_state *dstate = (descent_state *)ctx->descent;
+
+	/* the function declaration */
+	CXCursor target = clang_getCursorReferenced(call);
+	bool found = !(
+		clang_Cursor_isNull(target) ||
+		clang_equalLocations(clang_getCursorLocation(call), clang_getCursorLocation(target))
+	);
+
+	if (dstate->callees != NULL)
+	{
+		/* is it one of the functions we're interested in? */
+		CXString calleeName = clang_getCursorSpelling(found ? target : call);
+		bool targeted = callees_match(dstate->callees, clang_getCString(calleeName));
+		clang_disposeString(calleeName);
+
+		if (!targeted)
+		{
+			return CXType_Invalid;
+		}
+	}
+
+	if (!found)
+	{
+		/* function decl not found */
+		CXString funcName = clang_getCursorSpelling(call);
+		CXString locFileName;
+		module_loc_t loc;
+
+		rule_lock(ctx);
+		cursorLocation(call, &locFileName, &loc);
+		rule_unlock(ctx);
+
+		/* reported along with the findings, in source order however many threads traverse */
+		addFinding(dstate, FINDING_UNCHECKED_CALL, clang_getCString(locFileName), clang_getCString(funcName), loc, loc, 0);
+
+		clang_disposeString(locFileName);
+		clang_disposeString(funcName);
+		return CXType_Invalid;
+	}
+
+	return clang_getCursorResultType(target).kind;
+}
+
+void rule_reportCall(const rule_ctx_t *ctx, finding_kind_t kind, CXCursor call, CXCursor cast)
+{
+	descent_state *dstate = (descent_state *)ctx->descent;
+	bool superfluous = (kind == FINDING_SUPERFLUOUS_VOID);
+	CXString funcName = clang_getCursorSpelling(call);
+	CXString locFileName;
+	module_loc_t start, end;
+
+	lockTU(dstate);
+	cursorLocation(call, &locFileName, &start);
+	end = start;
+	if (superfluous)
+	{
+		/* the cast is what's reported */
+		castExtent(cast, &start, &end);
+	}
+	unlockTU(dstate);
+
+	reportCall(
+		dstate,
+		kind,
+		superfluous ? cast : call,
+		clang_getCString(locFileName),
+		clang_getCString(funcName),
+		start,
+		end
+	);
+
+	clang_disposeString(locFileName);
+	clang_disposeString(funcName);
+}
+
+/**
+ * Called upon every node visited in a translation unit. Passes the node to the
+ * rules interested in it and keeps track of its surroundings for its children.
+ *
+ * @param cur the cursor pointing to the node
+ * @param dstate the state of the descent at the node
+ * @return the state of the descent at the children of the node
+ */
+static descent_state visitation(CXCursor cur, descent_state *dstate)
+{
+	descent_state kiddstate = {
+		.found = dstate->found,
+		.rules = dstate->rules,
+		.callees = dstate->callees,
+		.exps = dstate->exps,
+		.spellings = dstate->spellings,
+		.item = dstate->item,
+		.occurrences = dstate->occurrences,
+		.tuLock = dstate->tuLock,
+		.cursors = dstate->cursors,
+		.level = dstate->level + 1,
+		.voidCastAbove = false,
+		.compoundStmtAbove = false
+	};
+	rule_ctx_t ctx = {
+		.discarded = dstate->compoundStmtAbove,
+		.voidCastAbove = dstate->voidCastAbove,
+		.voidCast = dstate->voidCast,
+		.descent = dstate
+	};
+
+	/* kind of cursor */
+	enum CXCursorKind curKind = clang_getCursorKind(cur);
+	++*dstate->cursors;
+
+	/* check the node */
+	ruleset_dispatch(dstate->rules, &ctx, cur, curKind);
+
+	if (curKind == CXCursor_CompoundStmt || curKind == CXCursor_CaseStmt)
+	{
+		/* compound statement above. means the function call tosses away its value. */
+		kiddstate.compoundStmtAbove = true;
+	}
+	else if (curKind == CXCursor_CStyleCastExpr)
+	{
+		/* it's a cast. is it to void? */
+		if (clang_getCursorType(cur).kind == CXType_Void)
+		{
+			/* yay! store it for the kid */
+			kiddstate.voidCastAbove = true;
+			kiddstate.voidCast = cur;
+		}
+	}
+
+#ifdef DEBUG
+	{
+		/* the location info */
+		CXString locFileName;
+		module_loc_t loc;
+
+		CXString cursDesc = clang_getCursorDisplayName(cur);
+		CXString cursKind = clang_getCursorKindSpelling(curKind);
+
+		lockTU(dstate);
+		cursorLocation(cur, &locFileName, &loc);
+
+		(void)printf(
+			"At level %zu, visiting node of kind %s named %s at %s:%zu:%zu.\n",
+			dstate->level,
+			clang_getCString(cursKind),
+			clang_getCString(cursDesc),
+			clang_getCString(locFileName),
+			loc.line, loc.col
+		);
+
+		unlockTU(dstate);
+
+		clang_disposeString(locFileName);
+		clang_disposeString(cursKind);
+		clang_disposeString(cursDesc);
+	}
+#endif
+
+	return kiddstate;
+}
+
+/**
+ * Visits a node and all its descendants in depth-first order.
+ *
+ * The descent keeps its own stack instead of recursing, so that deeply nested
+ * code (e.g. a long chain of binary operators) can't overflow the stack of
+ * the thread. Only the children of the nodes on the path to the current node
+ * are kept around.
+ *
+ * @param cur the cursor pointing to the node
+ * @param dstate the state of the descent at the node
+ * @param stack the stack to use; may be reused across calls
+ */
+static void descend(CXCursor cur, descent_state *dstate, descent_stack *stack)
+{
+	size_t depth = 1;
+
+	dstate->item = cur;
+	stack->frames = ensureSpace(stack->frames, &stack->capacity, 0, sizeof(descent_frame));
+	stack->frames[0].state = visitation(cur, dstate);
+	stack->pending.count = 0;
+	(void)clang_visitChildren(cur, collectChild, (CXClientData)&stack->pending);
+	stack->frames[0].next = 0;
+	stack->frames[0].end = stack->pending.count;
+
+	while (depth > 0)
+	{
+		descent_frame *frame = &stack->frames[depth - 1];
+		CXCursor child;
+
+		if (frame->next == frame->end)
+		{
+			/* all children visited; the parent's remaining children are on top again */
+			--depth;
+			stack->pending.count = (depth > 0) ? stack->frames[depth - 1].end : 0;
+			continue;
+		}
+
+		/* the children of the child go on top of the children of this node */
+		child = stack->pending.arr[frame->next++];
+		stack->frames = ensureSpace(stack->frames, &stack->capacity, depth, sizeof(descent_frame));
+		frame = &stack->frames[depth - 1];
+
+		stack->frames[depth].state = visitation(child, &frame->state);
+		stack->frames[depth].next = stack->pending.count;
+		(void)clang_visitChildren(child, collectChild, (CXClientData)&stack->pending);
+		stack->frames[depth].end = stack->pending.count;
+		++depth;
+	}
+}
+
+/**
+ * Visits a top-level node of a translation unit and its descendants.
+ *
+ * @param cur the cursor pointing to the node
+ * @param parent the cursor pointing to the translation unit
+ * @param dta pointer to the descent_traversal
+ */
+static enum CXChildVisitResult descendTopLevel(CXCursor cur, CXCursor parent, CXClientData dta)
+{
+	descent_traversal *trav = (descent_traversal *)dta;
+
+	(void)parent;
+
+	descend(cur, trav->state, trav->stack);
+	return CXChildVisit_Continue;
+}
+
+/**
+ * Returns whether a diagnostic of the given severity should be output.
+ *
+ * @param sev the severity of the diagnostic
+ * @param mode which diagnostics to output
+ * @return true if the diagnostic should be formatted and output
+ */
+static inline bool diagnosticShown(enum CXDiagnosticSeverity sev, diag_mode_t mode)
+{
+	switch (mode)
+	{
+		case DIAG_ALL:
+			return true;
+		case DIAG_ERRORS:
+			return (sev >= CXDiagnostic_Error);
+		case DIAG_NONE:
+			return false;
+	}
+	assert(0 && "Unknown diagnostic mode.");
+	return true;
+}
+
+/** The work shared by the threads traversing a translation unit. */
+typedef struct
+{
+	/** The state with which to start the descent into each top-level node. */
+	descent_state proto;
+
+	/** The cursor pointing to the translation unit. */
+	CXCursor tuCursor;
+
+	/** The top-level nodes of the translation unit. */
+	const cursors_t *items;
+
+	/** The findings for each top-level node. */
+	findings_t *itemFound;
+
+	/** The index of the next top-level node to traverse. */
+	atomic_size_t next;
+
+	/** The number of workers started so far; used to assign trace tracks. */
+	atomic_uint workers;
+} traversal_work;
+
+/** How many top-level nodes a worker traverses between samples of the queue depth. */
+#define QUEUE_SAMPLE_INTERVAL 256
+
+/**
+ * Traverses top-level nodes of a translation unit until none are left.
+ *
+ * @param dta pointer to the traversal_work
+ * @return NULL
+ */
+static void *traversalWorker(void *dta)
+{
+	traversal_work *work = (traversal_work *)dta;
+	unsigned int worker = atomic_fetch_add(&work->workers, 1);
+	descent_stack stack = { .frames = NULL, .capacity = 0 };
+	macro_occurrences_t occurrences = {
+		.item = clang_getNullCursor(),
+		.capacity = 0,
+		.count = 0,
+		.arr = NULL
+	};
+	uint64_t start;
+	size_t k, cursors = 0;
+
+	if (worker > 0 && trace_on())
+	{
+		/* the calling thread stays on the main track */
+		char trackName[32];
+		(void)snprintf(trackName, sizeof(trackName), "traversal worker %u", worker);
+		trace_track(TRACE_TRACK_MAIN + worker, trackName);
+	}
+	start = trace_now();
+
+	while ((k = atomic_fetch_add(&work->next, 1)) < work->items->count)
+	{
+		descent_state dstate = work->proto;
+		dstate.found = &work->itemFound[k];
+		dstate.cursors = &cursors;
+		dstate.occurrences = &occurrences;
+		descend(work->items->arr[k], &dstate, &stack);
+
+		if (k % QUEUE_SAMPLE_INTERVAL == 0)
+		{
+			trace_counter("traversal queue", (double)(work->items->count - k - 1));
+		}
+	}
+
+	free(stack.frames);
+	free(stack.pending.arr);
+	disposeOccurrences(&occurrences);
+	metrics_add(METRIC_CURSORS, cursors);
+	trace_span("traverse", NULL, start);
+	if (worker > 0)
+	{
+		trace_flush();
+	}
+
+	return NULL;
+}
+
+/**
+ * Traverses the top-level nodes of a translation unit using multiple threads.
+ * The findings are appended in the order of the nodes.
+ *
+ * @param tuCursor the cursor pointing to the translation unit
+ * @param items the top-level nodes of the translation unit
+ * @param dstate the state with which to start the descent into each node
+ * @param jobs the number of threads to use, including the calling one
+ */
+static void traverseParallel(CXCursor tuCursor, const cursors_t *items, const descent_state *dstate, unsigned int jobs)
+{
+	pthread_t threads[MAX_TRAVERSE_JOBS];
+	pthread_mutex_t tuLock = PTHREAD_MUTEX_INITIALIZER;
+	traversal_work work = {
+		.proto = *dstate,
+		.tuCursor = tuCursor,
+		.items = items
+	};
+	unsigned int started, t;
+	size_t k;
+
+	atomic_init(&work.next, 0);
+	atomic_init(&work.workers, 0);
+	work.proto.tuLock = &tuLock;
+	work.itemFound = calloc(items->count, sizeof(findings_t));
+	if (work.itemFound == NULL && items->count > 0)
+	{
+		perror("calloc");
+		exit(EXITCODE_MM);
+	}
 
-	/** The location of the cast to void. Valid iff voidCastAbove. */
-	struct
+	if (jobs > MAX_TRAVERSE_JOBS)
 	{
-		/** The file. */
-		const char *file;
+		jobs = MAX_TRAVERSE_JOBS;
+	}
 
-		/** The location where the cast begins. */
-		module_loc_t startLoc;
+	/* start the helpers; the calling thread is the first worker */
+	for (started = 1; started < jobs; ++started)
+	{
+		if (pthread_create(&threads[started], NULL, traversalWorker, &work) != 0)
+		{
+			/* make do with the threads we have */
+			break;
+		}
+	}
+	(void)traversalWorker(&work);
+	for (t = 1; t < started; ++t)
+	{
+		(void)pthread_join(threads[t], NULL);
+	}
 
-		/** The location where the cast ends. */
-		module_loc_t endLoc;
-	} castLoc;
-} descent_state;
+	/* merge the findings in source order */
+	for (k = 0; k < items->count; ++k)
+	{
+		if (findings_move(dstate->found, &work.itemFound[k]) == 0)
+		{
+			perror("findings_move");
+			exit(EXITCODE_MM);
+		}
+		findings_destroy(&work.itemFound[k]);
+	}
+
+	free(work.itemFound);
+	(void)pthread_mutex_destroy(&tuLock);
+}
 
 /**
- * Stores the location information from the cursor into the parameters
- * passed by reference.
+ * Checks the diagnostics of a translation unit, outputting those which the
+ * diagnostic mode asks for.
  *
- * @param cur cursor whose location to obtain
- * @param locFileName by-ref to string specifying the filename
- * @param loc by-ref to location
+ * Diagnostics are classified by their severity before anything else is done
+ * with them; formatting is expensive and only performed for diagnostics which
+ * are actually output.
+ *
+ * @param tu the translation unit whose diagnostics to check
+ * @param mode which diagnostics to output
+ * @return true if the translation unit contains an error
  */
-static inline void cursorLocation(CXCursor cur, CXString *locFileName, module_loc_t *loc)
+static bool checkDiagnostics(CXTranslationUnit tu, diag_mode_t mode)
 {
-	unsigned int l, c;
+	unsigned int i, numDiags;
+	unsigned int displayOpts = clang_defaultDiagnosticDisplayOptions();
 
-	CXSourceLocation cloc = clang_getCursorLocation(cur);
-	clang_getPresumedLocation(cloc, locFileName, &l, &c);
-	loc->line = l;
-	loc->col = c;
+	numDiags = clang_getNumDiagnostics(tu);
+	for (i = 0; i < numDiags; ++i)
+	{
+		CXDiagnostic diag = clang_getDiagnostic(tu, i);
+		enum CXDiagnosticSeverity sev = clang_getDiagnosticSeverity(diag);
+
+		if (diagnosticShown(sev, mode))
+		{
+			/* output the diagnostic message */
+			CXString diagStr = clang_formatDiagnostic(diag, displayOpts);
+			(void)fprintf(stderr, "%s\n", clang_getCString(diagStr));
+			clang_disposeString(diagStr);
+		}
+
+		clang_disposeDiagnostic(diag);
+
+		if (sev >= CXDiagnostic_Error)
+		{
+			return true;
+		}
+	}
+
+	return false;
 }
 
 /**
- * Returns the extent of the cast referenced by the given cursor.
+ * Returns whether a translation unit yields an error or any diagnostic which
+ * the diagnostic mode asks for, without outputting anything.
  *
- * @param cur cursor to C-style cast whose extent to obtain
- * @param start by-ref to the location where the cast begins
- * @param end by-ref to the location where the cast ends
+ * @param tu the translation unit whose diagnostics to check
+ * @param mode which diagnostics would be output
+ * @return true if the translation unit yields such a diagnostic
  */
-static inline void castExtent(CXCursor cur, module_loc_t *start, module_loc_t *end)
+static bool anyDiagnostic(CXTranslationUnit tu, diag_mode_t mode)
 {
-	CXToken *toks;
-	CXCursor *curs;
-	CXTranslationUnit tu = clang_Cursor_getTranslationUnit(cur);
-	unsigned int numToks, i;
-	bool startSet = false;
+	unsigned int i, numDiags;
+	bool any = false;
 
-	assert(clang_getCursorKind(cur) == CXCursor_CStyleCastExpr);
+	numDiags = clang_getNumDiagnostics(tu);
+	for (i = 0; i < numDiags && !any; ++i)
+	{
+		CXDiagnostic diag = clang_getDiagnostic(tu, i);
+		enum CXDiagnosticSeverity sev = clang_getDiagnosticSeverity(diag);
 
-	/* where is it? */
-	CXSourceRange rng = clang_getCursorExtent(cur);
+		any = (sev >= CXDiagnostic_Error || diagnosticShown(sev, mode));
+		clang_disposeDiagnostic(diag);
+	}
 
-	/* tokenize the cast */
-	clang_tokenize(tu, rng, &toks, &numToks);
+	return any;
+}
 
-	/* annotate it */
-	curs = malloc(numToks * sizeof(CXCursor));
-	if (curs == NULL)
+/**
+ * Called upon every file included by a translation unit; collects the names of
+ * the files.
+ *
+ * @param included the file included
+ * @param inclusionStack the stack of inclusions leading to the file
+ * @param includeLen the length of the inclusion stack
+ * @param dta pointer to the msa_t to fill
+ */
+static void collectInclusions(CXFile included, CXSourceLocation *inclusionStack, unsigned int includeLen, CXClientData dta)
+{
+	msa_t *inclusions = (msa_t *)dta;
+	CXString name = clang_getFileName(included);
+
+	if (msa_add(inclusions, clang_getCString(name)) == 0)
 	{
-		perror("malloc");
+		perror("msa_add");
 		exit(EXITCODE_MM);
 	}
-	clang_annotateTokens(tu, toks, numToks, curs);
 
-	/* find the tokens which correspond to the cursor */
-	for (i = 0; i < numToks; ++i)
-	{
-		CXSourceRange tokExt;
-		unsigned int newEL, newEC;
+	clang_disposeString(name);
+}
 
-		if (
-			clang_getCursorKind(cur) != clang_getCursorKind(curs[i]) ||
-			!clang_equalTypes(clang_getCursorType(cur), clang_getCursorType(curs[i]))
-		)
-		{
-			/* not part of our cast anymore */
-			break;
-		}
+/**
+ * Called upon every file included by a translation unit; adds the file to the
+ * include profile.
+ *
+ * @param included the file included
+ * @param inclusionStack the stack of inclusions leading to the file
+ * @param includeLen the length of the inclusion stack
+ * @param dta pointer to the inclusion_profiling structure
+ */
+static void profileInclusion(CXFile included, CXSourceLocation *inclusionStack, unsigned int includeLen, CXClientData dta)
+{
+	inclusion_profiling *prof = (inclusion_profiling *)dta;
+	CXString name = clang_getFileName(included);
+	size_t size = 0;
+	unsigned int mainOffset = 0;
+	bool fromMain = false;
 
-		/* fetch token range */
-		tokExt = clang_getTokenExtent(tu, toks[i]);
-		clang_getPresumedLocation(clang_getRangeEnd(tokExt), NULL, &newEL, &newEC);
+	/* the source manager has the file in memory anyway */
+	(void)clang_getFileContents(prof->tu, included, &size);
 
-		if (!startSet)
-		{
-			unsigned int newSL, newSC;
-			clang_getPresumedLocation(clang_getRangeStart(tokExt), NULL, &newSL, &newSC);
-			start->line = newSL;
-			start->col = newSC;
-			startSet = true;
-		}
+	if (includeLen > 0)
+	{
+		/* the outermost directive leading to the file */
+		clang_getFileLocation(inclusionStack[includeLen - 1], NULL, NULL, NULL, &mainOffset);
+		fromMain = (clang_Location_isFromMainFile(inclusionStack[includeLen - 1]) != 0);
+	}
 
-		end->line = newEL;
-		end->col = newEC;
+	if (incprof_addInclusion(prof->profile, clang_getCString(name), size, includeLen, fromMain, mainOffset) == 0)
+	{
+		perror("incprof_addInclusion");
+		exit(EXITCODE_MM);
 	}
 
-	/* free cursors, free tokens */
-	free(curs);
-	clang_disposeTokens(tu, toks, numToks);
+	clang_disposeString(name);
 }
 
 /**
- * Called upon every node visited in a translation unit.
+ * Parses a translation unit, importing modules if requested. If the translation
+ * unit can't be parsed with modules, it is parsed again using textual
+ * inclusion.
  *
- * @param cur the cursor pointing to the node
- * @param parent the cursor pointing to the parent
- * @param dta data passed to clang_visitCursorChildren()
+ * The arguments are passed as a full command line, as if Clang's driver had
+ * been invoked, so that the driver applies the same defaults as it would on
+ * the command line.
+ *
+ * @param idx the Clang index to use
+ * @param filename the name of the file to parse
+ * @param argcount number of arguments to Clang
+ * @param args aruments to Clang, or NULL if argcount is zero
+ * @param opts options influencing the processing
+ * @return the translation unit, or NULL on failure
  */
-static enum CXChildVisitResult visitation(CXCursor cur, CXCursor parent, CXClientData dta)
+static CXTranslationUnit parseFile(
+	CXIndex idx,
+	const char *filename,
+	unsigned int argcount,
+	const char * const *args,
+	const process_opts_t *opts
+)
 {
-	CXString locFileName;
-	bool disposeFileName = false;
-
-	descent_state *dstate = (descent_state *)dta;
-	descent_state kiddstate = {
-		.missProc = dstate->missProc,
-		.superProc = dstate->superProc,
-		.level = dstate->level + 1,
-		.voidCastAbove = false,
-		.compoundStmtAbove = false
-	};
+	const unsigned int flags =
+		CXTranslationUnit_DetailedPreprocessingRecord |
+		CXTranslationUnit_IgnoreNonErrorsFromIncludedFiles;
+	struct CXUnsavedFile *unsaved = (opts->overlay != NULL) ? opts->overlay->files : NULL;
+	unsigned int numUnsaved = (opts->overlay != NULL) ? (unsigned int)opts->overlay->count : 0;
+	size_t numModuleArgs = (opts->moduleArgs != NULL) ? opts->moduleArgs->count : 0;
+	CXTranslationUnit tu = NULL;
+	struct CXUnsavedFile *withContents = NULL;
+	const char **argv;
 
-	/* kind of cursor */
-	enum CXCursorKind curKind = clang_getCursorKind(cur);
-
-	if (curKind == CXCursor_CompoundStmt || curKind == CXCursor_CaseStmt)
-	{
-		/* compound statement above. means the function call tosses away its value. */
-		kiddstate.compoundStmtAbove = true;
-	}
-	else if (curKind == CXCursor_CStyleCastExpr)
+	if (opts->contents != NULL)
 	{
-		/* it's a cast. is it to void? */
-		if (clang_getCursorType(cur).kind == CXType_Void)
+		/* the overlay and the file itself */
+		withContents = malloc((numUnsaved + 1) * sizeof(struct CXUnsavedFile));
+		if (withContents == NULL)
 		{
-			/* yay! */
-			disposeFileName = true;
-
-			/* fetch location info */
-			castExtent(
-				cur,
-				&kiddstate.castLoc.startLoc,
-				&kiddstate.castLoc.endLoc
-			);
-
-			/* store it for the kid */
-			kiddstate.voidCastAbove = true;
-			kiddstate.castLoc.file = clang_getCString(locFileName);
+			perror("malloc");
+			exit(EXITCODE_MM);
+		}
+		if (numUnsaved > 0)
+		{
+			(void)memcpy(withContents, unsaved, numUnsaved * sizeof(struct CXUnsavedFile));
 		}
+		withContents[numUnsaved++] = *opts->contents;
+		unsaved = withContents;
 	}
-	else if (curKind == CXCursor_CallExpr)
-	{
-		/* name of the function */
-		CXString funcName = clang_getCursorSpelling(cur);
-		/* the function declaration */
-		CXCursor target = clang_getCursorReferenced(cur);
-		/* the location info */
-		module_loc_t loc;
 
-		disposeFileName = true;
+	/* the program name, the arguments and the module arguments */
+	argv = malloc((1 + argcount + numModuleArgs) * sizeof(const char *));
+	if (argv == NULL)
+	{
+		perror("malloc");
+		exit(EXITCODE_MM);
+	}
+	argv[0] = "clang";
+	if (argcount > 0)
+	{
+		(void)memcpy(argv + 1, args, argcount * sizeof(const char *));
+	}
 
-		cursorLocation(cur, &locFileName, &loc);
+	if (numModuleArgs > 0)
+	{
+		(void)memcpy(argv + 1 + argcount, opts->moduleArgs->arr, numModuleArgs * sizeof(const char *));
 
-		if (
-			clang_Cursor_isNull(target) ||
-			clang_equalLocations(clang_getCursorLocation(cur), clang_getCursorLocation(target))
-		)
+		if (clang_parseTranslationUnit2FullArgv(
+			idx, filename, argv, (int)(1 + argcount + numModuleArgs), unsaved, numUnsaved, flags, &tu
+		) != CXError_Success)
 		{
-			/* function decl not found */
-			(void)fprintf(stderr,
-				"%s:%zu:%zu: Warning: can't check call to %s (can't find original definition).\n",
-				clang_getCString(locFileName), loc.line, loc.col,
-				clang_getCString(funcName)
-			);
+			tu = NULL;
 		}
-		else
+		else if (checkDiagnostics(tu, DIAG_NONE))
 		{
-			switch (clang_getCursorResultType(target).kind)
-			{
-				case CXType_Void:
-					if (dstate->voidCastAbove)
-					{
-						/* magic! */
-						dstate->superProc(
-							clang_getCString(locFileName),
-							clang_getCString(funcName),
-							dstate->castLoc.startLoc,
-							dstate->castLoc.endLoc
-						);
-					}
-					break;
-				case CXType_Invalid:
-				case CXType_Unexposed:
-					/* can't judge; skip */
-					break;
-				default:
-					if (dstate->compoundStmtAbove && !dstate->voidCastAbove)
-					{
-						dstate->missProc(
-							clang_getCString(locFileName),
-							clang_getCString(funcName),
-							loc
-						);
-					}
-					break;
-			}
+			/* errors are output by the caller, or by the textual parse */
+			clang_disposeTranslationUnit(tu);
+			tu = NULL;
 		}
-
-		clang_disposeString(funcName);
 	}
-	else if (curKind == CXCursor_BinaryOperator)
+
+	if (tu == NULL && clang_parseTranslationUnit2FullArgv(
+		idx, filename, argv, (int)(1 + argcount), unsaved, numUnsaved, flags, &tu
+	) != CXError_Success)
 	{
-		/* FIXME: check for void casts in the comma operator? */
+		tu = NULL;
 	}
-#ifdef DEBUG
-	else
-	{
-		/* the location info */
-		module_loc_t loc;
 
-		CXString cursDesc = clang_getCursorDisplayName(cur);
-		CXString cursKind = clang_getCursorKindSpelling(clang_getCursorKind(cur));
+	free(argv);
+	free(withContents);
+	return tu;
+}
 
-		disposeFileName = true;
+/** A parse to be performed by the parsing thread. */
+typedef struct
+{
+	/** The Clang index to use. */
+	CXIndex idx;
 
-		cursorLocation(cur, &locFileName, &loc);
+	/** The name of the file to parse. */
+	const char *filename;
 
-		(void)printf(
-			"At level %zu, visiting node of kind %s named %s at %s:%zu:%zu.\n",
-			dstate->level,
-			clang_getCString(cursKind),
-			clang_getCString(cursDesc),
-			clang_getCString(locFileName),
-			loc.line, loc.col
-		);
+	/** The number of arguments to Clang. */
+	unsigned int argcount;
 
-		clang_disposeString(cursKind);
-		clang_disposeString(cursDesc);
-	}
-#endif
+	/** The arguments to Clang. */
+	const char * const *args;
 
-	/* continue recursively */
-	(void)clang_visitChildren(
-		cur,
-		visitation,
-		(CXClientData)&kiddstate
-	);
+	/** The options influencing the processing. */
+	const process_opts_t *opts;
 
-	if (disposeFileName)
-		clang_disposeString(locFileName);
+	/** The translation unit parsed, or NULL on failure. */
+	CXTranslationUnit tu;
+} parse_job;
 
-	return CXChildVisit_Continue;
+/**
+ * Performs a parse; the body of the parsing thread.
+ *
+ * @param dta pointer to the parse_job
+ * @return NULL
+ */
+static void *parseJob(void *dta)
+{
+	parse_job *job = (parse_job *)dta;
+	job->tu = parseFile(job->idx, job->filename, job->argcount, job->args, job->opts);
+	return NULL;
+}
+
+/**
+ * Parses a translation unit on a thread with a stack of PARSE_STACK_SIZE
+ * (falling back to the calling thread if none can be started), as
+ * parseFile() does.
+ *
+ * @param job the parse to perform; the translation unit is stored into it
+ */
+static void parseWithDeepStack(parse_job *job)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	bool started = false;
+
+	if (pthread_attr_init(&attr) == 0)
+	{
+		started = (
+			pthread_attr_setstacksize(&attr, PARSE_STACK_SIZE) == 0 &&
+			pthread_create(&thread, &attr, parseJob, job) == 0
+		);
+		(void)pthread_attr_destroy(&attr);
+	}
+
+	if (started)
+	{
+		(void)pthread_join(thread, NULL);
+	}
+	else
+	{
+		(void)parseJob(job);
+	}
 }
 
 /* this is the big one */
@@ -293,65 +1877,189 @@ enum exitcodes_e processFile(
 	const char *filename,
 	unsigned int argcount,
 	const char * const *args,
-	missingVoidProc missProc,
-	superfluousVoidProc superProc
+	const process_opts_t *opts,
+	findings_t *found,
+	msa_t *inclusions
 )
 {
-	unsigned int i;
+	size_t firstFound = found->count;
+	bool parallel = (opts->traverseJobs > 1 && opts->moduleArgs == NULL);
+	macro_exps_t exps = {
+		.capacity = 0,
+		.count = 0,
+		.arr = NULL
+	};
+	macro_spellings_t spellings = {
+		.capacity = 0,
+		.count = 0,
+		.slots = NULL
+	};
+	cursors_t items = {
+		.capacity = 0,
+		.count = 0,
+		.arr = NULL
+	};
+	toplevel_collection coll = {
+		.exps = &exps,
+		.items = parallel ? &items : NULL,
+		.sigs = opts->sigs
+	};
+	macro_occurrences_t occurrences = {
+		.item = clang_getNullCursor(),
+		.capacity = 0,
+		.count = 0,
+		.arr = NULL
+	};
+	size_t cursors = 0;
 	descent_state dstate = {
-		.missProc = missProc,
-		.superProc = superProc,
+		.found = found,
+		.rules = opts->rules,
+		.callees = (opts->callees != NULL && callees_any(opts->callees)) ? opts->callees : NULL,
+		.exps = &exps,
+		.spellings = &spellings,
+		.item = clang_getNullCursor(),
+		.occurrences = &occurrences,
+		.tuLock = NULL,
+		.cursors = &cursors,
 		.level = 0,
 		.voidCastAbove = false,
 		.compoundStmtAbove = false
 	};
 
 	/* parse! */
-	CXTranslationUnit tu = clang_parseTranslationUnit(
-		idx,		/* index */
-		filename,	/* source filename */
-		args,		/* commandline args */
-		argcount,	/* commandline arg count */
-		NULL,		/* unsaved files */
-		0,		/* unsaved file count */
-		CXTranslationUnit_None	/* flags, or lack thereof */
+	struct timespec parseStart, parseEnd;
+	uint64_t traceStart = trace_now();
+	(void)clock_gettime(CLOCK_MONOTONIC, &parseStart);
+	parse_job job = {
+		.idx = idx,
+		.filename = filename,
+		.argcount = argcount,
+		.args = args,
+		.opts = opts
+	};
+	parseWithDeepStack(&job);
+	CXTranslationUnit tu = job.tu;
+	(void)clock_gettime(CLOCK_MONOTONIC, &parseEnd);
+	trace_span("parse", filename, traceStart);
+	metrics_observe(METRIC_PARSE_NS,
+		(uint64_t)(parseEnd.tv_sec - parseStart.tv_sec) * UINT64_C(1000000000) + (uint64_t)parseEnd.tv_nsec - (uint64_t)parseStart.tv_nsec
 	);
+	if (tu == NULL && opts->contents != NULL)
+	{
+		return EXITCODE_FILE_PARSE;
+	}
 	if (tu == NULL)
 	{
 		(void)fprintf(stderr, "%s: error parsing %s\n", progname, filename);
 		return EXITCODE_CLANG_FAIL;
 	}
 
-	/* loop over all diagnostics */
-	for (i = 0; i < clang_getNumDiagnostics(tu); ++i)
+	/* check the diagnostics */
+	traceStart = trace_now();
+	bool erroneous = (opts->contents != NULL) ? anyDiagnostic(tu, opts->diagMode) : checkDiagnostics(tu, opts->diagMode);
+	trace_span("diagnostics", filename, traceStart);
+	if (erroneous && opts->contents != NULL)
 	{
-		CXDiagnostic diag = clang_getDiagnostic(tu, i);
-		CXString diagStr = clang_formatDiagnostic(diag, clang_defaultDiagnosticDisplayOptions());
+		/* quietly */
+		clang_disposeTranslationUnit(tu);
+		return EXITCODE_FILE_PARSE;
+	}
+	if (erroneous)
+	{
+		(void)fprintf(stderr, "%s: errors in %s; aborting parse.\n", progname, filename);
+		clang_disposeTranslationUnit(tu);
+		return EXITCODE_FILE_PARSE;
+	}
 
-		/* output the diagnostic message */
-		(void)fprintf(stderr, "%s\n", clang_getCString(diagStr));
+	traceStart = trace_now();
 
-		if (clang_getDiagnosticSeverity(diag) >= CXDiagnostic_Error)
-		{
-			(void)fprintf(stderr, "Aborting parse.\n");
-			clang_disposeString(diagStr);
-			clang_disposeDiagnostic(diag);
-			clang_disposeTranslationUnit(tu);
-			return EXITCODE_FILE_PARSE;
-		}
+	if (inclusions != NULL)
+	{
+		/* find out which files are included */
+		clang_getInclusions(tu, collectInclusions, (CXClientData)inclusions);
+	}
 
-		clang_disposeString(diagStr);
-		clang_disposeDiagnostic(diag);
+	if (opts->profile != NULL)
+	{
+		/* apportion the parse time among the included files */
+		inclusion_profiling prof = {
+			.tu = tu,
+			.profile = opts->profile
+		};
+		clang_getInclusions(tu, profileInclusion, (CXClientData)&prof);
+		incprof_endTU(opts->profile,
+			(double)(parseEnd.tv_sec - parseStart.tv_sec) + (double)(parseEnd.tv_nsec - parseStart.tv_nsec) / 1e9
+		);
 	}
 
-	/* okay, time do to the magic */
+	/* find out where macros are expanded (and what to parallelize, and which functions exist) */
 	(void)clang_visitChildren(
 		clang_getTranslationUnitCursor(tu),
-		visitation,
-		(CXClientData)&dstate
+		collectTopLevel,
+		(CXClientData)&coll
+	);
+	qsort(exps.arr, exps.count, sizeof(macro_exp_t), comparator_macroexp);
+	trace_span("collect", filename, traceStart);
+
+	/* okay, time do to the magic */
+	struct timespec traverseStart, traverseEnd;
+	(void)clock_gettime(CLOCK_MONOTONIC, &traverseStart);
+	if (parallel)
+	{
+		traverseParallel(clang_getTranslationUnitCursor(tu), &items, &dstate, opts->traverseJobs);
+	}
+	else
+	{
+		descent_stack stack = { .frames = NULL, .capacity = 0 };
+		descent_traversal trav = {
+			.state = &dstate,
+			.stack = &stack
+		};
+
+		traceStart = trace_now();
+		(void)clang_visitChildren(
+			clang_getTranslationUnitCursor(tu),
+			descendTopLevel,
+			(CXClientData)&trav
+		);
+		trace_span("traverse", filename, traceStart);
+		free(stack.frames);
+		free(stack.pending.arr);
+		metrics_add(METRIC_CURSORS, cursors);
+	}
+	(void)clock_gettime(CLOCK_MONOTONIC, &traverseEnd);
+	metrics_observe(METRIC_TRAVERSE_NS,
+		(uint64_t)(traverseEnd.tv_sec - traverseStart.tv_sec) * UINT64_C(1000000000) + (uint64_t)traverseEnd.tv_nsec - (uint64_t)traverseStart.tv_nsec
 	);
 
+	if (opts->sampleMemory)
+	{
+		/* while the translation unit is still around */
+		metrics_observe(METRIC_TU_RESIDENT_BYTES, metrics_sampleResident());
+	}
+
+	disposeSpellings(&spellings);
+	disposeOccurrences(&occurrences);
 	clang_disposeTranslationUnit(tu);	/* with greetings to TU Wien */
+	free(exps.arr);
+	free(items.arr);
+
+	/* report findings in macro expansions once per spelling location */
+	if (found->count - firstFound > 1)
+	{
+		findings_t ours = {
+			.capacity = found->capacity - firstFound,
+			.count = found->count - firstFound,
+			.arr = found->arr + firstFound
+		};
+
+		if (findings_collapse(&ours) == 0)
+		{
+			perror("findings_collapse");
+			return EXITCODE_MM;
+		}
+		found->count = firstFound + ours.count;
+	}
 
 	return EXITCODE_OK;
 }
@@ -12,34 +12,131 @@
 #include <clang-c/Index.h>
 
 #include "shared.h"
+#include "callees.h"
+#include "findings.h"
+#include "incprof.h"
+#include "msa.h"
+#include "overlay.h"
+#include "rules.h"
+#include "sigdb.h"
 
 /**
  * Type of callback which acts upon a missing cast to void.
  *
- * @param file the name of the file where the cast is missing
- * @param func the name of the function called
- * @param loc the location at which the cast should be inserted
+ * @param fnd the finding describing the missing cast
  */
-typedef void (*missingVoidProc)(const char *file, const char *func, module_loc_t loc);
+typedef void (*missingVoidProc)(const finding_t *fnd);
 
 /**
  * Type of callback which acts upon a superfluous cast to void.
  *
- * @param file the name of the file containing the cast
- * @param func the name of the function called
- * @param start the location where the cast starts
- * @param end the location where the cast ends
+ * @param fnd the finding describing the superfluous cast
  */
-typedef void (*superfluousVoidProc)(const char *file, const char *func, module_loc_t start, module_loc_t end);
+typedef void (*superfluousVoidProc)(const finding_t *fnd);
+
+/** Which Clang diagnostics to output while processing a file. */
+typedef enum
+{
+	/** Output errors (and fatal errors) only. */
+	DIAG_ERRORS,
+
+	/** Output all diagnostics. */
+	DIAG_ALL,
+
+	/** Don't output any diagnostics. */
+	DIAG_NONE
+} diag_mode_t;
+
+/** Options which influence how a file is processed. */
+typedef struct
+{
+	/** Which diagnostics to output. */
+	diag_mode_t diagMode;
+
+	/** The rules to check; each node is dispatched to the interested ones. */
+	const ruleset_t *rules;
+
+	/**
+	 * The number of threads among which the top-level declarations of a
+	 * translation unit are distributed for traversal; 0 or 1 to traverse on
+	 * the calling thread only.
+	 *
+	 * libclang does not guarantee that a translation unit may be used by
+	 * multiple threads at once. Walking the AST and resolving types and
+	 * declarations only reads it, but decoding source locations, measuring
+	 * source ranges and tokenizing fill caches within the source manager and
+	 * the lexer. The traversal therefore serializes all such calls through a
+	 * lock held per translation unit; only the pure AST work runs in parallel.
+	 *
+	 * Ignored if moduleArgs is set: declarations imported from a module are
+	 * only deserialized once the traversal reaches them, which writes to the
+	 * AST from within the calls that would otherwise run unlocked.
+	 */
+	unsigned int traverseJobs;
+
+	/**
+	 * If not NULL, the signatures of all functions declared in the
+	 * translation unit are added to this collection.
+	 */
+	sigdb_builder_t *sigs;
+
+	/**
+	 * If not NULL and not empty, only calls to these functions are reported.
+	 */
+	const callees_t *callees;
+
+	/**
+	 * If not NULL, the files of this finalized overlay are passed to Clang
+	 * instead of being read from disk.
+	 */
+	const overlay_t *overlay;
+
+	/**
+	 * If not NULL, these arguments, which make Clang import modules, are
+	 * appended to the arguments. If the translation unit can't be parsed with
+	 * them (e.g. because a header is not modular after all), it is parsed again
+	 * without them, i.e. with textual inclusion.
+	 */
+	const msa_t *moduleArgs;
+
+	/**
+	 * If not NULL, the files included by the translation unit are added to
+	 * this profile, along with the time spent parsing it.
+	 */
+	incprof_t *profile;
+
+	/**
+	 * Whether to sample the resident set size while each translation unit is
+	 * loaded (the other metrics are always kept).
+	 */
+	bool sampleMemory;
+
+	/**
+	 * If not NULL, the contents of the file to process, which need not exist
+	 * on disk (its Filename is the name of the file). The translation unit is
+	 * then checked quietly: if it yields an error or any diagnostic the mode
+	 * would output, nothing is output and EXITCODE_FILE_PARSE is returned, so
+	 * that the caller may process the parts the contents were assembled from
+	 * one by one instead.
+	 */
+	const struct CXUnsavedFile *contents;
+} process_opts_t;
 
 /**
  * Processes one file of source code.
+ *
+ * Findings located within macro expansions are reported at the location where
+ * the macro's code is spelled, and only once per spelling location; their
+ * expansion count states how many expansions they stand for.
+ *
  * @param idx the Clang index to use
  * @param filename the name of the file to process
  * @param argcount number of arguments to Clang
  * @param args aruments to Clang, or NULL if argcount is zero
- * @param missProc callback if a cast to void is missing
- * @param superProc callback if a cast to void is superfluous
+ * @param opts options influencing the processing
+ * @param found findings are appended to this array
+ * @param inclusions if not NULL, the names of all files included by the
+ * translation unit (including the file itself) are appended to this array
  * @return EXITCODE_OK, or the exit code which should be returned after cleanup
  */
 enum exitcodes_e processFile(
@@ -47,8 +144,9 @@ enum exitcodes_e processFile(
 	const char *filename,
 	unsigned int argcount,
 	const char * const *args,
-	missingVoidProc missProc,
-	superfluousVoidProc superProc
+	const process_opts_t *opts,
+	findings_t *found,
+	msa_t *inclusions
 );
 
 #endif
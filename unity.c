@@ -0,0 +1,984 @@
+/**
+ * @file unity.c
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Analysis of several small files as one translation unit.
+ */
+
+#include "unity.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/** The longest name told apart by the pre-scan; longer ones are truncated. */
+#define NAME_MAX_LEN 255
+
+/** Words which never name anything declared at file scope; sorted. */
+static const char * const KEYWORDS[] = {
+	"_Alignas", "_Alignof", "_Atomic", "_Bool", "_Complex", "_Noreturn", "_Static_assert", "_Thread_local",
+	"__asm", "__asm__", "__attribute", "__attribute__", "__const", "__declspec", "__extension__",
+	"__inline", "__inline__", "__restrict", "__restrict__", "__signed__", "__thread", "__typeof",
+	"__typeof__", "__volatile__", "asm", "auto", "break", "case", "char", "const", "continue", "default",
+	"do", "double", "else", "enum", "extern", "float", "for", "goto", "if", "inline", "int", "long",
+	"register", "restrict", "return", "short", "signed", "sizeof", "static", "struct", "switch",
+	"typedef", "typeof", "union", "unsigned", "void", "volatile", "while"
+};
+
+/** The kinds of tokens told apart by the pre-scan. */
+typedef enum
+{
+	TOKEN_NONE,
+	TOKEN_NAME,
+	TOKEN_PUNCT,
+	TOKEN_OTHER
+} token_kind_t;
+
+/** A token, as far as the pre-scan cares. */
+typedef struct
+{
+	/** The kind of the token. */
+	token_kind_t kind;
+
+	/** For a name, the name. */
+	char name[NAME_MAX_LEN + 1];
+
+	/** For a name, whether it is a keyword. */
+	bool keyword;
+
+	/** For a punctuator, its (first) character. */
+	char punct;
+} token_t;
+
+/** The state of the pre-scan of a file. */
+typedef struct
+{
+	/** The file being scanned. */
+	unity_file_t *file;
+
+	/** The nesting depth of braces and parentheses. */
+	unsigned int braces, parens;
+
+	/** Is the file-scope declaration being scanned static, a typedef or extern? */
+	bool isStatic, isTypedef, isExtern;
+
+	/** Is the scan within the initializer of a declarator? */
+	bool initializer;
+
+	/** Has the declaration named a tag, and which? */
+	bool tagNamed;
+	char tag[NAME_MAX_LEN + 1];
+
+	/** Does the declaration define an enumeration, and is the scan within its body? */
+	bool isEnum, enumBody;
+
+	/** Has the declaration named a function, which, and have its parameters ended? */
+	bool funcNamed, afterParams;
+	char func[NAME_MAX_LEN + 1];
+
+	/** Is the scan within the body of a function? */
+	bool functionBody;
+
+	/** Has the parenthesis just opened been followed by an asterisk, as in "(*name)"? */
+	bool pointerParen;
+
+	/** The two tokens before the current one. */
+	token_t prev, prevPrev;
+
+	/** Has memory run out? */
+	bool failed;
+} scan_t;
+
+/* utility functions */
+
+/**
+ * Compares two strings pointed to. Useful for bsearch(3).
+ *
+ * @param left Pointer to the first string (pointer to const char *).
+ * @param right Pointer to the second string (pointer to const char *).
+ * @return Less than zero, zero or more than zero, like strcmp(3).
+ */
+static int comparator_string(const void *left, const void *right)
+{
+	return strcmp(*(const char * const *)left, *(const char * const *)right);
+}
+
+/**
+ * Returns whether a name is a keyword.
+ *
+ * @param name The name.
+ * @return true if the name never names a declaration.
+ */
+static bool isKeyword(const char *name)
+{
+	return bsearch(&name, KEYWORDS, sizeof(KEYWORDS) / sizeof(KEYWORDS[0]), sizeof(KEYWORDS[0]), comparator_string) != NULL;
+}
+
+/**
+ * Returns whether a token introduces a tag.
+ *
+ * @param tok The token.
+ * @return true if the token is struct, union or enum
+ */
+static bool isTagKeyword(const token_t *tok)
+{
+	return tok->kind == TOKEN_NAME && (
+		strcmp(tok->name, "struct") == 0 || strcmp(tok->name, "union") == 0 || strcmp(tok->name, "enum") == 0
+	);
+}
+
+/**
+ * Returns whether a token is a name which may be declared.
+ *
+ * @param tok The token.
+ * @return true if the token is a name, but not a keyword
+ */
+static inline bool isDeclarable(const token_t *tok)
+{
+	return tok->kind == TOKEN_NAME && !tok->keyword;
+}
+
+/**
+ * Returns the length of the directory part of a path, including the slash.
+ *
+ * @param path The path.
+ * @return The length; 0 if the path has no directory part.
+ */
+static size_t dirLength(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	return (slash == NULL) ? 0 : (size_t)(slash - path) + 1;
+}
+
+/**
+ * Adds a name the file defines at file scope.
+ *
+ * @param s The state of the scan.
+ * @param prefix The prefix distinguishing the namespace, or NULL.
+ * @param name The name.
+ */
+static void addName(scan_t *s, const char *prefix, const char *name)
+{
+	int ok = (prefix != NULL) ? msa_add_prefixed(&s->file->names, prefix, name) : msa_add(&s->file->names, name);
+	if (ok == 0)
+	{
+		s->failed = true;
+	}
+}
+
+/**
+ * Forgets the declaration scanned so far.
+ *
+ * @param s The state of the scan.
+ */
+static void endDeclaration(scan_t *s)
+{
+	s->isStatic = s->isTypedef = s->isExtern = false;
+	s->initializer = false;
+	s->tagNamed = false;
+	s->isEnum = s->enumBody = false;
+	s->funcNamed = s->afterParams = false;
+	s->functionBody = false;
+}
+
+/**
+ * Takes note of the names a token declares.
+ *
+ * @param s The state of the scan.
+ * @param tok The token.
+ */
+static void handleToken(scan_t *s, const token_t *tok)
+{
+	bool tagName = isTagKeyword(&s->prevPrev);
+	char punct = (tok->kind == TOKEN_PUNCT) ? tok->punct : '\0';
+
+	if (punct == '{')
+	{
+		if (s->braces == 0 && s->parens == 0)
+		{
+			if (s->funcNamed && s->afterParams && !s->isTypedef)
+			{
+				/* a function definition */
+				addName(s, NULL, s->func);
+				s->functionBody = true;
+			}
+			if (s->tagNamed && s->prev.kind == TOKEN_NAME && strcmp(s->prev.name, s->tag) == 0)
+			{
+				/* a tag definition */
+				addName(s, "struct ", s->tag);
+			}
+			s->enumBody = s->isEnum && !s->functionBody;
+		}
+		++s->braces;
+	}
+	else if (punct == '}')
+	{
+		if (s->braces > 0 && --s->braces == 0)
+		{
+			s->enumBody = false;
+			if (s->functionBody)
+			{
+				endDeclaration(s);
+			}
+		}
+	}
+	else if (s->braces > 0)
+	{
+		if (
+			s->braces == 1 && s->enumBody && isDeclarable(tok) &&
+			s->prev.kind == TOKEN_PUNCT && (s->prev.punct == '{' || s->prev.punct == ',')
+		)
+		{
+			/* an enumerator */
+			addName(s, NULL, tok->name);
+		}
+	}
+	else if (tok->kind == TOKEN_NAME)
+	{
+		if (strcmp(tok->name, "static") == 0)
+			s->isStatic = true;
+		else if (strcmp(tok->name, "typedef") == 0)
+			s->isTypedef = true;
+		else if (strcmp(tok->name, "extern") == 0)
+			s->isExtern = true;
+		else if (strcmp(tok->name, "enum") == 0)
+			s->isEnum = true;
+		else if (!tok->keyword && isTagKeyword(&s->prev))
+		{
+			s->tagNamed = true;
+			(void)strcpy(s->tag, tok->name);
+		}
+	}
+	else if (punct == '(')
+	{
+		if (s->parens == 0 && !s->initializer && isDeclarable(&s->prev) && !tagName)
+		{
+			/* a function, or a function-like macro */
+			s->funcNamed = true;
+			(void)strcpy(s->func, s->prev.name);
+			if (s->isStatic || s->isTypedef)
+			{
+				addName(s, NULL, s->prev.name);
+			}
+		}
+		++s->parens;
+	}
+	else if (punct == '*')
+	{
+		s->pointerParen = (s->parens == 1 && s->prev.kind == TOKEN_PUNCT && s->prev.punct == '(');
+	}
+	else if (punct == ')')
+	{
+		if (
+			s->parens == 1 && s->pointerParen && !s->initializer && (s->isStatic || s->isTypedef) &&
+			isDeclarable(&s->prev) && s->prevPrev.kind == TOKEN_PUNCT && s->prevPrev.punct == '*'
+		)
+		{
+			/* a pointer to a function */
+			addName(s, NULL, s->prev.name);
+		}
+		s->pointerParen = false;
+		if (s->parens > 0 && --s->parens == 0 && s->funcNamed)
+		{
+			s->afterParams = true;
+		}
+	}
+	else if (s->parens == 0 && (punct == '=' || punct == ',' || punct == ';' || punct == '['))
+	{
+		if (
+			!s->initializer && isDeclarable(&s->prev) && !tagName &&
+			(s->isStatic || s->isTypedef || (punct == '=' && !s->isExtern))
+		)
+		{
+			/* a declarator; without static, only definitions clash */
+			addName(s, NULL, s->prev.name);
+		}
+
+		if (punct == '=')
+		{
+			s->initializer = true;
+		}
+		else if (punct == ',')
+		{
+			s->initializer = false;
+			s->funcNamed = s->afterParams = false;
+		}
+		else if (punct == ';')
+		{
+			endDeclaration(s);
+		}
+	}
+
+	s->prevPrev = s->prev;
+	s->prev = *tok;
+}
+
+/**
+ * Reads a name.
+ *
+ * @param p Where the name starts.
+ * @param end The end of the contents.
+ * @param name Filled with the name, truncated to NAME_MAX_LEN characters.
+ * @return Where the name ends.
+ */
+static const char *readName(const char *p, const char *end, char *name)
+{
+	size_t len = 0;
+
+	while (p < end && (isalnum((unsigned char)*p) || *p == '_'))
+	{
+		if (len < NAME_MAX_LEN)
+		{
+			name[len++] = *p;
+		}
+		++p;
+	}
+	name[len] = '\0';
+	return p;
+}
+
+/**
+ * Skips a comment.
+ *
+ * @param p Where the comment starts (at the slash).
+ * @param end The end of the contents.
+ * @return Where the comment ends; for a line comment, at the newline.
+ */
+static const char *skipComment(const char *p, const char *end)
+{
+	if (p[1] == '/')
+	{
+		while (p < end && *p != '\n')
+		{
+			p += (*p == '\\' && p + 1 < end) ? 2 : 1;
+		}
+		return p;
+	}
+
+	for (p += 2; p + 1 < end; ++p)
+	{
+		if (p[0] == '*' && p[1] == '/')
+		{
+			return p + 2;
+		}
+	}
+	return end;
+}
+
+/**
+ * Handles a preprocessor directive: notes the macros defined or undefined,
+ * and the files which can't be combined with others.
+ *
+ * @param s The state of the scan.
+ * @param p Where the directive starts (after the hash).
+ * @param end The end of the contents.
+ * @return Where the directive ends, at the newline.
+ */
+static const char *handleDirective(scan_t *s, const char *p, const char *end)
+{
+	char word[NAME_MAX_LEN + 1], name[NAME_MAX_LEN + 1];
+
+	while (p < end && (*p == ' ' || *p == '\t'))
+		++p;
+	p = readName(p, end, word);
+	while (p < end && (*p == ' ' || *p == '\t'))
+		++p;
+
+	if (strcmp(word, "define") == 0 || strcmp(word, "undef") == 0)
+	{
+		p = readName(p, end, name);
+		if (name[0] != '\0' && msa_add(&s->file->macros, name) == 0)
+		{
+			s->failed = true;
+		}
+	}
+	else if (strcmp(word, "include") == 0 || strcmp(word, "include_next") == 0 || strcmp(word, "import") == 0)
+	{
+		if (s->file->macros.count > 0)
+		{
+			/* the macro may configure the header, which another file may have included already */
+			s->file->eligible = false;
+		}
+	}
+	else if (strcmp(word, "pragma") == 0)
+	{
+		p = readName(p, end, name);
+		if (strcmp(name, "once") != 0)
+		{
+			/* it may affect the files following it */
+			s->file->eligible = false;
+		}
+	}
+
+	while (p < end && *p != '\n')
+	{
+		if (*p == '/' && p + 1 < end && (p[1] == '/' || p[1] == '*'))
+		{
+			p = skipComment(p, end);
+		}
+		else
+		{
+			/* a backslash continues the directive on the next line */
+			p += (*p == '\\' && p + 1 < end) ? 2 : 1;
+		}
+	}
+	return p;
+}
+
+/**
+ * Scans the contents of a file for the names it defines at file scope and the
+ * macros it defines.
+ *
+ * @param s The state of the scan.
+ * @param p The contents.
+ * @param end The end of the contents.
+ */
+static void scanContents(scan_t *s, const char *p, const char *end)
+{
+	bool lineStart = true;
+	token_t tok;
+
+	while (p < end && !s->failed)
+	{
+		char c = *p;
+
+		if (c == '\n')
+		{
+			lineStart = true;
+			++p;
+			continue;
+		}
+		if (isspace((unsigned char)c) || (c == '\\' && p + 1 < end && p[1] == '\n'))
+		{
+			p += (c == '\\') ? 2 : 1;
+			continue;
+		}
+		if (c == '/' && p + 1 < end && (p[1] == '/' || p[1] == '*'))
+		{
+			p = skipComment(p, end);
+			continue;
+		}
+		if (c == '#' && lineStart)
+		{
+			p = handleDirective(s, p + 1, end);
+			continue;
+		}
+
+		lineStart = false;
+		tok.kind = TOKEN_OTHER;
+		tok.keyword = false;
+		tok.name[0] = '\0';
+		tok.punct = '\0';
+
+		if (c == '"' || c == '\'')
+		{
+			/* a string or character literal */
+			for (++p; p < end && *p != c && *p != '\n'; ++p)
+			{
+				if (*p == '\\' && p + 1 < end)
+				{
+					++p;
+				}
+			}
+			if (p < end && *p == c)
+			{
+				++p;
+			}
+		}
+		else if (isalpha((unsigned char)c) || c == '_')
+		{
+			tok.kind = TOKEN_NAME;
+			p = readName(p, end, tok.name);
+			tok.keyword = isKeyword(tok.name);
+		}
+		else if (isdigit((unsigned char)c) || (c == '.' && p + 1 < end && isdigit((unsigned char)p[1])))
+		{
+			/* a number, with the sign of its exponent */
+			for (++p; p < end; ++p)
+			{
+				if ((*p == '+' || *p == '-') && strchr("eEpP", p[-1]) != NULL)
+					continue;
+				if (!isalnum((unsigned char)*p) && *p != '_' && *p != '.')
+					break;
+			}
+		}
+		else
+		{
+			tok.kind = TOKEN_PUNCT;
+			tok.punct = c;
+			++p;
+		}
+
+		handleToken(s, &tok);
+	}
+
+	if (s->braces != 0 || s->parens != 0)
+	{
+		/* probably a macro opening or closing a scope */
+		s->file->eligible = false;
+	}
+}
+
+/**
+ * Frees what is known about a file and excludes it from further groups.
+ *
+ * @param uf Pointer to the file.
+ */
+static void release(unity_file_t *uf)
+{
+	if (uf->contents != NULL)
+	{
+		free(uf->contents);
+		msa_destroy(&uf->names);
+		msa_destroy(&uf->macros);
+		uf->contents = NULL;
+	}
+	uf->eligible = false;
+}
+
+/**
+ * Reads and pre-scans a file, unless this has already happened.
+ *
+ * @param u Pointer to a unity structure.
+ * @param file The index of the file.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int scanFile(unity_t *u, size_t file)
+{
+	unity_file_t *uf = &u->files[file];
+	const char *path = u->paths[file];
+	struct stat st;
+	ssize_t rd;
+	int fd;
+	scan_t s;
+
+	if (uf->scanned)
+	{
+		return 1;
+	}
+	uf->scanned = true;
+	uf->eligible = false;
+
+	/* the line marker can't express a newline; files which can't be read are left for the analysis to complain about */
+	if (strchr(path, '\n') != NULL || (fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+	{
+		return 1;
+	}
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size > UNITY_MAX_SIZE)
+	{
+		(void)close(fd);
+		return 1;
+	}
+
+	uf->contents = malloc((size_t)st.st_size + 1);
+	if (uf->contents == NULL)
+	{
+		(void)close(fd);
+		return 0;
+	}
+	uf->size = 0;
+	while (uf->size < (size_t)st.st_size)
+	{
+		rd = read(fd, uf->contents + uf->size, (size_t)st.st_size - uf->size);
+		if (rd == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (rd <= 0)
+		{
+			break;
+		}
+		uf->size += (size_t)rd;
+	}
+	(void)close(fd);
+	if (uf->size < (size_t)st.st_size || msa_create(&uf->names) == 0)
+	{
+		free(uf->contents);
+		uf->contents = NULL;
+		return (uf->size < (size_t)st.st_size) ? 1 : 0;
+	}
+	if (msa_create(&uf->macros) == 0)
+	{
+		msa_destroy(&uf->names);
+		free(uf->contents);
+		uf->contents = NULL;
+		return 0;
+	}
+
+	(void)memset(&s, 0, sizeof(s));
+	s.file = uf;
+	uf->eligible = true;
+	scanContents(&s, uf->contents, uf->contents + uf->size);
+	if (s.failed)
+	{
+		release(uf);
+		errno = ENOMEM;
+		return 0;
+	}
+	if (!uf->eligible)
+	{
+		release(uf);
+		return 1;
+	}
+
+	msa_sort(&uf->names);
+	return 1;
+}
+
+/**
+ * Returns whether two files may be combined, i.e. whether they define no name
+ * at file scope in common.
+ *
+ * @param left Pointer to the first file.
+ * @param right Pointer to the second file.
+ * @return true if the files may be combined
+ */
+static bool compatible(const unity_file_t *left, const unity_file_t *right)
+{
+	size_t l = 0, r = 0;
+
+	while (l < left->names.count && r < right->names.count)
+	{
+		int cmp = strcmp(left->names.arr[l], right->names.arr[r]);
+		if (cmp == 0)
+		{
+			return false;
+		}
+		if (cmp < 0)
+			++l;
+		else
+			++r;
+	}
+	return true;
+}
+
+/**
+ * Appends text to the contents of the current group.
+ *
+ * @param u Pointer to a unity structure.
+ * @param text The text.
+ * @param len The length of the text.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int append(unity_t *u, const char *text, size_t len)
+{
+	char *buf = (char *)u->contents.Contents;
+
+	if (u->contents.Length + len > u->capacity)
+	{
+		size_t newcap = (u->capacity == 0) ? 4096 : u->capacity;
+		while (newcap < u->contents.Length + len)
+		{
+			newcap *= 2;
+		}
+		buf = realloc(buf, newcap);
+		if (buf == NULL)
+		{
+			return 0;
+		}
+		u->contents.Contents = buf;
+		u->capacity = newcap;
+	}
+
+	(void)memcpy(buf + u->contents.Length, text, len);
+	u->contents.Length += len;
+	return 1;
+}
+
+/**
+ * Appends a pragma saving or restoring a macro to the contents of the current
+ * group.
+ *
+ * @param u Pointer to a unity structure.
+ * @param pragma "push_macro" or "pop_macro".
+ * @param macro The name of the macro.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int appendMacroPragma(unity_t *u, const char *pragma, const char *macro)
+{
+	return
+		append(u, "#pragma ", 8) &&
+		append(u, pragma, strlen(pragma)) &&
+		append(u, "(\"", 2) &&
+		append(u, macro, strlen(macro)) &&
+		append(u, "\")\n", 3);
+}
+
+/**
+ * Assembles the translation unit of the current group.
+ *
+ * @param u Pointer to a unity structure.
+ * @param dirLen The length of the directory part of the paths of the files.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+static int assemble(unity_t *u, size_t dirLen)
+{
+	char *name = malloc(dirLen + sizeof(UNITY_NAME));
+	size_t m, i;
+	const char *p;
+
+	if (name == NULL)
+	{
+		return 0;
+	}
+	(void)memcpy(name, u->paths[u->members[0]], dirLen);
+	(void)memcpy(name + dirLen, UNITY_NAME, sizeof(UNITY_NAME));
+	free((char *)u->contents.Filename);
+	u->contents.Filename = name;
+	u->contents.Length = 0;
+
+	for (m = 0; m < u->memberCount; ++m)
+	{
+		const unity_file_t *uf = &u->files[u->members[m]];
+
+		for (i = 0; i < uf->macros.count; ++i)
+		{
+			if (appendMacroPragma(u, "push_macro", uf->macros.arr[i]) == 0)
+				return 0;
+		}
+
+		/* the findings are located in the file itself */
+		if (append(u, "#line 1 \"", 9) == 0)
+			return 0;
+		for (p = u->paths[u->members[m]]; *p != '\0'; ++p)
+		{
+			if ((*p == '"' || *p == '\\') && append(u, "\\", 1) == 0)
+				return 0;
+			if (append(u, p, 1) == 0)
+				return 0;
+		}
+		if (append(u, "\"\n", 2) == 0 || append(u, uf->contents, uf->size) == 0)
+			return 0;
+		if (uf->size > 0 && uf->contents[uf->size - 1] != '\n' && append(u, "\n", 1) == 0)
+			return 0;
+
+		for (i = uf->macros.count; i > 0; --i)
+		{
+			if (appendMacroPragma(u, "pop_macro", uf->macros.arr[i - 1]) == 0)
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* public functions */
+
+int unity_create(unity_t *u, const char * const *paths, size_t count, size_t configCount, size_t max)
+{
+	u->paths = paths;
+	u->count = count;
+	u->configCount = configCount;
+	u->max = max;
+	u->memberCount = 0;
+	u->contents.Filename = NULL;
+	u->contents.Contents = NULL;
+	u->contents.Length = 0;
+	u->capacity = 0;
+	u->groups = u->grouped = u->fellBack = 0;
+
+	u->files = calloc(count, sizeof(unity_file_t));
+	u->entries = calloc(count * configCount, sizeof(unity_entry_t));
+	u->members = malloc(max * sizeof(size_t));
+	if (u->files == NULL || u->entries == NULL || u->members == NULL)
+	{
+		free(u->files);
+		free(u->entries);
+		free(u->members);
+		return 0;
+	}
+	return 1;
+}
+
+void unity_destroy(unity_t *u)
+{
+	size_t i;
+
+	for (i = 0; i < u->count; ++i)
+	{
+		release(&u->files[i]);
+	}
+	for (i = 0; i < u->count * u->configCount; ++i)
+	{
+		if (u->entries[i].done)
+		{
+			findings_destroy(&u->entries[i].found);
+			msa_destroy(&u->entries[i].inclusions);
+		}
+	}
+	free(u->files);
+	free(u->entries);
+	free(u->members);
+	free((char *)u->contents.Filename);
+	free((char *)u->contents.Contents);
+	u->files = NULL;
+	u->entries = NULL;
+	u->members = NULL;
+	u->contents.Filename = NULL;
+	u->contents.Contents = NULL;
+}
+
+int unity_group(unity_t *u, size_t file, size_t config, const dedup_t *dd)
+{
+	size_t dirLen = dirLength(u->paths[file]);
+	size_t i, j, limit = file + u->max * UNITY_LOOKAHEAD;
+
+	u->memberCount = 0;
+	if (u->max < 2)
+	{
+		return 1;
+	}
+
+	/* the earlier files have been analyzed in every configuration */
+	for (i = 0; i < file; ++i)
+	{
+		release(&u->files[i]);
+	}
+
+	for (j = file; j < u->count && j < limit && u->memberCount < u->max; ++j)
+	{
+		size_t entry = j * u->configCount + config;
+		bool usable;
+
+		if (dirLength(u->paths[j]) != dirLen || memcmp(u->paths[j], u->paths[file], dirLen) != 0)
+		{
+			/* includes are looked up relative to the directory of the translation unit */
+			break;
+		}
+
+		usable = !u->entries[entry].done && (dd == NULL || dd->arr[entry].rep == entry);
+		if (usable)
+		{
+			if (scanFile(u, j) == 0)
+			{
+				return 0;
+			}
+			usable = u->files[j].eligible;
+		}
+		for (i = 0; usable && i < u->memberCount; ++i)
+		{
+			usable = compatible(&u->files[u->members[i]], &u->files[j]);
+		}
+
+		if (usable)
+		{
+			u->members[u->memberCount++] = j;
+		}
+		else if (j == file)
+		{
+			/* the group must start with the file */
+			break;
+		}
+	}
+
+	if (u->memberCount < 2)
+	{
+		return 1;
+	}
+	return assemble(u, dirLen);
+}
+
+int unity_split(unity_t *u, size_t config, findings_t *found, const msa_t *inclusions)
+{
+	size_t m, f, i;
+
+	for (m = 0; m < u->memberCount; ++m)
+	{
+		unity_entry_t *ent = &u->entries[u->members[m] * u->configCount + config];
+
+		if (findings_create(&ent->found) == 0)
+		{
+			return 0;
+		}
+		if (msa_create(&ent->inclusions) == 0)
+		{
+			findings_destroy(&ent->found);
+			return 0;
+		}
+		ent->done = true;
+
+		if (msa_add(&ent->inclusions, u->paths[u->members[m]]) == 0)
+		{
+			return 0;
+		}
+		for (i = 0; i < inclusions->count; ++i)
+		{
+			/* the translation unit of the group doesn't exist */
+			if (strcmp(inclusions->arr[i], u->contents.Filename) != 0 && msa_add(&ent->inclusions, inclusions->arr[i]) == 0)
+			{
+				return 0;
+			}
+		}
+	}
+
+	for (f = 0; f < found->count; ++f)
+	{
+		size_t target = u->members[0];
+
+		for (m = 0; m < u->memberCount; ++m)
+		{
+			if (strcmp(found->arr[f].file, u->paths[u->members[m]]) == 0)
+			{
+				target = u->members[m];
+				break;
+			}
+		}
+
+		if (findings_copy(&u->entries[target * u->configCount + config].found, &found->arr[f], NULL) == 0)
+		{
+			return 0;
+		}
+	}
+	findings_clear(found);
+
+	++u->groups;
+	u->grouped += u->memberCount;
+	return 1;
+}
+
+void unity_fallBack(unity_t *u)
+{
+	size_t m;
+
+	/* they would most likely fail together again in the other configurations */
+	for (m = 0; m < u->memberCount; ++m)
+	{
+		release(&u->files[u->members[m]]);
+	}
+	u->fellBack += u->memberCount;
+	u->memberCount = 0;
+}
+
+bool unity_done(const unity_t *u, size_t file, size_t config)
+{
+	return u->entries[file * u->configCount + config].done;
+}
+
+int unity_take(unity_t *u, size_t file, size_t config, findings_t *found, msa_t *inclusions)
+{
+	unity_entry_t *ent = &u->entries[file * u->configCount + config];
+	size_t i;
+
+	if (findings_move(found, &ent->found) == 0)
+	{
+		return 0;
+	}
+	for (i = 0; i < ent->inclusions.count; ++i)
+	{
+		if (msa_add(inclusions, ent->inclusions.arr[i]) == 0)
+		{
+			return 0;
+		}
+	}
+
+	/* handed over */
+	findings_destroy(&ent->found);
+	msa_destroy(&ent->inclusions);
+	ent->done = false;
+	return 1;
+}
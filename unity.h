@@ -0,0 +1,194 @@
+/**
+ * @file unity.h
+ *
+ * @author Ondřej Hošek
+ *
+ * @brief Analysis of several small files as one translation unit.
+ * @details Small files in the same directory often include the same headers,
+ * so parsing them one by one is mostly parsing those headers again and again.
+ * A unity build concatenates such files into one translation unit held in
+ * memory, with a line marker before each file so that the findings are
+ * located in the original files. A quick lexical pre-scan keeps files apart
+ * whose file-scope names (statics, typedefs, tags, enumerators, definitions)
+ * would clash, and keeps files out which define macros before including
+ * headers or use pragmas; macros a file defines are restored afterwards with
+ * push_macro and pop_macro, so they don't leak into the next file.
+ */
+
+#ifndef __UNITY_H__
+#define __UNITY_H__
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <clang-c/Index.h>
+
+#include "dedup.h"
+#include "findings.h"
+#include "msa.h"
+
+/** The largest file which is combined with others, in bytes. */
+#define UNITY_MAX_SIZE (64 * 1024)
+
+/** How many files beyond the first a group may look ahead for members, per member. */
+#define UNITY_LOOKAHEAD 4
+
+/** The name of the translation unit of a group, within the directory of its files. */
+#define UNITY_NAME ".voidcaster-unity.c"
+
+/** What the pre-scan found out about a file. */
+typedef struct
+{
+	/** Has the file been scanned? */
+	bool scanned;
+
+	/** May the file be combined with others? */
+	bool eligible;
+
+	/** The contents of the file, while it is eligible and not yet analyzed. */
+	char *contents;
+
+	/** The size of the contents. */
+	size_t size;
+
+	/** The names the file defines at file scope, sorted; tags prefixed with "struct ". */
+	msa_t names;
+
+	/** The macros the file defines or undefines. */
+	msa_t macros;
+} unity_file_t;
+
+/** The results of a file analyzed as part of a group, in one configuration. */
+typedef struct
+{
+	/** Has the file been analyzed as part of a group? */
+	bool done;
+
+	/** The findings in the file. */
+	findings_t found;
+
+	/** The files included by the group. */
+	msa_t inclusions;
+} unity_entry_t;
+
+/** The state of the unity builds of a run. */
+typedef struct
+{
+	/** The paths of the files to be analyzed. */
+	const char * const *paths;
+
+	/** The number of files. */
+	size_t count;
+
+	/** The number of configurations each file is analyzed in. */
+	size_t configCount;
+
+	/** The most files in a group. */
+	size_t max;
+
+	/** What is known about each file. */
+	unity_file_t *files;
+
+	/** The results of each file in each configuration; file-major. */
+	unity_entry_t *entries;
+
+	/** The indices of the files of the current group. */
+	size_t *members;
+
+	/** The number of files of the current group. */
+	size_t memberCount;
+
+	/** The translation unit of the current group; its name and contents are owned. */
+	struct CXUnsavedFile contents;
+
+	/** How many bytes the contents can house. */
+	size_t capacity;
+
+	/** The number of groups analyzed. */
+	size_t groups;
+
+	/** The number of files analyzed as part of a group. */
+	size_t grouped;
+
+	/** The number of files analyzed on their own after their group failed to parse. */
+	size_t fellBack;
+} unity_t;
+
+/**
+ * Prepare unity builds.
+ *
+ * @param u Pointer to fill with a unity structure.
+ * @param paths The paths of the files to be analyzed, in order; must stay valid.
+ * @param count The number of files.
+ * @param configCount The number of configurations each file is analyzed in.
+ * @param max The most files in a group.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int unity_create(unity_t *u, const char * const *paths, size_t count, size_t configCount, size_t max);
+
+/**
+ * Destroy a unity structure.
+ *
+ * @param u Pointer to a unity structure.
+ */
+void unity_destroy(unity_t *u);
+
+/**
+ * Form a group starting with a file: the file and the eligible files following
+ * it in the same directory which are compatible with each other and haven't
+ * been analyzed yet in the configuration. If the group has more than one
+ * file, its translation unit is assembled in contents.
+ *
+ * @param u Pointer to a unity structure.
+ * @param file The index of the first file.
+ * @param config The index of the configuration.
+ * @param dd The deduplication structure, or NULL; duplicates of other files
+ * are left out, as deduplication takes care of them.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int unity_group(unity_t *u, size_t file, size_t config, const dedup_t *dd);
+
+/**
+ * Distribute the findings of the current group among its files. Findings
+ * located outside the files (e.g. in headers) go to the first file.
+ *
+ * @param u Pointer to a unity structure.
+ * @param config The index of the configuration.
+ * @param found The findings of the group; left empty.
+ * @param inclusions The files included by the group.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int unity_split(unity_t *u, size_t config, findings_t *found, const msa_t *inclusions);
+
+/**
+ * Give up on the current group after its translation unit has failed to parse;
+ * its files are then analyzed on their own.
+ *
+ * @param u Pointer to a unity structure.
+ */
+void unity_fallBack(unity_t *u);
+
+/**
+ * Returns whether a file has been analyzed as part of a group.
+ *
+ * @param u Pointer to a unity structure.
+ * @param file The index of the file.
+ * @param config The index of the configuration.
+ * @return true if unity_take() will provide its results.
+ */
+bool unity_done(const unity_t *u, size_t file, size_t config);
+
+/**
+ * Take the results of a file analyzed as part of a group.
+ *
+ * @param u Pointer to a unity structure.
+ * @param file The index of the file.
+ * @param config The index of the configuration.
+ * @param found The findings are appended to this array.
+ * @param inclusions The file and the files included by its group are appended
+ * to this array.
+ * @return 1 on success, 0 on failure (setting errno appropriately).
+ */
+int unity_take(unity_t *u, size_t file, size_t config, findings_t *found, msa_t *inclusions);
+
+#endif
@@ -13,52 +13,664 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <getopt.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include <clang-c/Index.h>
 
+#include "bundle.h"
+#include "callees.h"
+#include "configs.h"
+#include "dedup.h"
+#include "fastcheck.h"
+#include "findb.h"
+#include "hash.h"
+#include "incprof.h"
+#include "lanes.h"
 #include "msa.h"
+#include "overlay.h"
+#include "prefetch.h"
+#include "rules.h"
+#include "sample.h"
+#include "shmcache.h"
+#include "sigdb.h"
+#include "toolchain.h"
+#include "trace.h"
 #include "treemunger.h"
+#include "unity.h"
 #include "interact.h"
+#include "libclang.h"
+#include "metrics.h"
+#include "query.h"
+#include "report.h"
 #include "version.h"
 
-/* make getopt accept -g option iff a system include path was specified */
-#ifdef GCC_SYSINCLUDE
-#define GETOPT_G "g"
-#else
-#define GETOPT_G ""
-#endif
+/** Values returned by getopt_long(3) for options without a short form. */
+enum longopts_e
+{
+	/** --diagnostics=MODE */
+	LONGOPT_DIAGNOSTICS = 0x100,
+
+	/** --no-dedup */
+	LONGOPT_NO_DEDUP,
+
+	/** --dedup-report */
+	LONGOPT_DEDUP_REPORT,
+
+	/** --config NAME:ARGS */
+	LONGOPT_CONFIG,
+
+	/** --traverse-jobs=N */
+	LONGOPT_TRAVERSE_JOBS,
+
+	/** --rules=LIST */
+	LONGOPT_RULES,
+
+	/** --list-rules */
+	LONGOPT_LIST_RULES,
+
+	/** --fast */
+	LONGOPT_FAST,
+
+	/** --sigdb=FILE */
+	LONGOPT_SIGDB,
+
+	/** --write-sigdb=FILE */
+	LONGOPT_WRITE_SIGDB,
+
+	/** --callee NAME */
+	LONGOPT_CALLEE,
+
+	/** --callees-from FILE */
+	LONGOPT_CALLEES_FROM,
+
+	/** --overlay[=PACK] */
+	LONGOPT_OVERLAY,
+
+	/** --write-overlay=PACK */
+	LONGOPT_WRITE_OVERLAY,
+
+	/** --stats */
+	LONGOPT_STATS,
+
+	/** --modules-cache=DIR */
+	LONGOPT_MODULES_CACHE,
+
+	/** --compiler=CC */
+	LONGOPT_COMPILER,
+
+	/** --libclang=PATH */
+	LONGOPT_LIBCLANG,
+
+	/** --include-profile */
+	LONGOPT_INCLUDE_PROFILE,
+
+	/** --trace=FILE */
+	LONGOPT_TRACE,
+
+	/** --metrics=FILE */
+	LONGOPT_METRICS,
+
+	/** --record=BUNDLE */
+	LONGOPT_RECORD,
+
+	/** --replay=BUNDLE */
+	LONGOPT_REPLAY,
+
+	/** --shared-cache=FILE */
+	LONGOPT_SHARED_CACHE,
+
+	/** --shared-cache-size=MIB */
+	LONGOPT_SHARED_CACHE_SIZE,
+
+	/** --db=FILE */
+	LONGOPT_DB,
+
+	/** --prefetch[=LIST] */
+	LONGOPT_PREFETCH,
+
+	/** --sample */
+	LONGOPT_SAMPLE,
+
+	/** --sample-seed */
+	LONGOPT_SAMPLE_SEED,
+
+	/** --unity */
+	LONGOPT_UNITY,
+
+	/** --lane */
+	LONGOPT_LANE,
+
+	/** --lane-dir */
+	LONGOPT_LANE_DIR,
+
+	/** --batch-jobs */
+	LONGOPT_BATCH_JOBS,
+
+	/** --slo */
+	LONGOPT_SLO,
+
+	/** --help */
+	LONGOPT_HELP
+};
+
+/** The long options understood by the Voidcaster. */
+static const struct option longopts[] = {
+	{ "diagnostics", required_argument, NULL, LONGOPT_DIAGNOSTICS },
+	{ "no-dedup", no_argument, NULL, LONGOPT_NO_DEDUP },
+	{ "dedup-report", no_argument, NULL, LONGOPT_DEDUP_REPORT },
+	{ "config", required_argument, NULL, LONGOPT_CONFIG },
+	{ "traverse-jobs", required_argument, NULL, LONGOPT_TRAVERSE_JOBS },
+	{ "rules", required_argument, NULL, LONGOPT_RULES },
+	{ "list-rules", no_argument, NULL, LONGOPT_LIST_RULES },
+	{ "fast", no_argument, NULL, LONGOPT_FAST },
+	{ "sigdb", required_argument, NULL, LONGOPT_SIGDB },
+	{ "write-sigdb", required_argument, NULL, LONGOPT_WRITE_SIGDB },
+	{ "callee", required_argument, NULL, LONGOPT_CALLEE },
+	{ "callees-from", required_argument, NULL, LONGOPT_CALLEES_FROM },
+	{ "overlay", optional_argument, NULL, LONGOPT_OVERLAY },
+	{ "write-overlay", required_argument, NULL, LONGOPT_WRITE_OVERLAY },
+	{ "stats", no_argument, NULL, LONGOPT_STATS },
+	{ "modules-cache", required_argument, NULL, LONGOPT_MODULES_CACHE },
+	{ "compiler", required_argument, NULL, LONGOPT_COMPILER },
+	{ "libclang", required_argument, NULL, LONGOPT_LIBCLANG },
+	{ "include-profile", no_argument, NULL, LONGOPT_INCLUDE_PROFILE },
+	{ "trace", required_argument, NULL, LONGOPT_TRACE },
+	{ "metrics", required_argument, NULL, LONGOPT_METRICS },
+	{ "record", required_argument, NULL, LONGOPT_RECORD },
+	{ "replay", required_argument, NULL, LONGOPT_REPLAY },
+	{ "shared-cache", required_argument, NULL, LONGOPT_SHARED_CACHE },
+	{ "shared-cache-size", required_argument, NULL, LONGOPT_SHARED_CACHE_SIZE },
+	{ "db", required_argument, NULL, LONGOPT_DB },
+	{ "prefetch", optional_argument, NULL, LONGOPT_PREFETCH },
+	{ "sample", required_argument, NULL, LONGOPT_SAMPLE },
+	{ "sample-seed", required_argument, NULL, LONGOPT_SAMPLE_SEED },
+	{ "unity", required_argument, NULL, LONGOPT_UNITY },
+	{ "lane", required_argument, NULL, LONGOPT_LANE },
+	{ "lane-dir", required_argument, NULL, LONGOPT_LANE_DIR },
+	{ "batch-jobs", required_argument, NULL, LONGOPT_BATCH_JOBS },
+	{ "slo", required_argument, NULL, LONGOPT_SLO },
+	{ "help", no_argument, NULL, LONGOPT_HELP },
+	{ NULL, 0, NULL, 0 }
+};
+
+/**
+ * What a command line asks for, as far as the options rule each other out.
+ * Each is a bit in options_t.asked.
+ */
+typedef enum
+{
+	/** Files to analyze. */
+	ASK_FILES,
+
+	/** -D */
+	ASK_DEFINES,
+
+	/** -I */
+	ASK_INCDIRS,
+
+	/** -i */
+	ASK_INTERACTIVE,
+
+	/** --config */
+	ASK_CONFIG,
+
+	/** --no-dedup */
+	ASK_NO_DEDUP,
+
+	/** --dedup-report */
+	ASK_DEDUP_REPORT,
+
+	/** --traverse-jobs above 1 */
+	ASK_TRAVERSE_JOBS,
+
+	/** --rules */
+	ASK_RULES,
+
+	/** --callee or --callees-from */
+	ASK_CALLEES,
+
+	/** --fast */
+	ASK_FAST,
+
+	/** --sigdb */
+	ASK_SIGDB,
+
+	/** --write-sigdb */
+	ASK_WRITE_SIGDB,
+
+	/** --overlay */
+	ASK_OVERLAY,
+
+	/** --overlay=PACK */
+	ASK_OVERLAY_PACK,
+
+	/** --write-overlay */
+	ASK_WRITE_OVERLAY,
+
+	/** --modules-cache */
+	ASK_MODULES_CACHE,
+
+	/** --include-profile */
+	ASK_INCLUDE_PROFILE,
+
+	/** --record */
+	ASK_RECORD,
+
+	/** --replay */
+	ASK_REPLAY,
+
+	/** --shared-cache */
+	ASK_SHARED_CACHE,
+
+	/** --shared-cache-size */
+	ASK_SHARED_CACHE_SIZE,
+
+	/** --db */
+	ASK_DB,
+
+	/** --sample */
+	ASK_SAMPLE,
+
+	/** --sample-seed */
+	ASK_SAMPLE_SEED,
+
+	/** --unity above 1 */
+	ASK_UNITY,
+
+	/** --lane */
+	ASK_LANE,
+
+	/** --lane-dir */
+	ASK_LANE_DIR,
+
+	/** --batch-jobs */
+	ASK_BATCH_JOBS,
+
+	/** --slo */
+	ASK_SLO,
+
+	/** The number of the above. */
+	ASK_COUNT
+} ask_t;
+
+/** The bit of an ask_t in options_t.asked. */
+#define ASKED(ask) ((uint64_t)1 << (ask))
+
+/** How each ask_t is named in error messages. */
+static const char * const askNames[ASK_COUNT] = {
+	[ASK_FILES] = "files",
+	[ASK_DEFINES] = "-D",
+	[ASK_INCDIRS] = "-I",
+	[ASK_INTERACTIVE] = "-i",
+	[ASK_CONFIG] = "--config",
+	[ASK_NO_DEDUP] = "--no-dedup",
+	[ASK_DEDUP_REPORT] = "--dedup-report",
+	[ASK_TRAVERSE_JOBS] = "--traverse-jobs above 1",
+	[ASK_RULES] = "--rules",
+	[ASK_CALLEES] = "--callee or --callees-from",
+	[ASK_FAST] = "--fast",
+	[ASK_SIGDB] = "--sigdb",
+	[ASK_WRITE_SIGDB] = "--write-sigdb",
+	[ASK_OVERLAY] = "--overlay",
+	[ASK_OVERLAY_PACK] = "--overlay=PACK",
+	[ASK_WRITE_OVERLAY] = "--write-overlay",
+	[ASK_MODULES_CACHE] = "--modules-cache",
+	[ASK_INCLUDE_PROFILE] = "--include-profile",
+	[ASK_RECORD] = "--record",
+	[ASK_REPLAY] = "--replay",
+	[ASK_SHARED_CACHE] = "--shared-cache",
+	[ASK_SHARED_CACHE_SIZE] = "--shared-cache-size",
+	[ASK_DB] = "--db",
+	[ASK_SAMPLE] = "--sample",
+	[ASK_SAMPLE_SEED] = "--sample-seed",
+	[ASK_UNITY] = "--unity above 1",
+	[ASK_LANE] = "--lane",
+	[ASK_LANE_DIR] = "--lane-dir",
+	[ASK_BATCH_JOBS] = "--batch-jobs",
+	[ASK_SLO] = "--slo"
+};
+
+/** Which options an option can't be combined with, and which it needs. */
+typedef struct
+{
+	/** The option. */
+	ask_t ask;
+
+	/** The options it can't be combined with (ASKED bits). */
+	uint64_t excludes;
+
+	/** The options at least one of which it needs (ASKED bits); 0 if none. */
+	uint64_t needs;
+} option_rule_t;
+
+/** All restrictions on combining options; checked by checkOptions(). */
+static const option_rule_t optionRules[] = {
+	/* the recorded arguments and files are all there is */
+	{
+		ASK_REPLAY,
+		ASKED(ASK_FILES) | ASKED(ASK_DEFINES) | ASKED(ASK_INCDIRS) | ASKED(ASK_CONFIG) | ASKED(ASK_FAST) |
+			ASKED(ASK_MODULES_CACHE) | ASKED(ASK_OVERLAY) | ASKED(ASK_WRITE_OVERLAY) | ASKED(ASK_RECORD) |
+			ASKED(ASK_INTERACTIVE),
+		0
+	},
+
+	/* the pack is either read or written */
+	{ ASK_OVERLAY_PACK, ASKED(ASK_WRITE_OVERLAY), 0 },
+
+	/* modules are deserialized lazily, i.e. while the traversal jobs read the AST */
+	{ ASK_MODULES_CACHE, ASKED(ASK_TRAVERSE_JOBS), 0 },
+
+	/* the fast mode doesn't parse, so there is nothing to record */
+	{ ASK_RECORD, ASKED(ASK_FAST), 0 },
+
+	/* these need every file parsed */
+	{
+		ASK_SHARED_CACHE,
+		ASKED(ASK_FAST) | ASKED(ASK_INCLUDE_PROFILE) | ASKED(ASK_RECORD) | ASKED(ASK_REPLAY) |
+			ASKED(ASK_WRITE_SIGDB),
+		0
+	},
+
+	/* these work on one file at a time */
+	{
+		ASK_UNITY,
+		ASKED(ASK_FAST) | ASKED(ASK_INCLUDE_PROFILE) | ASKED(ASK_RECORD) | ASKED(ASK_REPLAY) |
+			ASKED(ASK_SHARED_CACHE),
+		0
+	},
+
+	/* these would take the files or calls left out for fixed or empty */
+	{ ASK_SAMPLE, ASKED(ASK_DB) | ASKED(ASK_WRITE_SIGDB), 0 },
+	{ ASK_DB, ASKED(ASK_CALLEES) | ASKED(ASK_RULES), 0 },
+
+	/* the fast mode looks up functions instead of parsing declarations */
+	{ ASK_FAST, ASKED(ASK_WRITE_SIGDB) | ASKED(ASK_CONFIG), ASKED(ASK_SIGDB) },
+	{ ASK_SIGDB, 0, ASKED(ASK_FAST) },
+
+	/* options which only refine another one */
+	{ ASK_DEDUP_REPORT, ASKED(ASK_NO_DEDUP) | ASKED(ASK_REPLAY), 0 },
+	{ ASK_SAMPLE_SEED, 0, ASKED(ASK_SAMPLE) },
+	{ ASK_SHARED_CACHE_SIZE, 0, ASKED(ASK_SHARED_CACHE) },
+	{ ASK_LANE_DIR, 0, ASKED(ASK_LANE) },
+	{ ASK_BATCH_JOBS, 0, ASKED(ASK_LANE) },
+	{ ASK_SLO, 0, ASKED(ASK_LANE) }
+};
+
+/** The options given on the command line. */
+typedef struct
+{
+	/** The Clang arguments given directly (-D); the others are added later. */
+	msa_t clangargs;
+
+	/** The include paths (-I). */
+	msa_t incdirs;
+
+	/** -i */
+	bool interactive;
+
+	/** -s */
+	bool extstatus;
+
+	/** Not -g. */
+	bool inclToolchain;
+
+	/** --diagnostics */
+	diag_mode_t diagMode;
+
+	/** Not --no-dedup. */
+	bool dedup;
+
+	/** --dedup-report */
+	bool dedupreport;
+
+	/** --traverse-jobs */
+	unsigned int traverseJobs;
+
+	/** --fast */
+	bool fast;
+
+	/** --sigdb */
+	const char *sigdbPath;
+
+	/** --write-sigdb */
+	const char *writeSigdbPath;
+
+	/** --overlay or --write-overlay */
+	bool useOverlay;
+
+	/** The argument of --overlay, if any. */
+	const char *packPath;
+
+	/** --write-overlay */
+	const char *writePackPath;
+
+	/** --stats */
+	bool stats;
+
+	/** --modules-cache */
+	const char *modulesCache;
+
+	/** --compiler, or else $CC */
+	const char *compiler;
+
+	/** --libclang */
+	const char *libclangPath;
+
+	/** --include-profile */
+	bool includeProfile;
+
+	/** --trace */
+	const char *tracePath;
+
+	/** --metrics */
+	const char *metricsPath;
+
+	/** --record */
+	const char *recordPath;
+
+	/** --replay */
+	const char *replayPath;
+
+	/** --shared-cache */
+	const char *sharedPath;
+
+	/** --shared-cache-size */
+	unsigned int sharedMiB;
+
+	/** --db */
+	const char *dbPath;
+
+	/** --prefetch */
+	bool prefetching;
+
+	/** The argument of --prefetch, if any. */
+	const char *prefetchPath;
+
+	/** --sample */
+	bool sampling;
+
+	/** The amount of --sample as a fraction; valid if sampleCount is 0. */
+	double sampleFraction;
+
+	/** The amount of --sample as a number of files; 0 if given as a fraction. */
+	unsigned int sampleCount;
+
+	/** --sample-seed */
+	unsigned int sampleSeed;
+
+	/** --unity */
+	unsigned int unityMax;
+
+	/** --lane */
+	lane_t lane;
+
+	/** --lane-dir */
+	const char *laneDir;
+
+	/** --batch-jobs */
+	unsigned int batchJobs;
 
-/** True if a suggestion was given. */
-static bool suggested = false;
+	/** --slo */
+	unsigned int sloMs;
+
+	/** What the command line asks for (ASKED bits). */
+	uint64_t asked;
+} options_t;
+
+/** The configurations under which each file is analyzed. */
+static configs_t configs;
+
+/** The rules checked in each file. */
+static ruleset_t rules;
+
+/** The functions whose calls are reported; if empty, all are. */
+static callees_t callees;
+
+/** The header files passed to Clang from memory. */
+static overlay_t overlay;
+
+/** The cost of the files included by the files analyzed. */
+static incprof_t profile;
+
+/** The number of files listed in the include profile. */
+#define PROFILE_TOP 30
+
+/** How often the metrics file is rewritten, in seconds. */
+#define METRICS_INTERVAL 5.0
 
 /* initialize here */
 const char *progname = "<not set>";
 
 /**
- * Prints usage information about this program and exits with return code 1.
- * @note This function does not return.
+ * Prints usage information about this program.
+ *
+ * @param out the stream to print to
  */
-static void usage(void) __attribute__((noreturn));
-
-static void usage(void)
+static void printUsage(FILE *out)
 {
-	(void)fprintf(stderr,
+	(void)fprintf(out,
 		"\n"
 		"Voidcaster " GIT_REVINFO "\n"
 		"\n"
 		"Usage: %s [OPTION]... FILE...\n"
+		"  or:  %s [OPTION]... --replay=BUNDLE\n"
+		"  or:  %s query [OPTION]... DB\n"
 		"Proposes locations for casts to void in a C program.\n"
 		"\n"
+		"  --batch-jobs=N         let at most N runs in the batch lane analyze\n"
+		"                         files at once (default 2)\n"
+		"  --callee NAME          only report calls to the function NAME, which\n"
+		"                         may contain wildcards; may be given multiple\n"
+		"                         times. Files which don't mention any such\n"
+		"                         function are skipped without being parsed\n"
+		"  --callees-from FILE    like --callee for each line of FILE\n"
+		"  --compiler=CC          use the system include paths and builtin macros\n"
+		"                         of the compiler CC (default: $CC, or else cc)\n"
+		"  --config NAME:ARGS     analyze each file in the configuration NAME, i.e.\n"
+		"                         with the additional whitespace-separated Clang\n"
+		"                         arguments ARGS; may be given up to 64 times, in\n"
+		"                         which case the findings of all configurations\n"
+		"                         are merged\n"
 		"  -D<macro>[=<value>]    macro to define\n"
-#ifdef GCC_SYSINCLUDE
-		"  -g                     don't add the include path of the installed GCC\n"
-		"                         automatically\n"
-#endif
+		"  --db=FILE              append the findings of this run to the database\n"
+		"                         FILE, to be examined with the query subcommand;\n"
+		"                         not with --callee, --rules or --sample\n"
+		"  --diagnostics=WHICH    which Clang diagnostics to output: errors, all\n"
+		"                         (default) or none; non-errors from included\n"
+		"                         files are never output\n"
+		"  --dedup-report         report how much work was saved by analyzing\n"
+		"                         files with identical contents only once\n"
+		"  --fast                 don't parse the files; find calls lexically and\n"
+		"                         look up the functions in the database given by\n"
+		"                         --sigdb (approximate, but much faster)\n"
+		"  -g                     don't use the system include paths and builtin\n"
+		"                         macros of the compiler\n"
+		"  --help                 output this help and exit\n"
 		"  -i                     interactive mode\n"
+		"  --include-profile      output which included files cost the most parse\n"
+		"                         time and suggest a prefix header to precompile\n"
 		"  -I<path>               add a path where the preprocessor shall search\n"
 		"                         for includes\n"
+		"  --lane=LANE            schedule this run in the interactive or batch\n"
+		"                         lane along with the other runs on this host:\n"
+		"                         interactive runs (e.g. from an editor) go\n"
+		"                         first, and a newer one for a file cancels the\n"
+		"                         older ones; batch runs wait for them before\n"
+		"                         each file and run at a lower priority\n"
+		"  --lane-dir=DIR         coordinate with the runs using the lock files in\n"
+		"                         DIR (default $XDG_RUNTIME_DIR/voidcaster-lanes),\n"
+		"                         which must be private to you (mode 0700)\n"
+		"  --libclang=PATH        load libclang from PATH (default: the one found\n"
+		"                         when building, or else the system's)\n"
+		"  --list-rules           list the available rules and exit\n"
+		"  --metrics=FILE         keep FILE up to date with OpenMetrics counters\n"
+		"                         and latency histograms (rewritten every few\n"
+		"                         seconds) and summarize them at the end\n"
+		"  --modules-cache=DIR    import headers covered by module maps as Clang\n"
+		"                         modules, which are built once and kept in DIR;\n"
+		"                         files which fail to parse that way are parsed\n"
+		"                         again with plain inclusion\n"
+		"  --no-dedup             analyze each file even if another file with\n"
+		"                         identical contents has already been analyzed\n"
+		"  --overlay[=PACK]       read the files below the -I paths into memory\n"
+		"                         once (or load them from PACK) and pass them to\n"
+		"                         each parse; -I paths which don't exist are\n"
+		"                         dropped\n"
+		"  --prefetch[=LIST]      read the next few files ahead while parsing,\n"
+		"                         along with the headers they included last time\n"
+		"                         according to LIST, which is then updated\n"
+		"  --record=BUNDLE        write the command line, the Clang arguments and\n"
+		"                         every file opened while parsing into BUNDLE, to\n"
+		"                         reproduce the run elsewhere with --replay\n"
+		"  --replay=BUNDLE        analyze the files recorded in BUNDLE with the\n"
+		"                         recorded Clang arguments, passing every file\n"
+		"                         from the bundle, and report how long each took\n"
+		"  --rules=LIST           check only the comma-separated rules in LIST\n"
+		"                         (default: all)\n"
 		"  -s                     exit with code 4 if a suggestion is given\n"
+		"  --sample=AMOUNT        analyze only a random sample of AMOUNT files (a\n"
+		"                         count, a fraction such as 0.05 or a percentage\n"
+		"                         such as 5%%), drawn from each directory in\n"
+		"                         proportion, and estimate the number of findings\n"
+		"                         per directory and the time needed for all files\n"
+		"  --sample-seed=N        choose the sample with the seed N (default 1)\n"
+		"  --shared-cache=FILE    keep the findings in FILE, shared by all\n"
+		"                         Voidcaster processes on this host, and take\n"
+		"                         them from there while neither the file nor\n"
+		"                         anything it includes has changed\n"
+		"  --shared-cache-size=MIB\n"
+		"                         the size of the shared cache if it has to be\n"
+		"                         created (default 64); once it is full, no more\n"
+		"                         findings are added to it\n"
+		"  --sigdb=FILE           the function signature database for --fast\n"
+		"  --slo=MS               the time an interactive run aims to take per file\n"
+		"                         in milliseconds; --stats counts the files which\n"
+		"                         take longer (default 500)\n"
+		"  --stats                output how many files each parse included and\n"
+		"                         how much it read from disk, and a summary of\n"
+		"                         the latencies at the end\n"
+		"  --trace=FILE           write a trace of where the time is spent to FILE,\n"
+		"                         to be opened in Perfetto or chrome://tracing\n"
+		"  --traverse-jobs=N      traverse each file using N threads (default 1);\n"
+		"                         helps with huge files; not with --modules-cache\n"
+		"  --unity=N              parse up to N small files of a directory at once\n"
+		"                         as one translation unit, so that the headers\n"
+		"                         they share are parsed only once; files whose\n"
+		"                         names or macros might clash, and groups which\n"
+		"                         yield diagnostics, are parsed one by one\n"
+		"  --write-overlay=PACK   read the files below the -I paths into PACK for\n"
+		"                         --overlay=PACK (and use them as with --overlay)\n"
+		"  --write-sigdb=FILE     write the signatures of all functions declared in\n"
+		"                         the files into a database for --fast\n"
 		"\n"
 		"Exit status:\n"
 		" 0  if OK\n"
@@ -67,197 +679,1779 @@ static void usage(void)
 		" 3  if a file could not be parsed\n"
 		" 4  if -s is set and a suggestion was given\n"
 		" 5  if memory management fails\n"
+		" 7  if a newer interactive run for a file cancelled this one\n"
 		"\n"
 		"Report voidcaster bugs on the home page.\n"
 		"voidcaster home page: http://github.com/RavuAlHemio/voidcaster\n",
-		progname
+		progname, progname, progname
 	);
+}
+
+/**
+ * Prints usage information about this program to standard error and exits
+ * with return code 1.
+ * @note This function does not return.
+ */
+static void usage(void) __attribute__((noreturn));
+
+static void usage(void)
+{
+	printUsage(stderr);
 	exit(EXITCODE_USAGE);
 }
 
 /**
- * Warns about a missing cast to void.
+ * Prints usage information about this program to standard output and exits
+ * with return code 0.
+ * @note This function does not return.
+ */
+static void help(void) __attribute__((noreturn));
+
+static void help(void)
+{
+	printUsage(stdout);
+	exit(EXITCODE_OK);
+}
+
+/**
+ * Returns the current value of the monotonic clock.
  *
- * @param file the name of the file where the cast is missing
- * @param func the name of the function called
- * @param loc the location where the cast should be inserted
+ * @return the current time in seconds
  */
-static void warnMissingVoid(const char *file, const char *func, module_loc_t loc)
+static double monotonicNow(void)
 {
-	(void)fprintf(stderr,
-		"%s:%zu:%zu: Missing cast to void when calling function %s.\n",
-		file, loc.line, loc.col, func
-	);
-	suggested = true;
+	struct timespec ts;
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
 }
 
 /**
- * Warns about a superfluous cast to void.
+ * Counts an analysis of a file in the metrics.
  *
- * @param file the name of the file containing the cast
- * @param func the name of the function called
- * @param start the location where the cast starts
- * @param end the location where the cast ends
+ * @param ret the result of the analysis
+ * @param dedup whether the file was looked up among the files analyzed earlier
  */
-static void warnSuperfluousVoid(const char *file, const char *func, module_loc_t start, module_loc_t end)
+static void countAnalysis(enum exitcodes_e ret, bool dedup)
 {
-	(void)fprintf(stderr,
-		"%s:%zu:%zu: Pointless cast to void when calling function %s.\n",
-		file, start.line, start.col, func
-	);
-	suggested = true;
+	metrics_add(METRIC_FILES, 1);
+	if (ret != EXITCODE_OK)
+	{
+		metrics_add(METRIC_FAILURES, 1);
+	}
+	if (dedup)
+	{
+		metrics_add(METRIC_DEDUP_MISSES, 1);
+	}
 }
 
 /**
- * Prints out a warning that it is pointless to specify the given option
- * multiple times.
+ * Continues a hash with a number.
  *
- * @param option the option to warn about, including the hyphen
+ * @param hash the hash so far
+ * @param value the number to hash
+ * @return the updated hash
  */
-static inline void pointless(const char *option)
+static uint64_t hashValue(uint64_t hash, uint64_t value)
 {
-	(void)fprintf(stderr, "Warning: it is pointless to specify %s multiple times.\n", option);
+	return hash_bytes(hash, &value, sizeof(value));
 }
 
 /**
- * The main entry point of the application.
- * @param argc the number of command-line arguments
- * @param argv the array of command-line arguments
+ * Hashes what influences the findings in a file besides its contents and the
+ * Clang arguments: the version of the Voidcaster, the rules checked, the
+ * callees reported and the working directory (as file names are stored as
+ * given).
+ *
+ * @param salt by-ref to the hash to set
+ * @return true on success, false if the working directory is unknown
  */
-int main(int argc, char **argv)
+static bool sharedCacheSalt(uint64_t *salt)
 {
-	int opt, i;
-	bool interactive = false;
-	bool extstatus = false;
-	enum exitcodes_e ret = EXITCODE_OK;
-#ifdef GCC_SYSINCLUDE
-	bool inclgcc = true;
-#endif
-	missingVoidProc missProc = warnMissingVoid;
-	superfluousVoidProc superProc = warnSuperfluousVoid;
-	msa_t clangargs;
+	uint64_t hash = hash_string(HASH_INIT, "Voidcaster " GIT_REVINFO);
+	char *cwd = getcwd(NULL, 0);
+	size_t r;
 
-	if (argc > 0)
+	if (cwd == NULL)
 	{
-		progname = argv[0];
+		return false;
 	}
+	hash = hash_string(hash, cwd);
+	free(cwd);
 
-	/* allocate space for clangargs */
-	if (msa_create(&clangargs) == 0)
+	for (r = 0; r < rules.count; ++r)
 	{
-		perror("msa_create");
-		return EXITCODE_MM;
+		hash = hash_string(hash, rules.rules[r]->name);
 	}
+	hash = hashValue(hash, hash_strings((const char * const *)callees.names.arr, callees.names.count));
+	hash = hashValue(hash, hash_strings((const char * const *)callees.patterns.arr, callees.patterns.count));
 
-	while ((opt = getopt(argc, argv, "D:I:is" GETOPT_G)) != -1)
-	{
-		switch (opt)
-		{
-			case 'D':
-				if (msa_add_prefixed(&clangargs, "-D", optarg) == 0)
-				{
-					perror("msa_add");
-					return EXITCODE_MM;
-				}
-				break;
-			case 'I':
-				if (msa_add_prefixed(&clangargs, "-I", optarg) == 0)
-				{
-					perror("msa_add");
-					return EXITCODE_MM;
-				}
-				break;
-#ifdef GCC_SYSINCLUDE
-			case 'g':
-				if (!inclgcc)
-					pointless("-g");
-				inclgcc = false;
-				break;
-#endif
-			case 'i':
-				if (interactive)
-					pointless("-i");
-				interactive = true;
-				break;
-			case 's':
-				if (extstatus)
-					pointless("-s");
-				extstatus = true;
-				break;
-			case '?':
-				usage();
-			default:
-				assert(0 && "Default case in getopt switch.");
-		}
-	}
+	*salt = hash;
+	return true;
+}
 
-	if (optind == argc)
-	{
-		/* no file has been specified */
-		(void)fprintf(stderr, "%s: no file specified\n", progname);
-		msa_destroy(&clangargs);
-		usage();
-	}
+/**
+ * Looks up the findings of a file in the shared cache.
+ *
+ * @param sc the shared cache
+ * @param salt the hash returned by sharedCacheSalt
+ * @param argsHash the hash of the Clang arguments
+ * @param path the path to the file
+ * @param key by-ref to the key under which to store the findings after a
+ * miss; set to zero if they can't be stored
+ * @param found the array to which to append the findings
+ * @param inclusions the array to which to append the files included
+ * @return true on a hit, false on a miss
+ */
+static bool sharedLookup(
+	shmcache_t *sc,
+	uint64_t salt,
+	uint64_t argsHash,
+	const char *path,
+	uint64_t *key,
+	findings_t *found,
+	msa_t *inclusions
+)
+{
+	uint64_t contentHash;
 
-#ifdef GCC_SYSINCLUDE
-	/* add GCC include path */
-	if (inclgcc)
+	*key = 0;
+	if (sc->map == NULL || hash_file(path, &contentHash, NULL) == 0)
 	{
-		if (msa_add_prefixed(&clangargs, "-I", GCC_SYSINCLUDE) == 0)
-		{
-			perror("msa_add");
-			return EXITCODE_MM;
-		}
+		/* let the analysis complain about it */
+		return false;
 	}
-#endif
 
-	if (interactive)
+	*key = hash_string(hashValue(hashValue(salt, argsHash), contentHash), path);
+	if (shmcache_getFindings(sc, *key, found, inclusions) == 0)
 	{
-		/* swap functions */
-		missProc = interactMissingVoid;
-		superProc = interactSuperfluousVoid;
+		metrics_add(METRIC_SHARED_MISSES, 1);
+		msa_clear(inclusions);
+		return false;
 	}
 
-	/* fetch clang index */
-	CXIndex idx = clang_createIndex(0, 0);
-	if (idx == NULL)
+	metrics_add(METRIC_SHARED_HITS, 1);
+	return true;
+}
+
+/**
+ * Writes the metrics file.
+ *
+ * @param path the path to the metrics file
+ * @return EXITCODE_OK, or the exit code which should be returned after cleanup
+ */
+static enum exitcodes_e writeMetrics(const char *path)
+{
+	if (metrics_write(path) == 0)
 	{
-		(void)fprintf(stderr, "%s: clang index creation failed\n", progname);
-		msa_destroy(&clangargs);
-		exit(EXITCODE_CLANG_FAIL);
+		(void)fprintf(stderr, "%s: can't write metrics %s: %s\n", progname, path, strerror(errno));
+		return EXITCODE_FILE_OPEN;
 	}
+	return EXITCODE_OK;
+}
 
-	/* process each file in turn */
-	for (i = optind; i < argc; ++i)
-	{
-		ret = processFile(
-			idx,
-			argv[i],
-			clangargs.count,
-			(const char **)clangargs.arr,
-			missProc,
-			superProc
-		);
+/**
+ * Prints out a warning that it is pointless to specify the given option
+ * multiple times.
+ *
+ * @param option the option to warn about, including the hyphen
+ */
+static inline void pointless(const char *option)
+{
+	(void)fprintf(stderr, "Warning: it is pointless to specify %s multiple times.\n", option);
+}
 
-		if (ret != EXITCODE_OK)
-		{
-			/* process_file already printed a diagnostic; just stop */
-			break;
-		}
+/**
+ * Parses the argument of the --diagnostics option.
+ *
+ * @param arg the argument to parse
+ * @param mode by-ref to the diagnostic mode to set
+ * @return true on success, false if the argument is invalid
+ */
+static bool parseDiagMode(const char *arg, diag_mode_t *mode)
+{
+	if (strcmp(arg, "errors") == 0)
+	{
+		*mode = DIAG_ERRORS;
 	}
-
-	if (interactive)
+	else if (strcmp(arg, "all") == 0)
+	{
+		*mode = DIAG_ALL;
+	}
+	else if (strcmp(arg, "none") == 0)
+	{
+		*mode = DIAG_NONE;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Parses the argument of the --lane option.
+ *
+ * @param arg the argument to parse
+ * @param lane by-ref to the lane to set
+ * @return true on success, false if the argument is invalid
+ */
+static bool parseLane(const char *arg, lane_t *lane)
+{
+	if (strcmp(arg, "interactive") == 0)
+	{
+		*lane = LANE_INTERACTIVE;
+	}
+	else if (strcmp(arg, "batch") == 0)
+	{
+		*lane = LANE_BATCH;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Determines the directory of lock files used by the lanes unless another one
+ * is specified: within the runtime directory of the user, or else in /tmp,
+ * where lanes_open() refuses it unless the user created it.
+ *
+ * @param dir the buffer to fill
+ * @param size the size of the buffer
+ */
+static void defaultLaneDir(char *dir, size_t size)
+{
+	const char *runtime = getenv("XDG_RUNTIME_DIR");
+
+	if (runtime != NULL && runtime[0] != '\0')
+	{
+		(void)snprintf(dir, size, "%s/voidcaster-lanes", runtime);
+	}
+	else
+	{
+		(void)snprintf(dir, size, "/tmp/voidcaster-lanes-%lu", (unsigned long)getuid());
+	}
+}
+
+/**
+ * Parses a non-negative number given as an option argument.
+ *
+ * @param arg the argument to parse
+ * @param count by-ref to the number to set
+ * @return true on success, false if the argument is invalid
+ */
+static bool parseCount(const char *arg, unsigned int *count)
+{
+	char *end;
+	unsigned long val;
+
+	errno = 0;
+	val = strtoul(arg, &end, 10);
+	if (errno != 0 || end == arg || *end != '\0' || val > UINT_MAX || arg[0] == '-')
+	{
+		return false;
+	}
+
+	*count = (unsigned int)val;
+	return true;
+}
+
+/**
+ * Parses the amount of files to sample: a count, a fraction or a percentage.
+ *
+ * @param arg the argument to parse
+ * @param fraction by-ref to the fraction to set; 0 if a count is given
+ * @param count by-ref to the count to set; 0 if a fraction is given
+ * @return true on success, false if the argument is invalid
+ */
+static bool parseSampleAmount(const char *arg, double *fraction, unsigned int *count)
+{
+	char *end;
+	double val;
+
+	if (strchr(arg, '.') == NULL && strchr(arg, '%') == NULL)
+	{
+		*fraction = 0.0;
+		return parseCount(arg, count) && *count > 0;
+	}
+
+	errno = 0;
+	val = strtod(arg, &end);
+	if (errno != 0 || end == arg || arg[0] == '-')
+	{
+		return false;
+	}
+	if (end[0] == '%' && end[1] == '\0')
+	{
+		val /= 100.0;
+	}
+	else if (end[0] != '\0')
+	{
+		return false;
+	}
+	if (!(val > 0.0 && val <= 1.0))
+	{
+		return false;
+	}
+
+	*fraction = val;
+	*count = 0;
+	return true;
+}
+
+/**
+ * Reads how many read calls this process has made so far and how many bytes
+ * they have read.
+ *
+ * @param calls by-ref to the number of read calls to set
+ * @param bytes by-ref to the number of bytes read to set
+ * @return true on success, false if the operating system doesn't tell
+ */
+static bool readIoCounters(unsigned long long *calls, unsigned long long *bytes)
+{
+	char line[64];
+	int known = 0;
+	FILE *io = fopen("/proc/self/io", "r");
+
+	if (io == NULL)
+	{
+		return false;
+	}
+
+	while (fgets(line, sizeof(line), io) != NULL)
+	{
+		if (sscanf(line, "syscr: %llu", calls) == 1 || sscanf(line, "rchar: %llu", bytes) == 1)
+		{
+			++known;
+		}
+	}
+
+	(void)fclose(io);
+	return (known == 2);
+}
+
+/**
+ * Adds the include paths to the Clang arguments.
+ *
+ * If the overlay is used, it is populated first: from the pack, if one is
+ * given, or else from the files below the include paths. Include paths which
+ * don't exist (and aren't covered by the pack) are dropped; Clang would
+ * otherwise look for each header in them anew for each translation unit.
+ *
+ * @param clangargs the Clang arguments to add the include paths to
+ * @param incdirs the include paths
+ * @param useOverlay whether to populate and use the overlay
+ * @param packPath if not NULL, the pack to load the overlay from
+ * @param writePackPath if not NULL, the pack to write the overlay into
+ * @param stats whether to report on the overlay
+ * @return EXITCODE_OK, or the exit code which should be returned
+ */
+static enum exitcodes_e setUpIncludes(
+	msa_t *clangargs,
+	const msa_t *incdirs,
+	bool useOverlay,
+	const char *packPath,
+	const char *writePackPath,
+	bool stats
+)
+{
+	size_t i, dropped = 0;
+
+	if (packPath != NULL)
+	{
+		if (overlay_load(&overlay, packPath) == 0)
+		{
+			(void)fprintf(stderr, "%s: can't load overlay %s: %s\n", progname, packPath, strerror(errno));
+			return EXITCODE_FILE_OPEN;
+		}
+		overlay_finalize(&overlay);
+	}
+
+	for (i = 0; i < incdirs->count; ++i)
+	{
+		const char *dir = incdirs->arr[i];
+
+		if (useOverlay && packPath == NULL)
+		{
+			size_t added;
+			if (overlay_addDir(&overlay, dir, &added) == 0)
+			{
+				if (errno != ENOENT && errno != ENOTDIR)
+				{
+					(void)fprintf(stderr, "%s: can't read %s into the overlay: %s\n", progname, dir, strerror(errno));
+					return EXITCODE_FILE_OPEN;
+				}
+				++dropped;
+				continue;
+			}
+		}
+		else if (useOverlay && !overlay_containsDir(&overlay, dir))
+		{
+			struct stat st;
+			if (stat(dir, &st) == -1 || !S_ISDIR(st.st_mode))
+			{
+				++dropped;
+				continue;
+			}
+		}
+
+		if (msa_add_prefixed(clangargs, "-I", dir) == 0)
+		{
+			perror("msa_add");
+			return EXITCODE_MM;
+		}
+	}
+
+	if (!useOverlay)
+	{
+		return EXITCODE_OK;
+	}
+
+	overlay_finalize(&overlay);
+
+	if (writePackPath != NULL && overlay_write(&overlay, writePackPath) == 0)
+	{
+		(void)fprintf(stderr, "%s: can't write overlay %s: %s\n", progname, writePackPath, strerror(errno));
+		return EXITCODE_FILE_OPEN;
+	}
+
+	if (stats)
+	{
+		(void)fprintf(stderr, "overlay: %zu files, %zu bytes; %zu include path%s dropped\n",
+			overlay.count, overlay.bytes, dropped, (dropped == 1) ? "" : "s"
+		);
+	}
+
+	return EXITCODE_OK;
+}
+
+/**
+ * Adds the system include paths of the compiler to the Clang arguments, after
+ * all other include paths, and makes Clang define the compiler's builtin macros
+ * which it doesn't define itself. The compiler is only run if it has changed
+ * since its answers were cached.
+ *
+ * @param clangargs the Clang arguments to add to
+ * @param compiler the compiler's name or path
+ * @param stats whether to report on the compiler
+ * @return EXITCODE_OK, or the exit code which should be returned
+ */
+static enum exitcodes_e addToolchain(msa_t *clangargs, const char *compiler, bool stats)
+{
+	toolchain_t tc;
+	bool probed;
+	size_t i;
+	enum exitcodes_e ret = EXITCODE_OK;
+
+	if (toolchain_create(&tc) == 0)
+	{
+		perror("toolchain_create");
+		return EXITCODE_MM;
+	}
+
+	if (toolchain_probe(&tc, compiler, &probed) == 0)
+	{
+		/* Clang's own defaults might still do */
+		(void)fprintf(stderr, "Warning: can't ask the compiler %s for its include paths: %s\n", compiler, strerror(errno));
+		toolchain_destroy(&tc);
+		return (errno == ENOMEM) ? EXITCODE_MM : EXITCODE_OK;
+	}
+
+	/* after Clang's defaults, so that its resource headers take precedence */
+	for (i = 0; i < tc.includes.count && ret == EXITCODE_OK; ++i)
+	{
+		if (msa_add(clangargs, "-idirafter") == 0 || msa_add(clangargs, tc.includes.arr[i]) == 0)
+		{
+			perror("msa_add");
+			ret = EXITCODE_MM;
+		}
+	}
+
+	if (
+		ret == EXITCODE_OK && tc.definesPath != NULL &&
+		(msa_add(clangargs, "-include") == 0 || msa_add(clangargs, tc.definesPath) == 0)
+	)
+	{
+		perror("msa_add");
+		ret = EXITCODE_MM;
+	}
+
+	if (stats)
+	{
+		(void)fprintf(stderr, "compiler %s: %zu include paths (%s)\n",
+			compiler, tc.includes.count, probed ? "probed" : "cached"
+		);
+	}
+
+	toolchain_destroy(&tc);
+	return ret;
+}
+
+/**
+ * Outputs how many files the parse of a file has included, how many of them
+ * came from the overlay, and how much has been read from disk meanwhile.
+ *
+ * @param filename the file which has been parsed
+ * @param inclusions the files included by the parse
+ * @param ioKnown whether the I/O counters are valid
+ * @param calls the number of read calls made
+ * @param bytes the number of bytes read
+ */
+static void reportParseStats(
+	const char *filename,
+	const msa_t *inclusions,
+	bool ioKnown,
+	unsigned long long calls,
+	unsigned long long bytes
+)
+{
+	size_t i, fromOverlay = 0;
+
+	for (i = 0; i < inclusions->count; ++i)
+	{
+		if (overlay_contains(&overlay, inclusions->arr[i]))
+		{
+			++fromOverlay;
+		}
+	}
+
+	(void)fprintf(stderr, "%s: %zu files included (%zu from the overlay)",
+		filename, inclusions->count, fromOverlay
+	);
+	if (ioKnown)
+	{
+		(void)fprintf(stderr, ", %llu read calls, %llu bytes read", calls, bytes);
+	}
+	(void)fputs("\n", stderr);
+}
+
+/**
+ * Loads libclang and creates the index through which files are parsed. This is
+ * put off until the first file actually has to be parsed.
+ *
+ * @param idx by-ref to the index to create
+ * @param path the path to libclang, or NULL for the default
+ * @return EXITCODE_OK, or the exit code which should be returned after cleanup
+ */
+static enum exitcodes_e fetchIndex(CXIndex *idx, const char *path)
+{
+	const char *err;
+	uint64_t traceStart = trace_now();
+
+	if (libclang_load(path, &err) == 0)
+	{
+		(void)fprintf(stderr, "%s: can't load libclang: %s\n", progname, err);
+		return EXITCODE_CLANG_FAIL;
+	}
+
+	*idx = clang_createIndex(0, 0);
+	if (*idx == NULL)
+	{
+		(void)fprintf(stderr, "%s: clang index creation failed\n", progname);
+		return EXITCODE_CLANG_FAIL;
+	}
+
+	trace_span("load libclang", NULL, traceStart);
+	return EXITCODE_OK;
+}
+
+/**
+ * Prints the names and descriptions of the built-in rules and exits with
+ * return code 0.
+ * @note This function does not return.
+ */
+static void listRules(void) __attribute__((noreturn));
+
+static void listRules(void)
+{
+	size_t r;
+
+	for (r = 0; rules_builtin[r] != NULL; ++r)
+	{
+		(void)printf("%-20s %s\n", rules_builtin[r]->name, rules_builtin[r]->description);
+	}
+	exit(EXITCODE_OK);
+}
+
+/**
+ * Checks that the options asked for go together, according to optionRules.
+ * Prints usage information and exits with return code 1 if they don't.
+ *
+ * @param asked what the command line asks for (ASKED bits)
+ */
+static void checkOptions(uint64_t asked)
+{
+	size_t r;
+	int a;
+
+	for (r = 0; r < sizeof(optionRules) / sizeof(optionRules[0]); ++r)
+	{
+		const option_rule_t *rule = &optionRules[r];
+		uint64_t clash = asked & rule->excludes;
+		bool first = true;
+
+		if ((asked & ASKED(rule->ask)) == 0)
+		{
+			continue;
+		}
+
+		if (clash != 0)
+		{
+			for (a = 0; (clash & ASKED(a)) == 0; ++a)
+			{
+				/* find the first option clashing with it */
+			}
+			(void)fprintf(stderr, "%s: %s can't be combined with %s\n", progname, askNames[rule->ask], askNames[a]);
+			usage();
+		}
+
+		if (rule->needs != 0 && (asked & rule->needs) == 0)
+		{
+			(void)fprintf(stderr, "%s: %s needs ", progname, askNames[rule->ask]);
+			for (a = 0; a < ASK_COUNT; ++a)
+			{
+				if ((rule->needs & ASKED(a)) != 0)
+				{
+					(void)fprintf(stderr, "%s%s", first ? "" : " or ", askNames[a]);
+					first = false;
+				}
+			}
+			(void)fputc('\n', stderr);
+			usage();
+		}
+	}
+}
+
+/**
+ * Parses the command line into options, filling the configurations, rules
+ * and callees on the way. Prints usage information and exits with return
+ * code 1 if the options are invalid or don't go together.
+ *
+ * @param argc the number of command-line arguments
+ * @param argv the array of command-line arguments; the files start at optind
+ * @param opts the options to fill
+ * @return EXITCODE_OK on success, otherwise the code to exit with
+ */
+static enum exitcodes_e parseOptions(int argc, char **argv, options_t *opts)
+{
+	int opt;
+	bool diagset = false;
+
+	*opts = (options_t){
+		.inclToolchain = true,
+		.diagMode = DIAG_ALL,
+		.dedup = true,
+		.traverseJobs = 1,
+		.compiler = getenv("CC"),
+		.sharedMiB = (unsigned int)(SHMCACHE_DEFAULT_SIZE / (1024 * 1024)),
+		.sampleSeed = 1,
+		.lane = LANE_NONE,
+		.batchJobs = LANES_DEFAULT_BATCH_JOBS,
+		.sloMs = (unsigned int)(LANES_DEFAULT_SLO * 1000.0)
+	};
+	if (msa_create(&opts->clangargs) == 0 || msa_create(&opts->incdirs) == 0)
+	{
+		perror("msa_create");
+		return EXITCODE_MM;
+	}
+
+	while ((opt = getopt_long(argc, argv, "D:I:gis", longopts, NULL)) != -1)
+	{
+		switch (opt)
+		{
+			case 'D':
+				if (msa_add_prefixed(&opts->clangargs, "-D", optarg) == 0)
+				{
+					perror("msa_add");
+					return EXITCODE_MM;
+				}
+				break;
+			case 'I':
+				/* added to clangargs once the options are known */
+				if (msa_add(&opts->incdirs, optarg) == 0)
+				{
+					perror("msa_add");
+					return EXITCODE_MM;
+				}
+				break;
+			case 'g':
+				if (!opts->inclToolchain)
+					pointless("-g");
+				opts->inclToolchain = false;
+				break;
+			case 'i':
+				if (opts->interactive)
+					pointless("-i");
+				opts->interactive = true;
+				break;
+			case 's':
+				if (opts->extstatus)
+					pointless("-s");
+				opts->extstatus = true;
+				break;
+			case LONGOPT_DIAGNOSTICS:
+				if (diagset)
+					pointless("--diagnostics");
+				diagset = true;
+				if (!parseDiagMode(optarg, &opts->diagMode))
+				{
+					(void)fprintf(stderr, "%s: invalid diagnostic mode '%s'\n", progname, optarg);
+					usage();
+				}
+				break;
+			case LONGOPT_NO_DEDUP:
+				if (!opts->dedup)
+					pointless("--no-dedup");
+				opts->dedup = false;
+				break;
+			case LONGOPT_DEDUP_REPORT:
+				if (opts->dedupreport)
+					pointless("--dedup-report");
+				opts->dedupreport = true;
+				break;
+			case LONGOPT_CONFIG:
+				if (configs_add(&configs, optarg) == 0)
+				{
+					if (errno != EINVAL)
+					{
+						perror("configs_add");
+						return EXITCODE_MM;
+					}
+					(void)fprintf(stderr,
+						"%s: invalid or duplicate configuration '%s' (or more than %d configurations)\n",
+						progname, optarg, CONFIGS_MAX
+					);
+					usage();
+				}
+				break;
+			case LONGOPT_TRAVERSE_JOBS:
+				if (!parseCount(optarg, &opts->traverseJobs) || opts->traverseJobs == 0)
+				{
+					(void)fprintf(stderr, "%s: invalid number of traversal jobs '%s'\n", progname, optarg);
+					usage();
+				}
+				break;
+			case LONGOPT_RULES:
+				if (ruleset_addNamed(&rules, optarg) == 0)
+				{
+					(void)fprintf(stderr, "%s: unknown rule in '%s' (see --list-rules)\n", progname, optarg);
+					usage();
+				}
+				break;
+			case LONGOPT_LIST_RULES:
+				listRules();
+			case LONGOPT_HELP:
+				help();
+			case LONGOPT_FAST:
+				if (opts->fast)
+					pointless("--fast");
+				opts->fast = true;
+				break;
+			case LONGOPT_SIGDB:
+				opts->sigdbPath = optarg;
+				break;
+			case LONGOPT_WRITE_SIGDB:
+				opts->writeSigdbPath = optarg;
+				break;
+			case LONGOPT_CALLEE:
+				if (callees_add(&callees, optarg) == 0)
+				{
+					if (errno != EINVAL)
+					{
+						perror("callees_add");
+						return EXITCODE_MM;
+					}
+					(void)fprintf(stderr, "%s: callee '%s' consists of wildcards only\n", progname, optarg);
+					usage();
+				}
+				break;
+			case LONGOPT_CALLEES_FROM:
+				if (callees_addFile(&callees, optarg) == 0)
+				{
+					if (errno != EINVAL)
+					{
+						(void)fprintf(stderr, "%s: can't read callees from %s: %s\n", progname, optarg, strerror(errno));
+						return EXITCODE_FILE_OPEN;
+					}
+					(void)fprintf(stderr, "%s: a callee in %s consists of wildcards only\n", progname, optarg);
+					usage();
+				}
+				break;
+			case LONGOPT_OVERLAY:
+				if (opts->useOverlay)
+					pointless("--overlay");
+				opts->useOverlay = true;
+				opts->packPath = optarg;
+				break;
+			case LONGOPT_WRITE_OVERLAY:
+				opts->useOverlay = true;
+				opts->writePackPath = optarg;
+				break;
+			case LONGOPT_STATS:
+				if (opts->stats)
+					pointless("--stats");
+				opts->stats = true;
+				break;
+			case LONGOPT_MODULES_CACHE:
+				if (opts->modulesCache != NULL)
+					pointless("--modules-cache");
+				opts->modulesCache = optarg;
+				break;
+			case LONGOPT_COMPILER:
+				opts->compiler = optarg;
+				break;
+			case LONGOPT_LIBCLANG:
+				opts->libclangPath = optarg;
+				break;
+			case LONGOPT_INCLUDE_PROFILE:
+				if (opts->includeProfile)
+					pointless("--include-profile");
+				opts->includeProfile = true;
+				break;
+			case LONGOPT_TRACE:
+				opts->tracePath = optarg;
+				break;
+			case LONGOPT_METRICS:
+				opts->metricsPath = optarg;
+				break;
+			case LONGOPT_RECORD:
+				opts->recordPath = optarg;
+				break;
+			case LONGOPT_REPLAY:
+				opts->replayPath = optarg;
+				break;
+			case LONGOPT_DB:
+				opts->dbPath = optarg;
+				break;
+			case LONGOPT_PREFETCH:
+				if (opts->prefetching)
+					pointless("--prefetch");
+				opts->prefetching = true;
+				opts->prefetchPath = optarg;
+				break;
+			case LONGOPT_SAMPLE:
+				if (opts->sampling)
+					pointless("--sample");
+				opts->sampling = true;
+				if (!parseSampleAmount(optarg, &opts->sampleFraction, &opts->sampleCount))
+				{
+					(void)fprintf(stderr, "%s: invalid sample amount '%s'\n", progname, optarg);
+					usage();
+				}
+				break;
+			case LONGOPT_SAMPLE_SEED:
+				opts->asked |= ASKED(ASK_SAMPLE_SEED);
+				if (!parseCount(optarg, &opts->sampleSeed))
+				{
+					(void)fprintf(stderr, "%s: invalid sample seed '%s'\n", progname, optarg);
+					usage();
+				}
+				break;
+			case LONGOPT_UNITY:
+				if (opts->unityMax > 0)
+					pointless("--unity");
+				if (!parseCount(optarg, &opts->unityMax) || opts->unityMax == 0 || opts->unityMax > 1024)
+				{
+					(void)fprintf(stderr, "%s: invalid unity group size '%s'\n", progname, optarg);
+					usage();
+				}
+				break;
+			case LONGOPT_LANE:
+				if (opts->lane != LANE_NONE)
+					pointless("--lane");
+				if (!parseLane(optarg, &opts->lane))
+				{
+					(void)fprintf(stderr, "%s: invalid lane '%s'\n", progname, optarg);
+					usage();
+				}
+				break;
+			case LONGOPT_LANE_DIR:
+				opts->laneDir = optarg;
+				break;
+			case LONGOPT_BATCH_JOBS:
+				opts->asked |= ASKED(ASK_BATCH_JOBS);
+				if (!parseCount(optarg, &opts->batchJobs) || opts->batchJobs == 0)
+				{
+					(void)fprintf(stderr, "%s: invalid number of batch jobs '%s'\n", progname, optarg);
+					usage();
+				}
+				break;
+			case LONGOPT_SLO:
+				opts->asked |= ASKED(ASK_SLO);
+				if (!parseCount(optarg, &opts->sloMs) || opts->sloMs == 0)
+				{
+					(void)fprintf(stderr, "%s: invalid latency objective '%s'\n", progname, optarg);
+					usage();
+				}
+				break;
+			case LONGOPT_SHARED_CACHE:
+				opts->sharedPath = optarg;
+				break;
+			case LONGOPT_SHARED_CACHE_SIZE:
+				opts->asked |= ASKED(ASK_SHARED_CACHE_SIZE);
+				if (!parseCount(optarg, &opts->sharedMiB) || opts->sharedMiB == 0 || opts->sharedMiB > 1024 * 1024)
+				{
+					(void)fprintf(stderr, "%s: invalid shared cache size '%s'\n", progname, optarg);
+					usage();
+				}
+				break;
+			case '?':
+				usage();
+			default:
+				assert(0 && "Default case in getopt switch.");
+		}
+	}
+
+	if (optind == argc && opts->replayPath == NULL)
+	{
+		/* no file has been specified */
+		(void)fprintf(stderr, "%s: no file specified\n", progname);
+		usage();
+	}
+
+	opts->asked =
+		((optind != argc) ? ASKED(ASK_FILES) : 0) |
+		((opts->clangargs.count > 0) ? ASKED(ASK_DEFINES) : 0) |
+		((opts->incdirs.count > 0) ? ASKED(ASK_INCDIRS) : 0) |
+		(opts->interactive ? ASKED(ASK_INTERACTIVE) : 0) |
+		((configs.count > 0) ? ASKED(ASK_CONFIG) : 0) |
+		(!opts->dedup ? ASKED(ASK_NO_DEDUP) : 0) |
+		(opts->dedupreport ? ASKED(ASK_DEDUP_REPORT) : 0) |
+		((opts->traverseJobs > 1) ? ASKED(ASK_TRAVERSE_JOBS) : 0) |
+		/* a rule set as large as the built-in one (e.g. --rules=all) leaves none out */
+		((rules.count > 0 && rules_builtin[rules.count] != NULL) ? ASKED(ASK_RULES) : 0) |
+		(callees_any(&callees) ? ASKED(ASK_CALLEES) : 0) |
+		(opts->fast ? ASKED(ASK_FAST) : 0) |
+		((opts->sigdbPath != NULL) ? ASKED(ASK_SIGDB) : 0) |
+		((opts->writeSigdbPath != NULL) ? ASKED(ASK_WRITE_SIGDB) : 0) |
+		((opts->useOverlay && opts->writePackPath == NULL) ? ASKED(ASK_OVERLAY) : 0) |
+		((opts->packPath != NULL) ? ASKED(ASK_OVERLAY_PACK) : 0) |
+		((opts->writePackPath != NULL) ? ASKED(ASK_WRITE_OVERLAY) : 0) |
+		((opts->modulesCache != NULL) ? ASKED(ASK_MODULES_CACHE) : 0) |
+		(opts->includeProfile ? ASKED(ASK_INCLUDE_PROFILE) : 0) |
+		((opts->recordPath != NULL) ? ASKED(ASK_RECORD) : 0) |
+		((opts->replayPath != NULL) ? ASKED(ASK_REPLAY) : 0) |
+		((opts->sharedPath != NULL) ? ASKED(ASK_SHARED_CACHE) : 0) |
+		((opts->dbPath != NULL) ? ASKED(ASK_DB) : 0) |
+		(opts->sampling ? ASKED(ASK_SAMPLE) : 0) |
+		((opts->unityMax > 1) ? ASKED(ASK_UNITY) : 0) |
+		((opts->lane != LANE_NONE) ? ASKED(ASK_LANE) : 0) |
+		((opts->laneDir != NULL) ? ASKED(ASK_LANE_DIR) : 0) |
+		opts->asked;
+	checkOptions(opts->asked);
+
+	return EXITCODE_OK;
+}
+
+/**
+ * The main entry point of the application.
+ * @param argc the number of command-line arguments
+ * @param argv the array of command-line arguments
+ */
+int main(int argc, char **argv)
+{
+	int i;
+	size_t c, f, numFiles, numEntries;
+	options_t opts;
+	enum exitcodes_e ret = EXITCODE_OK;
+	missingVoidProc missProc = report_warnMissingVoid;
+	superfluousVoidProc superProc = report_warnSuperfluousVoid;
+	msa_t moduleArgs;
+	prefetch_t prefetcher = {
+		.running = false
+	};
+	prefetch_list_t previousIncl, learnedIncl;
+	sample_t smp;
+	double fileBegan;
+	unity_t unity;
+	char laneDirBuf[PATH_MAX];
+	lanes_t lanes = {
+		.lane = LANE_NONE
+	};
+	bool superseded, cancelled = false;
+	process_opts_t unityOpts;
+	shmcache_t shared = {
+		.map = NULL,
+		.size = 0
+	};
+	uint64_t sharedSalt = 0, sharedKey;
+	bool sharedFull = false;
+	uint64_t cfgargs[CONFIGS_MAX];
+	double metricsWritten = 0.0;
+	uint64_t traceStart, fileStart;
+	CXIndex idx = NULL;
+	findings_t found, merged, history, elsewhere;
+	msa_t inclusions;
+	bundle_t bundle;
+	sigdb_t sigdb = {
+		.map = NULL
+	};
+	sigdb_builder_t sigs;
+	dedup_t dd = {
+		.count = 0,
+		.arr = NULL
+	};
+	process_opts_t procopts = {
+		.rules = &rules,
+		.sigs = NULL,
+		.callees = &callees,
+		.overlay = NULL,
+		.moduleArgs = NULL,
+		.profile = NULL
+	};
+
+	if (argc > 0)
+	{
+		progname = argv[0];
+	}
+
+	if (argc > 1 && strcmp(argv[1], "query") == 0)
+	{
+		return query_main(argc - 1, argv + 1);
+	}
+
+	configs_create(&configs);
+	report_init(&configs);
+	ruleset_create(&rules);
+	if (callees_create(&callees) == 0)
+	{
+		perror("callees_create");
+		return EXITCODE_MM;
+	}
+
+	overlay_create(&overlay);
+	incprof_create(&profile);
+
+	ret = parseOptions(argc, argv, &opts);
+	if (ret != EXITCODE_OK)
+	{
+		return ret;
+	}
+	procopts.diagMode = opts.diagMode;
+	procopts.traverseJobs = opts.traverseJobs;
+	procopts.profile = opts.includeProfile ? &profile : NULL;
+	procopts.sampleMemory = (opts.metricsPath != NULL);
+
+	/* before anything changes argv */
+	if (opts.recordPath != NULL && bundle_create(&bundle, argc, argv) == 0)
+	{
+		perror("bundle_create");
+		return EXITCODE_MM;
+	}
+
+	if (opts.replayPath != NULL)
+	{
+		if (bundle_load(&bundle, &configs, opts.replayPath) == 0)
+		{
+			(void)fprintf(stderr, "%s: can't load bundle %s: %s\n", progname, opts.replayPath, strerror(errno));
+			msa_destroy(&opts.clangargs);
+			return EXITCODE_FILE_OPEN;
+		}
+
+		/* the recorded arguments already contain the toolchain's, and the files exist only in the bundle */
+		opts.inclToolchain = false;
+		opts.dedup = false;
+		procopts.overlay = &bundle.files;
+
+		/* analyze the recorded files instead of those given */
+		argv = bundle.sources.arr;
+		argc = (int)bundle.sources.count;
+		optind = 0;
+	}
+
+	if (opts.tracePath != NULL && trace_open(opts.tracePath) == 0)
+	{
+		(void)fprintf(stderr, "%s: can't write trace %s: %s\n", progname, opts.tracePath, strerror(errno));
+		msa_destroy(&opts.clangargs);
+		return EXITCODE_FILE_OPEN;
+	}
+
+	traceStart = trace_now();
+	ret = setUpIncludes(&opts.clangargs, &opts.incdirs, opts.useOverlay, opts.packPath, opts.writePackPath, opts.stats);
+	msa_destroy(&opts.incdirs);
+	if (ret != EXITCODE_OK)
+	{
+		overlay_destroy(&overlay);
+		incprof_destroy(&profile);
+		msa_destroy(&opts.clangargs);
+		return ret;
+	}
+	if (opts.useOverlay)
+	{
+		procopts.overlay = &overlay;
+	}
+	trace_span("set up includes", NULL, traceStart);
+
+	if (opts.modulesCache != NULL)
+	{
+		char stamp[32];
+
+		/* validate the modules' inputs once per run instead of once per translation unit */
+		(void)snprintf(stamp, sizeof(stamp), "%lld", (long long)time(NULL));
+
+		if (
+			msa_create(&moduleArgs) == 0 ||
+			msa_add(&moduleArgs, "-fmodules") == 0 ||
+			msa_add_prefixed(&moduleArgs, "-fmodules-cache-path=", opts.modulesCache) == 0 ||
+			msa_add_prefixed(&moduleArgs, "-fbuild-session-timestamp=", stamp) == 0 ||
+			msa_add(&moduleArgs, "-fmodules-validate-once-per-build-session") == 0
+		)
+		{
+			perror("msa_add");
+			return EXITCODE_MM;
+		}
+		procopts.moduleArgs = &moduleArgs;
+	}
+
+	/* add the compiler's include paths and macros; the fast mode doesn't preprocess */
+	if (opts.inclToolchain && !opts.fast)
+	{
+		traceStart = trace_now();
+		ret = addToolchain(
+			&opts.clangargs, (opts.compiler != NULL && opts.compiler[0] != '\0') ? opts.compiler : "cc", opts.stats
+		);
+		if (ret != EXITCODE_OK)
+		{
+			return ret;
+		}
+		trace_span("probe toolchain", NULL, traceStart);
+	}
+
+	if (opts.fast && sigdb_open(&sigdb, opts.sigdbPath) == 0)
+	{
+		(void)fprintf(stderr, "%s: can't open signature database %s: %s\n", progname, opts.sigdbPath, strerror(errno));
+		msa_destroy(&opts.clangargs);
+		return EXITCODE_FILE_OPEN;
+	}
+
+	if (opts.writeSigdbPath != NULL)
+	{
+		if (sigdb_builder_create(&sigs) == 0)
+		{
+			perror("sigdb_builder_create");
+			return EXITCODE_MM;
+		}
+		procopts.sigs = &sigs;
+	}
+
+	if (rules.count == 0 && ruleset_addNamed(&rules, "all") == 0)
+	{
+		perror("ruleset_addNamed");
+		return EXITCODE_USAGE;
+	}
+
+	if (opts.interactive)
+	{
+		/* swap functions */
+		missProc = interactMissingVoid;
+		superProc = interactSuperfluousVoid;
+	}
+
+	if (configs_finalize(&configs, &opts.clangargs) == 0)
+	{
+		perror("configs_finalize");
+		return EXITCODE_MM;
+	}
+
+	if (
+		findings_create(&found) == 0 || findings_create(&merged) == 0 || findings_create(&history) == 0 ||
+		findings_create(&elsewhere) == 0 || msa_create(&inclusions) == 0
+	)
+	{
+		perror("create");
+		msa_destroy(&opts.clangargs);
+		return EXITCODE_MM;
+	}
+
+	if (callees_any(&callees))
+	{
+		/* drop the files which can't call any of the callees before doing anything else */
+		int kept = optind;
+		for (i = optind; i < argc; ++i)
+		{
+			bool mentioned;
+			if (callees_mentioned(&callees, argv[i], &mentioned) == 0)
+			{
+				/* let the analysis complain about it */
+				mentioned = true;
+			}
+			if (mentioned)
+			{
+				argv[kept++] = argv[i];
+			}
+		}
+		argc = kept;
+	}
+
+	if (opts.sampling && argc > optind)
+	{
+		/* analyze only the files chosen, in their original order */
+		size_t total = (size_t)(argc - optind);
+		size_t want = (opts.sampleCount > 0) ?
+			(size_t)opts.sampleCount :
+			(size_t)ceil(opts.sampleFraction * (double)total);
+
+		if (sample_choose(&smp, (const char * const *)&argv[optind], total, want, opts.sampleSeed) == 0)
+		{
+			perror("sample_choose");
+			return EXITCODE_MM;
+		}
+		for (f = 0; f < smp.pickCount; ++f)
+		{
+			argv[optind + (int)f] = argv[optind + (int)smp.picks[f]];
+		}
+		argc = optind + (int)smp.pickCount;
+	}
+	else
+	{
+		opts.sampling = false;
+	}
+
+	/* each file is analyzed in each configuration, one right after the other */
+	numFiles = (size_t)(argc - optind);
+	numEntries = numFiles * configs.count;
+
+	for (c = 0; c < configs.count; ++c)
+	{
+		cfgargs[c] = hash_strings((const char * const *)configs.arr[c].args.arr, configs.arr[c].args.count);
+	}
+
+	if (opts.sharedPath != NULL)
+	{
+		/* the cache only saves time; go on without it */
+		if (!sharedCacheSalt(&sharedSalt))
+		{
+			perror("getcwd");
+		}
+		else if (shmcache_open(&shared, opts.sharedPath, (size_t)opts.sharedMiB * 1024 * 1024) == 0)
+		{
+			(void)fprintf(stderr, "%s: not using shared cache %s: %s\n", progname, opts.sharedPath,
+				(errno == EINVAL) ? "not a cache file" : strerror(errno)
+			);
+		}
+	}
+
+	if (opts.prefetching)
+	{
+		if (prefetch_list_create(&previousIncl) == 0 || prefetch_list_create(&learnedIncl) == 0)
+		{
+			perror("prefetch_list_create");
+			return EXITCODE_MM;
+		}
+		if (opts.prefetchPath != NULL && prefetch_list_load(&previousIncl, opts.prefetchPath) == 0 && errno != ENOENT)
+		{
+			/* prefetching only saves time; make do without the headers */
+			(void)fprintf(stderr, "%s: can't load inclusion list %s: %s\n", progname, opts.prefetchPath, strerror(errno));
+		}
+		if (numFiles > 1 && prefetch_start(&prefetcher, (const char * const *)&argv[optind], numFiles, &previousIncl) == 0)
+		{
+			perror("prefetch_start");
+		}
+	}
+
+	/* find files with identical contents */
+	if (opts.dedup && numEntries > 0)
+	{
+		const char **ddpaths = malloc(numEntries * sizeof(const char *));
+		uint64_t *ddargs = malloc(numEntries * sizeof(uint64_t));
+
+		if (ddpaths == NULL || ddargs == NULL)
+		{
+			perror("malloc");
+			return EXITCODE_MM;
+		}
+
+		for (f = 0; f < numEntries; ++f)
+		{
+			ddpaths[f] = argv[optind + (int)(f / configs.count)];
+			ddargs[f] = cfgargs[f % configs.count];
+		}
+
+		if (dedup_create(&dd, ddpaths, ddargs, numEntries) == 0)
+		{
+			perror("dedup_create");
+			return EXITCODE_MM;
+		}
+
+		free(ddpaths);
+		free(ddargs);
+	}
+
+	if (opts.unityMax > 1)
+	{
+		if (unity_create(&unity, (const char * const *)&argv[optind], numFiles, configs.count, opts.unityMax) == 0)
+		{
+			perror("unity_create");
+			return EXITCODE_MM;
+		}
+		unityOpts = procopts;
+		unityOpts.contents = &unity.contents;
+	}
+
+	if (opts.lane != LANE_NONE)
+	{
+		if (opts.laneDir == NULL)
+		{
+			defaultLaneDir(laneDirBuf, sizeof(laneDirBuf));
+			opts.laneDir = laneDirBuf;
+		}
+		if (lanes_open(&lanes, opts.laneDir, opts.lane, opts.batchJobs, (double)opts.sloMs / 1000.0) == 0)
+		{
+			(void)fprintf(stderr, "%s: can't use lane directory %s: %s\n", progname, opts.laneDir,
+				(errno == EPERM) ? "not a directory private to this user (mode 0700)" : strerror(errno)
+			);
+			msa_destroy(&opts.clangargs);
+			return EXITCODE_FILE_OPEN;
+		}
+	}
+
+	/* process each file in turn */
+	for (i = optind; i < argc && ret == EXITCODE_OK; ++i)
+	{
+		bool recorded = false;
+
+		fileStart = trace_now();
+		fileBegan = monotonicNow();
+		trace_counter("files queued", (double)(argc - i));
+		metrics_set(METRIC_QUEUE_DEPTH, (uint64_t)(argc - i));
+		if (prefetcher.running)
+		{
+			prefetch_advance(&prefetcher, (size_t)(i - optind));
+		}
+		if (lanes.lane != LANE_NONE && lanes_enter(&lanes, argv[i]) == 0)
+		{
+			(void)fprintf(stderr, "%s: can't enter lane for %s: %s\n", progname, argv[i], strerror(errno));
+			ret = EXITCODE_FILE_OPEN;
+			break;
+		}
+
+		for (c = 0; c < configs.count && ret == EXITCODE_OK; ++c)
+		{
+			size_t ddi = (size_t)(i - optind) * configs.count + c;
+			const msa_t *args = &configs.arr[c].args;
+
+			if (opts.dedup && !dedup_needed(&dd, ddi))
+			{
+				/* we've seen this one before */
+				metrics_add(METRIC_DEDUP_HITS, 1);
+				if (dedup_replicate(&dd, ddi, &found) == 0)
+				{
+					perror("dedup_replicate");
+					ret = EXITCODE_MM;
+				}
+			}
+			else if (opts.unityMax > 1 && unity_done(&unity, (size_t)(i - optind), c))
+			{
+				/* analyzed along with an earlier file */
+				countAnalysis(EXITCODE_OK, opts.dedup);
+				if (unity_take(&unity, (size_t)(i - optind), c, &found, &inclusions) == 0)
+				{
+					perror("unity_take");
+					ret = EXITCODE_MM;
+				}
+				else if (opts.dedup && dedup_analyzed(&dd, ddi, &found, &inclusions, 0.0) == 0)
+				{
+					perror("dedup_analyzed");
+					ret = EXITCODE_MM;
+				}
+				else if (opts.prefetchPath != NULL && prefetch_list_add(&learnedIncl, argv[i], &inclusions) == 0)
+				{
+					perror("prefetch_list_add");
+					ret = EXITCODE_MM;
+				}
+				msa_clear(&inclusions);
+			}
+			else if (sharedLookup(&shared, sharedSalt, cfgargs[c], argv[i], &sharedKey, &found, &inclusions))
+			{
+				/* another process (or an earlier run) has already analyzed it */
+				if (opts.dedup && dedup_analyzed(&dd, ddi, &found, &inclusions, 0.0) == 0)
+				{
+					perror("dedup_analyzed");
+					ret = EXITCODE_MM;
+				}
+				msa_clear(&inclusions);
+			}
+			else if (opts.fast)
+			{
+				/* fastcheckFile prints a diagnostic on failure */
+				traceStart = trace_now();
+				ret = fastcheckFile(argv[i], &sigdb, &rules, &callees, &found);
+				trace_span("fast check", argv[i], traceStart);
+				countAnalysis(ret, opts.dedup);
+
+				if (ret == EXITCODE_OK && opts.dedup && dedup_analyzed(&dd, ddi, &found, &inclusions, 0.0) == 0)
+				{
+					perror("dedup_analyzed");
+					ret = EXITCODE_MM;
+				}
+			}
+			else if (idx == NULL && (ret = fetchIndex(&idx, opts.libclangPath)) != EXITCODE_OK)
+			{
+				/* fetchIndex prints a diagnostic on failure */
+			}
+			else
+			{
+				double start = monotonicNow();
+				unsigned long long calls = 0, bytes = 0, callsAfter = 0, bytesAfter = 0;
+				bool ioKnown = opts.stats && readIoCounters(&calls, &bytes);
+				bool united = false;
+
+				if (opts.recordPath != NULL && !recorded)
+				{
+					recorded = true;
+					if (bundle_addSource(&bundle, argv[i]) == 0)
+					{
+						perror("bundle_addSource");
+						ret = EXITCODE_MM;
+						break;
+					}
+				}
+
+				if (opts.unityMax > 1 && unity_group(&unity, (size_t)(i - optind), c, opts.dedup ? &dd : NULL) == 0)
+				{
+					perror("unity_group");
+					ret = EXITCODE_MM;
+					break;
+				}
+				if (opts.unityMax > 1 && unity.memberCount > 1)
+				{
+					/* this file and the ones following it at once */
+					ret = processFile(
+						idx,
+						unity.contents.Filename,
+						args->count,
+						(const char **)args->arr,
+						&unityOpts,
+						&found,
+						&inclusions
+					);
+					if (ret == EXITCODE_OK)
+					{
+						united = true;
+						if (unity_split(&unity, c, &found, &inclusions) == 0)
+						{
+							perror("unity_split");
+							ret = EXITCODE_MM;
+							break;
+						}
+						msa_clear(&inclusions);
+						if (unity_take(&unity, (size_t)(i - optind), c, &found, &inclusions) == 0)
+						{
+							perror("unity_take");
+							ret = EXITCODE_MM;
+							break;
+						}
+					}
+					else if (ret != EXITCODE_MM)
+					{
+						/* processFile has output nothing; the files will say what's wrong */
+						unity_fallBack(&unity);
+						msa_clear(&inclusions);
+						ret = EXITCODE_OK;
+					}
+				}
+
+				/* process_file prints a diagnostic on failure */
+				if (!united && ret == EXITCODE_OK)
+				{
+					ret = processFile(
+						idx,
+						argv[i],
+						args->count,
+						(const char **)args->arr,
+						&procopts,
+						&found,
+						(
+							opts.dedup || opts.stats || opts.recordPath != NULL || shared.map != NULL ||
+							opts.prefetchPath != NULL
+						) ? &inclusions : NULL
+					);
+				}
+				countAnalysis(ret, opts.dedup);
+
+				if (opts.replayPath != NULL)
+				{
+					(void)fprintf(stderr, "%s: analyzed in %.3f ms\n", argv[i], (monotonicNow() - start) * 1e3);
+				}
+				if (opts.recordPath != NULL && bundle_addOpened(&bundle, &inclusions) == 0)
+				{
+					perror("bundle_addOpened");
+					ret = EXITCODE_MM;
+				}
+				if (opts.prefetchPath != NULL && prefetch_list_add(&learnedIncl, argv[i], &inclusions) == 0)
+				{
+					perror("prefetch_list_add");
+					ret = EXITCODE_MM;
+				}
+
+				if (ret == EXITCODE_OK && opts.stats && !united)
+				{
+					ioKnown = ioKnown && readIoCounters(&callsAfter, &bytesAfter);
+					reportParseStats(argv[i], &inclusions, ioKnown, callsAfter - calls, bytesAfter - bytes);
+				}
+
+				if (
+					ret == EXITCODE_OK && opts.dedup &&
+					dedup_analyzed(&dd, ddi, &found, &inclusions, monotonicNow() - start) == 0
+				)
+				{
+					perror("dedup_analyzed");
+					ret = EXITCODE_MM;
+				}
+
+				if (
+					ret == EXITCODE_OK && sharedKey != 0 &&
+					shmcache_putFindings(&shared, sharedKey, &found, &inclusions) == 0
+				)
+				{
+					if (errno == ENOMEM)
+					{
+						perror("shmcache_putFindings");
+						ret = EXITCODE_MM;
+					}
+					else if (errno == ENOSPC && !sharedFull)
+					{
+						sharedFull = true;
+						(void)fprintf(stderr, "%s: shared cache %s is full\n", progname, opts.sharedPath);
+					}
+				}
+				msa_clear(&inclusions);
+			}
+
+			/* gather the findings of all configurations */
+			for (f = 0; f < found.count && ret != EXITCODE_MM; ++f)
+			{
+				found.arr[f].configs = (configset_t)1 << c;
+				if (findings_copy(&merged, &found.arr[f], NULL) == 0)
+				{
+					perror("findings_copy");
+					ret = EXITCODE_MM;
+				}
+			}
+			findings_clear(&found);
+		}
+
+		/* merge the findings of the configurations */
+		if (configs.count > 1 && findings_collapse(&merged) == 0)
+		{
+			perror("findings_collapse");
+			ret = EXITCODE_MM;
+		}
+
+		superseded = false;
+		if (lanes.lane != LANE_NONE)
+		{
+			superseded = lanes_superseded(&lanes);
+			lanes_leave(&lanes, superseded);
+		}
+		if (superseded)
+		{
+			/* the newer run reports the findings that are up to date */
+			(void)fprintf(stderr, "%s: superseded by a newer run, not reported\n", argv[i]);
+			findings_clear(&merged);
+			cancelled = true;
+		}
+
+		/* a header included by multiple files is reported along with the first one */
+		if (findings_dropSeen(&merged, &elsewhere, argv[i]) == 0)
+		{
+			perror("findings_dropSeen");
+			ret = EXITCODE_MM;
+		}
+
+		/* report what was found */
+		traceStart = trace_now();
+		report_findings(&merged, missProc, superProc);
+		trace_span("report", argv[i], traceStart);
+
+		if (opts.sampling && !superseded)
+		{
+			sample_record(&smp, (size_t)(i - optind), &merged, monotonicNow() - fileBegan);
+		}
+
+		/* keep them for the database */
+		for (f = 0; opts.dbPath != NULL && f < merged.count && ret != EXITCODE_MM; ++f)
+		{
+			if (merged.arr[f].kind == FINDING_UNCHECKED_CALL)
+			{
+				/* a warning, not a cast to keep track of */
+				continue;
+			}
+			if (findings_copy(&history, &merged.arr[f], NULL) == 0)
+			{
+				perror("findings_copy");
+				ret = EXITCODE_MM;
+			}
+		}
+		findings_clear(&merged);
+
+		trace_span("file", argv[i], fileStart);
+		trace_rss();
+
+		if (opts.metricsPath != NULL && ret == EXITCODE_OK && monotonicNow() - metricsWritten >= METRICS_INTERVAL)
+		{
+			(void)metrics_sampleResident();
+			ret = writeMetrics(opts.metricsPath);
+			metricsWritten = monotonicNow();
+		}
+	}
+
+	if (ret == EXITCODE_OK && cancelled)
+	{
+		/* like any other run which didn't report on every file */
+		ret = EXITCODE_CANCELLED;
+	}
+	lanes_close(&lanes);
+
+	if (opts.prefetching)
+	{
+		prefetch_stop(&prefetcher);
+		if (opts.stats)
+		{
+			(void)fprintf(stderr, "prefetch: %zu files read ahead, final window %zu files\n",
+				prefetcher.prefetched, prefetcher.window
+			);
+		}
+		if (opts.prefetchPath != NULL && ret != EXITCODE_MM && prefetch_list_write(&learnedIncl, opts.prefetchPath) == 0)
+		{
+			(void)fprintf(stderr, "%s: can't write inclusion list %s: %s\n", progname, opts.prefetchPath, strerror(errno));
+			if (ret == EXITCODE_OK)
+			{
+				ret = EXITCODE_FILE_OPEN;
+			}
+		}
+		prefetch_list_destroy(&previousIncl);
+		prefetch_list_destroy(&learnedIncl);
+	}
+
+	if (opts.metricsPath != NULL)
+	{
+		metrics_set(METRIC_QUEUE_DEPTH, 0);
+		(void)metrics_sampleResident();
+		if (writeMetrics(opts.metricsPath) != EXITCODE_OK && ret == EXITCODE_OK)
+		{
+			ret = EXITCODE_FILE_OPEN;
+		}
+	}
+	if (opts.metricsPath != NULL || opts.stats || opts.replayPath != NULL)
+	{
+		metrics_summary(stderr);
+	}
+
+	if (opts.recordPath != NULL && ret != EXITCODE_MM && bundle_write(&bundle, &configs, opts.recordPath) == 0)
+	{
+		(void)fprintf(stderr, "%s: can't write bundle %s: %s\n", progname, opts.recordPath, strerror(errno));
+		if (ret == EXITCODE_OK)
+		{
+			ret = EXITCODE_FILE_OPEN;
+		}
+	}
+
+	if (opts.dbPath != NULL)
+	{
+		traceStart = trace_now();
+		if (ret != EXITCODE_OK)
+		{
+			/* the files which weren't analyzed would seem to have been fixed */
+			(void)fprintf(stderr, "%s: not adding the findings of an incomplete run to %s\n", progname, opts.dbPath);
+		}
+		else if (findb_append(opts.dbPath, &history, time(NULL)) == 0)
+		{
+			(void)fprintf(stderr, "%s: can't add the findings to %s: %s\n", progname, opts.dbPath,
+				(errno == EINVAL) ? "not a findings database" : strerror(errno)
+			);
+			ret = EXITCODE_FILE_OPEN;
+		}
+		trace_span("store findings", NULL, traceStart);
+	}
+
+	if (opts.writeSigdbPath != NULL)
+	{
+		if (ret == EXITCODE_OK && sigdb_write(&sigs, opts.writeSigdbPath) == 0)
+		{
+			(void)fprintf(stderr, "%s: can't write signature database %s: %s\n", progname, opts.writeSigdbPath, strerror(errno));
+			ret = EXITCODE_FILE_OPEN;
+		}
+		sigdb_builder_destroy(&sigs);
+	}
+
+	if (opts.unityMax > 1)
+	{
+		if (opts.stats)
+		{
+			(void)fprintf(stderr, "unity: %zu files parsed in %zu groups, %zu files parsed one by one after their group failed\n",
+				unity.grouped, unity.groups, unity.fellBack
+			);
+		}
+		unity_destroy(&unity);
+	}
+
+	if (opts.sampling)
+	{
+		if (ret == EXITCODE_OK)
+		{
+			sample_report(&smp, stdout);
+		}
+		sample_destroy(&smp);
+	}
+
+	if (opts.dedup && opts.dedupreport)
+	{
+		dedup_report(&dd);
+	}
+
+	if (opts.includeProfile)
+	{
+		incprof_report(&profile, stdout, PROFILE_TOP);
+	}
+
+	if (opts.interactive)
 	{
 		/* perform interactive changes, hoping that nothing breaks */
+		traceStart = trace_now();
 		performModifs();
 		disposeModifs();
+		trace_span("apply changes", NULL, traceStart);
+	}
+
+	if (trace_close() == 0)
+	{
+		(void)fprintf(stderr, "%s: can't write trace %s: %s\n", progname, opts.tracePath, strerror(errno));
+		if (ret == EXITCODE_OK)
+		{
+			ret = EXITCODE_FILE_OPEN;
+		}
 	}
 
 	/* clean up */
-	clang_disposeIndex(idx);
-	msa_destroy(&clangargs);
+	if (idx != NULL)
+	{
+		clang_disposeIndex(idx);
+	}
+	sigdb_close(&sigdb);
+	shmcache_close(&shared);
+	dedup_destroy(&dd);
+	findings_destroy(&found);
+	findings_destroy(&merged);
+	findings_destroy(&history);
+	findings_destroy(&elsewhere);
+	msa_destroy(&inclusions);
+	msa_destroy(&opts.clangargs);
+	configs_destroy(&configs);
+	callees_destroy(&callees);
+	overlay_destroy(&overlay);
+	incprof_destroy(&profile);
+	if (opts.recordPath != NULL || opts.replayPath != NULL)
+	{
+		bundle_destroy(&bundle);
+	}
+	if (opts.modulesCache != NULL)
+	{
+		msa_destroy(&moduleArgs);
+	}
 
-	if (ret == EXITCODE_OK && extstatus && suggested)
+	if (ret == EXITCODE_OK && opts.extstatus && report_suggested())
 	{
 		ret = EXITCODE_EXT_SUGGEST;
 	}